@@ -43,6 +43,12 @@ FatFreeODir (
     FatFreeDirEnt (DirEnt);
   }
 
+  if (ODir->EntryBuffer != NULL) {
+    FreePool (ODir->EntryBuffer);
+  }
+
+  FreePool (ODir->LongNameHashTable);
+  FreePool (ODir->ShortNameHashTable);
   FreePool (ODir);
 }
 
@@ -69,6 +75,25 @@ FatAllocateODir (
     ODir->Signature = FAT_ODIR_SIGNATURE;
     InitializeListHead (&ODir->ChildList);
     ODir->CurrentCursor = &ODir->ChildList;
+    //
+    // Start with small hash tables, they grow with the directory
+    //
+    ODir->HashTableMask       = HASH_TABLE_MIN_SIZE - 1;
+    ODir->LongNameHashTable   = AllocateZeroPool (HASH_TABLE_MIN_SIZE * sizeof (FAT_DIRENT *));
+    ODir->ShortNameHashTable  = AllocateZeroPool (HASH_TABLE_MIN_SIZE * sizeof (FAT_DIRENT *));
+    ODir->DirCacheSize        = sizeof (FAT_ODIR) + 2 * HASH_TABLE_MIN_SIZE * sizeof (FAT_DIRENT *);
+    if (ODir->LongNameHashTable == NULL || ODir->ShortNameHashTable == NULL) {
+      if (ODir->LongNameHashTable != NULL) {
+        FreePool (ODir->LongNameHashTable);
+      }
+
+      if (ODir->ShortNameHashTable != NULL) {
+        FreePool (ODir->ShortNameHashTable);
+      }
+
+      FreePool (ODir);
+      ODir = NULL;
+    }
   }
 
   return ODir;
@@ -78,6 +103,8 @@ FatAllocateODir (
 
   Discard the directory structure when an OFile will be freed.
   Volume will cache this directory if the OFile does not represent a deleted file.
+  The least recently used directories are freed while the cached directories
+  use more than FAT_DIR_CACHE_BUDGET bytes of memory.
 
   @param  OFile                 - The OFile whose directory structure is to be discarded.
 
@@ -92,6 +119,15 @@ FatDiscardODir (
 
   Volume  = OFile->Volume;
   ODir    = OFile->ODir;
+  //
+  // The entries read ahead are only needed while the directory is open
+  //
+  if (ODir->EntryBuffer != NULL) {
+    FreePool (ODir->EntryBuffer);
+    ODir->EntryBuffer       = NULL;
+    ODir->EntryBufferCount  = 0;
+  }
+
   if (!OFile->DirEnt->Invalid) {
     //
     // If OFile does not represent a deleted file, then we will cache the directory
@@ -99,17 +135,18 @@ FatDiscardODir (
     //
     ODir->DirCacheTag = OFile->FileCluster;
     InsertHeadList (&Volume->DirCacheList, &ODir->DirCacheLink);
-    if (Volume->DirCacheCount == FAT_MAX_DIR_CACHE_COUNT) {
+    Volume->DirCacheCount++;
+    Volume->DirCacheSize += ODir->DirCacheSize;
+    ODir = NULL;
+    while (Volume->DirCacheSize > FAT_DIR_CACHE_BUDGET) {
       //
       // Replace the least recent used directory
       //
       ODir = ODIR_FROM_DIRCACHELINK (Volume->DirCacheList.BackLink);
       RemoveEntryList (&ODir->DirCacheLink);
-    } else {
-      //
-      // No need to find a replace
-      //
-      Volume->DirCacheCount++;
+      Volume->DirCacheCount--;
+      Volume->DirCacheSize -= ODir->DirCacheSize;
+      FatFreeODir (ODir);
       ODir = NULL;
     }
   }
@@ -153,6 +190,7 @@ FatRequestODir (
     if (CurrentODir->DirCacheTag == DirCacheTag) {
       RemoveEntryList (&CurrentODir->DirCacheLink);
       Volume->DirCacheCount--;
+      Volume->DirCacheSize -= CurrentODir->DirCacheSize;
       ODir = CurrentODir;
       break;
     }
@@ -187,4 +225,6 @@ FatCleanupODirCache (
     FatFreeODir (ODir);
     Volume->DirCacheCount--;
   }
+
+  Volume->DirCacheSize = 0;
 }
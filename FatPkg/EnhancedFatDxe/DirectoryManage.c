@@ -36,8 +36,11 @@ FatAccessEntry (
   IN OUT VOID                 *Entry
   )
 {
-  UINTN Position;
-  UINTN BufferSize;
+  EFI_STATUS  Status;
+  FAT_ODIR    *ODir;
+  UINTN       Position;
+  UINTN       BufferSize;
+  UINTN       BufferPos;
 
   Position = EntryPos * sizeof (FAT_DIRECTORY_ENTRY);
   if (Position >= Parent->FileSize) {
@@ -50,8 +53,48 @@ FatAccessEntry (
     return EFI_SUCCESS;
   }
 
+  ODir = Parent->ODir;
+  if (ODir != NULL && IoMode == ReadData) {
+    //
+    // Read the directory entries FAT_DIR_READ_AHEAD_SIZE bytes at a time,
+    // so that loading a directory does not cost a disk access per entry
+    //
+    if (EntryPos < ODir->EntryBufferPos || EntryPos >= ODir->EntryBufferPos + ODir->EntryBufferCount) {
+      if (ODir->EntryBuffer == NULL) {
+        ODir->EntryBuffer = AllocatePool (FAT_DIR_READ_AHEAD_SIZE);
+      }
+
+      if (ODir->EntryBuffer != NULL) {
+        BufferPos               = EntryPos & ~(FAT_DIR_READ_AHEAD_SIZE / sizeof (FAT_DIRECTORY_ENTRY) - 1);
+        BufferSize              = MIN (FAT_DIR_READ_AHEAD_SIZE, Parent->FileSize - BufferPos * sizeof (FAT_DIRECTORY_ENTRY));
+        ODir->EntryBufferCount  = 0;
+        Status = FatAccessOFile (Parent, ReadData, BufferPos * sizeof (FAT_DIRECTORY_ENTRY), &BufferSize, (UINT8 *) ODir->EntryBuffer, NULL);
+        if (EFI_ERROR (Status)) {
+          return Status;
+        }
+
+        ODir->EntryBufferPos    = BufferPos;
+        ODir->EntryBufferCount  = BufferSize / sizeof (FAT_DIRECTORY_ENTRY);
+      }
+    }
+
+    if (EntryPos >= ODir->EntryBufferPos && EntryPos < ODir->EntryBufferPos + ODir->EntryBufferCount) {
+      CopyMem (Entry, &ODir->EntryBuffer[EntryPos - ODir->EntryBufferPos], sizeof (FAT_DIRECTORY_ENTRY));
+      return EFI_SUCCESS;
+    }
+  }
+
   BufferSize = sizeof (FAT_DIRECTORY_ENTRY);
-  return FatAccessOFile (Parent, IoMode, Position, &BufferSize, Entry, NULL);
+  Status = FatAccessOFile (Parent, IoMode, Position, &BufferSize, Entry, NULL);
+  if (!EFI_ERROR (Status) && ODir != NULL && IoMode == WriteData &&
+      EntryPos >= ODir->EntryBufferPos && EntryPos < ODir->EntryBufferPos + ODir->EntryBufferCount) {
+    //
+    // Keep the entries read ahead in sync with the disk
+    //
+    CopyMem (&ODir->EntryBuffer[EntryPos - ODir->EntryBufferPos], Entry, sizeof (FAT_DIRECTORY_ENTRY));
+  }
+
+  return Status;
 }
 
 /**
@@ -1225,6 +1268,10 @@ FatCloseDirEnt (
     RemoveEntryList (&OFile->ChildLink);
   }
 
+  if (OFile->Extents != NULL) {
+    FreePool (OFile->Extents);
+  }
+
   FreePool (OFile);
   DirEnt->OFile = NULL;
   if (DirEnt->Invalid == TRUE) {
@@ -14,6 +14,97 @@ WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
 
 #include "Fat.h"
 
+/**
+
+  Find the cache page which holds the specified PageNo.
+
+  @param  DiskCache             - The disk cache to search.
+  @param  PageNo                - PageNo to match with the cache.
+
+  @return The Cache Tag of the page, or NULL if the page is not in the cache.
+
+**/
+STATIC
+CACHE_TAG *
+FatFindCachePage (
+  IN DISK_CACHE         *DiskCache,
+  IN UINTN              PageNo
+  )
+{
+  UINTN     Way;
+  UINTN     SetCount;
+  CACHE_TAG *CacheTag;
+
+  SetCount  = DiskCache->GroupMask + 1;
+  CacheTag  = &DiskCache->CacheTag[PageNo & DiskCache->GroupMask];
+  for (Way = 0; Way < DiskCache->WayCount; Way++, CacheTag += SetCount) {
+    if (CacheTag->RealSize > 0 && CacheTag->PageNo == PageNo) {
+      return CacheTag;
+    }
+  }
+
+  return NULL;
+}
+
+/**
+
+  Select the cache page of the set of PageNo to be replaced: an invalid one
+  if there is any, else the least recently used one.
+
+  @param  DiskCache             - The disk cache.
+  @param  PageNo                - PageNo which is going to be loaded.
+
+  @return The Cache Tag of the page to be replaced.
+
+**/
+STATIC
+CACHE_TAG *
+FatSelectCachePage (
+  IN DISK_CACHE         *DiskCache,
+  IN UINTN              PageNo
+  )
+{
+  UINTN     Way;
+  UINTN     SetCount;
+  CACHE_TAG *CacheTag;
+  CACHE_TAG *Victim;
+
+  SetCount  = DiskCache->GroupMask + 1;
+  CacheTag  = &DiskCache->CacheTag[PageNo & DiskCache->GroupMask];
+  Victim    = CacheTag;
+  for (Way = 0; Way < DiskCache->WayCount; Way++, CacheTag += SetCount) {
+    if (CacheTag->RealSize == 0) {
+      return CacheTag;
+    }
+
+    if (CacheTag->LastAccess < Victim->LastAccess) {
+      Victim = CacheTag;
+    }
+  }
+
+  return Victim;
+}
+
+/**
+
+  Get the address of the buffer of a cache page.
+
+  @param  DiskCache             - The disk cache.
+  @param  CacheTag              - The Cache Tag of the page.
+
+  @return The address of the cache page.
+
+**/
+STATIC
+UINT8 *
+FatCachePageAddress (
+  IN DISK_CACHE         *DiskCache,
+  IN CACHE_TAG          *CacheTag
+  )
+{
+  return DiskCache->CacheBase + ((UINTN) (CacheTag - DiskCache->CacheTag) << DiskCache->PageAlignment);
+}
+
 /**
 
   This function is used by the Data Cache.
@@ -44,24 +135,18 @@ FatFlushDataCacheRange (
   )
 {
   UINTN       PageNo;
-  UINTN       GroupNo;
-  UINTN       GroupMask;
   UINTN       PageSize;
   UINT8       PageAlignment;
   DISK_CACHE  *DiskCache;
   CACHE_TAG   *CacheTag;
-  UINT8       *BaseAddress;
 
   DiskCache     = &Volume->DiskCache[CacheData];
-  BaseAddress   = DiskCache->CacheBase;
-  GroupMask     = DiskCache->GroupMask;
   PageAlignment = DiskCache->PageAlignment;
   PageSize      = (UINTN)1 << PageAlignment;
 
   for (PageNo = StartPageNo; PageNo < EndPageNo; PageNo++) {
-    GroupNo   = PageNo & GroupMask;
-    CacheTag  = &DiskCache->CacheTag[GroupNo];
-    if (CacheTag->RealSize > 0 && CacheTag->PageNo == PageNo) {
+    CacheTag = FatFindCachePage (DiskCache, PageNo);
+    if (CacheTag != NULL) {
       //
       // When reading data form disk directly, if some dirty data
       // in cache is in this rang, this data in the Buffer need to
@@ -71,7 +156,7 @@ FatFlushDataCacheRange (
         if (CacheTag->Dirty) {
           CopyMem (
             Buffer + ((PageNo - StartPageNo) << PageAlignment),
-            BaseAddress + (GroupNo << PageAlignment),
+            FatCachePageAddress (DiskCache, CacheTag),
             PageSize
             );
         }
@@ -110,7 +195,6 @@ FatExchangeCachePage (
   )
 {
   EFI_STATUS  Status;
-  UINTN       GroupNo;
   UINTN       PageNo;
   UINTN       WriteCount;
   UINTN       RealSize;
@@ -122,9 +206,8 @@ FatExchangeCachePage (
 
   DiskCache     = &Volume->DiskCache[DataType];
   PageNo        = CacheTag->PageNo;
-  GroupNo       = PageNo & DiskCache->GroupMask;
   PageAlignment = DiskCache->PageAlignment;
-  PageAddress   = DiskCache->CacheBase + (GroupNo << PageAlignment);
+  PageAddress   = FatCachePageAddress (DiskCache, CacheTag);
   EntryPos      = DiskCache->BaseAddress + LShiftU64 (PageNo, PageAlignment);
   RealSize      = CacheTag->RealSize;
   if (IoMode == ReadDisk) {
@@ -158,6 +241,87 @@ FatExchangeCachePage (
   return EFI_SUCCESS;
 }
 
+/**
+
+  Load the data page PageNo and the pages following it into one way of the
+  Data Cache with a single disk read. Loading stops at the end of the way, at
+  the end of the volume, or at the first page which is already in the cache.
+
+  @param  Volume                - FAT file system volume.
+  @param  PageNo                - The first PageNo to load.
+  @param  CacheTag              - The Cache Tag selected for PageNo.
+
+  @retval EFI_SUCCESS           - The pages were loaded successfully.
+  @return Others                - An error occurred when accessing the disk.
+
+**/
+STATIC
+EFI_STATUS
+FatPrefetchCachePages (
+  IN FAT_VOLUME         *Volume,
+  IN UINTN              PageNo,
+  IN CACHE_TAG          *CacheTag
+  )
+{
+  EFI_STATUS  Status;
+  DISK_CACHE  *DiskCache;
+  UINTN       PageCount;
+  UINTN       Index;
+  UINTN       PageSize;
+  UINTN       RealSize;
+  UINT64      EntryPos;
+  UINT64      MaxSize;
+  UINT8       PageAlignment;
+
+  DiskCache     = &Volume->DiskCache[CacheData];
+  PageAlignment = DiskCache->PageAlignment;
+  PageSize      = (UINTN)1 << PageAlignment;
+  EntryPos      = DiskCache->BaseAddress + LShiftU64 (PageNo, PageAlignment);
+  MaxSize       = DiskCache->LimitAddress - EntryPos;
+
+  //
+  // The pages of one way are contiguous as long as the set number does not wrap.
+  //
+  PageCount = MIN (FAT_PREFETCH_PAGE_COUNT, DiskCache->GroupMask + 1 - (PageNo & DiskCache->GroupMask));
+  for (Index = 1; Index < PageCount; Index++) {
+    if (LShiftU64 (Index, PageAlignment) >= MaxSize ||
+        FatFindCachePage (DiskCache, PageNo + Index) != NULL) {
+      break;
+    }
+  }
+
+  PageCount = Index;
+  for (Index = 0; Index < PageCount; Index++) {
+    if (CacheTag[Index].RealSize > 0 && CacheTag[Index].Dirty) {
+      Status = FatExchangeCachePage (Volume, CacheData, WriteDisk, &CacheTag[Index], NULL);
+      if (EFI_ERROR (Status)) {
+        return Status;
+      }
+    }
+
+    CacheTag[Index].RealSize = 0;
+  }
+
+  RealSize = PageCount << PageAlignment;
+  if (MaxSize < RealSize) {
+    RealSize = (UINTN) MaxSize;
+  }
+
+  Status = FatDiskIo (Volume, ReadDisk, EntryPos, RealSize, FatCachePageAddress (DiskCache, CacheTag), NULL);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  for (Index = 0; Index < PageCount; Index++) {
+    CacheTag[Index].PageNo      = PageNo + Index;
+    CacheTag[Index].RealSize    = MIN (PageSize, RealSize - (Index << PageAlignment));
+    CacheTag[Index].LastAccess  = DiskCache->AccessCount;
+    CacheTag[Index].Dirty       = FALSE;
+  }
+
+  return EFI_SUCCESS;
+}
+
 /**
 
   Get one cache page by specified PageNo.
@@ -165,7 +329,8 @@ FatExchangeCachePage (
   @param  Volume                - FAT file system volume.
   @param  CacheDataType         - The cache type: CACHE_FAT or CACHE_DATA.
   @param  PageNo                - PageNo to match with the cache.
-  @param  CacheTag              - The Cache Tag for the current cache page.
+  @param  Prefetch              - Whether to load the following pages too on a cache miss.
+  @param  CacheTag              - Returns the Cache Tag for the cache page.
 
   @retval EFI_SUCCESS           - Get the cache page successfully.
   @return other                 - An error occurred when accessing data.
@@ -174,28 +339,40 @@ FatExchangeCachePage (
 STATIC
 EFI_STATUS
 FatGetCachePage (
-  IN FAT_VOLUME         *Volume,
-  IN CACHE_DATA_TYPE    CacheDataType,
-  IN UINTN              PageNo,
-  IN CACHE_TAG          *CacheTag
+  IN  FAT_VOLUME        *Volume,
+  IN  CACHE_DATA_TYPE   CacheDataType,
+  IN  UINTN             PageNo,
+  IN  BOOLEAN           Prefetch,
+  OUT CACHE_TAG         **CacheTag
   )
 {
   EFI_STATUS  Status;
-  UINTN       OldPageNo;
+  DISK_CACHE  *DiskCache;
+  CACHE_TAG   *Tag;
 
-  OldPageNo = CacheTag->PageNo;
-  if (CacheTag->RealSize > 0 && OldPageNo == PageNo) {
+  DiskCache = &Volume->DiskCache[CacheDataType];
+  DiskCache->AccessCount++;
+  Tag = FatFindCachePage (DiskCache, PageNo);
+  if (Tag != NULL) {
     //
     // Cache Hit occurred
     //
+    Tag->LastAccess = DiskCache->AccessCount;
+    *CacheTag       = Tag;
     return EFI_SUCCESS;
   }
 
+  Tag       = FatSelectCachePage (DiskCache, PageNo);
+  *CacheTag = Tag;
+  if (Prefetch) {
+    return FatPrefetchCachePages (Volume, PageNo, Tag);
+  }
+
   //
   // Write dirty cache page back to disk
   //
-  if (CacheTag->RealSize > 0 && CacheTag->Dirty) {
-    Status = FatExchangeCachePage (Volume, CacheDataType, WriteDisk, CacheTag, NULL);
+  if (Tag->RealSize > 0 && Tag->Dirty) {
+    Status = FatExchangeCachePage (Volume, CacheDataType, WriteDisk, Tag, NULL);
     if (EFI_ERROR (Status)) {
       return Status;
     }
@@ -203,8 +380,12 @@ FatGetCachePage (
   //
   // Load new data from disk;
   //
-  CacheTag->PageNo  = PageNo;
-  Status            = FatExchangeCachePage (Volume, CacheDataType, ReadDisk, CacheTag, NULL);
+  Tag->PageNo     = PageNo;
+  Tag->LastAccess = DiskCache->AccessCount;
+  Status          = FatExchangeCachePage (Volume, CacheDataType, ReadDisk, Tag, NULL);
+  if (EFI_ERROR (Status)) {
+    Tag->RealSize = 0;
+  }
 
   return Status;
 }
@@ -243,14 +424,14 @@ FatAccessUnalignedCachePage (
   VOID        *Destination;
   DISK_CACHE  *DiskCache;
   CACHE_TAG   *CacheTag;
-  UINTN       GroupNo;
+  BOOLEAN     Prefetch;
 
   DiskCache = &Volume->DiskCache[CacheDataType];
-  GroupNo   = PageNo & DiskCache->GroupMask;
-  CacheTag  = &DiskCache->CacheTag[GroupNo];
-  Status    = FatGetCachePage (Volume, CacheDataType, PageNo, CacheTag);
+  Prefetch  = (BOOLEAN) (CacheDataType == CacheData && IoMode == ReadDisk &&
+                         DiskCache->SequentialCount >= FAT_SEQUENTIAL_THRESHOLD);
+  Status    = FatGetCachePage (Volume, CacheDataType, PageNo, Prefetch, &CacheTag);
   if (!EFI_ERROR (Status)) {
-    Source      = DiskCache->CacheBase + (GroupNo << DiskCache->PageAlignment) + Offset;
+    Source      = FatCachePageAddress (DiskCache, CacheTag) + Offset;
     Destination = Buffer;
     if (IoMode != ReadDisk) {
       CacheTag->Dirty   = TRUE;
@@ -280,6 +461,9 @@ FatAccessUnalignedCachePage (
      The access data will be divided into UnderRun data, Aligned data and OverRun data;
      The UnderRun data and OverRun data will be accessed by the Data cache,
      but the Aligned data will be accessed with disk directly.
+     A read of at least one page that is aligned to the block size of the media
+     is done with disk directly as a whole. Consecutive reads are detected as a
+     sequential stream, and a cache miss in the stream loads several pages at once.
 
   @param  Volume                - FAT file system volume.
   @param  CacheDataType         - The type of cache: CACHE_DATA or CACHE_FAT.
@@ -314,7 +498,9 @@ FatAccessCache (
   UINTN       PageNo;
   UINTN       AlignedPageCount;
   UINTN       OverRunPageNo;
+  UINT32      BlockRemainder;
   DISK_CACHE  *DiskCache;
+  CACHE_TAG   *CacheTag;
   UINT64      EntryPos;
   UINT8       PageAlignment;
 
@@ -328,6 +514,63 @@ FatAccessCache (
   PageNo        = (UINTN) RShiftU64 (EntryPos, PageAlignment);
   UnderRun      = ((UINTN) EntryPos) & (PageSize - 1);
 
+  if (CacheDataType == CacheData) {
+    if (IoMode == ReadDisk && Offset == DiskCache->NextOffset) {
+      DiskCache->SequentialCount++;
+    } else {
+      DiskCache->SequentialCount = 0;
+    }
+
+    DiskCache->NextOffset = Offset + BufferSize;
+  }
+
+  if (CacheDataType == CacheData && IoMode == ReadDisk && BufferSize >= PageSize) {
+    DivU64x32Remainder (Offset, Volume->BlockIo->Media->BlockSize, &BlockRemainder);
+    BlockRemainder |= (UINT32) (BufferSize % Volume->BlockIo->Media->BlockSize);
+    OverRunPageNo   = (UINTN) RShiftU64 (EntryPos + BufferSize - 1, PageAlignment);
+    //
+    // A partial page at either end can only be read from disk directly if the
+    // cache does not hold newer data for it.
+    //
+    if (BlockRemainder == 0) {
+      CacheTag = FatFindCachePage (DiskCache, PageNo);
+      if (UnderRun > 0 && CacheTag != NULL && CacheTag->Dirty) {
+        BlockRemainder = 1;
+      }
+
+      CacheTag = FatFindCachePage (DiskCache, OverRunPageNo);
+      if (((UINTN) (EntryPos + BufferSize) & (PageSize - 1)) != 0 && CacheTag != NULL && CacheTag->Dirty) {
+        BlockRemainder = 1;
+      }
+    }
+
+    if (BlockRemainder == 0) {
+      //
+      // Read the whole range into the caller's buffer with one disk access,
+      // then update the complete pages which are dirty in the cache.
+      //
+      Status = FatDiskIo (Volume, ReadDisk, Offset, BufferSize, Buffer, Task);
+      if (EFI_ERROR (Status)) {
+        return Status;
+      }
+
+      if (UnderRun > 0) {
+        Length = PageSize - UnderRun;
+        Buffer += Length;
+        PageNo++;
+      }
+
+      FatFlushDataCacheRange (
+        Volume,
+        ReadDisk,
+        PageNo,
+        (UINTN) RShiftU64 (EntryPos + BufferSize, PageAlignment),
+        Buffer
+        );
+      return EFI_SUCCESS;
+    }
+  }
+
   if (UnderRun > 0) {
     Length = PageSize - UnderRun;
     if (Length > BufferSize) {
@@ -402,8 +645,8 @@ FatVolumeFlushCache (
 {
   EFI_STATUS      Status;
   CACHE_DATA_TYPE CacheDataType;
-  UINTN           GroupIndex;
-  UINTN           GroupMask;
+  UINTN           PageIndex;
+  UINTN           PageCount;
   DISK_CACHE      *DiskCache;
   CACHE_TAG       *CacheTag;
 
@@ -413,9 +656,9 @@ FatVolumeFlushCache (
       //
       // Data cache or fat cache is dirty, write the dirty data back
       //
-      GroupMask = DiskCache->GroupMask;
-      for (GroupIndex = 0; GroupIndex <= GroupMask; GroupIndex++) {
-        CacheTag = &DiskCache->CacheTag[GroupIndex];
+      PageCount = (DiskCache->GroupMask + 1) * DiskCache->WayCount;
+      for (PageIndex = 0; PageIndex < PageCount; PageIndex++) {
+        CacheTag = &DiskCache->CacheTag[PageIndex];
         if (CacheTag->RealSize > 0 && CacheTag->Dirty) {
           //
           // Write back all Dirty Data Cache Page to disk
@@ -439,7 +682,10 @@ FatVolumeFlushCache (
 
 /**
 
-  Initialize the disk cache according to Volume's FatType.
+  Initialize the disk cache according to Volume's FatType and size.
+
+  The FAT cache is made large enough to hold the whole FAT, and the Data cache
+  grows with the size of the volume, both within fixed limits.
 
   @param  Volume                - FAT file system volume.
 
@@ -454,9 +700,11 @@ FatInitializeDiskCache (
 {
   DISK_CACHE  *DiskCache;
   UINTN       FatCacheGroupCount;
+  UINTN       DataCacheGroupCount;
   UINTN       DataCacheSize;
   UINTN       FatCacheSize;
   UINT8       *CacheBuffer;
+  CACHE_TAG   *CacheTag;
 
   DiskCache = Volume->DiskCache;
   //
@@ -467,29 +715,50 @@ FatInitializeDiskCache (
     DiskCache[CacheFat].PageAlignment  = FAT_FATCACHE_PAGE_MIN_ALIGNMENT;
     DiskCache[CacheData].PageAlignment = FAT_DATACACHE_PAGE_MIN_ALIGNMENT;
   } else {
-    FatCacheGroupCount                  = FAT_FATCACHE_GROUP_MAX_COUNT;
+    FatCacheGroupCount                  = (Volume->FatSize + (1 << FAT_FATCACHE_PAGE_MAX_ALIGNMENT) - 1) >> FAT_FATCACHE_PAGE_MAX_ALIGNMENT;
     DiskCache[CacheFat].PageAlignment  = FAT_FATCACHE_PAGE_MAX_ALIGNMENT;
     DiskCache[CacheData].PageAlignment = FAT_DATACACHE_PAGE_MAX_ALIGNMENT;
   }
 
-  DiskCache[CacheData].GroupMask     = FAT_DATACACHE_GROUP_COUNT - 1;
+  //
+  // Round the FAT cache up and the Data cache down to a power of 2 pages.
+  //
+  FatCacheGroupCount = MIN (MAX (FatCacheGroupCount, FAT_FATCACHE_GROUP_MIN_COUNT), FAT_FATCACHE_GROUP_MAX_COUNT);
+  if (GetPowerOfTwo32 ((UINT32) FatCacheGroupCount) != FatCacheGroupCount) {
+    FatCacheGroupCount = GetPowerOfTwo32 ((UINT32) FatCacheGroupCount) << 1;
+  }
+
+  DataCacheGroupCount = (UINTN) MIN (RShiftU64 (Volume->VolumeSize, FAT_DATACACHE_VOLUME_ALIGNMENT), FAT_DATACACHE_GROUP_MAX_COUNT);
+  DataCacheGroupCount = MAX (DataCacheGroupCount, FAT_DATACACHE_GROUP_MIN_COUNT);
+  DataCacheGroupCount = GetPowerOfTwo32 ((UINT32) DataCacheGroupCount);
+
+  DiskCache[CacheData].WayCount      = MIN (FAT_CACHE_WAY_COUNT, DataCacheGroupCount);
+  DiskCache[CacheData].GroupMask     = DataCacheGroupCount / DiskCache[CacheData].WayCount - 1;
   DiskCache[CacheData].BaseAddress   = Volume->RootPos;
   DiskCache[CacheData].LimitAddress  = Volume->VolumeSize;
-  DiskCache[CacheFat].GroupMask      = FatCacheGroupCount - 1;
+  DiskCache[CacheFat].WayCount       = MIN (FAT_CACHE_WAY_COUNT, FatCacheGroupCount);
+  DiskCache[CacheFat].GroupMask      = FatCacheGroupCount / DiskCache[CacheFat].WayCount - 1;
   DiskCache[CacheFat].BaseAddress    = Volume->FatPos;
   DiskCache[CacheFat].LimitAddress   = Volume->FatPos + Volume->FatSize;
   FatCacheSize                        = FatCacheGroupCount << DiskCache[CacheFat].PageAlignment;
-  DataCacheSize                       = FAT_DATACACHE_GROUP_COUNT << DiskCache[CacheData].PageAlignment;
+  DataCacheSize                       = DataCacheGroupCount << DiskCache[CacheData].PageAlignment;
   //
-  // Allocate the Fat Cache buffer
+  // Allocate the Fat Cache buffer, with the cache tags after the pages
   //
-  CacheBuffer = AllocateZeroPool (FatCacheSize + DataCacheSize);
+  CacheBuffer = AllocateZeroPool (
+                  FatCacheSize + DataCacheSize +
+                  (FatCacheGroupCount + DataCacheGroupCount) * sizeof (CACHE_TAG)
+                  );
   if (CacheBuffer == NULL) {
     return EFI_OUT_OF_RESOURCES;
   }
 
+  CacheTag                        = (CACHE_TAG *) (CacheBuffer + FatCacheSize + DataCacheSize);
   Volume->CacheBuffer             = CacheBuffer;
   DiskCache[CacheFat].CacheBase  = CacheBuffer;
+  DiskCache[CacheFat].CacheTag   = CacheTag;
   DiskCache[CacheData].CacheBase = CacheBuffer + FatCacheSize;
+  DiskCache[CacheData].CacheTag  = CacheTag + FatCacheGroupCount;
+  DiskCache[CacheData].NextOffset = MAX_UINT64;
   return EFI_SUCCESS;
 }
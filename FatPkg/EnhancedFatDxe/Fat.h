@@ -86,9 +86,25 @@ WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
 #define FAT_FATCACHE_PAGE_MAX_ALIGNMENT   15
 #define FAT_DATACACHE_PAGE_MIN_ALIGNMENT  13
 #define FAT_DATACACHE_PAGE_MAX_ALIGNMENT  16
-#define FAT_DATACACHE_GROUP_COUNT         64
+#define FAT_DATACACHE_GROUP_MIN_COUNT     64
+#define FAT_DATACACHE_GROUP_MAX_COUNT     256
 #define FAT_FATCACHE_GROUP_MIN_COUNT      1
-#define FAT_FATCACHE_GROUP_MAX_COUNT      16
+#define FAT_FATCACHE_GROUP_MAX_COUNT      64
+
+//
+// The caches are set associative. One data cache page is given to every
+// FAT_DATACACHE_VOLUME_ALIGNMENT bytes of the volume, within the limits above.
+//
+#define FAT_CACHE_WAY_COUNT               4
+#define FAT_DATACACHE_VOLUME_ALIGNMENT    22
+
+//
+// A sequential stream is detected after FAT_SEQUENTIAL_THRESHOLD consecutive
+// accesses to the data area; a cache miss in the stream then loads up to
+// FAT_PREFETCH_PAGE_COUNT pages with one disk read.
+//
+#define FAT_SEQUENTIAL_THRESHOLD          2
+#define FAT_PREFETCH_PAGE_COUNT           8
 
 //
 // Used in 8.3 generation algorithm
@@ -110,7 +126,9 @@ WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
 #define LC_ISO_639_2_ENTRY_SIZE 3
 #define MAX_LANG_CODE_SIZE      100
 
-#define FAT_MAX_DIR_CACHE_COUNT 8
+#define FAT_DIR_CACHE_BUDGET    0x400000
+#define FAT_DIR_READ_AHEAD_SIZE 0x8000
+#define FAT_EXTENT_GROW_COUNT   16
 #define FAT_MAX_DIRENTRY_COUNT  0xFFFF
 typedef CHAR8                   LC_ISO_639_2;
 
@@ -152,24 +170,34 @@ typedef enum {
 typedef struct {
   UINTN   PageNo;
   UINTN   RealSize;
+  UINTN   LastAccess;             // Value of AccessCount when the page was last used
   BOOLEAN Dirty;
 } CACHE_TAG;
 
+//
+// The page of way W in set S is CacheTag[W * (GroupMask + 1) + S], so the pages
+// of one way for consecutive PageNo are contiguous in CacheBase.
+//
 typedef struct {
   UINT64    BaseAddress;
   UINT64    LimitAddress;
   UINT8     *CacheBase;
   BOOLEAN   Dirty;
   UINT8     PageAlignment;
-  UINTN     GroupMask;
-  CACHE_TAG CacheTag[FAT_DATACACHE_GROUP_COUNT];
+  UINTN     GroupMask;            // Number of sets - 1
+  UINTN     WayCount;
+  UINTN     AccessCount;
+  UINT64    NextOffset;           // Offset following the last read, for stream detection
+  UINTN     SequentialCount;
+  CACHE_TAG *CacheTag;
 } DISK_CACHE;
 
 //
-// Hash table size
+// Hash table size. A directory's hash tables double in size
+// when they hold twice as many entries as they have buckets.
 //
-#define HASH_TABLE_SIZE  0x400
-#define HASH_TABLE_MASK  (HASH_TABLE_SIZE - 1)
+#define HASH_TABLE_MIN_SIZE  0x40
+#define HASH_TABLE_MAX_SIZE  0x10000
 
 //
 // The directory entry for opened directory
@@ -189,6 +217,8 @@ struct _FAT_DIRENT {
   FAT_OFILE           *OFile;                 // The OFile of the corresponding directory entry
   FAT_DIRENT          *ShortNameForwardLink;  // Hash successor link for short filename
   FAT_DIRENT          *LongNameForwardLink;   // Hash successor link for long filename
+  UINT32              ShortNameHash;          // Hash value of the short filename
+  UINT32              LongNameHash;           // Hash value of the long filename
   LIST_ENTRY          Link;                   // Connection of every directory entry
   FAT_DIRECTORY_ENTRY Entry;                  // The physical directory entry stored in disk
 };
@@ -202,8 +232,14 @@ struct _FAT_ODIR {
   BOOLEAN             EndOfDir;               // Indicate whether we have reached the end of the directory
   LIST_ENTRY          DirCacheLink;           // Linked in Volume->DirCacheList when discarded
   UINTN               DirCacheTag;            // The identification of the directory when in directory cache
-  FAT_DIRENT          *LongNameHashTable[HASH_TABLE_SIZE];
-  FAT_DIRENT          *ShortNameHashTable[HASH_TABLE_SIZE];
+  UINTN               DirCacheSize;           // Bytes of memory used by the directory structure
+  UINTN               DirEntCount;            // Number of directory entries in the hash tables
+  UINTN               HashTableMask;          // Number of buckets of the hash tables - 1
+  FAT_DIRENT          **LongNameHashTable;
+  FAT_DIRENT          **ShortNameHashTable;
+  FAT_DIRECTORY_ENTRY *EntryBuffer;           // Directory entries read ahead from the disk
+  UINTN               EntryBufferPos;         // Position of the first entry in EntryBuffer
+  UINTN               EntryBufferCount;       // Number of valid entries in EntryBuffer
 };
 
 typedef struct {
@@ -235,6 +271,15 @@ typedef struct {
   LIST_ENTRY          Link;
 } FAT_SUBTASK;
 
+//
+// A run of clusters that are contiguous both in the file and on the disk
+//
+typedef struct {
+  UINTN               FileCluster;            // Index of the first cluster of the run within the file
+  UINTN               Cluster;                // First cluster of the run on the disk
+  UINTN               Length;                 // Number of clusters in the run
+} FAT_EXTENT;
+
 //
 // FAT_OFILE - Each opened file
 //
@@ -278,6 +323,14 @@ struct _FAT_OFILE {
   UINT64              PosDisk;  // on the disk
   UINTN               PosRem;   // remaining in this disk run
   //
+  // The extent map of the cluster chain, built on demand. It maps
+  // the first ExtentClusters clusters of the file.
+  //
+  FAT_EXTENT          *Extents;
+  UINTN               ExtentCount;
+  UINTN               ExtentMaxCount;
+  UINTN               ExtentClusters;
+  //
   // The opened parent, full path length and currently opened child files
   //
   FAT_OFILE           *Parent;
@@ -341,6 +394,7 @@ struct _FAT_VOLUME {
   FAT_INFO_SECTOR                 FatInfoSector;  // Free cluster info
   UINTN                           FreeInfoPos;    // Pos with the free cluster info
   BOOLEAN                         FreeInfoValid;  // If free cluster info is valid
+  UINT8                           *FreeBitmap;    // One bit per cluster, set if the cluster is free
   //
   // Unpacked Fat BPB info
   //
@@ -375,6 +429,7 @@ struct _FAT_VOLUME {
   //
   LIST_ENTRY                      DirCacheList;
   UINTN                           DirCacheCount;
+  UINTN                           DirCacheSize;
 
   //
   // Disk Cache for this volume
@@ -171,6 +171,14 @@ FatSetFatEntry (
       Volume->FatInfoSector.FreeInfo.ClusterCount -= 1;
     }
   }
+
+  if (Volume->FreeBitmap != NULL && Index <= Volume->MaxCluster + 1) {
+    if (Value == FAT_CLUSTER_FREE) {
+      Volume->FreeBitmap[Index / 8] |= (UINT8) (1 << (Index % 8));
+    } else {
+      Volume->FreeBitmap[Index / 8] &= (UINT8) ~(1 << (Index % 8));
+    }
+  }
   //
   // Make sure the entry is in memory
   //
@@ -278,6 +286,7 @@ FatAllocateCluster (
   )
 {
   UINTN Cluster;
+  UINTN Index;
 
   //
   // Start looking at FatFreePos for the next unallocated cluster
@@ -301,9 +310,24 @@ FatAllocateCluster (
       }
     }
 
-    Cluster = FatGetFatEntry (Volume, Volume->FatInfoSector.FreeInfo.NextCluster);
-    if (Cluster == FAT_CLUSTER_FREE) {
-      break;
+    Index = Volume->FatInfoSector.FreeInfo.NextCluster;
+    if (Volume->FreeBitmap != NULL) {
+      //
+      // Skip eight clusters in use at a time
+      //
+      if (Volume->FreeBitmap[Index / 8] == 0) {
+        Volume->FatInfoSector.FreeInfo.NextCluster = (UINT32) ((Index | 7) + 1);
+        continue;
+      }
+
+      if ((Volume->FreeBitmap[Index / 8] & (1 << (Index % 8))) != 0) {
+        break;
+      }
+    } else {
+      Cluster = FatGetFatEntry (Volume, Index);
+      if (Cluster == FAT_CLUSTER_FREE) {
+        break;
+      }
     }
     //
     // Try the next cluster
@@ -343,6 +367,179 @@ FatSizeToClusters (
   return Clusters;
 }
 
+/**
+
+  Append one cluster to the end of the extent map of the open file.
+
+  @param  OFile                 - The open file.
+  @param  Cluster               - The cluster following the last mapped cluster of the file.
+
+  @retval EFI_SUCCESS           - The cluster is appended successfully.
+  @retval EFI_OUT_OF_RESOURCES  - Not enough memory to grow the extent map.
+
+**/
+STATIC
+EFI_STATUS
+FatAppendExtent (
+  IN FAT_OFILE            *OFile,
+  IN UINTN                Cluster
+  )
+{
+  FAT_EXTENT  *Extent;
+  FAT_EXTENT  *NewExtents;
+
+  if (OFile->ExtentCount > 0) {
+    Extent = &OFile->Extents[OFile->ExtentCount - 1];
+    if (Extent->Cluster + Extent->Length == Cluster) {
+      Extent->Length += 1;
+      OFile->ExtentClusters += 1;
+      return EFI_SUCCESS;
+    }
+  }
+
+  if (OFile->ExtentCount == OFile->ExtentMaxCount) {
+    NewExtents = ReallocatePool (
+                   OFile->ExtentMaxCount * sizeof (FAT_EXTENT),
+                   (OFile->ExtentMaxCount + FAT_EXTENT_GROW_COUNT) * sizeof (FAT_EXTENT),
+                   OFile->Extents
+                   );
+    if (NewExtents == NULL) {
+      return EFI_OUT_OF_RESOURCES;
+    }
+
+    OFile->Extents         = NewExtents;
+    OFile->ExtentMaxCount += FAT_EXTENT_GROW_COUNT;
+  }
+
+  Extent              = &OFile->Extents[OFile->ExtentCount];
+  Extent->FileCluster = OFile->ExtentClusters;
+  Extent->Cluster     = Cluster;
+  Extent->Length      = 1;
+  OFile->ExtentCount    += 1;
+  OFile->ExtentClusters += 1;
+  return EFI_SUCCESS;
+}
+
+/**
+
+  Drop the clusters after the first ClusterCount clusters from the extent map
+  of the open file.
+
+  @param  OFile                 - The open file.
+  @param  ClusterCount          - The number of clusters to keep in the extent map.
+
+**/
+STATIC
+VOID
+FatTruncateExtents (
+  IN FAT_OFILE            *OFile,
+  IN UINTN                ClusterCount
+  )
+{
+  FAT_EXTENT  *Extent;
+
+  if (OFile->ExtentClusters <= ClusterCount) {
+    return;
+  }
+
+  while (OFile->ExtentCount > 0) {
+    Extent = &OFile->Extents[OFile->ExtentCount - 1];
+    if (Extent->FileCluster < ClusterCount) {
+      Extent->Length = MIN (Extent->Length, ClusterCount - Extent->FileCluster);
+      break;
+    }
+
+    OFile->ExtentCount -= 1;
+  }
+
+  OFile->ExtentClusters = ClusterCount;
+}
+
+/**
+
+  Find the extent of the open file which maps the cluster ClusterIndex of the
+  file, and extend the extent map along the cluster chain as needed.
+
+  The map is extended up to ClusterIndex, and further while the chain stays
+  contiguous, up to LastIndex, so that a long run is returned as one extent.
+
+  @param  OFile                 - The open file.
+  @param  ClusterIndex          - The index of the cluster within the file.
+  @param  LastIndex             - The index of the last cluster of the file which is going to be accessed.
+  @param  Extent                - Returns the extent mapping ClusterIndex.
+
+  @retval EFI_SUCCESS           - The extent is found.
+  @retval EFI_VOLUME_CORRUPTED  - Cluster chain corrupt.
+  @retval EFI_OUT_OF_RESOURCES  - Not enough memory to grow the extent map.
+
+**/
+STATIC
+EFI_STATUS
+FatMapOFileCluster (
+  IN  FAT_OFILE           *OFile,
+  IN  UINTN               ClusterIndex,
+  IN  UINTN               LastIndex,
+  OUT FAT_EXTENT          **Extent
+  )
+{
+  EFI_STATUS  Status;
+  FAT_VOLUME  *Volume;
+  FAT_EXTENT  *Last;
+  UINTN       Cluster;
+  UINTN       Low;
+  UINTN       High;
+  UINTN       Middle;
+
+  Volume = OFile->Volume;
+  for (;;) {
+    if (OFile->ExtentCount > 0) {
+      Last = &OFile->Extents[OFile->ExtentCount - 1];
+      if (OFile->ExtentClusters > ClusterIndex &&
+          (OFile->ExtentClusters > LastIndex || Last->FileCluster > ClusterIndex)) {
+        break;
+      }
+
+      Cluster = FatGetFatEntry (Volume, Last->Cluster + Last->Length - 1);
+    } else {
+      Cluster = OFile->FileCluster;
+    }
+
+    if (Cluster == FAT_CLUSTER_FREE || Cluster >= FAT_CLUSTER_SPECIAL) {
+      if (OFile->ExtentClusters > ClusterIndex) {
+        //
+        // The end of the chain was reached after ClusterIndex
+        //
+        break;
+      }
+
+      DEBUG ((EFI_D_INIT | EFI_D_ERROR, "FatMapOFileCluster: cluster chain corrupt\n"));
+      return EFI_VOLUME_CORRUPTED;
+    }
+
+    Status = FatAppendExtent (OFile, Cluster);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+  }
+
+  //
+  // Binary search the extent which maps ClusterIndex
+  //
+  Low  = 0;
+  High = OFile->ExtentCount - 1;
+  while (Low < High) {
+    Middle = (Low + High + 1) / 2;
+    if (OFile->Extents[Middle].FileCluster <= ClusterIndex) {
+      Low = Middle;
+    } else {
+      High = Middle - 1;
+    }
+  }
+
+  *Extent = &OFile->Extents[Low];
+  return EFI_SUCCESS;
+}
+
 /**
 
   Shrink the end of the open file base on the file size.
@@ -389,6 +586,7 @@ FatShrinkEof (
     }
 
     FatSetFatEntry (Volume, LastCluster, (UINTN) FAT_CLUSTER_LAST);
+    FatTruncateExtents (OFile, NewSize);
 
   } else {
     //
@@ -401,6 +599,7 @@ FatShrinkEof (
     // The file is being completely truncated.
     //
     OFile->FileCluster      = FAT_CLUSTER_FREE;
+    FatTruncateExtents (OFile, 0);
   }
   //
   // Set CurrentCluster == FileCluster
@@ -460,8 +659,15 @@ FatGrowEof (
 
   if (CurSize < NewSize) {
     //
-    // If we haven't found the files last cluster do it now
+    // If we haven't found the files last cluster do it now,
+    // from the extent map if it covers the whole file
     //
+    if ((OFile->FileCluster != 0) && (OFile->FileLastCluster == 0) &&
+        (OFile->ExtentClusters == CurSize) && (CurSize != 0)) {
+      OFile->FileLastCluster = OFile->Extents[OFile->ExtentCount - 1].Cluster +
+                               OFile->Extents[OFile->ExtentCount - 1].Length - 1;
+    }
+
     if ((OFile->FileCluster != 0) && (OFile->FileLastCluster == 0)) {
       Cluster       = OFile->FileCluster;
       ClusterCount  = 0;
@@ -516,6 +722,14 @@ FatGrowEof (
         OFile->FileCurrentCluster = NewCluster;
       }
 
+      //
+      // Keep a complete extent map up to date. If memory runs out, the map
+      // simply stays shorter and is extended from the FAT when needed.
+      //
+      if (OFile->ExtentClusters == CurSize) {
+        FatAppendExtent (OFile, NewCluster);
+      }
+
       LastCluster = NewCluster;
       CurSize += 1;
     }
@@ -555,9 +769,13 @@ FatOFilePosition (
   IN UINTN                PosLimit
   )
 {
+  EFI_STATUS  Status;
   FAT_VOLUME  *Volume;
+  FAT_EXTENT  *Extent;
   UINTN       ClusterSize;
   UINTN       Cluster;
+  UINTN       ClusterIndex;
+  UINTN       LastIndex;
   UINTN       StartPos;
   UINTN       Run;
 
@@ -574,6 +792,33 @@ FatOFilePosition (
     OFile->PosDisk  = Volume->RootPos + Position;
     Run             = OFile->FileSize - Position;
   } else {
+    //
+    // Look the position up in the extent map of the file, so that
+    // the cluster chain is only followed once
+    //
+    ClusterIndex  = Position >> Volume->ClusterAlignment;
+    LastIndex     = (Position + PosLimit - 1) >> Volume->ClusterAlignment;
+    Status        = FatMapOFileCluster (OFile, ClusterIndex, LastIndex, &Extent);
+    if (!EFI_ERROR (Status)) {
+      Cluster       = Extent->Cluster + (ClusterIndex - Extent->FileCluster);
+      StartPos      = ClusterIndex << Volume->ClusterAlignment;
+      OFile->PosDisk            = Volume->FirstClusterPos +
+                                  LShiftU64 (Cluster - FAT_MIN_CLUSTER, Volume->ClusterAlignment) +
+                                  Position - StartPos;
+      OFile->FileCurrentCluster = Cluster;
+      OFile->Position           = StartPos;
+      //
+      // The run is clipped to the access, so it cannot overflow at 4GB
+      //
+      Run                       = MIN (Extent->FileCluster + Extent->Length - 1, LastIndex);
+      OFile->PosRem             = ((Run - ClusterIndex) << Volume->ClusterAlignment) + ClusterSize - (Position - StartPos);
+      return EFI_SUCCESS;
+    }
+
+    if (Status != EFI_OUT_OF_RESOURCES) {
+      return Status;
+    }
+
     //
     // Run the file's cluster chain to find the current position
     // If possible, run from the current cluster rather than
@@ -709,24 +954,51 @@ FatComputeFreeInfo (
   IN FAT_VOLUME *Volume
   )
 {
-  UINTN Index;
+  UINTN   Index;
+  UINTN   BitmapSize;
+  BOOLEAN ScanFat;
 
   //
-  // If we don't have valid info, compute it now
+  // If we don't have valid info, compute it now.
+  // The FAT is scanned only once; the free cluster bitmap
+  // built by the scan is kept up to date by FatSetFatEntry.
   //
   if (!Volume->FreeInfoValid) {
 
+    ScanFat = (BOOLEAN) (Volume->FreeBitmap == NULL);
+    if (ScanFat) {
+      BitmapSize = (Volume->MaxCluster + 2 + 7) / 8;
+      if (BitmapSize <= FAT_MAX_ALLOCATE_SIZE) {
+        Volume->FreeBitmap = AllocateZeroPool (BitmapSize);
+      }
+    }
+
     Volume->FreeInfoValid                        = TRUE;
     Volume->FatInfoSector.FreeInfo.ClusterCount  = 0;
     for (Index = Volume->MaxCluster + 1; Index >= FAT_MIN_CLUSTER; Index--) {
-      if (Volume->DiskError) {
-        break;
-      }
+      if (ScanFat) {
+        if (Volume->DiskError) {
+          break;
+        }
+
+        if (FatGetFatEntry (Volume, Index) != FAT_CLUSTER_FREE) {
+          continue;
+        }
 
-      if (FatGetFatEntry (Volume, Index) == FAT_CLUSTER_FREE) {
-        Volume->FatInfoSector.FreeInfo.ClusterCount += 1;
-        Volume->FatInfoSector.FreeInfo.NextCluster = (UINT32) Index;
+        if (Volume->FreeBitmap != NULL) {
+          Volume->FreeBitmap[Index / 8] |= (UINT8) (1 << (Index % 8));
+        }
+      } else if ((Volume->FreeBitmap[Index / 8] & (1 << (Index % 8))) == 0) {
+        continue;
       }
+
+      Volume->FatInfoSector.FreeInfo.ClusterCount += 1;
+      Volume->FatInfoSector.FreeInfo.NextCluster = (UINT32) Index;
+    }
+
+    if (ScanFat && Volume->DiskError && Volume->FreeBitmap != NULL) {
+      FreePool (Volume->FreeBitmap);
+      Volume->FreeBitmap = NULL;
     }
 
     Volume->FatInfoSector.Signature          = FAT_INFO_SIGNATURE;
@@ -39,7 +39,7 @@ FatHashLongName (
     );
   FatStrUpr (UpCasedLongFileName);
   gBS->CalculateCrc32 (UpCasedLongFileName, StrSize (UpCasedLongFileName), &HashValue);
-  return (HashValue & HASH_TABLE_MASK);
+  return HashValue;
 }
 
 /**
@@ -59,7 +59,7 @@ FatHashShortName (
 {
   UINT32  HashValue;
   gBS->CalculateCrc32 (ShortNameString, FAT_NAME_LEN, &HashValue);
-  return (HashValue & HASH_TABLE_MASK);
+  return HashValue;
 }
 
 /**
@@ -79,7 +79,7 @@ FatLongNameHashSearch (
   )
 {
   FAT_DIRENT  **PreviousHashNode;
-  for (PreviousHashNode   = &ODir->LongNameHashTable[FatHashLongName (LongNameString)];
+  for (PreviousHashNode   = &ODir->LongNameHashTable[FatHashLongName (LongNameString) & ODir->HashTableMask];
        *PreviousHashNode != NULL;
        PreviousHashNode   = &(*PreviousHashNode)->LongNameForwardLink
       ) {
@@ -108,7 +108,7 @@ FatShortNameHashSearch (
   )
 {
   FAT_DIRENT  **PreviousHashNode;
-  for (PreviousHashNode   = &ODir->ShortNameHashTable[FatHashShortName (ShortNameString)];
+  for (PreviousHashNode   = &ODir->ShortNameHashTable[FatHashShortName (ShortNameString) & ODir->HashTableMask];
        *PreviousHashNode != NULL;
        PreviousHashNode   = &(*PreviousHashNode)->ShortNameForwardLink
       ) {
@@ -120,6 +120,70 @@ FatShortNameHashSearch (
   return PreviousHashNode;
 }
 
+/**
+
+  Double the size of the hash tables of the directory. The tables keep
+  their size if there is not enough memory for the new ones.
+
+  @param  ODir                  - The directory.
+
+**/
+STATIC
+VOID
+FatGrowHashTable (
+  IN FAT_ODIR     *ODir
+  )
+{
+  FAT_DIRENT  **LongNameHashTable;
+  FAT_DIRENT  **ShortNameHashTable;
+  FAT_DIRENT  *DirEnt;
+  UINTN       TableSize;
+  UINTN       NewMask;
+  UINTN       Index;
+
+  TableSize           = (ODir->HashTableMask + 1) * 2;
+  NewMask             = TableSize - 1;
+  LongNameHashTable   = AllocateZeroPool (TableSize * sizeof (FAT_DIRENT *));
+  ShortNameHashTable  = AllocateZeroPool (TableSize * sizeof (FAT_DIRENT *));
+  if (LongNameHashTable == NULL || ShortNameHashTable == NULL) {
+    if (LongNameHashTable != NULL) {
+      FreePool (LongNameHashTable);
+    }
+
+    if (ShortNameHashTable != NULL) {
+      FreePool (ShortNameHashTable);
+    }
+
+    return;
+  }
+
+  //
+  // Move the entries into the new tables with the stored hash values
+  //
+  for (Index = 0; Index <= ODir->HashTableMask; Index++) {
+    while (ODir->LongNameHashTable[Index] != NULL) {
+      DirEnt                                          = ODir->LongNameHashTable[Index];
+      ODir->LongNameHashTable[Index]                  = DirEnt->LongNameForwardLink;
+      DirEnt->LongNameForwardLink                     = LongNameHashTable[DirEnt->LongNameHash & NewMask];
+      LongNameHashTable[DirEnt->LongNameHash & NewMask] = DirEnt;
+    }
+
+    while (ODir->ShortNameHashTable[Index] != NULL) {
+      DirEnt                                            = ODir->ShortNameHashTable[Index];
+      ODir->ShortNameHashTable[Index]                   = DirEnt->ShortNameForwardLink;
+      DirEnt->ShortNameForwardLink                      = ShortNameHashTable[DirEnt->ShortNameHash & NewMask];
+      ShortNameHashTable[DirEnt->ShortNameHash & NewMask] = DirEnt;
+    }
+  }
+
+  FreePool (ODir->LongNameHashTable);
+  FreePool (ODir->ShortNameHashTable);
+  ODir->DirCacheSize       += (TableSize / 2) * 2 * sizeof (FAT_DIRENT *);
+  ODir->LongNameHashTable   = LongNameHashTable;
+  ODir->ShortNameHashTable  = ShortNameHashTable;
+  ODir->HashTableMask       = NewMask;
+}
+
 /**
 
   Insert directory entry to hash table.
@@ -140,17 +204,25 @@ FatInsertToHashTable (
   //
   // Insert hash table index for short name
   //
-  HashTableIndex                = FatHashShortName (DirEnt->Entry.FileName);
+  DirEnt->ShortNameHash         = FatHashShortName (DirEnt->Entry.FileName);
+  HashTableIndex                = (UINT32) (DirEnt->ShortNameHash & ODir->HashTableMask);
   HashTable                     = ODir->ShortNameHashTable;
   DirEnt->ShortNameForwardLink  = HashTable[HashTableIndex];
   HashTable[HashTableIndex]     = DirEnt;
   //
   // Insert hash table index for long name
   //
-  HashTableIndex                = FatHashLongName (DirEnt->FileString);
+  DirEnt->LongNameHash          = FatHashLongName (DirEnt->FileString);
+  HashTableIndex                = (UINT32) (DirEnt->LongNameHash & ODir->HashTableMask);
   HashTable                     = ODir->LongNameHashTable;
   DirEnt->LongNameForwardLink   = HashTable[HashTableIndex];
   HashTable[HashTableIndex]     = DirEnt;
+
+  ODir->DirEntCount++;
+  ODir->DirCacheSize += sizeof (FAT_DIRENT) + StrSize (DirEnt->FileString);
+  if (ODir->DirEntCount > (ODir->HashTableMask + 1) * 2 && ODir->HashTableMask + 1 < HASH_TABLE_MAX_SIZE) {
+    FatGrowHashTable (ODir);
+  }
 }
 
 /**
@@ -167,6 +239,22 @@ FatDeleteFromHashTable (
   IN FAT_DIRENT   *DirEnt
   )
 {
-  *FatShortNameHashSearch (ODir, DirEnt->Entry.FileName) = DirEnt->ShortNameForwardLink;
-  *FatLongNameHashSearch (ODir, DirEnt->FileString)      = DirEnt->LongNameForwardLink;
+  FAT_DIRENT  **PreviousHashNode;
+
+  PreviousHashNode = &ODir->ShortNameHashTable[DirEnt->ShortNameHash & ODir->HashTableMask];
+  while (*PreviousHashNode != DirEnt) {
+    PreviousHashNode = &(*PreviousHashNode)->ShortNameForwardLink;
+  }
+
+  *PreviousHashNode = DirEnt->ShortNameForwardLink;
+
+  PreviousHashNode = &ODir->LongNameHashTable[DirEnt->LongNameHash & ODir->HashTableMask];
+  while (*PreviousHashNode != DirEnt) {
+    PreviousHashNode = &(*PreviousHashNode)->LongNameForwardLink;
+  }
+
+  *PreviousHashNode = DirEnt->LongNameForwardLink;
+
+  ODir->DirEntCount--;
+  ODir->DirCacheSize -= sizeof (FAT_DIRENT) + StrSize (DirEnt->FileString);
 }
@@ -461,6 +461,10 @@ FatFreeVolume (
   if (Volume->CacheBuffer != NULL) {
     FreePool (Volume->CacheBuffer);
   }
+
+  if (Volume->FreeBitmap != NULL) {
+    FreePool (Volume->FreeBitmap);
+  }
   //
   // Free directory cache
   //
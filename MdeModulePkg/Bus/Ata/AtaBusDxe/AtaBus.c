@@ -208,6 +208,8 @@ ReleaseAtaResources (
   @param  AtaBusDriverData      The parent ATA bus driver data structure.
   @param  Port                  The port number of the ATA device.
   @param  PortMultiplierPort    The port multiplier port number of the ATA device.
+  @param  IdentifyData          The identify data the bus scan already read from
+                                the device, or NULL to issue the command.
 
   @retval EFI_SUCCESS           The ATA device is successfully registered.
   @retval EFI_OUT_OF_RESOURCES  There is not enough memory to allocate the ATA device
@@ -218,7 +220,8 @@ EFI_STATUS
 RegisterAtaDevice (
   IN OUT ATA_BUS_DRIVER_DATA        *AtaBusDriverData,
   IN     UINT16                     Port,
-  IN     UINT16                     PortMultiplierPort
+  IN     UINT16                     PortMultiplierPort,
+  IN     ATA_IDENTIFY_DATA          *IdentifyData  OPTIONAL
   )
 {
   EFI_STATUS                        Status;
@@ -305,7 +308,7 @@ RegisterAtaDevice (
   //
   // Try to identify the ATA device via the ATA pass through command.
   //
-  Status = DiscoverAtaDevice (AtaDevice);
+  Status = DiscoverAtaDevice (AtaDevice, IdentifyData);
   if (EFI_ERROR (Status)) {
     goto Done;
   }
@@ -812,34 +815,12 @@ AtaBusDriverBindingStart (
     );
 
   if (RemainingDevicePath == NULL) {
-    Port = 0xFFFF;
-    while (TRUE) {
-      Status = AtaPassThru->GetNextPort (AtaPassThru, &Port);
-      if (EFI_ERROR (Status)) {
-        //
-        // We cannot find more legal port then we are done.
-        //
-        break;
-      }
-
-      PortMultiplierPort = 0xFFFF;
-      while (TRUE) {
-        Status = AtaPassThru->GetNextDevice (AtaPassThru, Port, &PortMultiplierPort);
-        if (EFI_ERROR (Status)) {
-          //
-          // We cannot find more legal port multiplier port number for ATA device
-          // on the port, then we are done.
-          //
-          break;
-        }
-        RegisterAtaDevice (AtaBusDriverData, Port, PortMultiplierPort);
-      }
-    }
+    AtaBusScanAllDevices (AtaBusDriverData);
     Status = EFI_SUCCESS;
   } else if (!IsDevicePathEnd (RemainingDevicePath)) {
     Status = AtaPassThru->GetDevice (AtaPassThru, RemainingDevicePath, &Port, &PortMultiplierPort);
     if (!EFI_ERROR (Status)) {
-      Status = RegisterAtaDevice (AtaBusDriverData,Port, PortMultiplierPort);
+      Status = RegisterAtaDevice (AtaBusDriverData,Port, PortMultiplierPort, NULL);
     }
   }
 
@@ -18,7 +18,7 @@
 #ifndef _ATA_BUS_H_
 #define _ATA_BUS_H_
 
-#include <Uefi.h>
+#include <PiDxe.h>
 
 #include <Protocol/AtaPassThru.h>
 #include <Protocol/BlockIo.h>
@@ -27,6 +27,8 @@
 #include <Protocol/DevicePath.h>
 #include <Protocol/StorageSecurityCommand.h>
 
+#include <Guid/StorageBusDiscovery.h>
+
 #include <Library/DebugLib.h>
 #include <Library/UefiDriverEntryPoint.h>
 #include <Library/BaseLib.h>
@@ -38,6 +40,9 @@
 #include <Library/UefiRuntimeServicesTableLib.h>
 #include <Library/TimerLib.h>
 #include <Library/ReportStatusCodeLib.h>
+#include <Library/HobLib.h>
+#include <Library/PcdLib.h>
+#include <Library/PrintLib.h>
 
 #include <IndustryStandard/Atapi.h>
 
@@ -51,6 +56,21 @@
 //
 #define MAX_RETRY_TIMES                   3
 
+//
+// The number of IDENTIFY commands the bus scan keeps outstanding on a pass
+// thru that supports non-blocking I/O, and the interval in microseconds at
+// which the outstanding commands are polled.
+//
+#define ATA_BUS_MAX_PROBES                16
+#define ATA_BUS_PROBE_POLL_PERIOD         10
+
+//
+// The prefix of the discovery cache variable names, see
+// Guid/StorageBusDiscovery.h. The CRC32 of the controller device path follows.
+//
+#define ATA_BUS_DISCOVERY_VARIABLE_PREFIX L"AtaBus"
+#define ATA_BUS_DISCOVERY_VARIABLE_LENGTH 16
+
 //
 // The maximum total sectors count in 28 bit addressing mode
 //
@@ -162,6 +182,43 @@ typedef struct {
   LIST_ENTRY                        TaskEntry;
 } ATA_BUS_ASYN_TASK;
 
+//
+// State of a device during the bus scan
+//
+typedef enum {
+  AtaBusProbePending,
+  AtaBusProbeInFlight,
+  AtaBusProbePresent,
+  AtaBusProbeAbsent,
+  //
+  // The device is left to the blocking IDENTIFY command of DiscoverAtaDevice().
+  //
+  AtaBusProbeUnknown
+} ATA_BUS_PROBE_STATE;
+
+//
+// A device address found by the bus scan
+//
+typedef struct {
+  UINT16                            Port;
+  UINT16                            PortMultiplierPort;
+  ATA_BUS_PROBE_STATE               State;
+  UINTN                             Attempts;
+  ATA_IDENTIFY_DATA                 IdentifyData;
+} ATA_BUS_PROBE;
+
+//
+// An outstanding IDENTIFY command of the bus scan
+//
+typedef struct {
+  ATA_BUS_PROBE                     *Probe;
+  EFI_EVENT                         Event;
+  EFI_ATA_PASS_THRU_COMMAND_PACKET  Packet;
+  EFI_ATA_COMMAND_BLOCK             Acb;
+  EFI_ATA_STATUS_BLOCK              *Asb;
+  ATA_IDENTIFY_DATA                 *IdentifyData;
+} ATA_BUS_PROBE_SLOT;
+
 #define ATA_DEVICE_FROM_BLOCK_IO(a)         CR (a, ATA_DEVICE, BlockIo, ATA_DEVICE_SIGNATURE)
 #define ATA_DEVICE_FROM_BLOCK_IO2(a)        CR (a, ATA_DEVICE, BlockIo2, ATA_DEVICE_SIGNATURE)
 #define ATA_DEVICE_FROM_DISK_INFO(a)        CR (a, ATA_DEVICE, DiskInfo, ATA_DEVICE_SIGNATURE)
@@ -248,6 +305,8 @@ ResetAtaDevice (
   the Media information in Block IO protocol interface.
 
   @param  AtaDevice         The ATA child device involved for the operation.
+  @param  IdentifyData      The identify data the bus scan already read from
+                            the device, or NULL to issue the command.
 
   @retval EFI_SUCCESS       The device is successfully identified and Media information
                             is correctly initialized.
@@ -256,7 +315,52 @@ ResetAtaDevice (
 **/
 EFI_STATUS
 DiscoverAtaDevice (
-  IN OUT ATA_DEVICE                 *AtaDevice
+  IN OUT ATA_DEVICE                 *AtaDevice,
+  IN     ATA_IDENTIFY_DATA          *IdentifyData  OPTIONAL
+  );
+
+/**
+  Registers an ATA device.
+
+  This function allocates an ATA device structure for the ATA device specified by
+  Port and PortMultiplierPort if the ATA device is identified as a valid one.
+  Then it will create child handle and install Block IO and Disk Info protocol on
+  it.
+
+  @param  AtaBusDriverData      The parent ATA bus driver data structure.
+  @param  Port                  The port number of the ATA device.
+  @param  PortMultiplierPort    The port multiplier port number of the ATA device.
+  @param  IdentifyData          The identify data the bus scan already read from
+                                the device, or NULL to issue the command.
+
+  @retval EFI_SUCCESS           The ATA device is successfully registered.
+  @retval EFI_OUT_OF_RESOURCES  There is not enough memory to allocate the ATA device
+                                and related data structures.
+  @return Others                Some error occurs when registering the ATA device.
+**/
+EFI_STATUS
+RegisterAtaDevice (
+  IN OUT ATA_BUS_DRIVER_DATA        *AtaBusDriverData,
+  IN     UINT16                     Port,
+  IN     UINT16                     PortMultiplierPort,
+  IN     ATA_IDENTIFY_DATA          *IdentifyData  OPTIONAL
+  );
+
+/**
+  Scan all the devices on the ATA controller, and register the ones that are
+  found.
+
+  If the pass thru supports non-blocking I/O, the IDENTIFY commands are sent to
+  up to ATA_BUS_MAX_PROBES devices at a time. If PcdStorageBusDiscoveryCache is
+  set, the devices found are remembered, and on a boot assuming no
+  configuration changes only those are probed.
+
+  @param  AtaBusDriverData      The parent ATA bus driver data structure.
+
+**/
+VOID
+AtaBusScanAllDevices (
+  IN OUT ATA_BUS_DRIVER_DATA        *AtaBusDriverData
   );
 
 /**
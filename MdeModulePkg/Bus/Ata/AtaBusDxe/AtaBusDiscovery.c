@@ -0,0 +1,539 @@
+/** @file
+  Bus scan of the ATA Bus Driver: identifies the devices on the ATA controller
+  with overlapping IDENTIFY commands, and keeps the discovery cache.
+
+  Copyright (c) 2017, Intel Corporation. All rights reserved.<BR>
+  This program and the accompanying materials
+  are licensed and made available under the terms and conditions of the BSD License
+  which accompanies this distribution.  The full text of the license may be found at
+  http://opensource.org/licenses/bsd-license.php
+
+  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+**/
+
+#include "AtaBus.h"
+
+/**
+  Read the discovery cache variable of an ATA controller.
+
+  @param  AtaBusDriverData      The parent ATA bus driver data structure.
+  @param  VariableName          Returns the name of the variable of the
+                                controller. The buffer holds
+                                ATA_BUS_DISCOVERY_VARIABLE_LENGTH characters.
+
+  @return The cache of the controller, allocated from pool, or NULL if there is
+          no valid cache for it.
+
+**/
+EDKII_STORAGE_BUS_DISCOVERY *
+AtaBusGetDiscoveryCache (
+  IN  ATA_BUS_DRIVER_DATA           *AtaBusDriverData,
+  OUT CHAR16                        *VariableName
+  )
+{
+  EFI_STATUS                        Status;
+  UINTN                             DevicePathSize;
+  UINT32                            Crc;
+  EDKII_STORAGE_BUS_DISCOVERY       *Cache;
+  UINTN                             CacheSize;
+
+  DevicePathSize = GetDevicePathSize (AtaBusDriverData->ParentDevicePath);
+  Crc = 0;
+  gBS->CalculateCrc32 (AtaBusDriverData->ParentDevicePath, DevicePathSize, &Crc);
+  UnicodeSPrint (
+    VariableName,
+    ATA_BUS_DISCOVERY_VARIABLE_LENGTH * sizeof (CHAR16),
+    L"%s%08X",
+    ATA_BUS_DISCOVERY_VARIABLE_PREFIX,
+    Crc
+    );
+
+  Cache  = NULL;
+  Status = GetVariable2 (VariableName, &gEdkiiStorageBusDiscoveryGuid, (VOID **) &Cache, &CacheSize);
+  if (EFI_ERROR (Status)) {
+    return NULL;
+  }
+
+  if ((CacheSize < sizeof (EDKII_STORAGE_BUS_DISCOVERY)) ||
+      (Cache->Signature != EDKII_STORAGE_BUS_DISCOVERY_SIGNATURE) ||
+      (Cache->DeviceSize != sizeof (EDKII_STORAGE_BUS_DISCOVERY_ATA_DEVICE)) ||
+      (Cache->DevicePathSize != DevicePathSize) ||
+      (CacheSize != sizeof (EDKII_STORAGE_BUS_DISCOVERY) + DevicePathSize +
+                    MultU64x32 (Cache->DeviceCount, Cache->DeviceSize)) ||
+      (CompareMem (Cache + 1, AtaBusDriverData->ParentDevicePath, DevicePathSize) != 0)) {
+    FreePool (Cache);
+    return NULL;
+  }
+
+  return Cache;
+}
+
+/**
+  Return the device addresses held by a discovery cache.
+
+  @param  Cache                 The discovery cache.
+
+  @return The first device address of the cache.
+
+**/
+EDKII_STORAGE_BUS_DISCOVERY_ATA_DEVICE *
+AtaBusCachedDevices (
+  IN EDKII_STORAGE_BUS_DISCOVERY    *Cache
+  )
+{
+  return (EDKII_STORAGE_BUS_DISCOVERY_ATA_DEVICE *) ((UINT8 *) (Cache + 1) + Cache->DevicePathSize);
+}
+
+/**
+  Check whether a device address is recorded in a discovery cache.
+
+  @param  Cache                 The discovery cache.
+  @param  Port                  The port number of the ATA device.
+  @param  PortMultiplierPort    The port multiplier port number of the ATA device.
+
+  @retval TRUE                  The device answered the scan that built the cache.
+  @retval FALSE                 The device did not.
+
+**/
+BOOLEAN
+AtaBusDeviceCached (
+  IN EDKII_STORAGE_BUS_DISCOVERY    *Cache,
+  IN UINT16                         Port,
+  IN UINT16                         PortMultiplierPort
+  )
+{
+  EDKII_STORAGE_BUS_DISCOVERY_ATA_DEVICE  *Device;
+  UINT32                                  Index;
+
+  Device = AtaBusCachedDevices (Cache);
+  for (Index = 0; Index < Cache->DeviceCount; Index++) {
+    if ((Device[Index].Port == Port) && (Device[Index].PortMultiplierPort == PortMultiplierPort)) {
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+/**
+  Save the devices found by a bus scan in the discovery cache variable of the
+  ATA controller, unless the variable already holds them.
+
+  @param  AtaBusDriverData      The parent ATA bus driver data structure.
+  @param  VariableName          The name of the variable of the controller.
+  @param  OldCache              The current content of the variable, or NULL.
+  @param  Probes                The devices of the bus scan.
+  @param  ProbeCount            The number of entries in Probes.
+
+**/
+VOID
+AtaBusSetDiscoveryCache (
+  IN ATA_BUS_DRIVER_DATA            *AtaBusDriverData,
+  IN CHAR16                         *VariableName,
+  IN EDKII_STORAGE_BUS_DISCOVERY    *OldCache,   OPTIONAL
+  IN ATA_BUS_PROBE                  *Probes,
+  IN UINTN                          ProbeCount
+  )
+{
+  EDKII_STORAGE_BUS_DISCOVERY             *Cache;
+  EDKII_STORAGE_BUS_DISCOVERY_ATA_DEVICE  *Device;
+  UINTN                                   DevicePathSize;
+  UINTN                                   CacheSize;
+  UINTN                                   DeviceCount;
+  UINTN                                   Index;
+
+  DeviceCount = 0;
+  for (Index = 0; Index < ProbeCount; Index++) {
+    if (Probes[Index].State == AtaBusProbePresent) {
+      DeviceCount++;
+    }
+  }
+
+  DevicePathSize = GetDevicePathSize (AtaBusDriverData->ParentDevicePath);
+  CacheSize      = sizeof (EDKII_STORAGE_BUS_DISCOVERY) + DevicePathSize +
+                   DeviceCount * sizeof (EDKII_STORAGE_BUS_DISCOVERY_ATA_DEVICE);
+  Cache = AllocateZeroPool (CacheSize);
+  if (Cache == NULL) {
+    return;
+  }
+
+  Cache->Signature      = EDKII_STORAGE_BUS_DISCOVERY_SIGNATURE;
+  Cache->DevicePathSize = (UINT32) DevicePathSize;
+  Cache->DeviceSize     = sizeof (EDKII_STORAGE_BUS_DISCOVERY_ATA_DEVICE);
+  Cache->DeviceCount    = (UINT32) DeviceCount;
+  CopyMem (Cache + 1, AtaBusDriverData->ParentDevicePath, DevicePathSize);
+
+  Device = AtaBusCachedDevices (Cache);
+  for (Index = 0; Index < ProbeCount; Index++) {
+    if (Probes[Index].State == AtaBusProbePresent) {
+      Device->Port               = Probes[Index].Port;
+      Device->PortMultiplierPort = Probes[Index].PortMultiplierPort;
+      Device++;
+    }
+  }
+
+  if ((OldCache == NULL) ||
+      (OldCache->DeviceCount != DeviceCount) ||
+      (CompareMem (OldCache, Cache, CacheSize) != 0)) {
+    gRT->SetVariable (
+           VariableName,
+           &gEdkiiStorageBusDiscoveryGuid,
+           EFI_VARIABLE_NON_VOLATILE | EFI_VARIABLE_BOOTSERVICE_ACCESS,
+           CacheSize,
+           Cache
+           );
+  }
+
+  FreePool (Cache);
+}
+
+/**
+  Send the IDENTIFY command of a probe as a non-blocking request. The command
+  block and the packet are the ones of DiscoverAtaDevice().
+
+  @param  AtaPassThru           The ATA pass thru of the controller.
+  @param  Slot                  A free probe slot.
+  @param  Probe                 The probe to send the command for.
+
+  @return The status returned by EFI_ATA_PASS_THRU_PROTOCOL.PassThru().
+
+**/
+EFI_STATUS
+AtaBusSubmitProbe (
+  IN     EFI_ATA_PASS_THRU_PROTOCOL *AtaPassThru,
+  IN OUT ATA_BUS_PROBE_SLOT         *Slot,
+  IN     ATA_BUS_PROBE              *Probe
+  )
+{
+  EFI_ATA_COMMAND_BLOCK             *Acb;
+  EFI_ATA_PASS_THRU_COMMAND_PACKET  *Packet;
+
+  ZeroMem (Slot->Asb, sizeof (EFI_ATA_STATUS_BLOCK));
+  ZeroMem (Slot->IdentifyData, sizeof (ATA_IDENTIFY_DATA));
+
+  Acb = ZeroMem (&Slot->Acb, sizeof (EFI_ATA_COMMAND_BLOCK));
+  Acb->AtaCommand = ATA_CMD_IDENTIFY_DRIVE;
+  Acb->AtaDeviceHead = (UINT8) (BIT7 | BIT6 | BIT5 | (Probe->PortMultiplierPort == 0xFFFF ? 0 : (Probe->PortMultiplierPort << 4)));
+
+  Packet = ZeroMem (&Slot->Packet, sizeof (EFI_ATA_PASS_THRU_COMMAND_PACKET));
+  Packet->Asb = Slot->Asb;
+  Packet->Acb = Acb;
+  Packet->InDataBuffer = Slot->IdentifyData;
+  Packet->InTransferLength = sizeof (ATA_IDENTIFY_DATA);
+  Packet->Protocol = EFI_ATA_PASS_THRU_PROTOCOL_PIO_DATA_IN;
+  Packet->Length   = EFI_ATA_PASS_THRU_LENGTH_BYTES | EFI_ATA_PASS_THRU_LENGTH_SECTOR_COUNT;
+  Packet->Timeout  = ATA_TIMEOUT;
+
+  Slot->Probe = Probe;
+
+  return AtaPassThru->PassThru (
+                        AtaPassThru,
+                        Probe->Port,
+                        Probe->PortMultiplierPort,
+                        Packet,
+                        Slot->Event
+                        );
+}
+
+/**
+  Account for an IDENTIFY command of a probe that failed. The command is sent
+  again as many times as DiscoverAtaDevice() does; a device that keeps failing
+  is left to DiscoverAtaDevice() itself, since the pass thru only reports the
+  ports it detected a device on.
+
+  @param  Probe                 The probe.
+  @param  PendingCount          The number of probes waiting to be sent; updated.
+
+**/
+VOID
+AtaBusRetryProbe (
+  IN OUT ATA_BUS_PROBE              *Probe,
+  IN OUT UINTN                      *PendingCount
+  )
+{
+  Probe->Attempts++;
+  if (Probe->Attempts <= MAX_RETRY_TIMES) {
+    Probe->State = AtaBusProbePending;
+    (*PendingCount)++;
+  } else {
+    Probe->State = AtaBusProbeUnknown;
+  }
+}
+
+/**
+  Send IDENTIFY commands to all the pending probes, with up to
+  ATA_BUS_MAX_PROBES of them outstanding at a time, and collect the identify
+  data.
+
+  If the resources for the non-blocking commands cannot be allocated, the
+  probes are left to DiscoverAtaDevice().
+
+  @param  AtaPassThru           The ATA pass thru of the controller.
+  @param  Probes                The probes of the bus scan.
+  @param  ProbeCount            The number of entries in Probes.
+
+**/
+VOID
+AtaBusProbeDevices (
+  IN     EFI_ATA_PASS_THRU_PROTOCOL *AtaPassThru,
+  IN OUT ATA_BUS_PROBE              *Probes,
+  IN     UINTN                      ProbeCount
+  )
+{
+  EFI_STATUS                        Status;
+  ATA_BUS_PROBE_SLOT                *Slots;
+  ATA_BUS_PROBE_SLOT                *Slot;
+  ATA_BUS_PROBE                     *Probe;
+  UINTN                             SlotCount;
+  UINTN                             SlotIndex;
+  UINTN                             PendingCount;
+  UINTN                             BusyCount;
+  UINTN                             Next;
+  UINT32                            IoAlign;
+
+  SlotCount = MIN (ProbeCount, ATA_BUS_MAX_PROBES);
+  Slots     = AllocateZeroPool (SlotCount * sizeof (ATA_BUS_PROBE_SLOT));
+  if (Slots == NULL) {
+    return;
+  }
+
+  IoAlign = AtaPassThru->Mode->IoAlign;
+  for (SlotIndex = 0; SlotIndex < SlotCount; SlotIndex++) {
+    Slot = &Slots[SlotIndex];
+    Slot->Asb          = AllocateAlignedPages (EFI_SIZE_TO_PAGES (sizeof (EFI_ATA_STATUS_BLOCK)), IoAlign);
+    Slot->IdentifyData = AllocateAlignedPages (EFI_SIZE_TO_PAGES (sizeof (ATA_IDENTIFY_DATA)), IoAlign);
+    Status = gBS->CreateEvent (0, TPL_NOTIFY, NULL, NULL, &Slot->Event);
+    if (EFI_ERROR (Status)) {
+      Slot->Event = NULL;
+    }
+    if ((Slot->Asb == NULL) || (Slot->IdentifyData == NULL) || (Slot->Event == NULL)) {
+      goto Exit;
+    }
+  }
+
+  PendingCount = 0;
+  for (Next = 0; Next < ProbeCount; Next++) {
+    if (Probes[Next].State == AtaBusProbePending) {
+      PendingCount++;
+    }
+  }
+
+  BusyCount = 0;
+  Next      = 0;
+  while ((PendingCount > 0) || (BusyCount > 0)) {
+    //
+    // Fill the free slots.
+    //
+    for (SlotIndex = 0; (SlotIndex < SlotCount) && (PendingCount > 0); SlotIndex++) {
+      Slot = &Slots[SlotIndex];
+      if (Slot->Probe != NULL) {
+        continue;
+      }
+
+      while (Probes[Next].State != AtaBusProbePending) {
+        Next = (Next + 1) % ProbeCount;
+      }
+      Probe = &Probes[Next];
+      Next  = (Next + 1) % ProbeCount;
+
+      Probe->State = AtaBusProbeInFlight;
+      PendingCount--;
+      Status = AtaBusSubmitProbe (AtaPassThru, Slot, Probe);
+      if (!EFI_ERROR (Status)) {
+        BusyCount++;
+        continue;
+      }
+
+      Slot->Probe = NULL;
+      if ((Status == EFI_NOT_READY) && (BusyCount > 0)) {
+        //
+        // The pass thru has too many commands queued; wait for one of them.
+        //
+        Probe->State = AtaBusProbePending;
+        PendingCount++;
+        break;
+      }
+      if ((Status == EFI_BAD_BUFFER_SIZE) ||
+          (Status == EFI_INVALID_PARAMETER) ||
+          (Status == EFI_UNSUPPORTED)) {
+        Probe->State = AtaBusProbeUnknown;
+      } else {
+        AtaBusRetryProbe (Probe, &PendingCount);
+      }
+    }
+
+    if (BusyCount == 0) {
+      continue;
+    }
+
+    //
+    // Collect the completed commands. The pass thru reports a failed
+    // non-blocking command through the error bit of the status block.
+    //
+    gBS->Stall (ATA_BUS_PROBE_POLL_PERIOD);
+    for (SlotIndex = 0; SlotIndex < SlotCount; SlotIndex++) {
+      Slot = &Slots[SlotIndex];
+      if ((Slot->Probe == NULL) || EFI_ERROR (gBS->CheckEvent (Slot->Event))) {
+        continue;
+      }
+
+      Probe = Slot->Probe;
+      if ((Slot->Asb->AtaStatus & 0x01) == 0x01) {
+        AtaBusRetryProbe (Probe, &PendingCount);
+      } else {
+        CopyMem (&Probe->IdentifyData, Slot->IdentifyData, sizeof (ATA_IDENTIFY_DATA));
+        Probe->State = AtaBusProbePresent;
+      }
+      Slot->Probe = NULL;
+      BusyCount--;
+    }
+  }
+
+Exit:
+  for (SlotIndex = 0; SlotIndex < SlotCount; SlotIndex++) {
+    Slot = &Slots[SlotIndex];
+    if (Slot->Event != NULL) {
+      gBS->CloseEvent (Slot->Event);
+    }
+    if (Slot->Asb != NULL) {
+      FreeAlignedPages (Slot->Asb, EFI_SIZE_TO_PAGES (sizeof (EFI_ATA_STATUS_BLOCK)));
+    }
+    if (Slot->IdentifyData != NULL) {
+      FreeAlignedPages (Slot->IdentifyData, EFI_SIZE_TO_PAGES (sizeof (ATA_IDENTIFY_DATA)));
+    }
+  }
+  FreePool (Slots);
+}
+
+/**
+  Scan all the devices on the ATA controller, and register the ones that are
+  found.
+
+  If the pass thru supports non-blocking I/O, the IDENTIFY commands are sent to
+  up to ATA_BUS_MAX_PROBES devices at a time. If PcdStorageBusDiscoveryCache is
+  set, the devices found are remembered, and on a boot assuming no
+  configuration changes only those are probed.
+
+  @param  AtaBusDriverData      The parent ATA bus driver data structure.
+
+**/
+VOID
+AtaBusScanAllDevices (
+  IN OUT ATA_BUS_DRIVER_DATA        *AtaBusDriverData
+  )
+{
+  EFI_STATUS                        Status;
+  EFI_ATA_PASS_THRU_PROTOCOL        *AtaPassThru;
+  EDKII_STORAGE_BUS_DISCOVERY       *Cache;
+  BOOLEAN                           UseCache;
+  CHAR16                            VariableName[ATA_BUS_DISCOVERY_VARIABLE_LENGTH];
+  UINT16                            Port;
+  UINT16                            PortMultiplierPort;
+  ATA_BUS_PROBE                     *Probes;
+  ATA_BUS_PROBE                     *NewProbes;
+  UINTN                             ProbeCount;
+  UINTN                             MaxProbeCount;
+  BOOLEAN                           Complete;
+  UINTN                             Index;
+
+  AtaPassThru = AtaBusDriverData->AtaPassThru;
+
+  Cache    = NULL;
+  UseCache = FALSE;
+  if (FeaturePcdGet (PcdStorageBusDiscoveryCache)) {
+    Cache    = AtaBusGetDiscoveryCache (AtaBusDriverData, VariableName);
+    UseCache = (BOOLEAN) ((Cache != NULL) &&
+                          (GetBootModeHob () == BOOT_ASSUMING_NO_CONFIGURATION_CHANGES));
+  }
+
+  //
+  // Collect the device addresses to probe, growing the array as needed. If it
+  // cannot grow, the devices collected so far are still probed.
+  //
+  Probes        = NULL;
+  ProbeCount    = 0;
+  MaxProbeCount = 0;
+  Complete      = TRUE;
+  Port = 0xFFFF;
+  while (Complete) {
+    Status = AtaPassThru->GetNextPort (AtaPassThru, &Port);
+    if (EFI_ERROR (Status)) {
+      //
+      // We cannot find more legal port then we are done.
+      //
+      break;
+    }
+
+    PortMultiplierPort = 0xFFFF;
+    while (TRUE) {
+      Status = AtaPassThru->GetNextDevice (AtaPassThru, Port, &PortMultiplierPort);
+      if (EFI_ERROR (Status)) {
+        //
+        // We cannot find more legal port multiplier port number for ATA device
+        // on the port, then we are done.
+        //
+        break;
+      }
+      //
+      // Skip the devices that did not answer the last scan.
+      //
+      if (UseCache && !AtaBusDeviceCached (Cache, Port, PortMultiplierPort)) {
+        continue;
+      }
+
+      if (ProbeCount == MaxProbeCount) {
+        NewProbes = ReallocatePool (
+                      MaxProbeCount * sizeof (ATA_BUS_PROBE),
+                      (MaxProbeCount + ATA_BUS_MAX_PROBES) * sizeof (ATA_BUS_PROBE),
+                      Probes
+                      );
+        if (NewProbes == NULL) {
+          Complete = FALSE;
+          break;
+        }
+        Probes         = NewProbes;
+        MaxProbeCount += ATA_BUS_MAX_PROBES;
+      }
+      ZeroMem (&Probes[ProbeCount], sizeof (ATA_BUS_PROBE));
+      Probes[ProbeCount].Port               = Port;
+      Probes[ProbeCount].PortMultiplierPort = PortMultiplierPort;
+      Probes[ProbeCount].State              = AtaBusProbeUnknown;
+      ProbeCount++;
+    }
+  }
+
+  if ((ProbeCount > 1) &&
+      ((AtaPassThru->Mode->Attributes & EFI_ATA_PASS_THRU_ATTRIBUTES_NONBLOCKIO) != 0)) {
+    for (Index = 0; Index < ProbeCount; Index++) {
+      Probes[Index].State = AtaBusProbePending;
+    }
+    AtaBusProbeDevices (AtaPassThru, Probes, ProbeCount);
+  }
+
+  for (Index = 0; Index < ProbeCount; Index++) {
+    Status = RegisterAtaDevice (
+               AtaBusDriverData,
+               Probes[Index].Port,
+               Probes[Index].PortMultiplierPort,
+               Probes[Index].State == AtaBusProbePresent ? &Probes[Index].IdentifyData : NULL
+               );
+    Probes[Index].State = (!EFI_ERROR (Status) || (Status == EFI_ALREADY_STARTED)) ?
+                          AtaBusProbePresent :
+                          AtaBusProbeAbsent;
+  }
+
+  //
+  // A partial scan would drop the devices it did not reach from the cache.
+  //
+  if (FeaturePcdGet (PcdStorageBusDiscoveryCache) && Complete) {
+    AtaBusSetDiscoveryCache (AtaBusDriverData, VariableName, Cache, Probes, ProbeCount);
+  }
+
+  if (Probes != NULL) {
+    FreePool (Probes);
+  }
+  if (Cache != NULL) {
+    FreePool (Cache);
+  }
+}
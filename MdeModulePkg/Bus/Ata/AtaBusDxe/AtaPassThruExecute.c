@@ -393,6 +393,8 @@ IdentifyAtaDevice (
   the Media information in Block IO protocol interface.
 
   @param  AtaDevice         The ATA child device involved for the operation.
+  @param  IdentifyData      The identify data the bus scan already read from
+                            the device, or NULL to issue the command.
 
   @retval EFI_SUCCESS       The device is successfully identified and Media information
                             is correctly initialized.
@@ -401,7 +403,8 @@ IdentifyAtaDevice (
 **/
 EFI_STATUS
 DiscoverAtaDevice (
-  IN OUT ATA_DEVICE                 *AtaDevice
+  IN OUT ATA_DEVICE                 *AtaDevice,
+  IN     ATA_IDENTIFY_DATA          *IdentifyData  OPTIONAL
   )
 {
   EFI_STATUS                        Status;
@@ -409,6 +412,11 @@ DiscoverAtaDevice (
   EFI_ATA_PASS_THRU_COMMAND_PACKET  *Packet;
   UINTN                             Retry;
 
+  if (IdentifyData != NULL) {
+    CopyMem (AtaDevice->IdentifyData, IdentifyData, sizeof (ATA_IDENTIFY_DATA));
+    return IdentifyAtaDevice (AtaDevice);
+  }
+
   //
   // Prepare for ATA command block.
   //
@@ -45,6 +45,7 @@
 #include <Library/MemoryAllocationLib.h>
 #include <Library/UefiBootServicesTableLib.h>
 #include <Library/UefiDriverEntryPoint.h>
+#include <Library/TimerLib.h>
 
 typedef struct _NVME_CONTROLLER_PRIVATE_DATA NVME_CONTROLLER_PRIVATE_DATA;
 typedef struct _NVME_DEVICE_PRIVATE_DATA     NVME_DEVICE_PRIVATE_DATA;
@@ -64,8 +65,16 @@ extern EFI_DRIVER_SUPPORTED_EFI_VERSION_PROTOCOL  gNvmExpressDriverSupportedEfiV
 #define NVME_ASQ_SIZE                             1     // Number of admin submission queue entries, which is 0-based
 #define NVME_ACQ_SIZE                             1     // Number of admin completion queue entries, which is 0-based
 
-#define NVME_CSQ_SIZE                             1     // Number of I/O submission queue entries, which is 0-based
-#define NVME_CCQ_SIZE                             1     // Number of I/O completion queue entries, which is 0-based
+//
+// Number of synchronous I/O submission queue entries, which is 0-based.
+// The synchronous I/O submission queue size is 4kB in total.
+//
+#define NVME_CSQ_SIZE                             63
+//
+// Number of synchronous I/O completion queue entries, which is 0-based.
+// No more commands than the submission queue holds are in flight.
+//
+#define NVME_CCQ_SIZE                             63
 
 //
 // Number of asynchronous I/O submission queue entries, which is 0-based.
@@ -80,6 +89,13 @@ extern EFI_DRIVER_SUPPORTED_EFI_VERSION_PROTOCOL  gNvmExpressDriverSupportedEfiV
 
 #define NVME_MAX_QUEUES                           3     // Number of queues supported by the driver
 
+//
+// One PRP list page for each command in flight on the synchronous I/O queue.
+// The controller buffer holds the 6 queue pages followed by the PRP list pool.
+//
+#define NVME_PRP_LIST_POOL_PAGES                  NVME_CSQ_SIZE
+#define NVME_CONTROLLER_BUFFER_PAGES              (6 + NVME_PRP_LIST_POOL_PAGES)
+
 #define NVME_CONTROLLER_ID                        0
 
 //
@@ -128,6 +144,7 @@ struct _NVME_CONTROLLER_PRIVATE_DATA {
   // 4th 4kB boundary is the start of I/O completion queue #1.
   // 5th 4kB boundary is the start of I/O submission queue #2.
   // 6th 4kB boundary is the start of I/O completion queue #2.
+  // The PRP list pool of I/O queue #1 follows.
   //
   UINT8                               *Buffer;
   UINT8                               *BufferPciAddr;
@@ -150,6 +167,14 @@ struct _NVME_CONTROLLER_PRIVATE_DATA {
   UINT8                               Pt[NVME_MAX_QUEUES];
   UINT16                              Cid[NVME_MAX_QUEUES];
 
+  //
+  // Number of synchronous I/O queue entries, which is 0-based, and the PRP
+  // list pages of the commands in flight on that queue.
+  //
+  UINT16                              SyncQueueSize;
+  UINT64                              *PrpListPool;
+  UINT8                               *PrpListPoolPciAddr;
+
   //
   // Nvme controller capabilities
   //
@@ -722,6 +747,22 @@ NvmeDumpStatus (
   IN NVME_CQ             *Cq
   );
 
+/**
+  Reset the Nvm Express controller after a command timed out, which aborts all
+  the outstanding commands.
+
+  @param[in] Private        The pointer to the NVME_CONTROLLER_PRIVATE_DATA
+                            data structure.
+
+  @retval EFI_TIMEOUT       The controller has been reset.
+  @return Others            The controller could not be reset.
+
+**/
+EFI_STATUS
+NvmeResetTimedOutController (
+  IN NVME_CONTROLLER_PRIVATE_DATA    *Private
+  );
+
 /**
   Register the shutdown notification through the ResetNotification protocol.
 
@@ -16,133 +16,320 @@
 #include "NvmExpress.h"
 
 /**
-  Read some sectors from the device.
+  Transfer blocks between a mapped buffer and the device, keeping as many
+  commands in flight on the synchronous I/O queue as it holds.
+
+  The transfer is split in commands of at most the maximum data transfer size.
+  The submission queue doorbell is rung once for all the commands that fit in
+  the queue, and the completion queue doorbell once for all the completions
+  posted so far. The PRP list of a command is built in the PRP list pool page
+  of its command identifier, so no memory is allocated or mapped per command.
 
   @param  Device                 The pointer to the NVME_DEVICE_PRIVATE_DATA data structure.
-  @param  Buffer                 The buffer used to store the data read from the device.
+  @param  Read                   TRUE to read from the device, FALSE to write to it.
+  @param  PhyAddr                The device address of the mapped buffer.
   @param  Lba                    The start block number.
-  @param  Blocks                 Total block number to be read.
+  @param  Blocks                 Total block number to transfer.
 
-  @retval EFI_SUCCESS            Datum are read from the device.
-  @retval Others                 Fail to read all the datum.
+  @retval EFI_SUCCESS            All the blocks have been transferred.
+  @retval EFI_DEVICE_ERROR       A command failed.
+  @retval EFI_TIMEOUT            A command timed out and the controller has been reset.
+  @retval Others                 The controller could not be accessed.
 
 **/
 EFI_STATUS
-ReadSectors (
+NvmeQueuedTransfer (
   IN NVME_DEVICE_PRIVATE_DATA           *Device,
-  IN UINT64                             Buffer,
+  IN BOOLEAN                            Read,
+  IN EFI_PHYSICAL_ADDRESS               PhyAddr,
   IN UINT64                             Lba,
-  IN UINT32                             Blocks
+  IN UINTN                              Blocks
   )
 {
-  NVME_CONTROLLER_PRIVATE_DATA             *Private;
-  UINT32                                   Bytes;
-  EFI_NVM_EXPRESS_PASS_THRU_COMMAND_PACKET CommandPacket;
-  EFI_NVM_EXPRESS_COMMAND                  Command;
-  EFI_NVM_EXPRESS_COMPLETION               Completion;
-  EFI_STATUS                               Status;
-  UINT32                                   BlockSize;
+  NVME_CONTROLLER_PRIVATE_DATA          *Private;
+  EFI_PCI_IO_PROTOCOL                   *PciIo;
+  NVME_SQ                               *Sq;
+  NVME_CQ                               *Cq;
+  UINT64                                *PrpList;
+  EFI_PHYSICAL_ADDRESS                  PrpAddr;
+  EFI_EVENT                             TimerEvent;
+  EFI_STATUS                            Status;
+  EFI_STATUS                            IoStatus;
+  UINT32                                BlockSize;
+  UINT32                                MaxTransferBlocks;
+  UINT32                                TransferBlocks;
+  UINTN                                 Bytes;
+  UINTN                                 Index;
+  UINTN                                 Outstanding;
+  UINT64                                FreeCids;
+  UINT16                                Cid;
+  UINT32                                Data;
+
+  Private   = Device->Controller;
+  PciIo     = Private->PciIo;
+  BlockSize = Device->Media.BlockSize;
 
-  Private    = Device->Controller;
-  BlockSize  = Device->Media.BlockSize;
-  Bytes      = Blocks * BlockSize;
+  if (Private->ControllerData->Mdts != 0) {
+    MaxTransferBlocks = (1 << (Private->ControllerData->Mdts)) * (1 << (Private->Cap.Mpsmin + 12)) / BlockSize;
+  } else {
+    MaxTransferBlocks = 1024;
+  }
+  //
+  // A command takes a single PRP list page, and at most 64K blocks.
+  //
+  MaxTransferBlocks = MIN (MaxTransferBlocks, (EFI_PAGE_SIZE / sizeof (UINT64)) * EFI_PAGE_SIZE / BlockSize);
+  MaxTransferBlocks = MIN (MaxTransferBlocks, 0x10000);
 
-  ZeroMem (&CommandPacket, sizeof(EFI_NVM_EXPRESS_PASS_THRU_COMMAND_PACKET));
-  ZeroMem (&Command, sizeof(EFI_NVM_EXPRESS_COMMAND));
-  ZeroMem (&Completion, sizeof(EFI_NVM_EXPRESS_COMPLETION));
+  Status = gBS->CreateEvent (EVT_TIMER, TPL_CALLBACK, NULL, NULL, &TimerEvent);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
 
-  CommandPacket.NvmeCmd        = &Command;
-  CommandPacket.NvmeCompletion = &Completion;
+  IoStatus    = EFI_SUCCESS;
+  Outstanding = 0;
+  FreeCids    = LShiftU64 (1, Private->SyncQueueSize) - 1;
 
-  CommandPacket.NvmeCmd->Cdw0.Opcode = NVME_IO_READ_OPC;
-  CommandPacket.NvmeCmd->Nsid        = Device->NamespaceId;
-  CommandPacket.TransferBuffer       = (VOID *)(UINTN)Buffer;
+  while (((Blocks > 0) && !EFI_ERROR (IoStatus)) || (Outstanding > 0)) {
+    //
+    // Fill the submission queue, then ring its doorbell once.
+    //
+    if ((Blocks > 0) && !EFI_ERROR (IoStatus) && (Outstanding < Private->SyncQueueSize)) {
+      while ((Blocks > 0) && (Outstanding < Private->SyncQueueSize)) {
+        Cid       = (UINT16) LowBitSet64 (FreeCids);
+        FreeCids &= ~LShiftU64 (1, Cid);
 
-  CommandPacket.TransferLength = Bytes;
-  CommandPacket.CommandTimeout = NVME_GENERIC_TIMEOUT;
-  CommandPacket.QueueType      = NVME_IO_QUEUE;
+        TransferBlocks = (UINT32) MIN (Blocks, MaxTransferBlocks);
+        Bytes          = TransferBlocks * BlockSize;
 
-  CommandPacket.NvmeCmd->Cdw10 = (UINT32)Lba;
-  CommandPacket.NvmeCmd->Cdw11 = (UINT32)RShiftU64(Lba, 32);
-  CommandPacket.NvmeCmd->Cdw12 = (Blocks - 1) & 0xFFFF;
+        Sq = Private->SqBuffer[1] + Private->SqTdbl[1].Sqt;
+        ZeroMem (Sq, sizeof (NVME_SQ));
+        Sq->Opc    = Read ? NVME_IO_READ_OPC : NVME_IO_WRITE_OPC;
+        Sq->Cid    = Cid;
+        Sq->Nsid   = Device->NamespaceId;
+        Sq->Prp[0] = PhyAddr;
 
-  CommandPacket.NvmeCmd->Flags = CDW10_VALID | CDW11_VALID | CDW12_VALID;
+        //
+        // If the buffer spans more than two memory pages, list the pages after
+        // the first one in the PRP list page of the command.
+        //
+        if (((PhyAddr & (EFI_PAGE_SIZE - 1)) + Bytes) > (EFI_PAGE_SIZE * 2)) {
+          PrpList = Private->PrpListPool + Cid * (EFI_PAGE_SIZE / sizeof (UINT64));
+          PrpAddr = (PhyAddr + EFI_PAGE_SIZE) & ~((EFI_PHYSICAL_ADDRESS) EFI_PAGE_SIZE - 1);
+          for (Index = 0; PrpAddr < PhyAddr + Bytes; Index++) {
+            PrpList[Index] = PrpAddr;
+            PrpAddr       += EFI_PAGE_SIZE;
+          }
+          Sq->Prp[1] = (UINT64)(UINTN)(Private->PrpListPoolPciAddr + Cid * EFI_PAGE_SIZE);
+        } else if (((PhyAddr & (EFI_PAGE_SIZE - 1)) + Bytes) > EFI_PAGE_SIZE) {
+          Sq->Prp[1] = (PhyAddr + EFI_PAGE_SIZE) & ~((EFI_PHYSICAL_ADDRESS) EFI_PAGE_SIZE - 1);
+        }
+
+        Sq->Payload.Raw.Cdw10 = (UINT32)Lba;
+        Sq->Payload.Raw.Cdw11 = (UINT32)RShiftU64 (Lba, 32);
+        Sq->Payload.Raw.Cdw12 = (TransferBlocks - 1) & 0xFFFF;
+        if (!Read) {
+          //
+          // Set Force Unit Access bit (bit 30) to use write-through behaviour
+          //
+          Sq->Payload.Raw.Cdw12 |= BIT30;
+        }
+
+        Private->SqTdbl[1].Sqt = (Private->SqTdbl[1].Sqt + 1) % (Private->SyncQueueSize + 1);
+        Outstanding++;
+
+        PhyAddr += Bytes;
+        Lba     += TransferBlocks;
+        Blocks  -= TransferBlocks;
+      }
 
-  Status = Private->Passthru.PassThru (
-                               &Private->Passthru,
-                               Device->NamespaceId,
-                               &CommandPacket,
-                               NULL
-                               );
+      Data = ReadUnaligned32 ((UINT32*)&Private->SqTdbl[1]);
+      Status = PciIo->Mem.Write (
+                   PciIo,
+                   EfiPciIoWidthUint32,
+                   NVME_BAR,
+                   NVME_SQTDBL_OFFSET(1, Private->Cap.Dstrd),
+                   1,
+                   &Data
+                   );
+      if (EFI_ERROR (Status)) {
+        NvmeResetTimedOutController (Private);
+        goto Exit;
+      }
+    }
+
+    //
+    // Wait for a completion, then reap all the posted ones.
+    //
+    Status = gBS->SetTimer (TimerEvent, TimerRelative, NVME_GENERIC_TIMEOUT);
+    if (EFI_ERROR (Status)) {
+      goto Exit;
+    }
+
+    Cq = Private->CqBuffer[1] + Private->CqHdbl[1].Cqh;
+    while (Cq->Pt == Private->Pt[1]) {
+      if (!EFI_ERROR (gBS->CheckEvent (TimerEvent))) {
+        DEBUG ((DEBUG_ERROR, "%a: Timeout occurs for an NVMe command.\n", __FUNCTION__));
+        Status = NvmeResetTimedOutController (Private);
+        goto Exit;
+      }
+    }
+
+    do {
+      if ((Cq->Sct != 0) || (Cq->Sc != 0)) {
+        IoStatus = EFI_DEVICE_ERROR;
+
+        //
+        // Dump completion entry status for debugging.
+        //
+        DEBUG_CODE_BEGIN();
+          NvmeDumpStatus (Cq);
+        DEBUG_CODE_END();
+      }
+      FreeCids |= LShiftU64 (1, Cq->Cid);
+      Outstanding--;
 
+      Private->CqHdbl[1].Cqh = (Private->CqHdbl[1].Cqh + 1) % (Private->SyncQueueSize + 1);
+      if (Private->CqHdbl[1].Cqh == 0) {
+        Private->Pt[1] ^= 1;
+      }
+      Cq = Private->CqBuffer[1] + Private->CqHdbl[1].Cqh;
+    } while ((Cq->Pt != Private->Pt[1]) && (Outstanding > 0));
+
+    Data = ReadUnaligned32 ((UINT32*)&Private->CqHdbl[1]);
+    Status = PciIo->Mem.Write (
+                 PciIo,
+                 EfiPciIoWidthUint32,
+                 NVME_BAR,
+                 NVME_CQHDBL_OFFSET(1, Private->Cap.Dstrd),
+                 1,
+                 &Data
+                 );
+    if (EFI_ERROR (Status)) {
+      goto Exit;
+    }
+  }
+
+  Status = IoStatus;
+
+Exit:
+  gBS->CloseEvent (TimerEvent);
   return Status;
 }
 
 /**
-  Write some sectors to the device.
+  Get the time elapsed since a performance counter value.
 
-  @param  Device                 The pointer to the NVME_DEVICE_PRIVATE_DATA data structure.
-  @param  Buffer                 The buffer to be written into the device.
-  @param  Lba                    The start block number.
-  @param  Blocks                 Total block number to be written.
+  @param  StartTick              The performance counter value at the start.
 
-  @retval EFI_SUCCESS            Datum are written into the buffer.
-  @retval Others                 Fail to write all the datum.
+  @return The elapsed time in microseconds.
 
 **/
-EFI_STATUS
-WriteSectors (
-  IN NVME_DEVICE_PRIVATE_DATA      *Device,
-  IN UINT64                        Buffer,
-  IN UINT64                        Lba,
-  IN UINT32                        Blocks
+UINT64
+NvmeElapsedMicroSeconds (
+  IN UINT64                             StartTick
   )
 {
-  NVME_CONTROLLER_PRIVATE_DATA             *Private;
-  EFI_NVM_EXPRESS_PASS_THRU_COMMAND_PACKET CommandPacket;
-  EFI_NVM_EXPRESS_COMMAND                  Command;
-  EFI_NVM_EXPRESS_COMPLETION               Completion;
-  EFI_STATUS                               Status;
-  UINT32                                   Bytes;
-  UINT32                                   BlockSize;
+  UINT64                                Ticks;
+  UINT64                                StartValue;
+  UINT64                                EndValue;
+
+  Ticks = GetPerformanceCounter ();
+  GetPerformanceCounterProperties (&StartValue, &EndValue);
+  if (EndValue >= StartValue) {
+    Ticks = Ticks - StartTick;
+  } else {
+    Ticks = StartTick - Ticks;
+  }
 
-  Private    = Device->Controller;
-  BlockSize  = Device->Media.BlockSize;
-  Bytes      = Blocks * BlockSize;
+  return DivU64x32 (GetTimeInNanoSecond (Ticks), 1000);
+}
 
-  ZeroMem (&CommandPacket, sizeof(EFI_NVM_EXPRESS_PASS_THRU_COMMAND_PACKET));
-  ZeroMem (&Command, sizeof(EFI_NVM_EXPRESS_COMMAND));
-  ZeroMem (&Completion, sizeof(EFI_NVM_EXPRESS_COMPLETION));
+/**
+  Transfer blocks between a buffer and the device on the synchronous I/O queue,
+  and report the throughput of the transfer.
 
-  CommandPacket.NvmeCmd        = &Command;
-  CommandPacket.NvmeCompletion = &Completion;
+  @param  Device                 The pointer to the NVME_DEVICE_PRIVATE_DATA data structure.
+  @param  Read                   TRUE to read from the device, FALSE to write to it.
+  @param  Buffer                 The buffer of the transfer.
+  @param  Lba                    The start block number.
+  @param  Blocks                 Total block number to transfer.
 
-  CommandPacket.NvmeCmd->Cdw0.Opcode = NVME_IO_WRITE_OPC;
-  CommandPacket.NvmeCmd->Nsid  = Device->NamespaceId;
-  CommandPacket.TransferBuffer = (VOID *)(UINTN)Buffer;
+  @retval EFI_SUCCESS            All the blocks have been transferred.
+  @retval EFI_OUT_OF_RESOURCES   The buffer could not be mapped.
+  @retval Others                 Fail to transfer all the blocks.
 
-  CommandPacket.TransferLength = Bytes;
-  CommandPacket.CommandTimeout = NVME_GENERIC_TIMEOUT;
-  CommandPacket.QueueType      = NVME_IO_QUEUE;
+**/
+EFI_STATUS
+NvmeTransfer (
+  IN     NVME_DEVICE_PRIVATE_DATA       *Device,
+  IN     BOOLEAN                        Read,
+  IN OUT VOID                           *Buffer,
+  IN     UINT64                         Lba,
+  IN     UINTN                          Blocks
+  )
+{
+  EFI_PCI_IO_PROTOCOL                   *PciIo;
+  EFI_PHYSICAL_ADDRESS                  PhyAddr;
+  VOID                                  *Mapping;
+  UINTN                                 MapLength;
+  UINTN                                 MappedBlocks;
+  UINT32                                BlockSize;
+  UINT64                                OriginalLba;
+  UINTN                                 OriginalBlocks;
+  UINT64                                StartTick;
+  UINT64                                MicroSeconds;
+  EFI_STATUS                            Status;
+
+  PciIo          = Device->Controller->PciIo;
+  BlockSize      = Device->Media.BlockSize;
+  OriginalLba    = Lba;
+  OriginalBlocks = Blocks;
+  StartTick      = GetPerformanceCounter ();
+  Status         = EFI_SUCCESS;
 
-  CommandPacket.NvmeCmd->Cdw10 = (UINT32)Lba;
-  CommandPacket.NvmeCmd->Cdw11 = (UINT32)RShiftU64(Lba, 32);
   //
-  // Set Force Unit Access bit (bit 30) to use write-through behaviour
+  // Map the buffer once for all the commands, in several pieces if the
+  // mapping cannot cover it in one go.
   //
-  CommandPacket.NvmeCmd->Cdw12 = ((Blocks - 1) & 0xFFFF) | BIT30;
+  while (Blocks > 0) {
+    MapLength = Blocks * BlockSize;
+    Status = PciIo->Map (
+                      PciIo,
+                      Read ? EfiPciIoOperationBusMasterWrite : EfiPciIoOperationBusMasterRead,
+                      Buffer,
+                      &MapLength,
+                      &PhyAddr,
+                      &Mapping
+                      );
+    if (EFI_ERROR (Status)) {
+      Status = EFI_OUT_OF_RESOURCES;
+      break;
+    }
 
-  CommandPacket.MetadataBuffer = NULL;
-  CommandPacket.MetadataLength = 0;
+    MappedBlocks = MapLength / BlockSize;
+    if (MappedBlocks == 0) {
+      PciIo->Unmap (PciIo, Mapping);
+      Status = EFI_OUT_OF_RESOURCES;
+      break;
+    }
 
-  CommandPacket.NvmeCmd->Flags = CDW10_VALID | CDW11_VALID | CDW12_VALID;
+    Status = NvmeQueuedTransfer (Device, Read, PhyAddr, Lba, MappedBlocks);
+    PciIo->Unmap (PciIo, Mapping);
+    if (EFI_ERROR (Status)) {
+      break;
+    }
 
-  Status = Private->Passthru.PassThru (
-                               &Private->Passthru,
-                               Device->NamespaceId,
-                               &CommandPacket,
-                               NULL
-                               );
+    Buffer  = (UINT8 *) Buffer + MappedBlocks * BlockSize;
+    Lba    += MappedBlocks;
+    Blocks -= MappedBlocks;
+  }
+
+  MicroSeconds = NvmeElapsedMicroSeconds (StartTick);
+  DEBUG ((EFI_D_VERBOSE, "%a: %a Lba = 0x%08Lx, Original = 0x%08Lx, "
+    "Remaining = 0x%08Lx, BlockSize = 0x%x, Time = %Ld us, Throughput = %Ld KB/s, Status = %r\n",
+    __FUNCTION__, Read ? "Read" : "Write", OriginalLba, (UINT64)OriginalBlocks, (UINT64)Blocks, BlockSize,
+    MicroSeconds, DivU64x64Remainder (MultU64x32 (MultU64x32 ((UINT64)(OriginalBlocks - Blocks), BlockSize), 15625), MultU64x32 (MicroSeconds + 1, 16), NULL),
+    Status));
 
   return Status;
 }
@@ -167,11 +354,6 @@ NvmeRead (
   IN     UINTN                          Blocks
   )
 {
-  EFI_STATUS                       Status;
-  UINT32                           BlockSize;
-  NVME_CONTROLLER_PRIVATE_DATA     *Private;
-  UINT32                           MaxTransferBlocks;
-  UINTN                            OrginalBlocks;
   BOOLEAN                          IsEmpty;
   EFI_TPL                          OldTpl;
 
@@ -190,39 +372,7 @@ NvmeRead (
     gBS->Stall (100);
   }
 
-  Status        = EFI_SUCCESS;
-  Private       = Device->Controller;
-  BlockSize     = Device->Media.BlockSize;
-  OrginalBlocks = Blocks;
-
-  if (Private->ControllerData->Mdts != 0) {
-    MaxTransferBlocks = (1 << (Private->ControllerData->Mdts)) * (1 << (Private->Cap.Mpsmin + 12)) / BlockSize;
-  } else {
-    MaxTransferBlocks = 1024;
-  }
-
-  while (Blocks > 0) {
-    if (Blocks > MaxTransferBlocks) {
-      Status = ReadSectors (Device, (UINT64)(UINTN)Buffer, Lba, MaxTransferBlocks);
-
-      Blocks -= MaxTransferBlocks;
-      Buffer  = (VOID *)(UINTN)((UINT64)(UINTN)Buffer + MaxTransferBlocks * BlockSize);
-      Lba    += MaxTransferBlocks;
-    } else {
-      Status = ReadSectors (Device, (UINT64)(UINTN)Buffer, Lba, (UINT32)Blocks);
-      Blocks = 0;
-    }
-
-    if (EFI_ERROR(Status)) {
-      break;
-    }
-  }
-
-  DEBUG ((EFI_D_VERBOSE, "%a: Lba = 0x%08Lx, Original = 0x%08Lx, "
-    "Remaining = 0x%08Lx, BlockSize = 0x%x, Status = %r\n", __FUNCTION__, Lba,
-    (UINT64)OrginalBlocks, (UINT64)Blocks, BlockSize, Status));
-
-  return Status;
+  return NvmeTransfer (Device, TRUE, Buffer, Lba, Blocks);
 }
 
 /**
@@ -245,11 +395,6 @@ NvmeWrite (
   IN UINTN                              Blocks
   )
 {
-  EFI_STATUS                       Status;
-  UINT32                           BlockSize;
-  NVME_CONTROLLER_PRIVATE_DATA     *Private;
-  UINT32                           MaxTransferBlocks;
-  UINTN                            OrginalBlocks;
   BOOLEAN                          IsEmpty;
   EFI_TPL                          OldTpl;
 
@@ -268,39 +413,7 @@ NvmeWrite (
     gBS->Stall (100);
   }
 
-  Status        = EFI_SUCCESS;
-  Private       = Device->Controller;
-  BlockSize     = Device->Media.BlockSize;
-  OrginalBlocks = Blocks;
-
-  if (Private->ControllerData->Mdts != 0) {
-    MaxTransferBlocks = (1 << (Private->ControllerData->Mdts)) * (1 << (Private->Cap.Mpsmin + 12)) / BlockSize;
-  } else {
-    MaxTransferBlocks = 1024;
-  }
-
-  while (Blocks > 0) {
-    if (Blocks > MaxTransferBlocks) {
-      Status = WriteSectors (Device, (UINT64)(UINTN)Buffer, Lba, MaxTransferBlocks);
-
-      Blocks -= MaxTransferBlocks;
-      Buffer  = (VOID *)(UINTN)((UINT64)(UINTN)Buffer + MaxTransferBlocks * BlockSize);
-      Lba    += MaxTransferBlocks;
-    } else {
-      Status = WriteSectors (Device, (UINT64)(UINTN)Buffer, Lba, (UINT32)Blocks);
-      Blocks = 0;
-    }
-
-    if (EFI_ERROR(Status)) {
-      break;
-    }
-  }
-
-  DEBUG ((EFI_D_VERBOSE, "%a: Lba = 0x%08Lx, Original = 0x%08Lx, "
-    "Remaining = 0x%08Lx, BlockSize = 0x%x, Status = %r\n", __FUNCTION__, Lba,
-    (UINT64)OrginalBlocks, (UINT64)Blocks, BlockSize, Status));
-
-  return Status;
+  return NvmeTransfer (Device, FALSE, Buffer, Lba, Blocks);
 }
 
 /**
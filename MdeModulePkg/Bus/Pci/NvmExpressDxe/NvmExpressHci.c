@@ -711,7 +711,7 @@ NvmeCreateIoCompletionQueue (
     CommandPacket.QueueType      = NVME_ADMIN_QUEUE;
 
     if (Index == 1) {
-      QueueSize = NVME_CCQ_SIZE;
+      QueueSize = Private->SyncQueueSize;
     } else {
       if (Private->Cap.Mqes > NVME_ASYNC_CCQ_SIZE) {
         QueueSize = NVME_ASYNC_CCQ_SIZE;
@@ -780,7 +780,7 @@ NvmeCreateIoSubmissionQueue (
     CommandPacket.QueueType      = NVME_ADMIN_QUEUE;
 
     if (Index == 1) {
-      QueueSize = NVME_CSQ_SIZE;
+      QueueSize = Private->SyncQueueSize;
     } else {
       if (Private->Cap.Mqes > NVME_ASYNC_CSQ_SIZE) {
         QueueSize = NVME_ASYNC_CSQ_SIZE;
@@ -915,6 +915,11 @@ NvmeControllerInit (
   Private->CqHdbl[2].Cqh = 0;
   Private->AsyncSqHead   = 0;
 
+  //
+  // The synchronous I/O queue pair is as deep as the controller allows, up to a page.
+  //
+  Private->SyncQueueSize = (UINT16) MIN (NVME_CSQ_SIZE, Private->Cap.Mqes);
+
   Status = NvmeDisableController (Private);
 
   if (EFI_ERROR(Status)) {
@@ -955,6 +960,8 @@ NvmeControllerInit (
   Private->SqBufferPciAddr[2] = (NVME_SQ *)(UINTN)(Private->BufferPciAddr + 4 * EFI_PAGE_SIZE);
   Private->CqBuffer[2]        = (NVME_CQ *)(UINTN)(Private->Buffer + 5 * EFI_PAGE_SIZE);
   Private->CqBufferPciAddr[2] = (NVME_CQ *)(UINTN)(Private->BufferPciAddr + 5 * EFI_PAGE_SIZE);
+  Private->PrpListPool        = (UINT64 *)(UINTN)(Private->Buffer + 6 * EFI_PAGE_SIZE);
+  Private->PrpListPoolPciAddr = Private->BufferPciAddr + 6 * EFI_PAGE_SIZE;
 
   DEBUG ((EFI_D_INFO, "Private->Buffer = [%016X]\n", (UINT64)(UINTN)Private->Buffer));
   DEBUG ((EFI_D_INFO, "Admin     Submission Queue size (Aqa.Asqs) = [%08X]\n", Aqa.Asqs));
@@ -963,6 +970,7 @@ NvmeControllerInit (
   DEBUG ((EFI_D_INFO, "Admin     Completion Queue (CqBuffer[0]) = [%016X]\n", Private->CqBuffer[0]));
   DEBUG ((EFI_D_INFO, "Sync  I/O Submission Queue (SqBuffer[1]) = [%016X]\n", Private->SqBuffer[1]));
   DEBUG ((EFI_D_INFO, "Sync  I/O Completion Queue (CqBuffer[1]) = [%016X]\n", Private->CqBuffer[1]));
+  DEBUG ((EFI_D_INFO, "Sync  I/O Queue size (SyncQueueSize) = [%08X]\n", Private->SyncQueueSize));
   DEBUG ((EFI_D_INFO, "Async I/O Submission Queue (SqBuffer[2]) = [%016X]\n", Private->SqBuffer[2]));
   DEBUG ((EFI_D_INFO, "Async I/O Completion Queue (CqBuffer[2]) = [%016X]\n", Private->CqBuffer[2]));
 
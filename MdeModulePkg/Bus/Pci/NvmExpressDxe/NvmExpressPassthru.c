@@ -410,6 +410,59 @@ AbortAsyncPassThruTasks (
 }
 
 
+/**
+  Reset the Nvm Express controller after a command timed out, which aborts all
+  the outstanding commands.
+
+  @param[in] Private        The pointer to the NVME_CONTROLLER_PRIVATE_DATA
+                            data structure.
+
+  @retval EFI_TIMEOUT       The controller has been reset.
+  @return Others            The controller could not be reset.
+
+**/
+EFI_STATUS
+NvmeResetTimedOutController (
+  IN NVME_CONTROLLER_PRIVATE_DATA    *Private
+  )
+{
+  EFI_STATUS                         Status;
+
+  //
+  // Disable the timer to trigger the process of async transfers temporarily.
+  //
+  Status = gBS->SetTimer (Private->TimerEvent, TimerCancel, 0);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  //
+  // Reset the NVMe controller.
+  //
+  Status = NvmeControllerInit (Private);
+  if (EFI_ERROR (Status)) {
+    return EFI_DEVICE_ERROR;
+  }
+
+  Status = AbortAsyncPassThruTasks (Private);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  //
+  // Re-enable the timer to trigger the process of async transfers.
+  //
+  Status = gBS->SetTimer (Private->TimerEvent, TimerPeriodic, NVME_HC_ASYNC_TIMER);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  //
+  // Return EFI_TIMEOUT to indicate a timeout occurs for NVMe command.
+  //
+  return EFI_TIMEOUT;
+}
+
 /**
   Sends an NVM Express Command Packet to an NVM Express controller or namespace. This function supports
   both blocking I/O and non-blocking I/O. The blocking I/O functionality is required, and the non-blocking
@@ -693,6 +746,9 @@ NvmExpressPassThru (
   if ((Event != NULL) && (QueueId != 0)) {
     Private->SqTdbl[QueueId].Sqt =
       (Private->SqTdbl[QueueId].Sqt + 1) % (NVME_ASYNC_CSQ_SIZE + 1);
+  } else if (QueueId != 0) {
+    Private->SqTdbl[QueueId].Sqt =
+      (Private->SqTdbl[QueueId].Sqt + 1) % (Private->SyncQueueSize + 1);
   } else {
     Private->SqTdbl[QueueId].Sqt ^= 1;
   }
@@ -793,40 +849,17 @@ NvmExpressPassThru (
     //
     DEBUG ((DEBUG_ERROR, "NvmExpressPassThru: Timeout occurs for an NVMe command.\n"));
 
-    //
-    // Disable the timer to trigger the process of async transfers temporarily.
-    //
-    Status = gBS->SetTimer (Private->TimerEvent, TimerCancel, 0);
-    if (EFI_ERROR (Status)) {
-      goto EXIT;
-    }
-
-    //
-    // Reset the NVMe controller.
-    //
-    Status = NvmeControllerInit (Private);
-    if (!EFI_ERROR (Status)) {
-      Status = AbortAsyncPassThruTasks (Private);
-      if (!EFI_ERROR (Status)) {
-        //
-        // Re-enable the timer to trigger the process of async transfers.
-        //
-        Status = gBS->SetTimer (Private->TimerEvent, TimerPeriodic, NVME_HC_ASYNC_TIMER);
-        if (!EFI_ERROR (Status)) {
-          //
-          // Return EFI_TIMEOUT to indicate a timeout occurs for NVMe PassThru command.
-          //
-          Status = EFI_TIMEOUT;
-        }
-      }
-    } else {
-      Status = EFI_DEVICE_ERROR;
-    }
-
+    Status = NvmeResetTimedOutController (Private);
     goto EXIT;
   }
 
-  if ((Private->CqHdbl[QueueId].Cqh ^= 1) == 0) {
+  if (QueueId != 0) {
+    Private->CqHdbl[QueueId].Cqh =
+      (Private->CqHdbl[QueueId].Cqh + 1) % (Private->SyncQueueSize + 1);
+  } else {
+    Private->CqHdbl[QueueId].Cqh ^= 1;
+  }
+  if (Private->CqHdbl[QueueId].Cqh == 0) {
     Private->Pt[QueueId] ^= 1;
   }
 
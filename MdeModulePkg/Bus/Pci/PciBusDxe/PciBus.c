@@ -73,6 +73,7 @@ PciBusEntryPoint (
 {
   EFI_STATUS  Status;
   EFI_HANDLE  Handle;
+  EFI_EVENT   Event;
 
   //
   // Initializes PCI devices pool
@@ -92,6 +93,18 @@ PciBusEntryPoint (
              );
   ASSERT_EFI_ERROR (Status);
 
+  if (FeaturePcdGet (PcdPciEnumerationSnapshot)) {
+    //
+    // Save the BAR probes once all the host bridges are enumerated.
+    //
+    EfiCreateEventReadyToBootEx (
+      TPL_CALLBACK,
+      PciSnapshotSaveOnReadyToBoot,
+      NULL,
+      &Event
+      );
+  }
+
   if (FeaturePcdGet (PcdPciBusHotplugDeviceSupport)) {
     //
     // If Hot Plug is supported, install EFI PCI Hot Plug Request protocol.
@@ -34,6 +34,9 @@ WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
 #include <Protocol/PciEnumerationComplete.h>
 #include <Protocol/IoMmu.h>
 
+#include <Guid/PciEnumerationSnapshot.h>
+#include <Guid/VariableFormat.h>
+
 #include <Library/DebugLib.h>
 #include <Library/UefiDriverEntryPoint.h>
 #include <Library/BaseLib.h>
@@ -44,6 +47,8 @@ WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
 #include <Library/UefiBootServicesTableLib.h>
 #include <Library/DevicePathLib.h>
 #include <Library/PcdLib.h>
+#include <Library/HobLib.h>
+#include <Library/UefiRuntimeServicesTableLib.h>
 #include <Library/PeCoffLib.h>
 
 #include <IndustryStandard/Pci.h>
@@ -85,6 +90,7 @@ typedef enum {
 #include "PciPowerManagement.h"
 #include "PciHotPlugSupport.h"
 #include "PciLib.h"
+#include "PciEnumerationSnapshot.h"
 
 #define VGABASE1  0x3B0
 #define VGALIMIT1 0x3BB
@@ -290,6 +296,12 @@ struct _PCI_IO_DEVICE {
   // This field is used to support this case.
   //
   UINT16                                    BridgeIoAlignment;
+
+  //
+  // Verification of the BAR probes reused from the PCI enumeration snapshot
+  //
+  UINT8                                     SnapshotState;
+  UINT32                                    SnapshotExpectedValue;
 };
 
 #define PCI_IO_DEVICE_FROM_PCI_IO_THIS(a) \
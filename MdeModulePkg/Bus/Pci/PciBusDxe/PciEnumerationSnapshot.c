@@ -0,0 +1,576 @@
+/** @file
+  Save and reuse the BAR probes of a full PCI enumeration.
+
+  Probing a BAR writes all ones to it and reads it back, with the timer
+  interrupt disabled, and a full enumeration does that for every BAR and
+  bridge window of every function, VF BARs included. On a boot which assumes
+  no configuration changes, the values read back in the last enumeration are
+  reused instead. The bus scan still reads the header of every function, so
+  a probe is only reused for the same device in the same place, and the first
+  register of every function is still probed to verify the snapshot.
+
+Copyright (c) 2017, Intel Corporation. All rights reserved.<BR>
+This program and the accompanying materials
+are licensed and made available under the terms and conditions of the BSD License
+which accompanies this distribution.  The full text of the license may be found at
+http://opensource.org/licenses/bsd-license.php
+
+THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+**/
+
+#include "PciBus.h"
+
+#define PCI_SNAPSHOT_PROBE_GROWTH  64
+
+//
+// The snapshot is split into at most this many variables. The probes that do
+// not fit are not saved, and their registers are probed on every boot.
+//
+#define PCI_SNAPSHOT_MAX_PARTS     16
+
+//
+// The length of a part variable name: the base name, four hex digits and the
+// null terminator.
+//
+#define PCI_SNAPSHOT_NAME_LENGTH   (sizeof (EDKII_PCI_ENUMERATION_SNAPSHOT_VARIABLE_NAME) / sizeof (CHAR16) + 4)
+
+BOOLEAN                                 mPciSnapshotLoaded       = FALSE;
+BOOLEAN                                 mPciSnapshotSaved        = FALSE;
+EDKII_PCI_ENUMERATION_SNAPSHOT_PROBE    *mPciSnapshot            = NULL;
+UINTN                                   mPciSnapshotCount        = 0;
+UINTN                                   mPciSnapshotCursor       = 0;
+
+EDKII_PCI_ENUMERATION_SNAPSHOT_PROBE    *mPciSnapshotProbes      = NULL;
+UINTN                                   mPciSnapshotProbeCount   = 0;
+UINTN                                   mPciSnapshotProbeMax     = 0;
+UINTN                                   mPciSnapshotRecordCursor = 0;
+
+/**
+  Build the name of the variable holding a part of the snapshot.
+
+  @param PartIndex      The index of the part.
+  @param Name           Receives the variable name, PCI_SNAPSHOT_NAME_LENGTH
+                        characters long.
+
+**/
+VOID
+PciSnapshotPartName (
+  IN  UINTN                               PartIndex,
+  OUT CHAR16                              *Name
+  )
+{
+  UINTN                                 Length;
+  UINTN                                 Digit;
+
+  StrCpyS (Name, PCI_SNAPSHOT_NAME_LENGTH, EDKII_PCI_ENUMERATION_SNAPSHOT_VARIABLE_NAME);
+  Length = StrLen (Name);
+  for (Digit = 0; Digit < 4; Digit++) {
+    Name[Length + Digit] = L"0123456789ABCDEF"[(PartIndex >> (12 - 4 * Digit)) & 0xf];
+  }
+  Name[Length + 4] = L'\0';
+}
+
+/**
+  Fill in the key of a probe from the location and identity of a function.
+
+  @param PciIoDevice    PCI device instance.
+  @param Offset         Configuration space offset of the register.
+  @param Probe          The probe to fill in.
+
+**/
+VOID
+PciSnapshotInitProbe (
+  IN  PCI_IO_DEVICE                       *PciIoDevice,
+  IN  UINTN                               Offset,
+  OUT EDKII_PCI_ENUMERATION_SNAPSHOT_PROBE *Probe
+  )
+{
+  ZeroMem (Probe, sizeof (*Probe));
+  Probe->Segment        = (UINT16) PciIoDevice->PciRootBridgeIo->SegmentNumber;
+  Probe->Bus            = PciIoDevice->BusNumber;
+  Probe->DevFunc        = (UINT8) ((PciIoDevice->DeviceNumber << 3) | PciIoDevice->FunctionNumber);
+  Probe->Offset         = (UINT16) Offset;
+  Probe->VendorDeviceId = PciIoDevice->Pci.Hdr.VendorId | ((UINT32) PciIoDevice->Pci.Hdr.DeviceId << 16);
+  Probe->RevisionClass  = PciIoDevice->Pci.Hdr.RevisionID |
+                          ((UINT32) PciIoDevice->Pci.Hdr.ClassCode[0] << 8) |
+                          ((UINT32) PciIoDevice->Pci.Hdr.ClassCode[1] << 16) |
+                          ((UINT32) PciIoDevice->Pci.Hdr.ClassCode[2] << 24);
+  //
+  // SKUs sharing vendor and device ID may differ in their BAR sizes.
+  //
+  if (!IS_PCI_BRIDGE (&PciIoDevice->Pci) && !IS_CARDBUS_BRIDGE (&PciIoDevice->Pci)) {
+    Probe->SubsystemId  = PciIoDevice->Pci.Device.SubsystemVendorID |
+                          ((UINT32) PciIoDevice->Pci.Device.SubsystemID << 16);
+  }
+}
+
+/**
+  Find the probe with the same key in an array of probes.
+
+  The BARs are probed in the same order on every boot, so the search starts
+  after the probe found last time and wraps around.
+
+  @param Probes         The array of probes.
+  @param Count          The number of probes.
+  @param Cursor         The index to start at, updated on success.
+  @param Key            The probe to look for. Its value is ignored.
+
+  @return The probe found, or NULL.
+
+**/
+EDKII_PCI_ENUMERATION_SNAPSHOT_PROBE *
+PciSnapshotFindProbe (
+  IN     EDKII_PCI_ENUMERATION_SNAPSHOT_PROBE *Probes,
+  IN     UINTN                                Count,
+  IN OUT UINTN                                *Cursor,
+  IN     EDKII_PCI_ENUMERATION_SNAPSHOT_PROBE *Key
+  )
+{
+  UINTN                                 Index;
+  UINTN                                 Slot;
+
+  for (Index = 0; Index < Count; Index++) {
+    Slot = (*Cursor + Index) % Count;
+    if (CompareMem (&Probes[Slot], Key, OFFSET_OF (EDKII_PCI_ENUMERATION_SNAPSHOT_PROBE, Value)) == 0) {
+      *Cursor = (Slot + 1) % Count;
+      return &Probes[Slot];
+    }
+  }
+
+  return NULL;
+}
+
+/**
+  Read one part of the snapshot saved by the last full enumeration.
+
+  @param PartIndex      The index of the part.
+
+  @return The part, or NULL if it does not exist or it is not valid.
+
+**/
+EDKII_PCI_ENUMERATION_SNAPSHOT *
+PciSnapshotReadPart (
+  IN UINTN                                PartIndex
+  )
+{
+  EFI_STATUS                            Status;
+  CHAR16                                Name[PCI_SNAPSHOT_NAME_LENGTH];
+  EDKII_PCI_ENUMERATION_SNAPSHOT        *Part;
+  UINTN                                 PartSize;
+  UINT32                                Crc;
+
+  PciSnapshotPartName (PartIndex, Name);
+  Part   = NULL;
+  Status = GetVariable2 (Name, &gEdkiiPciEnumerationSnapshotGuid, (VOID **) &Part, &PartSize);
+  if (EFI_ERROR (Status)) {
+    return NULL;
+  }
+
+  Crc = 0;
+  if ((PartSize < sizeof (EDKII_PCI_ENUMERATION_SNAPSHOT)) ||
+      (Part->Signature != EDKII_PCI_ENUMERATION_SNAPSHOT_SIGNATURE) ||
+      (Part->PartIndex != PartIndex) ||
+      (Part->PartIndex >= Part->PartCount) ||
+      (Part->PartCount > PCI_SNAPSHOT_MAX_PARTS) ||
+      (Part->ProbeCount == 0) ||
+      (PartSize != sizeof (EDKII_PCI_ENUMERATION_SNAPSHOT) +
+                   MultU64x32 (Part->ProbeCount, sizeof (EDKII_PCI_ENUMERATION_SNAPSHOT_PROBE)))) {
+    FreePool (Part);
+    return NULL;
+  }
+
+  gBS->CalculateCrc32 (Part + 1, PartSize - sizeof (EDKII_PCI_ENUMERATION_SNAPSHOT), &Crc);
+  if (Crc != Part->Fingerprint) {
+    FreePool (Part);
+    return NULL;
+  }
+
+  return Part;
+}
+
+/**
+  Read the snapshot saved by the last full enumeration.
+
+  @param Count          Returns the number of probes.
+  @param PartCount      Returns the number of parts recorded in the first
+                        part, or 0 if the first part is not valid.
+
+  @return The probes, or NULL if there is no snapshot or it is not valid.
+
+**/
+EDKII_PCI_ENUMERATION_SNAPSHOT_PROBE *
+PciSnapshotRead (
+  OUT UINTN                               *Count,
+  OUT UINTN                               *PartCount
+  )
+{
+  EDKII_PCI_ENUMERATION_SNAPSHOT        *Part;
+  EDKII_PCI_ENUMERATION_SNAPSHOT_PROBE  *Probes;
+  EDKII_PCI_ENUMERATION_SNAPSHOT_PROBE  *NewProbes;
+  UINTN                                 PartIndex;
+
+  *Count     = 0;
+  *PartCount = 0;
+  Probes     = NULL;
+
+  Part = PciSnapshotReadPart (0);
+  if (Part == NULL) {
+    return NULL;
+  }
+  *PartCount = Part->PartCount;
+
+  for (PartIndex = 0; ; PartIndex++) {
+    //
+    // All parts must belong to the same snapshot.
+    //
+    if ((Part == NULL) || (Part->PartCount != *PartCount)) {
+      break;
+    }
+
+    NewProbes = ReallocatePool (
+                  *Count * sizeof (EDKII_PCI_ENUMERATION_SNAPSHOT_PROBE),
+                  (*Count + Part->ProbeCount) * sizeof (EDKII_PCI_ENUMERATION_SNAPSHOT_PROBE),
+                  Probes
+                  );
+    if (NewProbes == NULL) {
+      break;
+    }
+    Probes = NewProbes;
+    CopyMem (&Probes[*Count], Part + 1, Part->ProbeCount * sizeof (EDKII_PCI_ENUMERATION_SNAPSHOT_PROBE));
+    *Count += Part->ProbeCount;
+    FreePool (Part);
+    Part = NULL;
+
+    if (PartIndex + 1 == *PartCount) {
+      return Probes;
+    }
+    Part = PciSnapshotReadPart (PartIndex + 1);
+  }
+
+  if (Part != NULL) {
+    FreePool (Part);
+  }
+  if (Probes != NULL) {
+    FreePool (Probes);
+  }
+  *Count = 0;
+  return NULL;
+}
+
+/**
+  Look up the value a BAR or bridge window register read back after all ones
+  were written to it in the last full enumeration.
+
+  The snapshot is only used if PcdPciEnumerationSnapshot is TRUE and the boot
+  mode is BOOT_ASSUMING_NO_CONFIGURATION_CHANGES, and a probe is only reused
+  for a function with the same location, vendor, device, subsystem, revision
+  and class. The first register of a function found in the snapshot is probed
+  anyway, and the snapshot is only used for the function if both values match.
+
+  @param PciIoDevice    PCI device instance.
+  @param Offset         Configuration space offset of the register.
+  @param Value          The value read back after writing all ones.
+
+  @retval TRUE          The value was found in the snapshot.
+  @retval FALSE         The register has to be probed.
+
+**/
+BOOLEAN
+PciSnapshotGetProbeValue (
+  IN  PCI_IO_DEVICE                       *PciIoDevice,
+  IN  UINTN                               Offset,
+  OUT UINT32                              *Value
+  )
+{
+  EDKII_PCI_ENUMERATION_SNAPSHOT_PROBE  Key;
+  EDKII_PCI_ENUMERATION_SNAPSHOT_PROBE  *Probe;
+  UINTN                                 PartCount;
+
+  if (!FeaturePcdGet (PcdPciEnumerationSnapshot)) {
+    return FALSE;
+  }
+
+  if (!mPciSnapshotLoaded) {
+    mPciSnapshotLoaded = TRUE;
+    if (GetBootModeHob () == BOOT_ASSUMING_NO_CONFIGURATION_CHANGES) {
+      mPciSnapshot = PciSnapshotRead (&mPciSnapshotCount, &PartCount);
+    }
+  }
+
+  if ((mPciSnapshot == NULL) ||
+      (PciIoDevice->SnapshotState == PCI_SNAPSHOT_REJECTED) ||
+      (PciIoDevice->SnapshotState == PCI_SNAPSHOT_VERIFYING)) {
+    return FALSE;
+  }
+
+  PciSnapshotInitProbe (PciIoDevice, Offset, &Key);
+  Probe = PciSnapshotFindProbe (mPciSnapshot, mPciSnapshotCount, &mPciSnapshotCursor, &Key);
+  if (Probe == NULL) {
+    return FALSE;
+  }
+
+  if (PciIoDevice->SnapshotState == PCI_SNAPSHOT_UNVERIFIED) {
+    PciIoDevice->SnapshotState         = PCI_SNAPSHOT_VERIFYING;
+    PciIoDevice->SnapshotExpectedValue = Probe->Value;
+    return FALSE;
+  }
+
+  *Value = Probe->Value;
+  return TRUE;
+}
+
+/**
+  Record the value a BAR or bridge window register read back after all ones
+  were written to it.
+
+  If the register was probed to verify the snapshot, the snapshot is used for
+  the other registers of the function only if the value matches.
+
+  @param PciIoDevice    PCI device instance.
+  @param Offset         Configuration space offset of the register.
+  @param Value          The value read back after writing all ones.
+
+**/
+VOID
+PciSnapshotRecordProbe (
+  IN PCI_IO_DEVICE                        *PciIoDevice,
+  IN UINTN                                Offset,
+  IN UINT32                               Value
+  )
+{
+  EDKII_PCI_ENUMERATION_SNAPSHOT_PROBE  Key;
+  EDKII_PCI_ENUMERATION_SNAPSHOT_PROBE  *Probe;
+  EDKII_PCI_ENUMERATION_SNAPSHOT_PROBE  *Probes;
+
+  if (PciIoDevice->SnapshotState == PCI_SNAPSHOT_VERIFYING) {
+    if (Value == PciIoDevice->SnapshotExpectedValue) {
+      PciIoDevice->SnapshotState = PCI_SNAPSHOT_VERIFIED;
+    } else {
+      DEBUG ((
+        DEBUG_INFO,
+        "PciBus: Enumeration snapshot of %02x|%02x|%02x does not match the device, probing it\n",
+        PciIoDevice->BusNumber,
+        PciIoDevice->DeviceNumber,
+        PciIoDevice->FunctionNumber
+        ));
+      PciIoDevice->SnapshotState = PCI_SNAPSHOT_REJECTED;
+    }
+  }
+
+  //
+  // Only the enumeration done before the platform is ready to boot is saved.
+  //
+  if (!FeaturePcdGet (PcdPciEnumerationSnapshot) || mPciSnapshotSaved) {
+    return;
+  }
+
+  //
+  // The same register is probed more than once, e.g. by the bus scan and
+  // again when the device information is collected.
+  //
+  PciSnapshotInitProbe (PciIoDevice, Offset, &Key);
+  if (mPciSnapshotProbeCount != 0) {
+    Probe = PciSnapshotFindProbe (
+              mPciSnapshotProbes,
+              mPciSnapshotProbeCount,
+              &mPciSnapshotRecordCursor,
+              &Key
+              );
+    if (Probe != NULL) {
+      Probe->Value = Value;
+      return;
+    }
+  }
+
+  if (mPciSnapshotProbeCount == mPciSnapshotProbeMax) {
+    Probes = ReallocatePool (
+               mPciSnapshotProbeMax * sizeof (EDKII_PCI_ENUMERATION_SNAPSHOT_PROBE),
+               (mPciSnapshotProbeMax + PCI_SNAPSHOT_PROBE_GROWTH) * sizeof (EDKII_PCI_ENUMERATION_SNAPSHOT_PROBE),
+               mPciSnapshotProbes
+               );
+    if (Probes == NULL) {
+      return;
+    }
+    mPciSnapshotProbes    = Probes;
+    mPciSnapshotProbeMax += PCI_SNAPSHOT_PROBE_GROWTH;
+  }
+
+  Key.Value = Value;
+  CopyMem (&mPciSnapshotProbes[mPciSnapshotProbeCount], &Key, sizeof (Key));
+  mPciSnapshotProbeCount++;
+}
+
+/**
+  Compute how many probes fit in one part of the snapshot.
+
+  @return The number of probes per part, or 0 if PcdMaxVariableSize is too
+          small for a single probe.
+
+**/
+UINTN
+PciSnapshotProbesPerPart (
+  VOID
+  )
+{
+  UINTN                                 Overhead;
+
+  //
+  // The variable header and name count against PcdMaxVariableSize as well.
+  //
+  Overhead = sizeof (AUTHENTICATED_VARIABLE_HEADER) + PCI_SNAPSHOT_NAME_LENGTH * sizeof (CHAR16) +
+             sizeof (EDKII_PCI_ENUMERATION_SNAPSHOT);
+  if (PcdGet32 (PcdMaxVariableSize) < Overhead + sizeof (EDKII_PCI_ENUMERATION_SNAPSHOT_PROBE)) {
+    return 0;
+  }
+  return (PcdGet32 (PcdMaxVariableSize) - Overhead) / sizeof (EDKII_PCI_ENUMERATION_SNAPSHOT_PROBE);
+}
+
+/**
+  Save the probes in as many parts as needed, and delete the parts of a longer
+  snapshot saved before.
+
+  @param Probes         The probes to save.
+  @param Count          The number of probes, at most PCI_SNAPSHOT_MAX_PARTS
+                        times PerPart.
+  @param PerPart        The number of probes per part.
+  @param OldPartCount   The number of parts of the saved snapshot.
+
+**/
+VOID
+PciSnapshotWrite (
+  IN EDKII_PCI_ENUMERATION_SNAPSHOT_PROBE *Probes,
+  IN UINTN                                Count,
+  IN UINTN                                PerPart,
+  IN UINTN                                OldPartCount
+  )
+{
+  EFI_STATUS                            Status;
+  CHAR16                                Name[PCI_SNAPSHOT_NAME_LENGTH];
+  EDKII_PCI_ENUMERATION_SNAPSHOT        *Part;
+  UINTN                                 PartCount;
+  UINTN                                 PartIndex;
+  UINTN                                 ProbeCount;
+
+  PartCount = (Count + PerPart - 1) / PerPart;
+  ASSERT (PartCount <= PCI_SNAPSHOT_MAX_PARTS);
+
+  Part = AllocatePool (sizeof (EDKII_PCI_ENUMERATION_SNAPSHOT) + PerPart * sizeof (EDKII_PCI_ENUMERATION_SNAPSHOT_PROBE));
+  if (Part == NULL) {
+    return;
+  }
+
+  DEBUG ((DEBUG_INFO, "PciBus: Saving the enumeration snapshot of %d probes in %d parts\n", Count, PartCount));
+  Status = EFI_SUCCESS;
+  for (PartIndex = 0; PartIndex < PartCount; PartIndex++) {
+    ProbeCount = MIN (PerPart, Count - PartIndex * PerPart);
+    Part->Signature   = EDKII_PCI_ENUMERATION_SNAPSHOT_SIGNATURE;
+    Part->Fingerprint = 0;
+    Part->PartIndex   = (UINT16) PartIndex;
+    Part->PartCount   = (UINT16) PartCount;
+    Part->ProbeCount  = (UINT32) ProbeCount;
+    CopyMem (Part + 1, &Probes[PartIndex * PerPart], ProbeCount * sizeof (EDKII_PCI_ENUMERATION_SNAPSHOT_PROBE));
+    gBS->CalculateCrc32 (Part + 1, ProbeCount * sizeof (EDKII_PCI_ENUMERATION_SNAPSHOT_PROBE), &Part->Fingerprint);
+
+    PciSnapshotPartName (PartIndex, Name);
+    Status = gRT->SetVariable (
+                    Name,
+                    &gEdkiiPciEnumerationSnapshotGuid,
+                    EFI_VARIABLE_NON_VOLATILE | EFI_VARIABLE_BOOTSERVICE_ACCESS,
+                    sizeof (EDKII_PCI_ENUMERATION_SNAPSHOT) + ProbeCount * sizeof (EDKII_PCI_ENUMERATION_SNAPSHOT_PROBE),
+                    Part
+                    );
+    if (EFI_ERROR (Status)) {
+      DEBUG ((DEBUG_ERROR, "PciBus: Saving part %d of the enumeration snapshot failed - %r\n", PartIndex, Status));
+      break;
+    }
+  }
+  FreePool (Part);
+
+  //
+  // A snapshot saved in part is not used, so drop the first part on failure.
+  //
+  if (EFI_ERROR (Status)) {
+    PartCount = 0;
+  }
+  for (PartIndex = PartCount; PartIndex < MAX (OldPartCount, 1); PartIndex++) {
+    PciSnapshotPartName (PartIndex, Name);
+    gRT->SetVariable (Name, &gEdkiiPciEnumerationSnapshotGuid, 0, 0, NULL);
+  }
+}
+
+/**
+  Save the probes recorded by the enumeration of all the host bridges for the
+  next boot, once the platform is ready to boot.
+
+  The variables are only written if the probes differ from the saved snapshot.
+
+  @param Event          The ready to boot event.
+  @param Context        Not used.
+
+**/
+VOID
+EFIAPI
+PciSnapshotSaveOnReadyToBoot (
+  IN EFI_EVENT                            Event,
+  IN VOID                                 *Context
+  )
+{
+  EDKII_PCI_ENUMERATION_SNAPSHOT_PROBE  *OldProbes;
+  UINTN                                 OldCount;
+  UINTN                                 OldPartCount;
+  UINTN                                 PerPart;
+  UINTN                                 Count;
+
+  gBS->CloseEvent (Event);
+  mPciSnapshotSaved = TRUE;
+
+  if (mPciSnapshot != NULL) {
+    FreePool (mPciSnapshot);
+    mPciSnapshot      = NULL;
+    mPciSnapshotCount = 0;
+  }
+
+  if (mPciSnapshotProbeCount == 0) {
+    return;
+  }
+
+  PerPart = PciSnapshotProbesPerPart ();
+  Count   = mPciSnapshotProbeCount;
+  if (PerPart == 0) {
+    DEBUG ((DEBUG_ERROR, "PciBus: PcdMaxVariableSize is too small for the enumeration snapshot\n"));
+    Count = 0;
+  } else if (Count > PCI_SNAPSHOT_MAX_PARTS * PerPart) {
+    DEBUG ((
+      DEBUG_WARN,
+      "PciBus: Only %d of %d probes fit in the enumeration snapshot\n",
+      PCI_SNAPSHOT_MAX_PARTS * PerPart,
+      Count
+      ));
+    Count = PCI_SNAPSHOT_MAX_PARTS * PerPart;
+  }
+
+  //
+  // Read the saved snapshot again, so an unchanged topology does not rewrite
+  // the variables.
+  //
+  if (Count != 0) {
+    OldProbes = PciSnapshotRead (&OldCount, &OldPartCount);
+    if ((OldProbes == NULL) ||
+        (OldCount != Count) ||
+        (CompareMem (OldProbes, mPciSnapshotProbes, Count * sizeof (EDKII_PCI_ENUMERATION_SNAPSHOT_PROBE)) != 0)) {
+      PciSnapshotWrite (mPciSnapshotProbes, Count, PerPart, OldPartCount);
+    }
+
+    if (OldProbes != NULL) {
+      FreePool (OldProbes);
+    }
+  }
+
+  FreePool (mPciSnapshotProbes);
+  mPciSnapshotProbes       = NULL;
+  mPciSnapshotProbeCount   = 0;
+  mPciSnapshotProbeMax     = 0;
+  mPciSnapshotRecordCursor = 0;
+}
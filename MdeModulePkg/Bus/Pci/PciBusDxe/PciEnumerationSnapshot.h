@@ -0,0 +1,87 @@
+/** @file
+  Save and reuse the BAR probes of a full PCI enumeration.
+
+Copyright (c) 2017, Intel Corporation. All rights reserved.<BR>
+This program and the accompanying materials
+are licensed and made available under the terms and conditions of the BSD License
+which accompanies this distribution.  The full text of the license may be found at
+http://opensource.org/licenses/bsd-license.php
+
+THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+**/
+
+#ifndef _EFI_PCI_ENUMERATION_SNAPSHOT_H_
+#define _EFI_PCI_ENUMERATION_SNAPSHOT_H_
+
+//
+// Values of PCI_IO_DEVICE.SnapshotState
+//
+#define PCI_SNAPSHOT_UNVERIFIED  0    // No register of the function was found in the snapshot yet
+#define PCI_SNAPSHOT_VERIFYING   1    // The first register found is being probed
+#define PCI_SNAPSHOT_VERIFIED    2    // The probe matched, the snapshot is used
+#define PCI_SNAPSHOT_REJECTED    3    // The probe did not match, every register is probed
+
+/**
+  Look up the value a BAR or bridge window register read back after all ones
+  were written to it in the last full enumeration.
+
+  The snapshot is only used if PcdPciEnumerationSnapshot is TRUE and the boot
+  mode is BOOT_ASSUMING_NO_CONFIGURATION_CHANGES, and a probe is only reused
+  for a function with the same location, vendor, device, subsystem, revision
+  and class. The first register of a function found in the snapshot is probed
+  anyway, and the snapshot is only used for the function if both values match.
+
+  @param PciIoDevice    PCI device instance.
+  @param Offset         Configuration space offset of the register.
+  @param Value          The value read back after writing all ones.
+
+  @retval TRUE          The value was found in the snapshot.
+  @retval FALSE         The register has to be probed.
+
+**/
+BOOLEAN
+PciSnapshotGetProbeValue (
+  IN  PCI_IO_DEVICE                       *PciIoDevice,
+  IN  UINTN                               Offset,
+  OUT UINT32                              *Value
+  );
+
+/**
+  Record the value a BAR or bridge window register read back after all ones
+  were written to it.
+
+  If the register was probed to verify the snapshot, the snapshot is used for
+  the other registers of the function only if the value matches.
+
+  @param PciIoDevice    PCI device instance.
+  @param Offset         Configuration space offset of the register.
+  @param Value          The value read back after writing all ones.
+
+**/
+VOID
+PciSnapshotRecordProbe (
+  IN PCI_IO_DEVICE                        *PciIoDevice,
+  IN UINTN                                Offset,
+  IN UINT32                               Value
+  );
+
+/**
+  Save the probes recorded by the enumeration of all the host bridges for the
+  next boot, once the platform is ready to boot.
+
+  The variables are only written if the probes differ from the saved snapshot.
+
+  @param Event          The ready to boot event.
+  @param Context        Not used.
+
+**/
+VOID
+EFIAPI
+PciSnapshotSaveOnReadyToBoot (
+  IN EFI_EVENT                            Event,
+  IN VOID                                 *Context
+  );
+
+#endif
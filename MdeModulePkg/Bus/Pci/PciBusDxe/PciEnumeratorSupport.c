@@ -22,6 +22,22 @@ extern CHAR16  *mBarTypeStr[];
 #define SQUAD_ALIGN 0xFFFFFFFFFFFFFFFDULL
 #define DQUAD_ALIGN 0xFFFFFFFFFFFFFFFCULL
 
+//
+// The functions found by the bus scan on each segment. The device information
+// collection walks the same buses right after the scan, and only the functions
+// found by the scan need to be read again. The record is only kept, and only
+// consulted, while PciHostBridgeEnumerator() runs.
+//
+typedef struct {
+  UINT32                                Segment;
+  UINT32                                ScannedBus[(PCI_MAX_BUS + 1) / 32];
+  UINT32                                Present[PCI_MAX_BUS + 1][((PCI_MAX_DEVICE + 1) * (PCI_MAX_FUNC + 1)) / 32];
+} PCI_SCAN_PRESENCE;
+
+PCI_SCAN_PRESENCE                       *mPciScanPresence       = NULL;
+UINTN                                   mPciScanPresenceCount  = 0;
+BOOLEAN                                 mPciScanPresenceActive = FALSE;
+
 /**
   This routine is used to check whether the pci device is present.
 
@@ -81,6 +97,211 @@ PciDevicePresent (
   return EFI_NOT_FOUND;
 }
 
+/**
+  Get the presence map of the segment of a root bridge.
+
+  @param PciRootBridgeIo   Pointer to instance of EFI_PCI_ROOT_BRIDGE_IO_PROTOCOL.
+  @param Create            TRUE to create the map if the segment has none.
+
+  @return The presence map, or NULL if there is none.
+
+**/
+PCI_SCAN_PRESENCE *
+PciGetScanPresence (
+  IN EFI_PCI_ROOT_BRIDGE_IO_PROTOCOL     *PciRootBridgeIo,
+  IN BOOLEAN                             Create
+  )
+{
+  UINTN                                 Index;
+  PCI_SCAN_PRESENCE                     *Presence;
+
+  for (Index = 0; Index < mPciScanPresenceCount; Index++) {
+    if (mPciScanPresence[Index].Segment == PciRootBridgeIo->SegmentNumber) {
+      return &mPciScanPresence[Index];
+    }
+  }
+
+  if (!Create) {
+    return NULL;
+  }
+
+  Presence = ReallocatePool (
+               mPciScanPresenceCount * sizeof (PCI_SCAN_PRESENCE),
+               (mPciScanPresenceCount + 1) * sizeof (PCI_SCAN_PRESENCE),
+               mPciScanPresence
+               );
+  if (Presence == NULL) {
+    return NULL;
+  }
+
+  mPciScanPresence = Presence;
+  Presence         = &mPciScanPresence[mPciScanPresenceCount++];
+  ZeroMem (Presence, sizeof (PCI_SCAN_PRESENCE));
+  Presence->Segment = PciRootBridgeIo->SegmentNumber;
+  return Presence;
+}
+
+/**
+  Forget the functions found by the bus scan, and stop recording them.
+
+**/
+VOID
+PciStopScanPresence (
+  VOID
+  )
+{
+  if (mPciScanPresence != NULL) {
+    FreePool (mPciScanPresence);
+  }
+
+  mPciScanPresence       = NULL;
+  mPciScanPresenceCount  = 0;
+  mPciScanPresenceActive = FALSE;
+}
+
+/**
+  Start recording the functions found by a bus scan pass.
+
+  The functions found by an earlier pass are forgotten, so the second pass
+  after hot plug controller initialization replaces the first.
+
+**/
+VOID
+PciStartScanPresence (
+  VOID
+  )
+{
+  PciStopScanPresence ();
+  mPciScanPresenceActive = TRUE;
+}
+
+/**
+  Record that the bus scan is about to probe all the functions of a bus.
+
+  The bus is not marked as scanned until PciRecordScannedBus() is called, so
+  a scan that fails half way through the bus does not hide its functions.
+
+  @param PciRootBridgeIo   Pointer to instance of EFI_PCI_ROOT_BRIDGE_IO_PROTOCOL.
+  @param Bus               PCI bus NO.
+
+**/
+VOID
+PciClearScannedBus (
+  IN EFI_PCI_ROOT_BRIDGE_IO_PROTOCOL     *PciRootBridgeIo,
+  IN UINT8                               Bus
+  )
+{
+  PCI_SCAN_PRESENCE                     *Presence;
+
+  if (!mPciScanPresenceActive) {
+    return;
+  }
+
+  Presence = PciGetScanPresence (PciRootBridgeIo, TRUE);
+  if (Presence == NULL) {
+    return;
+  }
+
+  Presence->ScannedBus[Bus / 32] &= ~(1u << (Bus % 32));
+  ZeroMem (Presence->Present[Bus], sizeof (Presence->Present[Bus]));
+}
+
+/**
+  Record that the bus scan has probed all the functions of a bus.
+
+  @param PciRootBridgeIo   Pointer to instance of EFI_PCI_ROOT_BRIDGE_IO_PROTOCOL.
+  @param Bus               PCI bus NO.
+
+**/
+VOID
+PciRecordScannedBus (
+  IN EFI_PCI_ROOT_BRIDGE_IO_PROTOCOL     *PciRootBridgeIo,
+  IN UINT8                               Bus
+  )
+{
+  PCI_SCAN_PRESENCE                     *Presence;
+
+  if (!mPciScanPresenceActive) {
+    return;
+  }
+
+  Presence = PciGetScanPresence (PciRootBridgeIo, FALSE);
+  if (Presence == NULL) {
+    return;
+  }
+
+  Presence->ScannedBus[Bus / 32] |= 1u << (Bus % 32);
+}
+
+/**
+  Record that the bus scan found a function.
+
+  @param PciRootBridgeIo   Pointer to instance of EFI_PCI_ROOT_BRIDGE_IO_PROTOCOL.
+  @param Bus               PCI bus NO.
+  @param Device            PCI device NO.
+  @param Func              PCI Func NO.
+
+**/
+VOID
+PciRecordPresentFunction (
+  IN EFI_PCI_ROOT_BRIDGE_IO_PROTOCOL     *PciRootBridgeIo,
+  IN UINT8                               Bus,
+  IN UINT8                               Device,
+  IN UINT8                               Func
+  )
+{
+  PCI_SCAN_PRESENCE                     *Presence;
+  UINTN                                 Bit;
+
+  if (!mPciScanPresenceActive) {
+    return;
+  }
+
+  Presence = PciGetScanPresence (PciRootBridgeIo, FALSE);
+  if (Presence == NULL) {
+    return;
+  }
+
+  Bit = Device * (PCI_MAX_FUNC + 1) + Func;
+  Presence->Present[Bus][Bit / 32] |= 1u << (Bit % 32);
+}
+
+/**
+  Check whether the bus scan probed a function and did not find it.
+
+  @param PciRootBridgeIo   Pointer to instance of EFI_PCI_ROOT_BRIDGE_IO_PROTOCOL.
+  @param Bus               PCI bus NO.
+  @param Device            PCI device NO.
+  @param Func              PCI Func NO.
+
+  @retval TRUE             The bus was scanned and the function was not found.
+  @retval FALSE            The function has to be probed.
+
+**/
+BOOLEAN
+PciScanFoundNoFunction (
+  IN EFI_PCI_ROOT_BRIDGE_IO_PROTOCOL     *PciRootBridgeIo,
+  IN UINT8                               Bus,
+  IN UINT8                               Device,
+  IN UINT8                               Func
+  )
+{
+  PCI_SCAN_PRESENCE                     *Presence;
+  UINTN                                 Bit;
+
+  if (!mPciScanPresenceActive) {
+    return FALSE;
+  }
+
+  Presence = PciGetScanPresence (PciRootBridgeIo, FALSE);
+  if ((Presence == NULL) || ((Presence->ScannedBus[Bus / 32] & (1u << (Bus % 32))) == 0)) {
+    return FALSE;
+  }
+
+  Bit = Device * (PCI_MAX_FUNC + 1) + Func;
+  return (BOOLEAN) ((Presence->Present[Bus][Bit / 32] & (1u << (Bit % 32))) == 0);
+}
+
 /**
   Collect all the resource information under this root bridge.
 
@@ -116,15 +337,20 @@ PciPciDeviceInfoCollector (
     for (Func = 0; Func <= PCI_MAX_FUNC; Func++) {
 
       //
-      // Check to see whether PCI device is present
+      // Check to see whether PCI device is present, unless the bus scan
+      // already found that it is not
       //
-      Status = PciDevicePresent (
-                 Bridge->PciRootBridgeIo,
-                 &Pci,
-                 (UINT8) StartBusNumber,
-                 (UINT8) Device,
-                 (UINT8) Func
-                 );
+      if (PciScanFoundNoFunction (Bridge->PciRootBridgeIo, StartBusNumber, Device, Func)) {
+        Status = EFI_NOT_FOUND;
+      } else {
+        Status = PciDevicePresent (
+                   Bridge->PciRootBridgeIo,
+                   &Pci,
+                   (UINT8) StartBusNumber,
+                   (UINT8) Device,
+                   (UINT8) Func
+                   );
+      }
 
       if (EFI_ERROR (Status) && Func == 0) {
         //
@@ -819,22 +1045,28 @@ VfBarExisted (
   PciIo->Pci.Read (PciIo, EfiPciIoWidthUint32, (UINT32)Offset, 1, &OriginalValue);
 
   //
-  // Raise TPL to high level to disable timer interrupt while the BAR is probed
+  // Reuse the probe of the last full enumeration if the device is the same
   //
-  OldTpl = gBS->RaiseTPL (TPL_HIGH_LEVEL);
+  if (!PciSnapshotGetProbeValue (PciIoDevice, Offset, &Value)) {
+    //
+    // Raise TPL to high level to disable timer interrupt while the BAR is probed
+    //
+    OldTpl = gBS->RaiseTPL (TPL_HIGH_LEVEL);
 
-  PciIo->Pci.Write (PciIo, EfiPciIoWidthUint32, (UINT32)Offset, 1, &gAllOne);
-  PciIo->Pci.Read (PciIo, EfiPciIoWidthUint32, (UINT32)Offset, 1, &Value);
+    PciIo->Pci.Write (PciIo, EfiPciIoWidthUint32, (UINT32)Offset, 1, &gAllOne);
+    PciIo->Pci.Read (PciIo, EfiPciIoWidthUint32, (UINT32)Offset, 1, &Value);
 
-  //
-  // Write back the original value
-  //
-  PciIo->Pci.Write (PciIo, EfiPciIoWidthUint32, (UINT32)Offset, 1, &OriginalValue);
+    //
+    // Write back the original value
+    //
+    PciIo->Pci.Write (PciIo, EfiPciIoWidthUint32, (UINT32)Offset, 1, &OriginalValue);
 
-  //
-  // Restore TPL to its original level
-  //
-  gBS->RestoreTPL (OldTpl);
+    //
+    // Restore TPL to its original level
+    //
+    gBS->RestoreTPL (OldTpl);
+  }
+  PciSnapshotRecordProbe (PciIoDevice, Offset, Value);
 
   if (BarLengthValue != NULL) {
     *BarLengthValue = Value;
@@ -884,22 +1116,28 @@ BarExisted (
   PciIo->Pci.Read (PciIo, EfiPciIoWidthUint32, (UINT8) Offset, 1, &OriginalValue);
 
   //
-  // Raise TPL to high level to disable timer interrupt while the BAR is probed
+  // Reuse the probe of the last full enumeration if the device is the same
   //
-  OldTpl = gBS->RaiseTPL (TPL_HIGH_LEVEL);
+  if (!PciSnapshotGetProbeValue (PciIoDevice, Offset, &Value)) {
+    //
+    // Raise TPL to high level to disable timer interrupt while the BAR is probed
+    //
+    OldTpl = gBS->RaiseTPL (TPL_HIGH_LEVEL);
 
-  PciIo->Pci.Write (PciIo, EfiPciIoWidthUint32, (UINT8) Offset, 1, &gAllOne);
-  PciIo->Pci.Read (PciIo, EfiPciIoWidthUint32, (UINT8) Offset, 1, &Value);
+    PciIo->Pci.Write (PciIo, EfiPciIoWidthUint32, (UINT8) Offset, 1, &gAllOne);
+    PciIo->Pci.Read (PciIo, EfiPciIoWidthUint32, (UINT8) Offset, 1, &Value);
 
-  //
-  // Write back the original value
-  //
-  PciIo->Pci.Write (PciIo, EfiPciIoWidthUint32, (UINT8) Offset, 1, &OriginalValue);
+    //
+    // Write back the original value
+    //
+    PciIo->Pci.Write (PciIo, EfiPciIoWidthUint32, (UINT8) Offset, 1, &OriginalValue);
 
-  //
-  // Restore TPL to its original level
-  //
-  gBS->RestoreTPL (OldTpl);
+    //
+    // Restore TPL to its original level
+    //
+    gBS->RestoreTPL (OldTpl);
+  }
+  PciSnapshotRecordProbe (PciIoDevice, Offset, Value);
 
   if (BarLengthValue != NULL) {
     *BarLengthValue = Value;
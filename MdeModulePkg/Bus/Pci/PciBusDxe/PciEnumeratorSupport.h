@@ -37,6 +37,93 @@ PciDevicePresent (
   IN  UINT8                               Func
   );
 
+/**
+  Forget the functions found by the bus scan, and stop recording them.
+
+**/
+VOID
+PciStopScanPresence (
+  VOID
+  );
+
+/**
+  Start recording the functions found by a bus scan pass.
+
+  The functions found by an earlier pass are forgotten, so the second pass
+  after hot plug controller initialization replaces the first.
+
+**/
+VOID
+PciStartScanPresence (
+  VOID
+  );
+
+/**
+  Record that the bus scan is about to probe all the functions of a bus.
+
+  The bus is not marked as scanned until PciRecordScannedBus() is called, so
+  a scan that fails half way through the bus does not hide its functions.
+
+  @param PciRootBridgeIo   Pointer to instance of EFI_PCI_ROOT_BRIDGE_IO_PROTOCOL.
+  @param Bus               PCI bus NO.
+
+**/
+VOID
+PciClearScannedBus (
+  IN EFI_PCI_ROOT_BRIDGE_IO_PROTOCOL     *PciRootBridgeIo,
+  IN UINT8                               Bus
+  );
+
+/**
+  Record that the bus scan has probed all the functions of a bus.
+
+  @param PciRootBridgeIo   Pointer to instance of EFI_PCI_ROOT_BRIDGE_IO_PROTOCOL.
+  @param Bus               PCI bus NO.
+
+**/
+VOID
+PciRecordScannedBus (
+  IN EFI_PCI_ROOT_BRIDGE_IO_PROTOCOL     *PciRootBridgeIo,
+  IN UINT8                               Bus
+  );
+
+/**
+  Record that the bus scan found a function.
+
+  @param PciRootBridgeIo   Pointer to instance of EFI_PCI_ROOT_BRIDGE_IO_PROTOCOL.
+  @param Bus               PCI bus NO.
+  @param Device            PCI device NO.
+  @param Func              PCI Func NO.
+
+**/
+VOID
+PciRecordPresentFunction (
+  IN EFI_PCI_ROOT_BRIDGE_IO_PROTOCOL     *PciRootBridgeIo,
+  IN UINT8                               Bus,
+  IN UINT8                               Device,
+  IN UINT8                               Func
+  );
+
+/**
+  Check whether the bus scan probed a function and did not find it.
+
+  @param PciRootBridgeIo   Pointer to instance of EFI_PCI_ROOT_BRIDGE_IO_PROTOCOL.
+  @param Bus               PCI bus NO.
+  @param Device            PCI device NO.
+  @param Func              PCI Func NO.
+
+  @retval TRUE             The bus was scanned and the function was not found.
+  @retval FALSE            The function has to be probed.
+
+**/
+BOOLEAN
+PciScanFoundNoFunction (
+  IN EFI_PCI_ROOT_BRIDGE_IO_PROTOCOL     *PciRootBridgeIo,
+  IN UINT8                               Bus,
+  IN UINT8                               Device,
+  IN UINT8                               Func
+  );
+
 /**
   Collect all the resource information under this root bridge.
 
@@ -1002,6 +1002,8 @@ PciScanBus (
   PciDevice       = NULL;
   PciAddress      = 0;
 
+  PciClearScannedBus (PciRootBridgeIo, StartBusNumber);
+
   for (Device = 0; Device <= PCI_MAX_DEVICE; Device++) {
     TempReservedBusNum = 0;
     for (Func = 0; Func <= PCI_MAX_FUNC; Func++) {
@@ -1028,6 +1030,8 @@ PciScanBus (
         continue;
       }
 
+      PciRecordPresentFunction (PciRootBridgeIo, StartBusNumber, Device, Func);
+
       //
       // Get the PCI device information
       //
@@ -1288,6 +1292,8 @@ PciScanBus (
     }
   }
 
+  PciRecordScannedBus (PciRootBridgeIo, StartBusNumber);
+
   return EFI_SUCCESS;
 }
 
@@ -1448,9 +1454,11 @@ PciHostBridgeEnumerator (
   Status = NotifyPhase (PciResAlloc, EfiPciHostBridgeBeginBusAllocation);
 
   if (EFI_ERROR (Status)) {
-    return Status;
+    goto Done;
   }
 
+  PciStartScanPresence ();
+
   DEBUG((EFI_D_INFO, "PCI Bus First Scanning\n"));
   RootBridgeHandle = NULL;
   while (PciResAlloc->GetNextRootBridge (PciResAlloc, &RootBridgeHandle) == EFI_SUCCESS) {
@@ -1462,7 +1470,8 @@ PciHostBridgeEnumerator (
     RootBridgeDev = CreateRootBridge (RootBridgeHandle);
 
     if (RootBridgeDev == NULL) {
-      return EFI_OUT_OF_RESOURCES;
+      Status = EFI_OUT_OF_RESOURCES;
+      goto Done;
     }
 
     //
@@ -1479,7 +1488,7 @@ PciHostBridgeEnumerator (
       DestroyRootBridge (RootBridgeDev);
     }
     if (EFI_ERROR (Status)) {
-      return Status;
+      goto Done;
     }
   }
 
@@ -1506,7 +1515,7 @@ PciHostBridgeEnumerator (
                               (VOID **) &Configuration
                               );
       if (EFI_ERROR (Status)) {
-        return Status;
+        goto Done;
       }
 
       //
@@ -1531,7 +1540,7 @@ PciHostBridgeEnumerator (
 
     if (EFI_ERROR (Status)) {
       DEBUG ((EFI_D_ERROR, "Some root HPC failed to initialize\n"));
-      return Status;
+      goto Done;
     }
 
     //
@@ -1540,9 +1549,11 @@ PciHostBridgeEnumerator (
     Status = NotifyPhase (PciResAlloc, EfiPciHostBridgeBeginBusAllocation);
 
     if (EFI_ERROR (Status)) {
-      return Status;
+      goto Done;
     }
 
+    PciStartScanPresence ();
+
     DEBUG((EFI_D_INFO, "PCI Bus Second Scanning\n"));
     RootBridgeHandle = NULL;
     while (PciResAlloc->GetNextRootBridge (PciResAlloc, &RootBridgeHandle) == EFI_SUCCESS) {
@@ -1553,7 +1564,8 @@ PciHostBridgeEnumerator (
       RootBridgeDev = CreateRootBridge (RootBridgeHandle);
 
       if (RootBridgeDev == NULL) {
-        return EFI_OUT_OF_RESOURCES;
+        Status = EFI_OUT_OF_RESOURCES;
+        goto Done;
       }
 
       //
@@ -1566,7 +1578,7 @@ PciHostBridgeEnumerator (
 
       DestroyRootBridge (RootBridgeDev);
       if (EFI_ERROR (Status)) {
-        return Status;
+        goto Done;
       }
     }
 
@@ -1582,7 +1594,7 @@ PciHostBridgeEnumerator (
   Status = NotifyPhase (PciResAlloc, EfiPciHostBridgeBeginResourceAllocation);
 
   if (EFI_ERROR (Status)) {
-    return Status;
+    goto Done;
   }
 
   RootBridgeHandle = NULL;
@@ -1594,26 +1606,27 @@ PciHostBridgeEnumerator (
     RootBridgeDev = CreateRootBridge (RootBridgeHandle);
 
     if (RootBridgeDev == NULL) {
-      return EFI_OUT_OF_RESOURCES;
+      Status = EFI_OUT_OF_RESOURCES;
+      goto Done;
     }
 
     Status = StartManagingRootBridge (RootBridgeDev);
 
     if (EFI_ERROR (Status)) {
-      return Status;
+      goto Done;
     }
 
     PciRootBridgeIo = RootBridgeDev->PciRootBridgeIo;
     Status          = PciRootBridgeIo->Configuration (PciRootBridgeIo, (VOID **) &Descriptors);
 
     if (EFI_ERROR (Status)) {
-      return Status;
+      goto Done;
     }
 
     Status = PciGetBusRange (&Descriptors, &MinBus, NULL, NULL);
 
     if (EFI_ERROR (Status)) {
-      return Status;
+      goto Done;
     }
 
     //
@@ -1636,7 +1649,7 @@ PciHostBridgeEnumerator (
               );
 
     if (EFI_ERROR (Status)) {
-      return Status;
+      goto Done;
     }
 
     InsertRootBridge (RootBridgeDev);
@@ -1647,5 +1660,13 @@ PciHostBridgeEnumerator (
     AddHostBridgeEnumerator (RootBridgeDev->PciRootBridgeIo->ParentHandle);
   }
 
-  return EFI_SUCCESS;
+  Status = EFI_SUCCESS;
+
+Done:
+  //
+  // The functions found by the bus scan only hold for this enumeration
+  //
+  PciStopScanPresence ();
+
+  return Status;
 }
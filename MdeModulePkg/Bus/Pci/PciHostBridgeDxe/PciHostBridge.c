@@ -316,6 +316,66 @@ FreeMemorySpaceMap:
   return Status;
 }
 
+/**
+  Set the attributes of the MMIO apertures of a root bridge.
+
+  The apertures are handed to the Memory Space Attributes Protocol in one
+  call when it is available, so adjacent apertures update the page tables
+  once. Otherwise, or from the aperture the batch failed on, they are set one
+  by one through the DXE services.
+
+  @param MemorySpaceAttributes  The Memory Space Attributes Protocol, or NULL.
+  @param Ranges                 The apertures, in ascending address order.
+  @param RangeCount             The number of apertures in Ranges.
+**/
+VOID
+SetMemApertureAttributes (
+  IN EDKII_MEMORY_SPACE_ATTRIBUTES_PROTOCOL  *MemorySpaceAttributes,
+  IN EDKII_MEMORY_SPACE_ATTRIBUTES_RANGE     *Ranges,
+  IN UINTN                                   RangeCount
+  )
+{
+  EFI_STATUS                                 Status;
+  UINTN                                      Index;
+
+  if (RangeCount == 0) {
+    return;
+  }
+
+  Index = 0;
+  if (MemorySpaceAttributes != NULL) {
+    Status = MemorySpaceAttributes->SetMemorySpaceAttributesBatch (
+                                      MemorySpaceAttributes,
+                                      RangeCount,
+                                      Ranges,
+                                      &Index
+                                      );
+    if (!EFI_ERROR (Status)) {
+      return;
+    }
+    if (Index >= RangeCount) {
+      Index = 0;
+    }
+    //
+    // The apertures before Index may already be set, retry the rest one by one.
+    //
+    DEBUG ((DEBUG_WARN, "PciHostBridge driver failed to set EFI_MEMORY_UC to MMIO aperture [%lx, %lx) in a batch - %r.\n",
+      Ranges[Index].BaseAddress, Ranges[Index].BaseAddress + Ranges[Index].Length, Status));
+  }
+
+  for (; Index < RangeCount; Index++) {
+    Status = gDS->SetMemorySpaceAttributes (
+                    Ranges[Index].BaseAddress,
+                    Ranges[Index].Length,
+                    Ranges[Index].Attributes
+                    );
+    if (EFI_ERROR (Status)) {
+      DEBUG ((DEBUG_WARN, "PciHostBridge driver failed to set EFI_MEMORY_UC to MMIO aperture [%lx, %lx) - %r.\n",
+        Ranges[Index].BaseAddress, Ranges[Index].BaseAddress + Ranges[Index].Length, Status));
+    }
+  }
+}
+
 /**
   Event notification that is fired when IOMMU protocol is installed.
 
@@ -364,6 +424,10 @@ InitializePciHostBridge (
   UINTN                       Index;
   PCI_ROOT_BRIDGE_APERTURE    *MemApertures[4];
   UINTN                       MemApertureIndex;
+  EDKII_MEMORY_SPACE_ATTRIBUTES_PROTOCOL *MemorySpaceAttributes;
+  EDKII_MEMORY_SPACE_ATTRIBUTES_RANGE    MemRanges[ARRAY_SIZE (MemApertures)];
+  UINTN                       MemRangeCount;
+  UINTN                       MemRangeIndex;
   BOOLEAN                     ResourceAssigned;
   LIST_ENTRY                  *Link;
 
@@ -376,6 +440,10 @@ InitializePciHostBridge (
   ASSERT_EFI_ERROR (Status);
   Status = gBS->LocateProtocol (&gEfiCpuIo2ProtocolGuid, NULL, (VOID **) &mCpuIo);
   ASSERT_EFI_ERROR (Status);
+  Status = gBS->LocateProtocol (&gEdkiiMemorySpaceAttributesProtocolGuid, NULL, (VOID **) &MemorySpaceAttributes);
+  if (EFI_ERROR (Status)) {
+    MemorySpaceAttributes = NULL;
+  }
 
   //
   // Most systems in the world including complex servers have only one Host Bridge.
@@ -441,6 +509,7 @@ InitializePciHostBridge (
     MemApertures[2] = &RootBridges[Index].PMem;
     MemApertures[3] = &RootBridges[Index].PMemAbove4G;
 
+    MemRangeCount = 0;
     for (MemApertureIndex = 0; MemApertureIndex < ARRAY_SIZE (MemApertures); MemApertureIndex++) {
       if (MemApertures[MemApertureIndex]->Base <= MemApertures[MemApertureIndex]->Limit) {
         Status = AddMemoryMappedIoSpace (
@@ -449,14 +518,20 @@ InitializePciHostBridge (
                    EFI_MEMORY_UC
                    );
         ASSERT_EFI_ERROR (Status);
-        Status = gDS->SetMemorySpaceAttributes (
-                        MemApertures[MemApertureIndex]->Base,
-                        MemApertures[MemApertureIndex]->Limit - MemApertures[MemApertureIndex]->Base + 1,
-                        EFI_MEMORY_UC
-                        );
-        if (EFI_ERROR (Status)) {
-          DEBUG ((DEBUG_WARN, "PciHostBridge driver failed to set EFI_MEMORY_UC to MMIO aperture - %r.\n", Status));
+
+        //
+        // Keep the ranges sorted by address so adjacent apertures are merged
+        //
+        for (MemRangeIndex = MemRangeCount;
+             MemRangeIndex > 0 && MemRanges[MemRangeIndex - 1].BaseAddress > MemApertures[MemApertureIndex]->Base;
+             MemRangeIndex--) {
+          MemRanges[MemRangeIndex] = MemRanges[MemRangeIndex - 1];
         }
+        MemRanges[MemRangeIndex].BaseAddress = MemApertures[MemApertureIndex]->Base;
+        MemRanges[MemRangeIndex].Length      = MemApertures[MemApertureIndex]->Limit - MemApertures[MemApertureIndex]->Base + 1;
+        MemRanges[MemRangeIndex].Attributes  = EFI_MEMORY_UC;
+        MemRangeCount++;
+
         if (ResourceAssigned) {
           Status = gDS->AllocateMemorySpace (
                           EfiGcdAllocateAddress,
@@ -471,6 +546,8 @@ InitializePciHostBridge (
         }
       }
     }
+    SetMemApertureAttributes (MemorySpaceAttributes, MemRanges, MemRangeCount);
+
     //
     // Insert Root Bridge Handle Instance
     //
@@ -81,6 +81,11 @@ typedef struct _USB_DEV_CONTEXT      USB_DEV_CONTEXT;
 #define TR_RING_TRB_NUMBER           0x100
 #define ERST_NUMBER                  0x01
 #define EVENT_RING_TRB_NUMBER        0x200
+//
+// The largest data buffer of a transfer TRB. It can't cross a 64KB
+// boundary either.
+//
+#define XHC_TRB_MAX_DATA_LENGTH      SIZE_64KB
 
 #define CMD_INTER                    0
 #define CTRL_INTER                   1
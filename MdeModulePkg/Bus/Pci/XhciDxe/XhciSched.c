@@ -209,6 +209,32 @@ XhcFreeUrb (
   FreePool (Urb);
 }
 
+/**
+  Calculate the TD Size field of a Normal TRB: the number of packets the TD
+  still has to move after the TRB, as defined by XHCI 1.0.
+
+  @param  Remaining The length of the data after the TRB.
+  @param  MaxPacket The max packet length of the endpoint.
+
+  @return The TD Size, limited to 31.
+
+**/
+UINT32
+XhcTdSize (
+  IN UINTN                      Remaining,
+  IN UINTN                      MaxPacket
+  )
+{
+  UINTN                         Packets;
+
+  if ((Remaining == 0) || (MaxPacket == 0)) {
+    return 0;
+  }
+
+  Packets = (Remaining + MaxPacket - 1) / MaxPacket;
+  return (UINT32) MIN (Packets, 31);
+}
+
 /**
   Create a transfer TRB.
 
@@ -244,8 +270,6 @@ XhcCreateTransferTrb (
   }
 
   Urb->Finished  = FALSE;
-  Urb->StartDone = FALSE;
-  Urb->EndDone   = FALSE;
   Urb->Completed = 0;
   Urb->Result    = EFI_USB_NOERROR;
 
@@ -377,60 +401,38 @@ XhcCreateTransferTrb (
 
     case ED_BULK_OUT:
     case ED_BULK_IN:
-      TotalLen = 0;
-      Len      = 0;
-      TrbNum   = 0;
-      TrbStart = (TRB *)(UINTN)EPRing->RingEnqueue;
-      while (TotalLen < Urb->DataLen) {
-        if ((TotalLen + 0x10000) >= Urb->DataLen) {
-          Len = Urb->DataLen - TotalLen;
-        } else {
-          Len = 0x10000;
-        }
-        TrbStart = (TRB *)(UINTN)EPRing->RingEnqueue;
-        TrbStart->TrbNormal.TRBPtrLo  = XHC_LOW_32BIT((UINT8 *) Urb->DataPhy + TotalLen);
-        TrbStart->TrbNormal.TRBPtrHi  = XHC_HIGH_32BIT((UINT8 *) Urb->DataPhy + TotalLen);
-        TrbStart->TrbNormal.Length    = (UINT32) Len;
-        TrbStart->TrbNormal.TDSize    = 0;
-        TrbStart->TrbNormal.IntTarget = 0;
-        TrbStart->TrbNormal.ISP       = 1;
-        TrbStart->TrbNormal.IOC       = 1;
-        TrbStart->TrbNormal.Type      = TRB_TYPE_NORMAL;
-        //
-        // Update the cycle bit
-        //
-        TrbStart->TrbNormal.CycleBit = EPRing->RingPCS & BIT0;
-
-        XhcSyncTrsRing (Xhc, EPRing);
-        TrbNum++;
-        TotalLen += Len;
-      }
-
-      Urb->TrbNum = TrbNum;
-      Urb->TrbEnd = (TRB_TEMPLATE *)(UINTN)TrbStart;
-      break;
-
     case ED_INTERRUPT_OUT:
     case ED_INTERRUPT_IN:
+      //
+      // Build the whole transfer as one TD of chained Normal TRBs, so the
+      // controller moves it without pausing and reports it with one event.
+      // A data buffer can't cross a 64KB boundary, so split the data there.
+      // The ISP flag reports a short packet at the TRB where it happens.
+      //
       TotalLen = 0;
       Len      = 0;
       TrbNum   = 0;
       TrbStart = (TRB *)(UINTN)EPRing->RingEnqueue;
       while (TotalLen < Urb->DataLen) {
-        if ((TotalLen + 0x10000) >= Urb->DataLen) {
+        Len = XHC_TRB_MAX_DATA_LENGTH - (((UINTN) Urb->DataPhy + TotalLen) & (XHC_TRB_MAX_DATA_LENGTH - 1));
+        if (Len > Urb->DataLen - TotalLen) {
           Len = Urb->DataLen - TotalLen;
-        } else {
-          Len = 0x10000;
         }
         TrbStart = (TRB *)(UINTN)EPRing->RingEnqueue;
         TrbStart->TrbNormal.TRBPtrLo  = XHC_LOW_32BIT((UINT8 *) Urb->DataPhy + TotalLen);
         TrbStart->TrbNormal.TRBPtrHi  = XHC_HIGH_32BIT((UINT8 *) Urb->DataPhy + TotalLen);
         TrbStart->TrbNormal.Length    = (UINT32) Len;
-        TrbStart->TrbNormal.TDSize    = 0;
+        TrbStart->TrbNormal.TDSize    = XhcTdSize (Urb->DataLen - TotalLen - Len, Urb->Ep.MaxPacket);
         TrbStart->TrbNormal.IntTarget = 0;
         TrbStart->TrbNormal.ISP       = 1;
-        TrbStart->TrbNormal.IOC       = 1;
         TrbStart->TrbNormal.Type      = TRB_TYPE_NORMAL;
+        if (TotalLen + Len < Urb->DataLen) {
+          TrbStart->TrbNormal.CH      = 1;
+          TrbStart->TrbNormal.IOC     = 0;
+        } else {
+          TrbStart->TrbNormal.CH      = 0;
+          TrbStart->TrbNormal.IOC     = 1;
+        }
         //
         // Update the cycle bit
         //
@@ -1073,6 +1075,9 @@ IsAsyncIntTrb (
   Check the URB's execution result and update the URB's
   result accordingly.
 
+  All the new events on the event ring are handled, so the URBs they belong
+  to, other than the checked one, get their results updated as well.
+
   @param  Xhc             The XHCI Instance.
   @param  Urb             The URB to check result.
 
@@ -1092,10 +1097,8 @@ XhcCheckUrbResult (
   EFI_STATUS              Status;
   URB                     *AsyncUrb;
   URB                     *CheckedUrb;
-  UINT64                  XhcDequeue;
-  UINT32                  High;
-  UINT32                  Low;
   EFI_PHYSICAL_ADDRESS    PhyAddr;
+  EFI_PHYSICAL_ADDRESS    DataPhy;
 
   ASSERT ((Xhc != NULL) && (Urb != NULL));
 
@@ -1103,14 +1106,21 @@ XhcCheckUrbResult (
   AsyncUrb = NULL;
 
   if (Urb->Finished) {
-    goto EXIT;
+    return TRUE;
   }
 
   EvtTrb = NULL;
 
-  if (XhcIsHalt (Xhc) || XhcIsSysError (Xhc)) {
-    Urb->Result |= EFI_USB_ERR_SYSTEM;
-    goto EXIT;
+  //
+  // The controller reports all the progress through the event ring in
+  // memory. Only when it has nothing new, the controller is asked whether
+  // it still runs.
+  //
+  if (!XhcIsEventPending (Xhc, &Xhc->EventRing)) {
+    if (XhcIsHalt (Xhc) || XhcIsSysError (Xhc)) {
+      Urb->Result |= EFI_USB_ERR_SYSTEM;
+    }
+    return FALSE;
   }
 
   //
@@ -1121,9 +1131,9 @@ XhcCheckUrbResult (
     Status = XhcCheckNewEvent (Xhc, &Xhc->EventRing, ((TRB_TEMPLATE **)&EvtTrb));
     if (Status == EFI_NOT_READY) {
       //
-      // All new events are handled, return directly.
+      // All new events are handled.
       //
-      goto EXIT;
+      break;
     }
 
     //
@@ -1154,31 +1164,39 @@ XhcCheckUrbResult (
     } else {
       continue;
     }
+
+    //
+    // A TD stopped by a short packet may still report its last TRB, which
+    // has nothing more to tell.
+    //
+    if (CheckedUrb->Finished) {
+      continue;
+    }
   
     switch (EvtTrb->Completecode) {
       case TRB_COMPLETION_STALL_ERROR:
         CheckedUrb->Result  |= EFI_USB_ERR_STALL;
         CheckedUrb->Finished = TRUE;
         DEBUG ((EFI_D_ERROR, "XhcCheckUrbResult: STALL_ERROR! Completecode = %x\n",EvtTrb->Completecode));
-        goto EXIT;
+        continue;
 
       case TRB_COMPLETION_BABBLE_ERROR:
         CheckedUrb->Result  |= EFI_USB_ERR_BABBLE;
         CheckedUrb->Finished = TRUE;
         DEBUG ((EFI_D_ERROR, "XhcCheckUrbResult: BABBLE_ERROR! Completecode = %x\n",EvtTrb->Completecode));
-        goto EXIT;
+        continue;
 
       case TRB_COMPLETION_DATA_BUFFER_ERROR:
         CheckedUrb->Result  |= EFI_USB_ERR_BUFFER;
         CheckedUrb->Finished = TRUE;
         DEBUG ((EFI_D_ERROR, "XhcCheckUrbResult: ERR_BUFFER! Completecode = %x\n",EvtTrb->Completecode));
-        goto EXIT;
+        continue;
 
       case TRB_COMPLETION_USB_TRANSACTION_ERROR:
         CheckedUrb->Result  |= EFI_USB_ERR_TIMEOUT;
         CheckedUrb->Finished = TRUE;
         DEBUG ((EFI_D_ERROR, "XhcCheckUrbResult: TRANSACTION_ERROR! Completecode = %x\n",EvtTrb->Completecode));
-        goto EXIT;
+        continue;
 
       case TRB_COMPLETION_STOPPED:
       case TRB_COMPLETION_STOPPED_LENGTH_INVALID:
@@ -1196,61 +1214,55 @@ XhcCheckUrbResult (
           DEBUG ((EFI_D_VERBOSE, "XhcCheckUrbResult: short packet happens!\n"));
         }
 
+        //
+        // The event reports the TRB that completed the data. All the data
+        // before the buffer of this TRB is done as well, since the TRBs of
+        // a transfer describe its buffer in order.
+        //
         TRBType = (UINT8) (TRBPtr->Type);
         if ((TRBType == TRB_TYPE_DATA_STAGE) ||
             (TRBType == TRB_TYPE_NORMAL) ||
             (TRBType == TRB_TYPE_ISOCH)) {
-          CheckedUrb->Completed += (((TRANSFER_TRB_NORMAL*)TRBPtr)->Length - EvtTrb->Length);
+          DataPhy = (EFI_PHYSICAL_ADDRESS)(TRBPtr->Parameter1 | LShiftU64 ((UINT64) TRBPtr->Parameter2, 32));
+          CheckedUrb->Completed = (UINTN) (DataPhy - (UINTN) CheckedUrb->DataPhy) +
+                                  ((TRANSFER_TRB_NORMAL*)TRBPtr)->Length - EvtTrb->Length;
         }
 
+        //
+        // A short packet ends the chained TD of a bulk or interrupt transfer.
+        // The status stage of a control transfer still follows it.
+        //
+        if ((EvtTrb->Completecode == TRB_COMPLETION_SHORT_PACKET) && (TRBType == TRB_TYPE_NORMAL)) {
+          CheckedUrb->Finished = TRUE;
+          CheckedUrb->EvtTrb   = (TRB_TEMPLATE *)EvtTrb;
+        }
         break;
 
       default:
         DEBUG ((EFI_D_ERROR, "Transfer Default Error Occur! Completecode = 0x%x!\n",EvtTrb->Completecode));
         CheckedUrb->Result  |= EFI_USB_ERR_TIMEOUT;
         CheckedUrb->Finished = TRUE;
-        goto EXIT;
+        continue;
     }
 
     //
-    // Only check first and end Trb event address
+    // The last TRB of the URB is the only one left to report
     //
-    if (TRBPtr == CheckedUrb->TrbStart) {
-      CheckedUrb->StartDone = TRUE;
-    }
-
     if (TRBPtr == CheckedUrb->TrbEnd) {
-      CheckedUrb->EndDone = TRUE;
-    }
-
-    if (CheckedUrb->StartDone && CheckedUrb->EndDone) {
       CheckedUrb->Finished = TRUE;
       CheckedUrb->EvtTrb   = (TRB_TEMPLATE *)EvtTrb;
     }
   }
 
-EXIT:
-
   //
   // Advance event ring to last available entry
   //
   // Some 3rd party XHCI external cards don't support single 64-bytes width register access,
   // So divide it to two 32-bytes width register access.
   //
-  Low  = XhcReadRuntimeReg (Xhc, XHC_ERDP_OFFSET);
-  High = XhcReadRuntimeReg (Xhc, XHC_ERDP_OFFSET + 4);
-  XhcDequeue = (UINT64)(LShiftU64((UINT64)High, 32) | Low);
-
   PhyAddr = UsbHcGetPciAddrForHostAddr (Xhc->MemPool, Xhc->EventRing.EventRingDequeue, sizeof (TRB_TEMPLATE));
-
-  if ((XhcDequeue & (~0x0F)) != (PhyAddr & (~0x0F))) {
-    //
-    // Some 3rd party XHCI external cards don't support single 64-bytes width register access,
-    // So divide it to two 32-bytes width register access.
-    //
-    XhcWriteRuntimeReg (Xhc, XHC_ERDP_OFFSET, XHC_LOW_32BIT (PhyAddr) | BIT3);
-    XhcWriteRuntimeReg (Xhc, XHC_ERDP_OFFSET + 4, XHC_HIGH_32BIT (PhyAddr));
-  }
+  XhcWriteRuntimeReg (Xhc, XHC_ERDP_OFFSET, XHC_LOW_32BIT (PhyAddr) | BIT3);
+  XhcWriteRuntimeReg (Xhc, XHC_ERDP_OFFSET + 4, XHC_HIGH_32BIT (PhyAddr));
 
   return Urb->Finished;
 }
@@ -1304,10 +1316,17 @@ XhcExecTransfer (
 
   XhcRingDoorBell (Xhc, SlotId, Dci);
 
+  //
+  // The whole transfer is reported by the event of its last TRB. Poll the
+  // event ring in memory for it, and let XhcCheckUrbResult () look at the
+  // controller registers only once a millisecond while nothing happens.
+  //
   for (Index = 0; Index < Loop; Index++) {
-    Finished = XhcCheckUrbResult (Xhc, Urb);
-    if (Finished) {
-      break;
+    if (XhcIsEventPending (Xhc, &Xhc->EventRing) || ((Index % XHC_1_MILLISECOND) == 0)) {
+      Finished = XhcCheckUrbResult (Xhc, Urb);
+      if (Finished) {
+        break;
+      }
     }
     gBS->Stall (XHC_1_MICROSECOND);
   }
@@ -1522,6 +1541,14 @@ XhcMonitorAsyncRequests (
   EFI_LIST_FOR_EACH_SAFE (Entry, Next, &Xhc->AsyncIntTransfers) {
     Urb = EFI_LIST_CONTAINER (Entry, URB, UrbList);
 
+    //
+    // Nothing can have changed for the URB if it isn't finished yet and the
+    // event ring has no new event, so the idle check touches memory only.
+    //
+    if (!Urb->Finished && !XhcIsEventPending (Xhc, &Xhc->EventRing)) {
+      continue;
+    }
+
     //
     // Make sure that the device is available before every check.
     //
@@ -1863,6 +1890,11 @@ XhcSyncTrsRing (
       //
       ((LINK_TRB*)TrsTrb)->CycleBit = TrsRing->RingPCS & BIT0;
       //
+      // A TD may wrap around the ring, then the Link TRB is part of it and
+      // has to carry the chain flag of the TRB before it.
+      //
+      ((LINK_TRB*)TrsTrb)->CH = ((TRANSFER_TRB_NORMAL *) (TrsTrb - 1))->CH;
+      //
       // Toggle PCS maintained by software
       //
       TrsRing->RingPCS = (TrsRing->RingPCS & BIT0) ? 0 : 1;
@@ -1927,6 +1959,36 @@ XhcCheckNewEvent (
   return EFI_SUCCESS;
 }
 
+/**
+  Check if the event ring has events that are not handled yet. Only the
+  event ring in memory is read, so it is cheap to poll.
+
+  @param  Xhc           The XHCI Instance.
+  @param  EvtRing       The event ring to check.
+
+  @retval TRUE          The event ring has new events.
+  @retval FALSE         The event ring has no new event.
+
+**/
+BOOLEAN
+XhcIsEventPending (
+  IN  USB_XHCI_INSTANCE       *Xhc,
+  IN  EVENT_RING              *EvtRing
+  )
+{
+  ASSERT (EvtRing != NULL);
+
+  //
+  // The controller owns the TRB at the enqueue pointer until it writes an
+  // event there with the cycle bit software expects.
+  //
+  if (EvtRing->EventRingDequeue != EvtRing->EventRingEnqueue) {
+    return TRUE;
+  }
+
+  return (BOOLEAN) (EvtRing->EventRingEnqueue->CycleBit == EvtRing->EventRingCCS);
+}
+
 /**
   Ring the door bell to notify XHCI there is a transaction to be executed.
 
@@ -193,8 +193,6 @@ typedef struct _URB {
   TRB_TEMPLATE                    *TrbStart;
   TRB_TEMPLATE                    *TrbEnd;
   UINTN                           TrbNum;
-  BOOLEAN                         StartDone;
-  BOOLEAN                         EndDone;
   BOOLEAN                         Finished;
 
   TRB_TEMPLATE                    *EvtTrb;
@@ -1270,6 +1268,23 @@ XhcCheckNewEvent (
   OUT TRB_TEMPLATE            **NewEvtTrb
   );
 
+/**
+  Check if the event ring has events that are not handled yet. Only the
+  event ring in memory is read, so it is cheap to poll.
+
+  @param  Xhc           The XHCI Instance.
+  @param  EvtRing       The event ring to check.
+
+  @retval TRUE          The event ring has new events.
+  @retval FALSE         The event ring has no new event.
+
+**/
+BOOLEAN
+XhcIsEventPending (
+  IN  USB_XHCI_INSTANCE       *Xhc,
+  IN  EVENT_RING              *EvtRing
+  );
+
 /**
   Create XHCI transfer ring.
 
@@ -1447,6 +1462,22 @@ XhcFreeUrb (
   IN URB                  *Urb
   );
 
+/**
+  Calculate the TD Size field of a Normal TRB: the number of packets the TD
+  still has to move after the TRB, as defined by XHCI 1.0.
+
+  @param  Remaining The length of the data after the TRB.
+  @param  MaxPacket The max packet length of the endpoint.
+
+  @return The TD Size, limited to 31.
+
+**/
+UINT32
+XhcTdSize (
+  IN UINTN                      Remaining,
+  IN UINTN                      MaxPacket
+  );
+
 /**
   Create a transfer TRB.
 
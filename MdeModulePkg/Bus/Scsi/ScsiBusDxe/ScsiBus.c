@@ -498,43 +498,30 @@ SCSIBusDriverBindingStart (
     ScanOtherPuns = FALSE;
   }
 
-  while(ScanOtherPuns) {
-    if (FromFirstTarget) {
-      //
-      // Remaining Device Path is NULL, scan all the possible Puns in the
-      // SCSI Channel.
-      //
-      if (ScsiBusDev->ExtScsiSupport) {
-        Status = ScsiBusDev->ExtScsiInterface->GetNextTargetLun (ScsiBusDev->ExtScsiInterface, &TargetId, &Lun);
-      } else {
-        Status = ScsiBusDev->ScsiInterface->GetNextDevice (ScsiBusDev->ScsiInterface, &ScsiTargetId.ScsiId.Scsi, &Lun);
-      }
-      if (EFI_ERROR (Status)) {
-        //
-        // no legal Pun and Lun found any more
-        //
-        break;
-      }
-    } else {
-      ScanOtherPuns = FALSE;
-    }
+  if (FromFirstTarget) {
+    //
+    // Remaining Device Path is NULL, scan all the possible Puns in the
+    // SCSI Channel.
+    //
+    ScsiBusScanAllDevices (This, Controller, ScsiBusDev);
+  } else if (ScanOtherPuns) {
     //
     // Avoid creating handle for the host adapter.
     //
     if (ScsiBusDev->ExtScsiSupport) {
       if ((ScsiTargetId.ScsiId.Scsi) == ScsiBusDev->ExtScsiInterface->Mode->AdapterId) {
-        continue;
+        return EFI_SUCCESS;
       }
     } else {
       if ((ScsiTargetId.ScsiId.Scsi) == ScsiBusDev->ScsiInterface->Mode->AdapterId) {
-        continue;
+        return EFI_SUCCESS;
       }
     }
     //
     // Scan for the scsi device, if it attaches to the scsi bus,
     // then create handle and install scsi i/o protocol.
     //
-    Status = ScsiScanCreateDevice (This, Controller, &ScsiTargetId, Lun, ScsiBusDev);
+    ScsiScanCreateDevice (This, Controller, &ScsiTargetId, Lun, ScsiBusDev, NULL);
   }
   return EFI_SUCCESS;
 
@@ -1108,6 +1095,8 @@ ScsiExecuteSCSICommand (
   @param  TargetId       Tartget to be scanned
   @param  Lun            The Lun of the SCSI device on the SCSI channel.
   @param  ScsiBusDev     The pointer of SCSI_BUS_DEVICE
+  @param  InquiryData    The INQUIRY data already returned by the device, or
+                         NULL to send the INQUIRY command.
 
   @retval EFI_SUCCESS           Successfully to discover the device and attach
                                 ScsiIoProtocol to it.
@@ -1121,7 +1110,8 @@ ScsiScanCreateDevice (
   IN     EFI_HANDLE                    Controller,
   IN     SCSI_TARGET_ID                *TargetId,
   IN     UINT64                        Lun,
-  IN OUT SCSI_BUS_DEVICE               *ScsiBusDev
+  IN OUT SCSI_BUS_DEVICE               *ScsiBusDev,
+  IN     EFI_SCSI_INQUIRY_DATA         *InquiryData  OPTIONAL
   )
 {
   EFI_STATUS                Status;
@@ -1217,7 +1207,7 @@ ScsiScanCreateDevice (
     ScsiBusDev->DevicePath
     );
 
-  if (!DiscoverScsiDevice (ScsiIoDevice)) {
+  if (!DiscoverScsiDevice (ScsiIoDevice, InquiryData)) {
     Status = EFI_OUT_OF_RESOURCES;
     goto ErrorExit;
   }
@@ -1282,6 +1272,8 @@ ErrorExit:
   Discovery SCSI Device
 
   @param  ScsiIoDevice    The pointer of SCSI_IO_DEV
+  @param  KnownInquiry    The INQUIRY data already returned by the device, or
+                          NULL to send the INQUIRY command.
 
   @retval  TRUE   Find SCSI Device and verify it.
   @retval  FALSE  Unable to find SCSI Device.
@@ -1289,7 +1281,8 @@ ErrorExit:
 **/
 BOOLEAN
 DiscoverScsiDevice (
-  IN OUT  SCSI_IO_DEV   *ScsiIoDevice
+  IN OUT  SCSI_IO_DEV            *ScsiIoDevice,
+  IN      EFI_SCSI_INQUIRY_DATA  *KnownInquiry  OPTIONAL
   )
 {
   EFI_STATUS            Status;
@@ -1330,42 +1323,49 @@ DiscoverScsiDevice (
   ZeroMem (InquiryData, InquiryDataLength);
   ZeroMem (SenseData, SenseDataLength);
 
-  MaxRetry = 2;
-  for (Index = 0; Index < MaxRetry; Index++) {
-    Status = ScsiInquiryCommand (
-              &ScsiIoDevice->ScsiIo,
-              SCSI_BUS_TIMEOUT,
-              SenseData,
-              &SenseDataLength,
-              &HostAdapterStatus,
-              &TargetStatus,
-              (VOID *) InquiryData,
-              &InquiryDataLength,
-              FALSE
-              );
-    if (!EFI_ERROR (Status)) {
-      if ((HostAdapterStatus == EFI_SCSI_IO_STATUS_HOST_ADAPTER_OK) &&
-          (TargetStatus == EFI_SCSI_IO_STATUS_TARGET_CHECK_CONDITION) &&
-          (SenseData->Error_Code == 0x70) &&
-          (SenseData->Sense_Key == EFI_SCSI_SK_ILLEGAL_REQUEST)) {
+  if (KnownInquiry != NULL) {
+    //
+    // The bus scan has already sent the INQUIRY command.
+    //
+    CopyMem (InquiryData, KnownInquiry, sizeof (EFI_SCSI_INQUIRY_DATA));
+  } else {
+    MaxRetry = 2;
+    for (Index = 0; Index < MaxRetry; Index++) {
+      Status = ScsiInquiryCommand (
+                &ScsiIoDevice->ScsiIo,
+                SCSI_BUS_TIMEOUT,
+                SenseData,
+                &SenseDataLength,
+                &HostAdapterStatus,
+                &TargetStatus,
+                (VOID *) InquiryData,
+                &InquiryDataLength,
+                FALSE
+                );
+      if (!EFI_ERROR (Status)) {
+        if ((HostAdapterStatus == EFI_SCSI_IO_STATUS_HOST_ADAPTER_OK) &&
+            (TargetStatus == EFI_SCSI_IO_STATUS_TARGET_CHECK_CONDITION) &&
+            (SenseData->Error_Code == 0x70) &&
+            (SenseData->Sense_Key == EFI_SCSI_SK_ILLEGAL_REQUEST)) {
+          ScsiDeviceFound = FALSE;
+          goto Done;
+        }
+        break;
+      }
+      if ((Status == EFI_BAD_BUFFER_SIZE) ||
+          (Status == EFI_INVALID_PARAMETER) ||
+          (Status == EFI_UNSUPPORTED)) {
         ScsiDeviceFound = FALSE;
         goto Done;
       }
-      break;
     }
-    if ((Status == EFI_BAD_BUFFER_SIZE) ||
-        (Status == EFI_INVALID_PARAMETER) ||
-        (Status == EFI_UNSUPPORTED)) {
+
+    if (Index == MaxRetry) {
       ScsiDeviceFound = FALSE;
       goto Done;
     }
   }
 
-  if (Index == MaxRetry) {
-    ScsiDeviceFound = FALSE;
-    goto Done;
-  }
-  
   //
   // Retrieved inquiry data successfully
   //
@@ -16,7 +16,7 @@ WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
 #define _SCSI_BUS_H_
 
 
-#include <Uefi.h>
+#include <PiDxe.h>
 
 #include <Protocol/ScsiPassThru.h>
 #include <Protocol/ScsiPassThruExt.h>
@@ -25,6 +25,8 @@ WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
 #include <Protocol/DriverBinding.h>
 #include <Protocol/DevicePath.h>
 
+#include <Guid/StorageBusDiscovery.h>
+
 #include <Library/DebugLib.h>
 #include <Library/UefiDriverEntryPoint.h>
 #include <Library/UefiLib.h>
@@ -34,6 +36,10 @@ WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
 #include <Library/UefiBootServicesTableLib.h>
 #include <Library/DevicePathLib.h>
 #include <Library/ReportStatusCodeLib.h>
+#include <Library/HobLib.h>
+#include <Library/PcdLib.h>
+#include <Library/PrintLib.h>
+#include <Library/UefiRuntimeServicesTableLib.h>
 
 #include <IndustryStandard/Scsi.h>
 
@@ -65,6 +71,25 @@ typedef struct {
 //
 #define SCSI_BUS_TIMEOUT           EFI_TIMER_PERIOD_SECONDS (3)
 
+//
+// The number of INQUIRY commands the bus scan keeps outstanding on a pass thru
+// that supports non-blocking I/O, the number of times an unanswered INQUIRY is
+// sent, as DiscoverScsiDevice() does, and the interval in microseconds at
+// which the outstanding commands are polled.
+//
+#define SCSI_BUS_MAX_PROBES        32
+#define SCSI_BUS_PROBE_ATTEMPTS    2
+#define SCSI_BUS_PROBE_POLL_PERIOD 10
+
+#define EFI_SCSI_OP_LENGTH_SIX     0x6
+
+//
+// The prefix of the discovery cache variable names, see
+// Guid/StorageBusDiscovery.h. The CRC32 of the controller device path follows.
+//
+#define SCSI_BUS_DISCOVERY_VARIABLE_PREFIX  L"ScsiBus"
+#define SCSI_BUS_DISCOVERY_VARIABLE_LENGTH  16
+
 //
 // The ScsiBusProtocol is just used to locate ScsiBusDev
 // structure in the SCSIBusDriverBindingStop(). Then we can
@@ -105,6 +130,38 @@ typedef struct {
 
 #define SCSI_IO_DEV_FROM_THIS(a)  CR (a, SCSI_IO_DEV, ScsiIo, SCSI_IO_DEV_SIGNATURE)
 
+typedef enum {
+  ScsiBusProbePending,        // INQUIRY to be sent
+  ScsiBusProbeInFlight,       // INQUIRY outstanding
+  ScsiBusProbePresent,        // InquiryData is valid
+  ScsiBusProbeAbsent,         // no device, or the device is not supported
+  ScsiBusProbeUnknown         // left to DiscoverScsiDevice()
+} SCSI_BUS_PROBE_STATE;
+
+//
+// A device address found by the bus scan, and what the scan learned about it.
+//
+typedef struct {
+  SCSI_TARGET_ID                     TargetId;
+  UINT64                             Lun;
+  SCSI_BUS_PROBE_STATE               State;
+  UINTN                              Attempts;
+  EFI_SCSI_INQUIRY_DATA              InquiryData;
+} SCSI_BUS_PROBE;
+
+//
+// An outstanding non-blocking INQUIRY command of the bus scan. The data
+// buffers satisfy the IoAlign requirement of the pass thru.
+//
+typedef struct {
+  SCSI_BUS_PROBE                             *Probe;
+  EFI_EVENT                                  Event;
+  EFI_EXT_SCSI_PASS_THRU_SCSI_REQUEST_PACKET Packet;
+  UINT8                                      Cdb[EFI_SCSI_OP_LENGTH_SIX];
+  EFI_SCSI_INQUIRY_DATA                      *InquiryData;
+  EFI_SCSI_SENSE_DATA                        *SenseData;
+} SCSI_BUS_PROBE_SLOT;
+
 //
 // Global Variables
 //
@@ -459,6 +516,8 @@ ScsiExecuteSCSICommand (
   @param  TargetId       Tartget to be scanned
   @param  Lun            The Lun of the SCSI device on the SCSI channel.
   @param  ScsiBusDev     The pointer of SCSI_BUS_DEVICE
+  @param  InquiryData    The INQUIRY data already returned by the device, or
+                         NULL to send the INQUIRY command.
 
   @retval EFI_SUCCESS           Successfully to discover the device and attach
                                 ScsiIoProtocol to it.
@@ -472,13 +531,16 @@ ScsiScanCreateDevice (
   IN     EFI_HANDLE                    Controller,
   IN     SCSI_TARGET_ID                *TargetId,
   IN     UINT64                        Lun,
-  IN OUT SCSI_BUS_DEVICE               *ScsiBusDev
+  IN OUT SCSI_BUS_DEVICE               *ScsiBusDev,
+  IN     EFI_SCSI_INQUIRY_DATA         *InquiryData  OPTIONAL
   );
 
 /**
   Discovery SCSI Device
 
   @param  ScsiIoDevice    The pointer of SCSI_IO_DEV
+  @param  KnownInquiry    The INQUIRY data already returned by the device, or
+                          NULL to send the INQUIRY command.
 
   @retval  TRUE   Find SCSI Device and verify it.
   @retval  FALSE  Unable to find SCSI Device.
@@ -486,7 +548,30 @@ ScsiScanCreateDevice (
 **/
 BOOLEAN
 DiscoverScsiDevice (
-  IN  OUT  SCSI_IO_DEV   *ScsiIoDevice
+  IN  OUT  SCSI_IO_DEV            *ScsiIoDevice,
+  IN       EFI_SCSI_INQUIRY_DATA  *KnownInquiry  OPTIONAL
+  );
+
+/**
+  Scan all the devices on the SCSI channel, and attach ScsiIoProtocol to the
+  ones that are found.
+
+  If the pass thru supports non-blocking I/O, the INQUIRY commands are sent to
+  up to SCSI_BUS_MAX_PROBES devices at a time, so the timeouts of empty targets
+  overlap. If PcdStorageBusDiscoveryCache is set, the devices found are
+  remembered, and on a boot assuming no configuration changes only those are
+  probed.
+
+  @param  This           Protocol instance pointer
+  @param  Controller     Controller handle
+  @param  ScsiBusDev     The pointer of SCSI_BUS_DEVICE
+
+**/
+VOID
+ScsiBusScanAllDevices (
+  IN     EFI_DRIVER_BINDING_PROTOCOL   *This,
+  IN     EFI_HANDLE                    Controller,
+  IN OUT SCSI_BUS_DEVICE               *ScsiBusDev
   );
 
 #endif
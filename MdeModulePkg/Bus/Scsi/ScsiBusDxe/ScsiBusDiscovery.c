@@ -0,0 +1,587 @@
+/** @file
+  Bus scan of the SCSI Bus Driver: probes the devices on the SCSI channel with
+  overlapping INQUIRY commands, and keeps the discovery cache.
+
+Copyright (c) 2017, Intel Corporation. All rights reserved.<BR>
+This program and the accompanying materials
+are licensed and made available under the terms and conditions of the BSD License
+which accompanies this distribution.  The full text of the license may be found at
+http://opensource.org/licenses/bsd-license.php
+
+THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+**/
+
+#include "ScsiBus.h"
+
+/**
+  Read the discovery cache variable of a SCSI controller.
+
+  @param  ScsiBusDev     The pointer of SCSI_BUS_DEVICE
+  @param  VariableName   Returns the name of the variable of the controller.
+                         The buffer holds SCSI_BUS_DISCOVERY_VARIABLE_LENGTH
+                         characters.
+
+  @return The cache of the controller, allocated from pool, or NULL if there is
+          no valid cache for it.
+
+**/
+EDKII_STORAGE_BUS_DISCOVERY *
+ScsiBusGetDiscoveryCache (
+  IN  SCSI_BUS_DEVICE                 *ScsiBusDev,
+  OUT CHAR16                          *VariableName
+  )
+{
+  EFI_STATUS                          Status;
+  UINTN                               DevicePathSize;
+  UINT32                              Crc;
+  EDKII_STORAGE_BUS_DISCOVERY         *Cache;
+  UINTN                               CacheSize;
+
+  DevicePathSize = GetDevicePathSize (ScsiBusDev->DevicePath);
+  Crc = 0;
+  gBS->CalculateCrc32 (ScsiBusDev->DevicePath, DevicePathSize, &Crc);
+  UnicodeSPrint (
+    VariableName,
+    SCSI_BUS_DISCOVERY_VARIABLE_LENGTH * sizeof (CHAR16),
+    L"%s%08X",
+    SCSI_BUS_DISCOVERY_VARIABLE_PREFIX,
+    Crc
+    );
+
+  Cache  = NULL;
+  Status = GetVariable2 (VariableName, &gEdkiiStorageBusDiscoveryGuid, (VOID **) &Cache, &CacheSize);
+  if (EFI_ERROR (Status)) {
+    return NULL;
+  }
+
+  if ((CacheSize < sizeof (EDKII_STORAGE_BUS_DISCOVERY)) ||
+      (Cache->Signature != EDKII_STORAGE_BUS_DISCOVERY_SIGNATURE) ||
+      (Cache->DeviceSize != sizeof (EDKII_STORAGE_BUS_DISCOVERY_SCSI_DEVICE)) ||
+      (Cache->DevicePathSize != DevicePathSize) ||
+      (CacheSize != sizeof (EDKII_STORAGE_BUS_DISCOVERY) + DevicePathSize +
+                    MultU64x32 (Cache->DeviceCount, Cache->DeviceSize)) ||
+      (CompareMem (Cache + 1, ScsiBusDev->DevicePath, DevicePathSize) != 0)) {
+    FreePool (Cache);
+    return NULL;
+  }
+
+  return Cache;
+}
+
+/**
+  Return the device addresses held by a discovery cache.
+
+  @param  Cache          The discovery cache.
+
+  @return The first device address of the cache.
+
+**/
+EDKII_STORAGE_BUS_DISCOVERY_SCSI_DEVICE *
+ScsiBusCachedDevices (
+  IN EDKII_STORAGE_BUS_DISCOVERY      *Cache
+  )
+{
+  return (EDKII_STORAGE_BUS_DISCOVERY_SCSI_DEVICE *) ((UINT8 *) (Cache + 1) + Cache->DevicePathSize);
+}
+
+/**
+  Check whether a device address is recorded in a discovery cache.
+
+  @param  Cache          The discovery cache.
+  @param  TargetId       The target of the device.
+  @param  Lun            The Lun of the device.
+
+  @retval TRUE           The device answered the scan that built the cache.
+  @retval FALSE          The device did not.
+
+**/
+BOOLEAN
+ScsiBusDeviceCached (
+  IN EDKII_STORAGE_BUS_DISCOVERY      *Cache,
+  IN SCSI_TARGET_ID                   *TargetId,
+  IN UINT64                           Lun
+  )
+{
+  EDKII_STORAGE_BUS_DISCOVERY_SCSI_DEVICE  *Device;
+  UINT32                                   Index;
+
+  Device = ScsiBusCachedDevices (Cache);
+  for (Index = 0; Index < Cache->DeviceCount; Index++) {
+    if ((Device[Index].Lun == Lun) &&
+        (CompareMem (Device[Index].Target, TargetId, TARGET_MAX_BYTES) == 0)) {
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+/**
+  Save the devices found by a bus scan in the discovery cache variable of the
+  SCSI controller, unless the variable already holds them.
+
+  @param  ScsiBusDev     The pointer of SCSI_BUS_DEVICE
+  @param  VariableName   The name of the variable of the controller.
+  @param  OldCache       The current content of the variable, or NULL.
+  @param  Probes         The devices of the bus scan.
+  @param  ProbeCount     The number of entries in Probes.
+
+**/
+VOID
+ScsiBusSetDiscoveryCache (
+  IN SCSI_BUS_DEVICE                  *ScsiBusDev,
+  IN CHAR16                           *VariableName,
+  IN EDKII_STORAGE_BUS_DISCOVERY      *OldCache,   OPTIONAL
+  IN SCSI_BUS_PROBE                   *Probes,
+  IN UINTN                            ProbeCount
+  )
+{
+  EDKII_STORAGE_BUS_DISCOVERY              *Cache;
+  EDKII_STORAGE_BUS_DISCOVERY_SCSI_DEVICE  *Device;
+  UINTN                                    DevicePathSize;
+  UINTN                                    CacheSize;
+  UINTN                                    DeviceCount;
+  UINTN                                    Index;
+
+  DeviceCount = 0;
+  for (Index = 0; Index < ProbeCount; Index++) {
+    if (Probes[Index].State == ScsiBusProbePresent) {
+      DeviceCount++;
+    }
+  }
+
+  DevicePathSize = GetDevicePathSize (ScsiBusDev->DevicePath);
+  CacheSize      = sizeof (EDKII_STORAGE_BUS_DISCOVERY) + DevicePathSize +
+                   DeviceCount * sizeof (EDKII_STORAGE_BUS_DISCOVERY_SCSI_DEVICE);
+  Cache = AllocateZeroPool (CacheSize);
+  if (Cache == NULL) {
+    return;
+  }
+
+  Cache->Signature      = EDKII_STORAGE_BUS_DISCOVERY_SIGNATURE;
+  Cache->DevicePathSize = (UINT32) DevicePathSize;
+  Cache->DeviceSize     = sizeof (EDKII_STORAGE_BUS_DISCOVERY_SCSI_DEVICE);
+  Cache->DeviceCount    = (UINT32) DeviceCount;
+  CopyMem (Cache + 1, ScsiBusDev->DevicePath, DevicePathSize);
+
+  Device = ScsiBusCachedDevices (Cache);
+  for (Index = 0; Index < ProbeCount; Index++) {
+    if (Probes[Index].State == ScsiBusProbePresent) {
+      CopyMem (Device->Target, &Probes[Index].TargetId, TARGET_MAX_BYTES);
+      Device->Lun = Probes[Index].Lun;
+      Device++;
+    }
+  }
+
+  if ((OldCache == NULL) ||
+      (OldCache->DeviceCount != DeviceCount) ||
+      (CompareMem (OldCache, Cache, CacheSize) != 0)) {
+    gRT->SetVariable (
+           VariableName,
+           &gEdkiiStorageBusDiscoveryGuid,
+           EFI_VARIABLE_NON_VOLATILE | EFI_VARIABLE_BOOTSERVICE_ACCESS,
+           CacheSize,
+           Cache
+           );
+  }
+
+  FreePool (Cache);
+}
+
+/**
+  Send the INQUIRY command of a probe as a non-blocking request.
+
+  @param  ScsiBusDev     The pointer of SCSI_BUS_DEVICE
+  @param  Slot           A free probe slot.
+  @param  Probe          The probe to send the command for.
+
+  @return The status returned by EFI_EXT_SCSI_PASS_THRU_PROTOCOL.PassThru().
+
+**/
+EFI_STATUS
+ScsiBusSubmitProbe (
+  IN     SCSI_BUS_DEVICE              *ScsiBusDev,
+  IN OUT SCSI_BUS_PROBE_SLOT          *Slot,
+  IN     SCSI_BUS_PROBE               *Probe
+  )
+{
+  EFI_EXT_SCSI_PASS_THRU_SCSI_REQUEST_PACKET  *Packet;
+
+  ZeroMem (Slot->InquiryData, sizeof (EFI_SCSI_INQUIRY_DATA));
+  ZeroMem (Slot->SenseData, sizeof (EFI_SCSI_SENSE_DATA));
+  ZeroMem (Slot->Cdb, sizeof (Slot->Cdb));
+  Slot->Cdb[0] = EFI_SCSI_OP_INQUIRY;
+  Slot->Cdb[4] = (UINT8) sizeof (EFI_SCSI_INQUIRY_DATA);
+
+  Packet = ZeroMem (&Slot->Packet, sizeof (Slot->Packet));
+  Packet->Timeout          = SCSI_BUS_TIMEOUT;
+  Packet->InDataBuffer     = Slot->InquiryData;
+  Packet->InTransferLength = sizeof (EFI_SCSI_INQUIRY_DATA);
+  Packet->SenseData        = Slot->SenseData;
+  Packet->SenseDataLength  = sizeof (EFI_SCSI_SENSE_DATA);
+  Packet->Cdb              = Slot->Cdb;
+  Packet->CdbLength        = EFI_SCSI_OP_LENGTH_SIX;
+  Packet->DataDirection    = EFI_EXT_SCSI_DATA_DIRECTION_READ;
+
+  Slot->Probe = Probe;
+
+  return ScsiBusDev->ExtScsiInterface->PassThru (
+                                         ScsiBusDev->ExtScsiInterface,
+                                         Probe->TargetId.ScsiId.ExtScsi,
+                                         Probe->Lun,
+                                         Packet,
+                                         Slot->Event
+                                         );
+}
+
+/**
+  Account for an INQUIRY command of a probe that got no answer. The command is
+  sent again up to SCSI_BUS_PROBE_ATTEMPTS times in all, as DiscoverScsiDevice()
+  does, before the device is considered absent.
+
+  @param  Probe          The probe.
+  @param  PendingCount   The number of probes waiting to be sent; updated.
+
+**/
+VOID
+ScsiBusRetryProbe (
+  IN OUT SCSI_BUS_PROBE               *Probe,
+  IN OUT UINTN                        *PendingCount
+  )
+{
+  Probe->Attempts++;
+  if (Probe->Attempts < SCSI_BUS_PROBE_ATTEMPTS) {
+    Probe->State = ScsiBusProbePending;
+    (*PendingCount)++;
+  } else {
+    Probe->State = ScsiBusProbeAbsent;
+  }
+}
+
+/**
+  Evaluate the completed INQUIRY command of a probe slot, with the rules of
+  DiscoverScsiDevice().
+
+  @param  Slot           The probe slot whose command completed.
+  @param  PendingCount   The number of probes waiting to be sent; updated.
+
+**/
+VOID
+ScsiBusCompleteProbe (
+  IN OUT SCSI_BUS_PROBE_SLOT          *Slot,
+  IN OUT UINTN                        *PendingCount
+  )
+{
+  SCSI_BUS_PROBE                      *Probe;
+  EFI_EXT_SCSI_PASS_THRU_SCSI_REQUEST_PACKET  *Packet;
+
+  Probe  = Slot->Probe;
+  Packet = &Slot->Packet;
+
+  if (Packet->HostAdapterStatus != EFI_EXT_SCSI_STATUS_HOST_ADAPTER_OK) {
+    ScsiBusRetryProbe (Probe, PendingCount);
+  } else if (Packet->TargetStatus == EFI_EXT_SCSI_STATUS_TARGET_GOOD) {
+    CopyMem (&Probe->InquiryData, Slot->InquiryData, sizeof (EFI_SCSI_INQUIRY_DATA));
+    Probe->State = ScsiBusProbePresent;
+  } else if ((Packet->TargetStatus == EFI_EXT_SCSI_STATUS_TARGET_CHECK_CONDITION) &&
+             (Packet->SenseDataLength != 0) &&
+             (Slot->SenseData->Error_Code == 0x70) &&
+             (Slot->SenseData->Sense_Key == EFI_SCSI_SK_ILLEGAL_REQUEST)) {
+    Probe->State = ScsiBusProbeAbsent;
+  } else {
+    //
+    // Leave the less common outcomes to the blocking INQUIRY command of
+    // DiscoverScsiDevice().
+    //
+    Probe->State = ScsiBusProbeUnknown;
+  }
+
+  Slot->Probe = NULL;
+}
+
+/**
+  Send INQUIRY commands to all the pending probes, with up to
+  SCSI_BUS_MAX_PROBES of them outstanding at a time, and evaluate the answers.
+
+  If the resources for the non-blocking commands cannot be allocated, the
+  probes are left to DiscoverScsiDevice().
+
+  @param  ScsiBusDev     The pointer of SCSI_BUS_DEVICE
+  @param  Probes         The probes of the bus scan.
+  @param  ProbeCount     The number of entries in Probes.
+
+**/
+VOID
+ScsiBusProbeDevices (
+  IN     SCSI_BUS_DEVICE              *ScsiBusDev,
+  IN OUT SCSI_BUS_PROBE               *Probes,
+  IN     UINTN                        ProbeCount
+  )
+{
+  EFI_STATUS                          Status;
+  SCSI_BUS_PROBE_SLOT                 *Slots;
+  SCSI_BUS_PROBE_SLOT                 *Slot;
+  SCSI_BUS_PROBE                      *Probe;
+  UINTN                               SlotCount;
+  UINTN                               SlotIndex;
+  UINTN                               PendingCount;
+  UINTN                               BusyCount;
+  UINTN                               Next;
+  UINT32                              IoAlign;
+
+  SlotCount = MIN (ProbeCount, SCSI_BUS_MAX_PROBES);
+  Slots     = AllocateZeroPool (SlotCount * sizeof (SCSI_BUS_PROBE_SLOT));
+  if (Slots == NULL) {
+    return;
+  }
+
+  IoAlign = ScsiBusDev->ExtScsiInterface->Mode->IoAlign;
+  for (SlotIndex = 0; SlotIndex < SlotCount; SlotIndex++) {
+    Slot = &Slots[SlotIndex];
+    Slot->InquiryData = AllocateAlignedPages (EFI_SIZE_TO_PAGES (sizeof (EFI_SCSI_INQUIRY_DATA)), IoAlign);
+    Slot->SenseData   = AllocateAlignedPages (EFI_SIZE_TO_PAGES (sizeof (EFI_SCSI_SENSE_DATA)), IoAlign);
+    Status = gBS->CreateEvent (0, TPL_NOTIFY, NULL, NULL, &Slot->Event);
+    if (EFI_ERROR (Status)) {
+      Slot->Event = NULL;
+    }
+    if ((Slot->InquiryData == NULL) || (Slot->SenseData == NULL) || (Slot->Event == NULL)) {
+      goto Exit;
+    }
+  }
+
+  PendingCount = 0;
+  for (Next = 0; Next < ProbeCount; Next++) {
+    if (Probes[Next].State == ScsiBusProbePending) {
+      PendingCount++;
+    }
+  }
+
+  BusyCount = 0;
+  Next      = 0;
+  while ((PendingCount > 0) || (BusyCount > 0)) {
+    //
+    // Fill the free slots.
+    //
+    for (SlotIndex = 0; (SlotIndex < SlotCount) && (PendingCount > 0); SlotIndex++) {
+      Slot = &Slots[SlotIndex];
+      if (Slot->Probe != NULL) {
+        continue;
+      }
+
+      while (Probes[Next].State != ScsiBusProbePending) {
+        Next = (Next + 1) % ProbeCount;
+      }
+      Probe = &Probes[Next];
+      Next  = (Next + 1) % ProbeCount;
+
+      Probe->State = ScsiBusProbeInFlight;
+      PendingCount--;
+      Status = ScsiBusSubmitProbe (ScsiBusDev, Slot, Probe);
+      if (!EFI_ERROR (Status)) {
+        BusyCount++;
+        continue;
+      }
+
+      Slot->Probe = NULL;
+      if ((Status == EFI_NOT_READY) && (BusyCount > 0)) {
+        //
+        // The pass thru has too many commands queued; wait for one of them.
+        //
+        Probe->State = ScsiBusProbePending;
+        PendingCount++;
+        break;
+      }
+      if ((Status == EFI_BAD_BUFFER_SIZE) ||
+          (Status == EFI_INVALID_PARAMETER) ||
+          (Status == EFI_UNSUPPORTED)) {
+        Probe->State = ScsiBusProbeAbsent;
+      } else {
+        ScsiBusRetryProbe (Probe, &PendingCount);
+      }
+    }
+
+    if (BusyCount == 0) {
+      continue;
+    }
+
+    //
+    // Collect the completed commands.
+    //
+    gBS->Stall (SCSI_BUS_PROBE_POLL_PERIOD);
+    for (SlotIndex = 0; SlotIndex < SlotCount; SlotIndex++) {
+      Slot = &Slots[SlotIndex];
+      if ((Slot->Probe != NULL) && !EFI_ERROR (gBS->CheckEvent (Slot->Event))) {
+        ScsiBusCompleteProbe (Slot, &PendingCount);
+        BusyCount--;
+      }
+    }
+  }
+
+Exit:
+  for (SlotIndex = 0; SlotIndex < SlotCount; SlotIndex++) {
+    Slot = &Slots[SlotIndex];
+    if (Slot->Event != NULL) {
+      gBS->CloseEvent (Slot->Event);
+    }
+    if (Slot->InquiryData != NULL) {
+      FreeAlignedPages (Slot->InquiryData, EFI_SIZE_TO_PAGES (sizeof (EFI_SCSI_INQUIRY_DATA)));
+    }
+    if (Slot->SenseData != NULL) {
+      FreeAlignedPages (Slot->SenseData, EFI_SIZE_TO_PAGES (sizeof (EFI_SCSI_SENSE_DATA)));
+    }
+  }
+  FreePool (Slots);
+}
+
+/**
+  Scan all the devices on the SCSI channel, and attach ScsiIoProtocol to the
+  ones that are found.
+
+  If the pass thru supports non-blocking I/O, the INQUIRY commands are sent to
+  up to SCSI_BUS_MAX_PROBES devices at a time, so the timeouts of empty targets
+  overlap. If PcdStorageBusDiscoveryCache is set, the devices found are
+  remembered, and on a boot assuming no configuration changes only those are
+  probed.
+
+  @param  This           Protocol instance pointer
+  @param  Controller     Controller handle
+  @param  ScsiBusDev     The pointer of SCSI_BUS_DEVICE
+
+**/
+VOID
+ScsiBusScanAllDevices (
+  IN     EFI_DRIVER_BINDING_PROTOCOL   *This,
+  IN     EFI_HANDLE                    Controller,
+  IN OUT SCSI_BUS_DEVICE               *ScsiBusDev
+  )
+{
+  EFI_STATUS                           Status;
+  EDKII_STORAGE_BUS_DISCOVERY          *Cache;
+  BOOLEAN                              UseCache;
+  CHAR16                               VariableName[SCSI_BUS_DISCOVERY_VARIABLE_LENGTH];
+  SCSI_TARGET_ID                       ScsiTargetId;
+  UINT8                                *TargetId;
+  UINT64                               Lun;
+  UINT32                               AdapterId;
+  SCSI_BUS_PROBE                       *Probes;
+  SCSI_BUS_PROBE                       *NewProbes;
+  UINTN                                ProbeCount;
+  UINTN                                MaxProbeCount;
+  BOOLEAN                              Complete;
+  UINTN                                Index;
+
+  Cache    = NULL;
+  UseCache = FALSE;
+  if (FeaturePcdGet (PcdStorageBusDiscoveryCache)) {
+    Cache    = ScsiBusGetDiscoveryCache (ScsiBusDev, VariableName);
+    UseCache = (BOOLEAN) ((Cache != NULL) &&
+                          (GetBootModeHob () == BOOT_ASSUMING_NO_CONFIGURATION_CHANGES));
+  }
+
+  if (ScsiBusDev->ExtScsiSupport) {
+    AdapterId = ScsiBusDev->ExtScsiInterface->Mode->AdapterId;
+  } else {
+    AdapterId = ScsiBusDev->ScsiInterface->Mode->AdapterId;
+  }
+
+  //
+  // Collect the device addresses to probe, growing the array as needed. If it
+  // cannot grow, the devices collected so far are still probed.
+  //
+  Probes        = NULL;
+  ProbeCount    = 0;
+  MaxProbeCount = 0;
+  Complete      = TRUE;
+  TargetId      = &ScsiTargetId.ScsiId.ExtScsi[0];
+  SetMem (TargetId, TARGET_MAX_BYTES, 0xFF);
+  for (;;) {
+    if (ScsiBusDev->ExtScsiSupport) {
+      Status = ScsiBusDev->ExtScsiInterface->GetNextTargetLun (ScsiBusDev->ExtScsiInterface, &TargetId, &Lun);
+    } else {
+      Status = ScsiBusDev->ScsiInterface->GetNextDevice (ScsiBusDev->ScsiInterface, &ScsiTargetId.ScsiId.Scsi, &Lun);
+    }
+    if (EFI_ERROR (Status)) {
+      //
+      // no legal Pun and Lun found any more
+      //
+      break;
+    }
+    //
+    // Avoid creating handle for the host adapter.
+    //
+    if (ScsiTargetId.ScsiId.Scsi == AdapterId) {
+      continue;
+    }
+    //
+    // Skip the targets that were empty in the last scan.
+    //
+    if (UseCache && !ScsiBusDeviceCached (Cache, &ScsiTargetId, Lun)) {
+      continue;
+    }
+
+    if (ProbeCount == MaxProbeCount) {
+      NewProbes = ReallocatePool (
+                    MaxProbeCount * sizeof (SCSI_BUS_PROBE),
+                    (MaxProbeCount + SCSI_BUS_MAX_PROBES) * sizeof (SCSI_BUS_PROBE),
+                    Probes
+                    );
+      if (NewProbes == NULL) {
+        Complete = FALSE;
+        break;
+      }
+      Probes         = NewProbes;
+      MaxProbeCount += SCSI_BUS_MAX_PROBES;
+    }
+    ZeroMem (&Probes[ProbeCount], sizeof (SCSI_BUS_PROBE));
+    CopyMem (&Probes[ProbeCount].TargetId, &ScsiTargetId, sizeof (SCSI_TARGET_ID));
+    Probes[ProbeCount].Lun   = Lun;
+    Probes[ProbeCount].State = ScsiBusProbeUnknown;
+    ProbeCount++;
+  }
+
+  if ((ProbeCount > 1) && ScsiBusDev->ExtScsiSupport &&
+      ((ScsiBusDev->ExtScsiInterface->Mode->Attributes & EFI_EXT_SCSI_PASS_THRU_ATTRIBUTES_NONBLOCKIO) != 0)) {
+    for (Index = 0; Index < ProbeCount; Index++) {
+      Probes[Index].State = ScsiBusProbePending;
+    }
+    ScsiBusProbeDevices (ScsiBusDev, Probes, ProbeCount);
+  }
+
+  for (Index = 0; Index < ProbeCount; Index++) {
+    if ((Probes[Index].State == ScsiBusProbeAbsent) ||
+        (Probes[Index].State == ScsiBusProbeInFlight)) {
+      Probes[Index].State = ScsiBusProbeAbsent;
+      continue;
+    }
+    //
+    // Scan for the scsi device, if it attaches to the scsi bus,
+    // then create handle and install scsi i/o protocol.
+    //
+    Status = ScsiScanCreateDevice (
+               This,
+               Controller,
+               &Probes[Index].TargetId,
+               Probes[Index].Lun,
+               ScsiBusDev,
+               Probes[Index].State == ScsiBusProbePresent ? &Probes[Index].InquiryData : NULL
+               );
+    Probes[Index].State = (!EFI_ERROR (Status) || (Status == EFI_ALREADY_STARTED)) ?
+                          ScsiBusProbePresent :
+                          ScsiBusProbeAbsent;
+  }
+
+  //
+  // A partial scan would drop the devices it did not reach from the cache.
+  //
+  if (FeaturePcdGet (PcdStorageBusDiscoveryCache) && Complete) {
+    ScsiBusSetDiscoveryCache (ScsiBusDev, VariableName, Cache, Probes, ProbeCount);
+  }
+
+  if (Probes != NULL) {
+    FreePool (Probes);
+  }
+  if (Cache != NULL) {
+    FreePool (Cache);
+  }
+}
@@ -2044,6 +2044,17 @@ ScsiDiskInquiryDevice (
               (BlockLimits->OptimalTransferLengthGranularity2 << 8) |
                BlockLimits->OptimalTransferLengthGranularity1;
 
+            ScsiDiskDevice->MaxTransferLength =
+              (BlockLimits->MaximumTransferLength4 << 24) |
+              (BlockLimits->MaximumTransferLength3 << 16) |
+              (BlockLimits->MaximumTransferLength2 << 8)  |
+              BlockLimits->MaximumTransferLength1;
+            ScsiDiskDevice->OptimalTransferLength =
+              (BlockLimits->OptimalTransferLength4 << 24) |
+              (BlockLimits->OptimalTransferLength3 << 16) |
+              (BlockLimits->OptimalTransferLength2 << 8)  |
+              BlockLimits->OptimalTransferLength1;
+
             ScsiDiskDevice->UnmapInfo.MaxLbaCnt =
               (BlockLimits->MaximumUnmapLbaCount4 << 24) |
               (BlockLimits->MaximumUnmapLbaCount3 << 16) |
@@ -2814,6 +2825,127 @@ ParseInquiryData (
   ScsiDiskDevice->BlkIoMedia.RemovableMedia = (BOOLEAN) (!ScsiDiskDevice->FixedDevice);
 }
 
+/**
+  Get the number of blocks transferred by one Read/Write command.
+
+  The limit of the CDB is lowered to the maximum transfer length of the Block
+  Limits VPD page, and further to its optimal transfer length, so that long
+  transfers are split into commands the device handles best.
+
+  @param  ScsiDiskDevice  The pointer of SCSI_DISK_DEV.
+
+  @return The maximum number of blocks of one Read/Write command.
+
+**/
+UINT32
+ScsiDiskMaxTransferBlocks (
+  IN  SCSI_DISK_DEV     *ScsiDiskDevice
+  )
+{
+  UINT32  MaxBlock;
+
+  if (!ScsiDiskDevice->Cdb16Byte) {
+    MaxBlock = 0xFFFF;
+  } else {
+    //
+    // The data length of one command must fit in 32 bits
+    //
+    MaxBlock = MAX_UINT32 / ScsiDiskDevice->BlkIo.Media->BlockSize;
+  }
+
+  if (ScsiDiskDevice->MaxTransferLength != 0) {
+    MaxBlock = MIN (MaxBlock, ScsiDiskDevice->MaxTransferLength);
+  }
+
+  if (ScsiDiskDevice->OptimalTransferLength != 0) {
+    MaxBlock = MIN (MaxBlock, ScsiDiskDevice->OptimalTransferLength);
+  }
+
+  return MaxBlock;
+}
+
+/**
+  Read or write sectors with several Read/Write commands outstanding at a time.
+
+  The transfer is split into windows of PcdScsiDiskQueueDepth commands. The
+  commands of a window are submitted as one asynchronous request and the
+  function waits for them to complete before the next window is submitted.
+
+  @param  ScsiDiskDevice   The pointer of SCSI_DISK_DEV.
+  @param  Write            TRUE to write the sectors, FALSE to read them.
+  @param  Buffer           On input, the data buffer. On output, the buffer
+                           position after the transferred sectors.
+  @param  Lba              On input, the first logic block address. On output,
+                           the address after the transferred sectors.
+  @param  BlocksRemaining  On input, the number of blocks to transfer. On
+                           output, the number of blocks not transferred.
+
+  @retval EFI_SUCCESS       The sectors were transferred, or a window could
+                            not be submitted and BlocksRemaining blocks are
+                            left to transfer one command at a time.
+  @retval EFI_DEVICE_ERROR  Indicates a device error.
+
+**/
+EFI_STATUS
+ScsiDiskQueuedReadWriteSectors (
+  IN     SCSI_DISK_DEV     *ScsiDiskDevice,
+  IN     BOOLEAN           Write,
+  IN OUT UINT8             **Buffer,
+  IN OUT EFI_LBA           *Lba,
+  IN OUT UINTN             *BlocksRemaining
+  )
+{
+  EFI_STATUS            Status;
+  EFI_BLOCK_IO2_TOKEN   Token;
+  UINTN                 WindowBlocks;
+  UINTN                 Blocks;
+
+  //
+  // The event is not a notification event, so that its state can be polled
+  // while the SCSI sub-tasks complete in ScsiDiskNotify() at TPL_NOTIFY.
+  //
+  Status = gBS->CreateEvent (0, TPL_NOTIFY, NULL, NULL, &Token.Event);
+  if (EFI_ERROR (Status)) {
+    return EFI_SUCCESS;
+  }
+
+  WindowBlocks = (UINTN) ScsiDiskMaxTransferBlocks (ScsiDiskDevice) * PcdGet32 (PcdScsiDiskQueueDepth);
+  while (*BlocksRemaining > 0) {
+    Blocks                  = MIN (*BlocksRemaining, WindowBlocks);
+    Token.TransactionStatus = EFI_SUCCESS;
+    if (Write) {
+      Status = ScsiDiskAsyncWriteSectors (ScsiDiskDevice, *Buffer, *Lba, Blocks, &Token);
+    } else {
+      Status = ScsiDiskAsyncReadSectors (ScsiDiskDevice, *Buffer, *Lba, Blocks, &Token);
+    }
+
+    if (EFI_ERROR (Status)) {
+      //
+      // Nothing of this window is in flight; let the caller transfer
+      // the remaining sectors one command at a time.
+      //
+      Status = EFI_SUCCESS;
+      break;
+    }
+
+    while (gBS->CheckEvent (Token.Event) == EFI_NOT_READY) {
+      CpuPause ();
+    }
+
+    if (EFI_ERROR (Token.TransactionStatus)) {
+      Status = EFI_DEVICE_ERROR;
+      break;
+    }
+
+    *Lba             += Blocks;
+    *Buffer          += Blocks * ScsiDiskDevice->BlkIo.Media->BlockSize;
+    *BlocksRemaining -= Blocks;
+  }
+
+  gBS->CloseEvent (Token.Event);
+  return Status;
+}
+
 /**
   Read sector from SCSI Disk.
 
@@ -2855,14 +2987,19 @@ ScsiDiskReadSectors (
   //
   // limit the data bytes that can be transferred by one Read(10) or Read(16) Command
   //
-  if (!ScsiDiskDevice->Cdb16Byte) {
-    MaxBlock         = 0xFFFF;
-  } else {
-    MaxBlock         = 0xFFFFFFFF;
-  }
-
+  MaxBlock  = ScsiDiskMaxTransferBlocks (ScsiDiskDevice);
   PtrBuffer = Buffer;
 
+  //
+  // Keep several commands outstanding if the transfer needs more than one
+  //
+  if ((BlocksRemaining > MaxBlock) && (PcdGet32 (PcdScsiDiskQueueDepth) > 1)) {
+    Status = ScsiDiskQueuedReadWriteSectors (ScsiDiskDevice, FALSE, &PtrBuffer, &Lba, &BlocksRemaining);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+  }
+
   while (BlocksRemaining > 0) {
 
     if (BlocksRemaining <= MaxBlock) {
@@ -3018,16 +3155,21 @@ ScsiDiskWriteSectors (
   BlockSize         = ScsiDiskDevice->BlkIo.Media->BlockSize;
 
   //
-  // limit the data bytes that can be transferred by one Read(10) or Read(16) Command
+  // limit the data bytes that can be transferred by one Write(10) or Write(16) Command
   //
-  if (!ScsiDiskDevice->Cdb16Byte) {
-    MaxBlock         = 0xFFFF;
-  } else {
-    MaxBlock         = 0xFFFFFFFF;
-  }
-
+  MaxBlock  = ScsiDiskMaxTransferBlocks (ScsiDiskDevice);
   PtrBuffer = Buffer;
 
+  //
+  // Keep several commands outstanding if the transfer needs more than one
+  //
+  if ((BlocksRemaining > MaxBlock) && (PcdGet32 (PcdScsiDiskQueueDepth) > 1)) {
+    Status = ScsiDiskQueuedReadWriteSectors (ScsiDiskDevice, TRUE, &PtrBuffer, &Lba, &BlocksRemaining);
+    if (EFI_ERROR (Status)) {
+      return Status;
+    }
+  }
+
   while (BlocksRemaining > 0) {
 
     if (BlocksRemaining <= MaxBlock) {
@@ -3203,11 +3345,7 @@ ScsiDiskAsyncReadSectors (
   // Limit the data bytes that can be transferred by one Read(10) or Read(16)
   // Command
   //
-  if (!ScsiDiskDevice->Cdb16Byte) {
-    MaxBlock         = 0xFFFF;
-  } else {
-    MaxBlock         = 0xFFFFFFFF;
-  }
+  MaxBlock = ScsiDiskMaxTransferBlocks (ScsiDiskDevice);
 
   PtrBuffer = Buffer;
 
@@ -3317,6 +3455,11 @@ ScsiDiskAsyncReadSectors (
         Status = EFI_DEVICE_ERROR;
         goto Done;
       } else {
+        //
+        // The remaining sectors will not be transferred, so the request
+        // fails once the previous SCSI commands complete.
+        //
+        Token->TransactionStatus = EFI_DEVICE_ERROR;
         gBS->RestoreTPL (OldTpl);
 
         //
@@ -3417,14 +3560,10 @@ ScsiDiskAsyncWriteSectors (
   BlockSize         = ScsiDiskDevice->BlkIo.Media->BlockSize;
 
   //
-  // Limit the data bytes that can be transferred by one Read(10) or Read(16)
+  // Limit the data bytes that can be transferred by one Write(10) or Write(16)
   // Command
   //
-  if (!ScsiDiskDevice->Cdb16Byte) {
-    MaxBlock         = 0xFFFF;
-  } else {
-    MaxBlock         = 0xFFFFFFFF;
-  }
+  MaxBlock = ScsiDiskMaxTransferBlocks (ScsiDiskDevice);
 
   PtrBuffer = Buffer;
 
@@ -3534,6 +3673,11 @@ ScsiDiskAsyncWriteSectors (
         Status = EFI_DEVICE_ERROR;
         goto Done;
       } else {
+        //
+        // The remaining sectors will not be transferred, so the request
+        // fails once the previous SCSI commands complete.
+        //
+        Token->TransactionStatus = EFI_DEVICE_ERROR;
         gBS->RestoreTPL (OldTpl);
 
         //
@@ -30,6 +30,7 @@ WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
 #include <Protocol/DiskInfo.h>
 
 
+#include <Library/BaseLib.h>
 #include <Library/DebugLib.h>
 #include <Library/UefiDriverEntryPoint.h>
 #include <Library/UefiLib.h>
@@ -38,6 +39,7 @@ WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
 #include <Library/UefiScsiLib.h>
 #include <Library/UefiBootServicesTableLib.h>
 #include <Library/DevicePathLib.h>
+#include <Library/PcdLib.h>
 
 #include <IndustryStandard/Scsi.h>
 #include <IndustryStandard/Atapi.h>
@@ -86,6 +88,13 @@ typedef struct {
   //
   SCSI_UNMAP_PARAM_INFO     UnmapInfo;
   BOOLEAN                   BlockLimitsVpdSupported;
+
+  //
+  // Maximum and optimal transfer length in blocks of one READ/WRITE command
+  // reported by the Block Limits VPD page, 0 if not reported
+  //
+  UINT32                    MaxTransferLength;
+  UINT32                    OptimalTransferLength;
   
   //
   // The flag indicates if 16-byte command can be used
@@ -951,6 +960,50 @@ ScsiDiskWriteSectors (
   IN  UINTN             NumberOfBlocks
   );
 
+/**
+  Get the number of blocks transferred by one Read/Write command.
+
+  @param  ScsiDiskDevice  The pointer of SCSI_DISK_DEV.
+
+  @return The maximum number of blocks of one Read/Write command.
+
+**/
+UINT32
+ScsiDiskMaxTransferBlocks (
+  IN  SCSI_DISK_DEV     *ScsiDiskDevice
+  );
+
+/**
+  Read or write sectors with several Read/Write commands outstanding at a time.
+
+  The transfer is split into windows of PcdScsiDiskQueueDepth commands. The
+  commands of a window are submitted as one asynchronous request and the
+  function waits for them to complete before the next window is submitted.
+
+  @param  ScsiDiskDevice   The pointer of SCSI_DISK_DEV.
+  @param  Write            TRUE to write the sectors, FALSE to read them.
+  @param  Buffer           On input, the data buffer. On output, the buffer
+                           position after the transferred sectors.
+  @param  Lba              On input, the first logic block address. On output,
+                           the address after the transferred sectors.
+  @param  BlocksRemaining  On input, the number of blocks to transfer. On
+                           output, the number of blocks not transferred.
+
+  @retval EFI_SUCCESS       The sectors were transferred, or a window could
+                            not be submitted and BlocksRemaining blocks are
+                            left to transfer one command at a time.
+  @retval EFI_DEVICE_ERROR  Indicates a device error.
+
+**/
+EFI_STATUS
+ScsiDiskQueuedReadWriteSectors (
+  IN     SCSI_DISK_DEV     *ScsiDiskDevice,
+  IN     BOOLEAN           Write,
+  IN OUT UINT8             **Buffer,
+  IN OUT EFI_LBA           *Lba,
+  IN OUT UINTN             *BlocksRemaining
+  );
+
 /**
   Asynchronously read sector from SCSI Disk.
 
@@ -1279,6 +1279,8 @@ UsbBusControllerDriverStart (
   EFI_USB_BUS_PROTOCOL          *UsbBusId;
   EFI_STATUS                    Status;
   EFI_DEVICE_PATH_PROTOCOL      *ParentDevicePath;
+  USB_BUS                       *Bus;
+  EFI_TPL                       OldTpl;
 
   Status = gBS->OpenProtocol (
                   Controller,
@@ -1356,6 +1358,17 @@ UsbBusControllerDriverStart (
     Status = UsbBusAddWantedUsbIoDP (UsbBusId, RemainingDevicePath);
     ASSERT (!EFI_ERROR (Status));
     //
+    // The root hub ports leading to the newly wanted devices may have been
+    // skipped so far. Enumerate them now, before they are connected below,
+    // at the TPL of the root hub poll so the two do not interleave.
+    //
+    if (FeaturePcdGet (PcdUsbBusEnumerateWantedPortsOnly)) {
+      Bus    = USB_BUS_FROM_THIS (UsbBusId);
+      OldTpl = gBS->RaiseTPL (TPL_CALLBACK);
+      UsbRootHubEnumeration (NULL, Bus->Devices[0]->Interfaces[0]);
+      gBS->RestoreTPL (OldTpl);
+    }
+    //
     // Ensure all wanted child usb devices are fully recursively connected
     //
     Status = UsbBusRecursivelyConnectWantedUsbIo (UsbBusId);
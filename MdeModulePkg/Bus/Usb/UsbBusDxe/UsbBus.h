@@ -31,6 +31,7 @@ WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
 #include <Library/UefiBootServicesTableLib.h>
 #include <Library/UefiLib.h>
 #include <Library/DevicePathLib.h>
+#include <Library/PcdLib.h>
 #include <Library/MemoryAllocationLib.h>
 #include <Library/ReportStatusCodeLib.h>
 
@@ -356,6 +357,25 @@ UsbBusIsWantedUsbIO (
   IN USB_INTERFACE           *UsbIf
   );
 
+/**
+  Check whether the port of a hub leads to a wanted usb child device in a bus.
+
+  @param  Bus     The Usb bus's private data pointer.
+  @param  HubIf   The hub interface.
+  @param  Port    The port index of the hub (started with zero).
+
+  @retval True    If the port leads to a wanted usb child device.
+  @retval False   If the port doesn't lead to any wanted usb child device.
+
+**/
+BOOLEAN
+EFIAPI
+UsbBusIsWantedPort (
+  IN USB_BUS                 *Bus,
+  IN USB_INTERFACE           *HubIf,
+  IN UINT8                   Port
+  );
+
 /**
   Recursively connnect every wanted usb child device to ensure they all fully connected.
   Check all the child Usb IO handles in this bus, recursively connecte if it is wanted usb child device.
@@ -651,6 +651,7 @@ UsbFindChild (
 
 /**
   Enumerate and configure the new device on the port of this HUB interface.
+  The caller has waited for the connection of the device to be stable.
 
   @param  HubIf                 The HUB that has the device connected.
   @param  Port                  The port index of the hub (started with zero).
@@ -682,8 +683,6 @@ UsbEnumerateNewDev (
   HubApi  = HubIf->HubApi;  
   Address = Bus->MaxDevices;
 
-  gBS->Stall (USB_WAIT_PORT_STABLE_STALL);
-  
   //
   // Hub resets the device for at least 10 milliseconds.
   // Host learns device speed. If device is of low/full speed
@@ -875,18 +874,25 @@ ON_ERROR:
 /**
   Process the events on the port.
 
+  A new device connected to the port isn't enumerated here. It is reported
+  to the caller, which enumerates it with the new devices on the other ports
+  by UsbEnumerateNewDevs (). The port change is cleared after that.
+
   @param  HubIf                 The HUB that has the device connected.
   @param  Port                  The port index of the hub (started with zero).
+  @param  NewDevice             Return whether a new device is connected to the port.
+  @param  ResetIsNeeded         Return whether the port of the new device needs a reset.
 
-  @retval EFI_SUCCESS           The device is enumerated (added or removed).
-  @retval EFI_OUT_OF_RESOURCES  Failed to allocate resource for the device.
-  @retval Others                Failed to enumerate the device.
+  @retval EFI_SUCCESS           The events on the port are processed.
+  @retval Others                Failed to process the events on the port.
 
 **/
 EFI_STATUS
 UsbEnumeratePort (
-  IN USB_INTERFACE        *HubIf,
-  IN UINT8                Port
+  IN  USB_INTERFACE       *HubIf,
+  IN  UINT8               Port,
+  OUT BOOLEAN             *NewDevice,
+  OUT BOOLEAN             *ResetIsNeeded
   )
 {
   USB_HUB_API             *HubApi;
@@ -894,8 +900,10 @@ UsbEnumeratePort (
   EFI_USB_PORT_STATUS     PortState;
   EFI_STATUS              Status;
 
-  Child   = NULL;
-  HubApi  = HubIf->HubApi;
+  Child          = NULL;
+  HubApi         = HubIf->HubApi;
+  *NewDevice     = FALSE;
+  *ResetIsNeeded = FALSE;
 
   //
   // Host learns of the new device by polling the hub for port changes.
@@ -976,15 +984,13 @@ UsbEnumeratePort (
   
   if (USB_BIT_IS_SET (PortState.PortStatus, USB_PORT_STAT_CONNECTION)) {
     //
-    // Now, new device connected, enumerate and configure the device 
+    // Now, new device connected, let the caller enumerate and configure the device
     //
     DEBUG (( EFI_D_INFO, "UsbEnumeratePort: new device connected at port %d\n", Port));
-    if (USB_BIT_IS_SET (PortState.PortChangeStatus, USB_PORT_STAT_C_RESET)) {
-      Status = UsbEnumerateNewDev (HubIf, Port, FALSE);
-    } else {
-      Status = UsbEnumerateNewDev (HubIf, Port, TRUE);
-    }
-  
+    *NewDevice     = TRUE;
+    *ResetIsNeeded = (BOOLEAN) !USB_BIT_IS_SET (PortState.PortChangeStatus, USB_PORT_STAT_C_RESET);
+    return EFI_SUCCESS;
+
   } else {
     DEBUG (( EFI_D_INFO, "UsbEnumeratePort: device disconnected event on port %d\n", Port));
   }
@@ -994,6 +1000,79 @@ UsbEnumeratePort (
 }
 
 
+/**
+  Enumerate and configure the new devices on the ports of this HUB interface.
+
+  The connection of every new device has to be stable for 100ms before its
+  port is reset. The devices were all found by the same scan, so a single
+  wait covers them instead of one wait per device. The ports are then reset
+  and the devices addressed one at a time, because only one device may use
+  the default address.
+
+  @param  HubIf                 The HUB that has the devices connected.
+  @param  NewPorts              The bitmap of the ports with a new device.
+  @param  ResetPorts            The bitmap of the ports that need a reset.
+
+**/
+VOID
+UsbEnumerateNewDevs (
+  IN USB_INTERFACE        *HubIf,
+  IN UINT8                *NewPorts,
+  IN UINT8                *ResetPorts
+  )
+{
+  UINT8                   Index;
+  BOOLEAN                 Found;
+
+  Found = FALSE;
+  for (Index = 0; Index < HubIf->NumOfPort; Index++) {
+    if (USB_BIT_IS_SET (NewPorts[Index / 8], USB_BIT (Index % 8))) {
+      Found = TRUE;
+      break;
+    }
+  }
+
+  if (!Found) {
+    return ;
+  }
+
+  gBS->Stall (USB_WAIT_PORT_STABLE_STALL);
+
+  for (Index = 0; Index < HubIf->NumOfPort; Index++) {
+    if (!USB_BIT_IS_SET (NewPorts[Index / 8], USB_BIT (Index % 8))) {
+      continue;
+    }
+
+    UsbEnumerateNewDev (HubIf, Index, USB_BIT_IS_SET (ResetPorts[Index / 8], USB_BIT (Index % 8)));
+    HubIf->HubApi->ClearPortChange (HubIf, Index);
+  }
+}
+
+
+/**
+  Record the port with a new device in the bitmaps for UsbEnumerateNewDevs ().
+
+  @param  Port                  The port index of the hub (started with zero).
+  @param  ResetIsNeeded         Whether the port needs a reset.
+  @param  NewPorts              The bitmap of the ports with a new device.
+  @param  ResetPorts            The bitmap of the ports that need a reset.
+
+**/
+VOID
+UsbRecordNewDev (
+  IN     UINT8            Port,
+  IN     BOOLEAN          ResetIsNeeded,
+  IN OUT UINT8            *NewPorts,
+  IN OUT UINT8            *ResetPorts
+  )
+{
+  NewPorts[Port / 8] |= (UINT8) USB_BIT (Port % 8);
+  if (ResetIsNeeded) {
+    ResetPorts[Port / 8] |= (UINT8) USB_BIT (Port % 8);
+  }
+}
+
+
 /**
   Enumerate all the changed hub ports.
 
@@ -1013,6 +1092,10 @@ UsbHubEnumeration (
   UINT8                   Bit;
   UINT8                   Index;
   USB_DEVICE              *Child;
+  BOOLEAN                 NewDevice;
+  BOOLEAN                 ResetIsNeeded;
+  UINT8                   NewPorts[USB_PORT_MAP_SIZE];
+  UINT8                   ResetPorts[USB_PORT_MAP_SIZE];
   
   ASSERT (Context != NULL);
 
@@ -1035,15 +1118,23 @@ UsbHubEnumeration (
   //
   Byte  = 0;
   Bit   = 1;
+  ZeroMem (NewPorts, sizeof (NewPorts));
+  ZeroMem (ResetPorts, sizeof (ResetPorts));
 
   for (Index = 0; Index < HubIf->NumOfPort; Index++) {
-    if (USB_BIT_IS_SET (HubIf->ChangeMap[Byte], USB_BIT (Bit))) {
-      UsbEnumeratePort (HubIf, Index);
+    if (USB_BIT_IS_SET (HubIf->ChangeMap[Byte], USB_BIT (Bit)) &&
+        UsbBusIsWantedPort (HubIf->Device->Bus, HubIf, Index)) {
+      UsbEnumeratePort (HubIf, Index, &NewDevice, &ResetIsNeeded);
+      if (NewDevice) {
+        UsbRecordNewDev (Index, ResetIsNeeded, NewPorts, ResetPorts);
+      }
     }
 
     USB_NEXT_BIT (Byte, Bit);
   }
 
+  UsbEnumerateNewDevs (HubIf, NewPorts, ResetPorts);
+
   UsbHubAckHubStatus (HubIf->Device);
 
   gBS->FreePool (HubIf->ChangeMap);
@@ -1069,8 +1160,14 @@ UsbRootHubEnumeration (
   USB_INTERFACE           *RootHub;
   UINT8                   Index;
   USB_DEVICE              *Child;
+  BOOLEAN                 NewDevice;
+  BOOLEAN                 ResetIsNeeded;
+  UINT8                   NewPorts[USB_PORT_MAP_SIZE];
+  UINT8                   ResetPorts[USB_PORT_MAP_SIZE];
 
   RootHub = (USB_INTERFACE *) Context;
+  ZeroMem (NewPorts, sizeof (NewPorts));
+  ZeroMem (ResetPorts, sizeof (ResetPorts));
 
   for (Index = 0; Index < RootHub->NumOfPort; Index++) {
     Child = UsbFindChild (RootHub, Index);
@@ -1078,7 +1175,16 @@ UsbRootHubEnumeration (
       DEBUG (( EFI_D_INFO, "UsbEnumeratePort: The device disconnect fails at port %d from root hub %p, try again\n", Index, RootHub));
       UsbRemoveDevice (Child);
     }
-    
-    UsbEnumeratePort (RootHub, Index);
+
+    if (!UsbBusIsWantedPort (RootHub->Device->Bus, RootHub, Index)) {
+      continue;
+    }
+
+    UsbEnumeratePort (RootHub, Index, &NewDevice, &ResetIsNeeded);
+    if (NewDevice) {
+      UsbRecordNewDev (Index, ResetIsNeeded, NewPorts, ResetPorts);
+    }
   }
+
+  UsbEnumerateNewDevs (RootHub, NewPorts, ResetPorts);
 }
@@ -28,6 +28,12 @@ WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
             }                 \
           } while (0)
 
+//
+// The size of a bitmap with a bit for each port of a hub. A hub has at
+// most 255 ports.
+//
+#define USB_PORT_MAP_SIZE         32
+
 
 //
 // Common interface used by usb bus enumeration process.
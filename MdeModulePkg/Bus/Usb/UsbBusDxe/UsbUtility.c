@@ -1287,6 +1287,88 @@ UsbBusIsWantedUsbIO (
   }
 }
 
+/**
+  Check whether the port of a hub leads to a wanted usb child device in a bus.
+
+  Unless PcdUsbBusEnumerateWantedPortsOnly is TRUE, every port is wanted.
+  Otherwise a port is wanted if a wanted usb device path goes through it.
+  Usb class and WWID device paths can't tell a port, so they want every port.
+
+  @param  Bus     The Usb bus's private data pointer.
+  @param  HubIf   The hub interface.
+  @param  Port    The port index of the hub (started with zero).
+
+  @retval True    If the port leads to a wanted usb child device.
+  @retval False   If the port doesn't lead to any wanted usb child device.
+
+**/
+BOOLEAN
+EFIAPI
+UsbBusIsWantedPort (
+  IN USB_BUS                 *Bus,
+  IN USB_INTERFACE           *HubIf,
+  IN UINT8                   Port
+  )
+{
+  EFI_DEVICE_PATH_PROTOCOL      *HubDevicePath;
+  EFI_DEVICE_PATH_PROTOCOL      *HubNode;
+  EFI_DEVICE_PATH_PROTOCOL      *WantedNode;
+  LIST_ENTRY                    *WantedListIndex;
+  DEVICE_PATH_LIST_ITEM         *WantedListItem;
+  BOOLEAN                       Wanted;
+
+  if (!FeaturePcdGet (PcdUsbBusEnumerateWantedPortsOnly)) {
+    return TRUE;
+  }
+
+  //
+  // Check whether all Usb devices in this bus are wanted
+  //
+  if (SearchUsbDPInList ((EFI_DEVICE_PATH_PROTOCOL *)&mAllUsbClassDevicePath, &Bus->WantedUsbIoDPList)){
+    return TRUE;
+  }
+
+  //
+  // The usb part of the root hub device path is empty.
+  //
+  HubDevicePath = GetUsbDPFromFullDP (HubIf->DevicePath);
+
+  Wanted          = FALSE;
+  WantedListIndex = Bus->WantedUsbIoDPList.ForwardLink;
+  while (!Wanted && (WantedListIndex != &Bus->WantedUsbIoDPList)) {
+    WantedListItem = CR(WantedListIndex, DEVICE_PATH_LIST_ITEM, Link, DEVICE_PATH_LIST_ITEM_SIGNATURE);
+    WantedNode     = WantedListItem->DevicePath;
+    HubNode        = HubDevicePath;
+
+    //
+    // Walk the wanted device path along the device path of the hub, then
+    // the next node tells the port of the hub it goes through.
+    //
+    while (!IsDevicePathEnd (WantedNode) && (DevicePathSubType (WantedNode) == MSG_USB_DP) &&
+           (HubNode != NULL) && !IsDevicePathEnd (HubNode) &&
+           (CompareMem (WantedNode, HubNode, sizeof (USB_DEVICE_PATH)) == 0)) {
+      WantedNode = NextDevicePathNode (WantedNode);
+      HubNode    = NextDevicePathNode (HubNode);
+    }
+
+    if (!IsDevicePathEnd (WantedNode)) {
+      if (DevicePathSubType (WantedNode) != MSG_USB_DP) {
+        Wanted = TRUE;
+      } else if ((HubNode == NULL) || IsDevicePathEnd (HubNode)) {
+        Wanted = (BOOLEAN) (((USB_DEVICE_PATH *) WantedNode)->ParentPortNumber == Port);
+      }
+    }
+
+    WantedListIndex = WantedListIndex->ForwardLink;
+  }
+
+  if (HubDevicePath != NULL) {
+    FreePool (HubDevicePath);
+  }
+
+  return Wanted;
+}
+
 /**
   Recursively connnect every wanted usb child device to ensure they all fully connected.
   Check all the child Usb IO handles in this bus, recursively connecte if it is wanted usb child device.
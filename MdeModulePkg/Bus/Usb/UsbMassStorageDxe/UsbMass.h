@@ -188,6 +188,7 @@ struct _USB_MASS_DEVICE {
   EFI_DISK_INFO_PROTOCOL    DiskInfo;
   USB_BOOT_INQUIRY_DATA     InquiryData;
   BOOLEAN                   Cdb16Byte;
+  UINT32                    MaxTransferLength; ///< Blocks per read or write from the Block Limits VPD page, 0 if unknown
 };
 
 #endif
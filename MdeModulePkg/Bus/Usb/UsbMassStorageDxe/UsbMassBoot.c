@@ -386,6 +386,147 @@ UsbBootInquiry (
   return Status;
 }
 
+
+/**
+  Execute INQUIRY Command to read a Vital Product Data page of the device.
+
+  The command is not retried: devices that do not implement the page fail it
+  with ILLEGAL REQUEST, and many USB devices do not implement any.
+
+  @param  UsbMass                The device to inquire.
+  @param  PageCode               The VPD page to read.
+  @param  Page                   The buffer to hold the page.
+  @param  PageSize               The size of Page, at most
+                                 USB_BOOT_VPD_ALLOC_LEN bytes.
+
+  @retval EFI_SUCCESS            The page has been read.
+  @retval Others                 The page could not be read.
+
+**/
+EFI_STATUS
+UsbBootInquiryVpd (
+  IN  USB_MASS_DEVICE           *UsbMass,
+  IN  UINT8                     PageCode,
+  OUT VOID                      *Page,
+  IN  UINT8                     PageSize
+  )
+{
+  USB_BOOT_INQUIRY_VPD_CMD      InquiryCmd;
+  EFI_STATUS                    Status;
+
+  ZeroMem (&InquiryCmd, sizeof (USB_BOOT_INQUIRY_VPD_CMD));
+  ZeroMem (Page, PageSize);
+
+  InquiryCmd.OpCode   = USB_BOOT_INQUIRY_OPCODE;
+  InquiryCmd.Lun      = (UINT8) (USB_BOOT_LUN (UsbMass->Lun) | USB_BOOT_INQUIRY_EVPD);
+  InquiryCmd.PageCode = PageCode;
+  InquiryCmd.AllocLen = PageSize;
+
+  Status = UsbBootExecCmd (
+             UsbMass,
+             &InquiryCmd,
+             (UINT8) sizeof (USB_BOOT_INQUIRY_VPD_CMD),
+             EfiUsbDataIn,
+             Page,
+             PageSize,
+             USB_BOOT_GENERAL_CMD_TIMEOUT
+             );
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  //
+  // Byte 1 of every VPD page echoes its page code
+  //
+  if (((UINT8 *) Page)[1] != PageCode) {
+    return EFI_DEVICE_ERROR;
+  }
+
+  return EFI_SUCCESS;
+}
+
+
+/**
+  Get the transfer length limit of the device from its Block Limits VPD page.
+
+  UsbMass->MaxTransferLength is set to the optimal transfer length of the
+  page, or its maximum transfer length if that is smaller or the optimal one
+  is not reported. It stays 0, so reads and writes are split at
+  USB_BOOT_IO_BLOCKS blocks, if the device does not list the Block Limits
+  page in its Supported VPD Pages page or does not report a limit in it.
+
+  @param  UsbMass                The device to query.
+
+**/
+VOID
+UsbBootGetBlockLimits (
+  IN USB_MASS_DEVICE            *UsbMass
+  )
+{
+  EFI_SCSI_SUPPORTED_VPD_PAGES_VPD_PAGE SupportedVpdPages;
+  EFI_SCSI_BLOCK_LIMITS_VPD_PAGE        BlockLimits;
+  UINTN                                 PageLength;
+  UINTN                                 Index;
+  UINT32                                MaxTransferLength;
+  UINT32                                OptimalTransferLength;
+  EFI_STATUS                            Status;
+
+  UsbMass->MaxTransferLength = 0;
+
+  Status = UsbBootInquiryVpd (
+             UsbMass,
+             EFI_SCSI_PAGE_CODE_SUPPORTED_VPD,
+             &SupportedVpdPages,
+             USB_BOOT_VPD_ALLOC_LEN
+             );
+  if (EFI_ERROR (Status)) {
+    return;
+  }
+
+  PageLength = (SupportedVpdPages.PageLength2 << 8) | SupportedVpdPages.PageLength1;
+  PageLength = MIN (PageLength, USB_BOOT_VPD_ALLOC_LEN - OFFSET_OF (EFI_SCSI_SUPPORTED_VPD_PAGES_VPD_PAGE, SupportedVpdPageList));
+
+  //
+  // The page codes are listed in ascending order
+  //
+  for (Index = 0; Index < PageLength; Index++) {
+    if (SupportedVpdPages.SupportedVpdPageList[Index] >= EFI_SCSI_PAGE_CODE_BLOCK_LIMITS_VPD) {
+      break;
+    }
+  }
+  if ((Index == PageLength) ||
+      (SupportedVpdPages.SupportedVpdPageList[Index] != EFI_SCSI_PAGE_CODE_BLOCK_LIMITS_VPD)) {
+    return;
+  }
+
+  Status = UsbBootInquiryVpd (
+             UsbMass,
+             EFI_SCSI_PAGE_CODE_BLOCK_LIMITS_VPD,
+             &BlockLimits,
+             (UINT8) sizeof (EFI_SCSI_BLOCK_LIMITS_VPD_PAGE)
+             );
+  if (EFI_ERROR (Status)) {
+    return;
+  }
+
+  MaxTransferLength     = SwapBytes32 (ReadUnaligned32 ((CONST UINT32 *) &BlockLimits.MaximumTransferLength4));
+  OptimalTransferLength = SwapBytes32 (ReadUnaligned32 ((CONST UINT32 *) &BlockLimits.OptimalTransferLength4));
+
+  if ((OptimalTransferLength != 0) &&
+      ((MaxTransferLength == 0) || (OptimalTransferLength < MaxTransferLength))) {
+    UsbMass->MaxTransferLength = OptimalTransferLength;
+  } else {
+    UsbMass->MaxTransferLength = MaxTransferLength;
+  }
+
+  DEBUG ((
+    EFI_D_INFO,
+    "UsbBootGetBlockLimits: Max (0x%x), Optimal (0x%x) blocks per command\n",
+    MaxTransferLength,
+    OptimalTransferLength
+    ));
+}
+
 /**
   Execute READ CAPACITY 16 bytes command to request information regarding
   the capacity of the installed medium of the device.
@@ -653,6 +794,8 @@ UsbBootGetParams (
     // Default value 2048 Bytes, in case no media present at first time
     //
     Media->BlockSize        = 0x0800;
+  } else {
+    UsbBootGetBlockLimits (UsbMass);
   }
 
   Status = UsbBootDetectMedia (UsbMass);
@@ -765,6 +908,31 @@ ON_ERROR:
 }
 
 
+/**
+  Get the largest number of blocks to move with one read or write command.
+
+  @param  UsbMass                The USB mass storage device
+
+  @return UsbMass->MaxTransferLength, or USB_BOOT_IO_BLOCKS if the device
+          did not report a limit.
+
+**/
+UINT16
+UsbBootMaxIoBlocks (
+  IN  USB_MASS_DEVICE       *UsbMass
+  )
+{
+  if (UsbMass->MaxTransferLength == 0) {
+    return USB_BOOT_IO_BLOCKS;
+  }
+
+  //
+  // READ10/WRITE10 carry a 16 bit transfer length
+  //
+  return (UINT16) MIN (UsbMass->MaxTransferLength, MAX_UINT16);
+}
+
+
 /**
   Read some blocks from the device.
 
@@ -801,7 +969,7 @@ UsbBootReadBlocks (
     // on the device. We must split the total block because the READ10
     // command only has 16 bit transfer length (in the unit of block).
     //
-    Count     = (UINT16)((TotalBlock < USB_BOOT_IO_BLOCKS) ? TotalBlock : USB_BOOT_IO_BLOCKS);
+    Count     = (UINT16) MIN (TotalBlock, UsbBootMaxIoBlocks (UsbMass));
     ByteSize  = (UINT32)Count * BlockSize;
 
     //
@@ -877,7 +1045,7 @@ UsbBootWriteBlocks (
     // on the device. We must split the total block because the WRITE10
     // command only has 16 bit transfer length (in the unit of block).
     //
-    Count     = (UINT16)((TotalBlock < USB_BOOT_IO_BLOCKS) ? TotalBlock : USB_BOOT_IO_BLOCKS);
+    Count     = (UINT16) MIN (TotalBlock, UsbBootMaxIoBlocks (UsbMass));
     ByteSize  = (UINT32)Count * BlockSize;
 
     //
@@ -951,7 +1119,7 @@ UsbBootReadBlocks16 (
     //
     // Split the total blocks into smaller pieces.
     //
-    Count     = (UINT16)((TotalBlock < USB_BOOT_IO_BLOCKS) ? TotalBlock : USB_BOOT_IO_BLOCKS);
+    Count     = (UINT16) MIN (TotalBlock, UsbBootMaxIoBlocks (UsbMass));
     ByteSize  = (UINT32)Count * BlockSize;
 
     //
@@ -1025,7 +1193,7 @@ UsbBootWriteBlocks16 (
     //
     // Split the total blocks into smaller pieces.
     //
-    Count     = (UINT16)((TotalBlock < USB_BOOT_IO_BLOCKS) ? TotalBlock : USB_BOOT_IO_BLOCKS);
+    Count     = (UINT16) MIN (TotalBlock, UsbBootMaxIoBlocks (UsbMass));
     ByteSize  = (UINT32)Count * BlockSize;
 
     //
@@ -103,6 +103,23 @@ typedef struct {
   UINT8             Pad[6];
 } USB_BOOT_INQUIRY_CMD;
 
+//
+// INQUIRY for a Vital Product Data page. The allocation length is kept below
+// 256 bytes, as many USB devices do not decode its high byte.
+//
+#define USB_BOOT_INQUIRY_EVPD           0x01
+#define USB_BOOT_VPD_ALLOC_LEN          0xFF
+
+typedef struct {
+  UINT8             OpCode;
+  UINT8             Lun;            ///< Lun (high 3 bits), EVPD (lowest bit)
+  UINT8             PageCode;
+  UINT8             Reserved0;      ///< Allocation length (high byte)
+  UINT8             AllocLen;       ///< Allocation length (low byte)
+  UINT8             Reserved1;
+  UINT8             Pad[6];
+} USB_BOOT_INQUIRY_VPD_CMD;
+
 typedef struct {
   UINT8             Pdt;            ///< Peripheral Device Type (low 5 bits)
   UINT8             Removable;      ///< Removable Media (highest bit)
@@ -270,6 +287,31 @@ UsbBootDetectMedia (
   IN  USB_MASS_DEVICE       *UsbMass
   );
 
+/**
+  Get the transfer length limit of the device from its Block Limits VPD page.
+
+  @param  UsbMass                The device to query.
+
+**/
+VOID
+UsbBootGetBlockLimits (
+  IN USB_MASS_DEVICE            *UsbMass
+  );
+
+/**
+  Get the largest number of blocks to move with one read or write command.
+
+  @param  UsbMass                The USB mass storage device
+
+  @return UsbMass->MaxTransferLength, or USB_BOOT_IO_BLOCKS if the device
+          did not report a limit.
+
+**/
+UINT16
+UsbBootMaxIoBlocks (
+  IN  USB_MASS_DEVICE       *UsbMass
+  );
+
 /**
   Read some blocks from the device.
 
@@ -0,0 +1,834 @@
+/** @file
+  DXE Dispatcher dispatch plan.
+
+  The order in which drivers are placed on the mScheduledQueue is recorded,
+  together with a hash of the contents of every firmware volume that was
+  processed, and saved once at ReadyToBoot in as many variables as needed to
+  keep each of them within PcdMaxVariableSize.
+
+  On the next boot the plan is replayed: instead of evaluating the DEPEX of
+  every driver on the mDiscoveredList after each round, only the next driver of
+  the plan is evaluated. If the firmware volumes do not match the plan, or the
+  next driver of the plan is not schedulable once the mScheduledQueue has been
+  drained, the dispatcher falls back to the full dependency evaluation for the
+  rest of the boot. Since every replayed driver still passes CoreIsSchedulable(),
+  a stale plan can only cost time, it never dispatches a driver early.
+
+Copyright (c) 2006 - 2017, Intel Corporation. All rights reserved.<BR>
+This program and the accompanying materials
+are licensed and made available under the terms and conditions of the BSD License
+which accompanies this distribution.  The full text of the license may be found at
+http://opensource.org/licenses/bsd-license.php
+
+THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+**/
+
+#include "DxeMain.h"
+
+#define DISPATCH_PLAN_FNV_OFFSET_BASIS  0xcbf29ce484222325ULL
+#define DISPATCH_PLAN_FNV_PRIME         0x00000100000001b3ULL
+
+//
+// The plan is split into at most this many variables. A longer plan is not
+// saved, and the next boot evaluates every dependency expression.
+//
+#define DISPATCH_PLAN_MAX_PARTS         16
+
+//
+// The length of a part variable name: the base name, four hex digits and the
+// null terminator.
+//
+#define DISPATCH_PLAN_NAME_LENGTH       (sizeof (EDKII_DXE_DISPATCH_PLAN_VARIABLE_NAME) / sizeof (CHAR16) + 4)
+
+extern LIST_ENTRY  mDiscoveredList;
+
+//
+// Firmware volumes processed during this boot, in the order they were processed
+//
+UINT64                          *mPlanFvHash       = NULL;
+EFI_HANDLE                      *mPlanFvHandle     = NULL;
+UINT32                          mPlanFvCount       = 0;
+UINT32                          mPlanFvHashMax     = 0;
+UINT32                          mPlanFvHandleMax   = 0;
+
+//
+// Drivers placed on the mScheduledQueue during this boot, in order
+//
+EDKII_DXE_DISPATCH_PLAN_DRIVER  *mPlanRecord       = NULL;
+UINT32                          mPlanRecordCount   = 0;
+UINT32                          mPlanRecordMax     = 0;
+BOOLEAN                         mPlanRecordValid   = TRUE;
+
+//
+// The plan of the previous boot, and the position of the replay in it
+//
+EDKII_DXE_DISPATCH_PLAN         *mPlan             = NULL;
+UINT32                          mPlanCursor        = 0;
+BOOLEAN                         mPlanReplaying     = FALSE;
+BOOLEAN                         mPlanHobChecked    = FALSE;
+BOOLEAN                         mPlanLoadDone      = FALSE;
+
+//
+// Hash of the plan that is stored in the variable, to avoid rewriting it
+//
+UINT64                          mPlanStoredHash    = 0;
+
+/**
+  Add a buffer to a FNV-1a hash.
+
+  @param  Hash                   The hash so far, or 0 to start a new hash.
+  @param  Buffer                 The data to add.
+  @param  Length                 The size of Buffer in bytes.
+
+  @return The updated hash.
+
+**/
+UINT64
+CoreDispatchPlanHash (
+  IN UINT64      Hash,
+  IN CONST VOID  *Buffer,
+  IN UINTN       Length
+  )
+{
+  CONST UINT8  *Bytes;
+
+  if (Hash == 0) {
+    Hash = DISPATCH_PLAN_FNV_OFFSET_BASIS;
+  }
+
+  for (Bytes = Buffer; Length > 0; Bytes++, Length--) {
+    Hash = MultU64x64 (Hash ^ *Bytes, DISPATCH_PLAN_FNV_PRIME);
+  }
+
+  return Hash;
+}
+
+/**
+  Add a file found in a firmware volume to the hash of the firmware volume.
+
+  @param  FvHash                 The hash of the firmware volume so far, or 0
+                                 for the first file.
+  @param  NameGuid               The name of the file.
+  @param  Type                   The type of the file.
+  @param  Size                   The size of the file.
+
+  @return The updated hash of the firmware volume.
+
+**/
+UINT64
+CoreDispatchPlanHashFile (
+  IN UINT64           FvHash,
+  IN EFI_GUID         *NameGuid,
+  IN EFI_FV_FILETYPE  Type,
+  IN UINTN            Size
+  )
+{
+  UINT64  Size64;
+
+  Size64 = Size;
+  FvHash = CoreDispatchPlanHash (FvHash, NameGuid, sizeof (EFI_GUID));
+  FvHash = CoreDispatchPlanHash (FvHash, &Type, sizeof (Type));
+  return CoreDispatchPlanHash (FvHash, &Size64, sizeof (Size64));
+}
+
+/**
+  Make room for one more entry in an array that grows on demand.
+
+  @param  Array                  The array to grow.
+  @param  Count                  The number of entries in use.
+  @param  Max                    The number of entries allocated.
+  @param  EntrySize              The size of one entry.
+
+  @retval TRUE                   There is room for one more entry.
+  @retval FALSE                  The array could not be grown.
+
+**/
+BOOLEAN
+CoreDispatchPlanGrow (
+  IN OUT VOID    **Array,
+  IN     UINT32  Count,
+  IN OUT UINT32  *Max,
+  IN     UINTN   EntrySize
+  )
+{
+  VOID    *NewArray;
+  UINT32  NewMax;
+
+  if (Count < *Max) {
+    return TRUE;
+  }
+
+  NewMax   = (*Max == 0) ? 32 : *Max * 2;
+  NewArray = ReallocatePool (*Max * EntrySize, NewMax * EntrySize, *Array);
+  if (NewArray == NULL) {
+    return FALSE;
+  }
+
+  *Array = NewArray;
+  *Max   = NewMax;
+  return TRUE;
+}
+
+/**
+  Stop replaying the plan of the previous boot.
+
+  @param  Reason                 Why the replay stops, for the debug log.
+
+**/
+VOID
+CoreDispatchPlanStopReplay (
+  IN CONST CHAR8  *Reason
+  )
+{
+  if (mPlanReplaying) {
+    DEBUG ((
+      DEBUG_INFO,
+      "DXE dispatch plan: %a after %d of %d drivers, using full dependency evaluation\n",
+      Reason,
+      mPlanCursor,
+      mPlan->DriverCount
+      ));
+    mPlanReplaying = FALSE;
+  }
+}
+
+/**
+  Record a firmware volume that was processed by the dispatcher.
+
+  @param  FvHandle               The handle of the firmware volume.
+  @param  FvHash                 The hash of the files of the firmware volume.
+
+**/
+VOID
+CoreDispatchPlanAddFv (
+  IN EFI_HANDLE  FvHandle,
+  IN UINT64      FvHash
+  )
+{
+  if (!FeaturePcdGet (PcdDxeDispatchPlanEnable)) {
+    return;
+  }
+
+  if (!CoreDispatchPlanGrow ((VOID **) &mPlanFvHash, mPlanFvCount, &mPlanFvHashMax, sizeof (UINT64)) ||
+      !CoreDispatchPlanGrow ((VOID **) &mPlanFvHandle, mPlanFvCount, &mPlanFvHandleMax, sizeof (EFI_HANDLE))) {
+    mPlanRecordValid = FALSE;
+    return;
+  }
+
+  mPlanFvHash[mPlanFvCount]   = FvHash;
+  mPlanFvHandle[mPlanFvCount] = FvHandle;
+  mPlanFvCount++;
+
+  if (mPlanReplaying) {
+    if ((mPlanFvCount > mPlan->FvCount) ||
+        (((UINT64 *) (mPlan + 1))[mPlanFvCount - 1] != FvHash)) {
+      CoreDispatchPlanStopReplay ("firmware volume changed");
+    }
+  }
+}
+
+/**
+  Record a driver that was placed on the mScheduledQueue.
+
+  @param  DriverEntry            The driver that was scheduled.
+
+**/
+VOID
+CoreDispatchPlanRecord (
+  IN EFI_CORE_DRIVER_ENTRY  *DriverEntry
+  )
+{
+  UINT32  FvIndex;
+
+  if (!FeaturePcdGet (PcdDxeDispatchPlanEnable) || !mPlanRecordValid) {
+    return;
+  }
+
+  for (FvIndex = 0; FvIndex < mPlanFvCount; FvIndex++) {
+    if (mPlanFvHandle[FvIndex] == DriverEntry->FvHandle) {
+      break;
+    }
+  }
+
+  if ((FvIndex == mPlanFvCount) ||
+      !CoreDispatchPlanGrow ((VOID **) &mPlanRecord, mPlanRecordCount, &mPlanRecordMax, sizeof (EDKII_DXE_DISPATCH_PLAN_DRIVER))) {
+    mPlanRecordValid = FALSE;
+    return;
+  }
+
+  CopyGuid (&mPlanRecord[mPlanRecordCount].FileName, &DriverEntry->FileName);
+  mPlanRecord[mPlanRecordCount].FvIndex = FvIndex;
+  mPlanRecordCount++;
+}
+
+/**
+  Build the name of the variable holding a part of the plan.
+
+  @param  PartIndex              The index of the part.
+  @param  Name                   Receives the variable name,
+                                 DISPATCH_PLAN_NAME_LENGTH characters long.
+
+**/
+VOID
+CoreDispatchPlanPartName (
+  IN  UINTN   PartIndex,
+  OUT CHAR16  *Name
+  )
+{
+  UINTN  Length;
+  UINTN  Digit;
+
+  StrCpyS (Name, DISPATCH_PLAN_NAME_LENGTH, EDKII_DXE_DISPATCH_PLAN_VARIABLE_NAME);
+  Length = StrLen (Name);
+  for (Digit = 0; Digit < 4; Digit++) {
+    Name[Length + Digit] = L"0123456789ABCDEF"[(PartIndex >> (12 - 4 * Digit)) & 0xf];
+  }
+  Name[Length + 4] = L'\0';
+}
+
+/**
+  Compute how many bytes of the plan fit in one part variable.
+
+  @return The number of bytes per part, or 0 if PcdMaxVariableSize is too small
+          for the part header.
+
+**/
+UINTN
+CoreDispatchPlanBytesPerPart (
+  VOID
+  )
+{
+  UINTN  Overhead;
+
+  //
+  // The variable header and name count against PcdMaxVariableSize as well.
+  //
+  Overhead = sizeof (AUTHENTICATED_VARIABLE_HEADER) + DISPATCH_PLAN_NAME_LENGTH * sizeof (CHAR16) +
+             sizeof (EDKII_DXE_DISPATCH_PLAN_PART);
+  if (PcdGet32 (PcdMaxVariableSize) <= Overhead) {
+    return 0;
+  }
+  return PcdGet32 (PcdMaxVariableSize) - Overhead;
+}
+
+/**
+  Read one part of the plan of the previous boot.
+
+  @param  PartIndex              The index of the part.
+  @param  Size                   Returns the size of the part in bytes,
+                                 including the part header.
+
+  @return The part, allocated from pool, or NULL if it does not exist or its
+          header is not valid.
+
+**/
+EDKII_DXE_DISPATCH_PLAN_PART *
+CoreDispatchPlanReadPart (
+  IN  UINTN  PartIndex,
+  OUT UINTN  *Size
+  )
+{
+  EFI_STATUS                    Status;
+  CHAR16                        Name[DISPATCH_PLAN_NAME_LENGTH];
+  EDKII_DXE_DISPATCH_PLAN_PART  *Part;
+
+  CoreDispatchPlanPartName (PartIndex, Name);
+  *Size  = 0;
+  Status = gDxeCoreRT->GetVariable (Name, &gEdkiiDxeDispatchPlanGuid, NULL, Size, NULL);
+  if (Status != EFI_BUFFER_TOO_SMALL) {
+    return NULL;
+  }
+
+  Part = AllocatePool (*Size);
+  if (Part == NULL) {
+    return NULL;
+  }
+
+  Status = gDxeCoreRT->GetVariable (Name, &gEdkiiDxeDispatchPlanGuid, NULL, Size, Part);
+  if (EFI_ERROR (Status) ||
+      (*Size <= sizeof (EDKII_DXE_DISPATCH_PLAN_PART)) ||
+      (Part->Signature != EDKII_DXE_DISPATCH_PLAN_PART_SIGNATURE) ||
+      (Part->PartIndex != PartIndex) ||
+      (Part->PartIndex >= Part->PartCount) ||
+      (Part->PartCount > DISPATCH_PLAN_MAX_PARTS)) {
+    CoreFreePool (Part);
+    return NULL;
+  }
+
+  return Part;
+}
+
+/**
+  Read the plan of the previous boot from its part variables.
+
+  @param  Size                   Returns the size of the plan in bytes.
+
+  @return The plan, allocated from pool, or NULL if a part is missing, the
+          parts belong to different plans, or the plan does not match the
+          hash recorded in its parts.
+
+**/
+EDKII_DXE_DISPATCH_PLAN *
+CoreDispatchPlanRead (
+  OUT UINTN  *Size
+  )
+{
+  EDKII_DXE_DISPATCH_PLAN_PART  *Part;
+  UINTN                         PartSize;
+  UINTN                         PartIndex;
+  UINTN                         PartCount;
+  UINT64                        PlanHash;
+  UINT8                         *Plan;
+  UINT8                         *NewPlan;
+
+  *Size = 0;
+  Plan  = NULL;
+
+  Part = CoreDispatchPlanReadPart (0, &PartSize);
+  if (Part == NULL) {
+    return NULL;
+  }
+  PartCount = Part->PartCount;
+  PlanHash  = Part->PlanHash;
+
+  for (PartIndex = 0; ; PartIndex++) {
+    //
+    // All parts must belong to the same plan.
+    //
+    if ((Part == NULL) || (Part->PartCount != PartCount) || (Part->PlanHash != PlanHash)) {
+      break;
+    }
+
+    PartSize -= sizeof (EDKII_DXE_DISPATCH_PLAN_PART);
+    NewPlan = ReallocatePool (*Size, *Size + PartSize, Plan);
+    if (NewPlan == NULL) {
+      break;
+    }
+    Plan = NewPlan;
+    CopyMem (Plan + *Size, Part + 1, PartSize);
+    *Size += PartSize;
+    CoreFreePool (Part);
+    Part = NULL;
+
+    if (PartIndex + 1 == PartCount) {
+      if (CoreDispatchPlanHash (0, Plan, *Size) == PlanHash) {
+        return (EDKII_DXE_DISPATCH_PLAN *) Plan;
+      }
+      break;
+    }
+    Part = CoreDispatchPlanReadPart (PartIndex + 1, &PartSize);
+  }
+
+  DEBUG ((DEBUG_INFO, "DXE dispatch plan: stored plan is incomplete\n"));
+  if (Part != NULL) {
+    CoreFreePool (Part);
+  }
+  if (Plan != NULL) {
+    CoreFreePool (Plan);
+  }
+  *Size = 0;
+  return NULL;
+}
+
+/**
+  Save the plan in as many part variables as needed, and delete the parts of a
+  longer plan saved before.
+
+  @param  Plan                   The plan to save.
+  @param  Size                   The size of the plan in bytes.
+  @param  PlanHash               The hash of the plan.
+  @param  BytesPerPart           The number of bytes of the plan per part.
+
+  @retval EFI_SUCCESS            The plan was saved.
+  @retval EFI_BAD_BUFFER_SIZE    The plan needs more than DISPATCH_PLAN_MAX_PARTS
+                                 parts.
+  @retval EFI_OUT_OF_RESOURCES   There is not enough memory for a part.
+  @retval Others                 Writing a part failed.
+
+**/
+EFI_STATUS
+CoreDispatchPlanWrite (
+  IN EDKII_DXE_DISPATCH_PLAN  *Plan,
+  IN UINTN                    Size,
+  IN UINT64                   PlanHash,
+  IN UINTN                    BytesPerPart
+  )
+{
+  EFI_STATUS                    Status;
+  CHAR16                        Name[DISPATCH_PLAN_NAME_LENGTH];
+  EDKII_DXE_DISPATCH_PLAN_PART  *Part;
+  UINTN                         PartCount;
+  UINTN                         PartIndex;
+  UINTN                         PartSize;
+
+  PartCount = (Size + BytesPerPart - 1) / BytesPerPart;
+  if (PartCount > DISPATCH_PLAN_MAX_PARTS) {
+    return EFI_BAD_BUFFER_SIZE;
+  }
+
+  Part = AllocatePool (sizeof (EDKII_DXE_DISPATCH_PLAN_PART) + BytesPerPart);
+  if (Part == NULL) {
+    return EFI_OUT_OF_RESOURCES;
+  }
+
+  Status = EFI_SUCCESS;
+  for (PartIndex = 0; PartIndex < PartCount; PartIndex++) {
+    PartSize = MIN (BytesPerPart, Size - PartIndex * BytesPerPart);
+    Part->Signature = EDKII_DXE_DISPATCH_PLAN_PART_SIGNATURE;
+    Part->PartIndex = (UINT16) PartIndex;
+    Part->PartCount = (UINT16) PartCount;
+    Part->PlanHash  = PlanHash;
+    CopyMem (Part + 1, (UINT8 *) Plan + PartIndex * BytesPerPart, PartSize);
+
+    CoreDispatchPlanPartName (PartIndex, Name);
+    Status = gDxeCoreRT->SetVariable (
+                           Name,
+                           &gEdkiiDxeDispatchPlanGuid,
+                           EFI_VARIABLE_NON_VOLATILE | EFI_VARIABLE_BOOTSERVICE_ACCESS,
+                           sizeof (EDKII_DXE_DISPATCH_PLAN_PART) + PartSize,
+                           Part
+                           );
+    if (EFI_ERROR (Status)) {
+      break;
+    }
+  }
+  CoreFreePool (Part);
+
+  //
+  // A plan saved in part is not used, so drop all of it on failure, together
+  // with the parts of a longer plan saved before.
+  //
+  if (EFI_ERROR (Status)) {
+    PartCount = 0;
+  }
+  for (PartIndex = PartCount; PartIndex < DISPATCH_PLAN_MAX_PARTS; PartIndex++) {
+    CoreDispatchPlanPartName (PartIndex, Name);
+    gDxeCoreRT->SetVariable (Name, &gEdkiiDxeDispatchPlanGuid, 0, 0, NULL);
+  }
+
+  return Status;
+}
+
+/**
+  Check a plan of the previous boot and start replaying it.
+
+  @param  Plan                   The plan, allocated from pool. It is freed if
+                                 it is not used.
+  @param  Size                   The size of the plan in bytes.
+
+**/
+VOID
+CoreDispatchPlanAccept (
+  IN EDKII_DXE_DISPATCH_PLAN  *Plan,
+  IN UINTN                    Size
+  )
+{
+  UINT64                          *FvHash;
+  EDKII_DXE_DISPATCH_PLAN_DRIVER  *Driver;
+  UINT32                          Index;
+
+  if ((Size < sizeof (EDKII_DXE_DISPATCH_PLAN)) ||
+      (Plan->Signature != EDKII_DXE_DISPATCH_PLAN_SIGNATURE) ||
+      (Plan->Length != Size) ||
+      (Plan->FvCount > MAX_UINT16) || (Plan->DriverCount > MAX_UINT16) ||
+      (Size != sizeof (EDKII_DXE_DISPATCH_PLAN) + Plan->FvCount * sizeof (UINT64) +
+               Plan->DriverCount * sizeof (EDKII_DXE_DISPATCH_PLAN_DRIVER))) {
+    DEBUG ((DEBUG_INFO, "DXE dispatch plan: stored plan is malformed\n"));
+    CoreFreePool (Plan);
+    return;
+  }
+
+  FvHash = (UINT64 *) (Plan + 1);
+  Driver = (EDKII_DXE_DISPATCH_PLAN_DRIVER *) (FvHash + Plan->FvCount);
+  for (Index = 0; Index < Plan->DriverCount; Index++) {
+    if (Driver[Index].FvIndex >= Plan->FvCount) {
+      DEBUG ((DEBUG_INFO, "DXE dispatch plan: stored plan is malformed\n"));
+      CoreFreePool (Plan);
+      return;
+    }
+  }
+
+  mPlanStoredHash = CoreDispatchPlanHash (0, Plan, Size);
+
+  //
+  // The firmware volumes processed so far must match the plan.
+  //
+  for (Index = 0; Index < mPlanFvCount; Index++) {
+    if ((Index >= Plan->FvCount) || (FvHash[Index] != mPlanFvHash[Index])) {
+      DEBUG ((DEBUG_INFO, "DXE dispatch plan: firmware volume %d changed, plan not used\n", Index));
+      CoreFreePool (Plan);
+      return;
+    }
+  }
+
+  mPlan          = Plan;
+  mPlanCursor    = 0;
+  mPlanReplaying = TRUE;
+  DEBUG ((DEBUG_INFO, "DXE dispatch plan: replaying %d drivers\n", Plan->DriverCount));
+}
+
+/**
+  Load the plan of the previous boot, from a GUIDed HOB if the platform
+  provided one, or else from the part variables once the variable services
+  are available.
+
+**/
+VOID
+CoreDispatchPlanLoad (
+  VOID
+  )
+{
+  EFI_STATUS         Status;
+  EFI_HOB_GUID_TYPE  *GuidHob;
+  VOID               *Interface;
+  VOID               *Plan;
+  UINTN              Size;
+
+  if (!FeaturePcdGet (PcdDxeDispatchPlanEnable) || (mPlan != NULL) || mPlanLoadDone) {
+    return;
+  }
+
+  if (!mPlanHobChecked) {
+    mPlanHobChecked = TRUE;
+    GuidHob = GetFirstGuidHob (&gEdkiiDxeDispatchPlanGuid);
+    if (GuidHob != NULL) {
+      mPlanLoadDone = TRUE;
+      Plan = AllocateCopyPool (GET_GUID_HOB_DATA_SIZE (GuidHob), GET_GUID_HOB_DATA (GuidHob));
+      if (Plan != NULL) {
+        CoreDispatchPlanAccept (Plan, GET_GUID_HOB_DATA_SIZE (GuidHob));
+      }
+      return;
+    }
+  }
+
+  Status = CoreLocateProtocol (&gEfiVariableArchProtocolGuid, NULL, &Interface);
+  if (EFI_ERROR (Status)) {
+    return;
+  }
+  mPlanLoadDone = TRUE;
+
+  Plan = CoreDispatchPlanRead (&Size);
+  if (Plan != NULL) {
+    CoreDispatchPlanAccept (Plan, Size);
+  }
+}
+
+/**
+  Find a discovered driver by firmware volume and file name.
+
+  @param  FvHandle               The handle of the firmware volume.
+  @param  FileName               The name of the driver file.
+
+  @return The driver, or NULL if it was not discovered.
+
+**/
+EFI_CORE_DRIVER_ENTRY *
+CoreDispatchPlanFindDriver (
+  IN EFI_HANDLE  FvHandle,
+  IN EFI_GUID    *FileName
+  )
+{
+  LIST_ENTRY             *Link;
+  EFI_CORE_DRIVER_ENTRY  *DriverEntry;
+
+  for (Link = mDiscoveredList.ForwardLink; Link != &mDiscoveredList; Link = Link->ForwardLink) {
+    DriverEntry = CR (Link, EFI_CORE_DRIVER_ENTRY, Link, EFI_CORE_DRIVER_ENTRY_SIGNATURE);
+    if ((DriverEntry->FvHandle == FvHandle) && CompareGuid (&DriverEntry->FileName, FileName)) {
+      return DriverEntry;
+    }
+  }
+
+  return NULL;
+}
+
+/**
+  Place the next drivers of the plan of the previous boot on the
+  mScheduledQueue, as long as they are schedulable.
+
+  Drivers with a BEFORE or AFTER dependency are skipped, they are scheduled
+  together with the driver they depend on.
+
+  @retval TRUE                   One or more drivers were scheduled.
+  @retval FALSE                  Nothing was scheduled from the plan. The
+                                 caller has to evaluate the mDiscoveredList.
+
+**/
+BOOLEAN
+CoreDispatchPlanSchedule (
+  VOID
+  )
+{
+  EDKII_DXE_DISPATCH_PLAN_DRIVER  *Planned;
+  EFI_CORE_DRIVER_ENTRY           *DriverEntry;
+  BOOLEAN                         Scheduled;
+
+  if (!FeaturePcdGet (PcdDxeDispatchPlanEnable) || !mPlanReplaying) {
+    return FALSE;
+  }
+
+  Planned   = (EDKII_DXE_DISPATCH_PLAN_DRIVER *) ((UINT64 *) (mPlan + 1) + mPlan->FvCount);
+  Scheduled = FALSE;
+  while (mPlanCursor < mPlan->DriverCount) {
+    DriverEntry = NULL;
+    if (Planned[mPlanCursor].FvIndex < mPlanFvCount) {
+      DriverEntry = CoreDispatchPlanFindDriver (
+                      mPlanFvHandle[Planned[mPlanCursor].FvIndex],
+                      &Planned[mPlanCursor].FileName
+                      );
+    }
+    if (DriverEntry == NULL) {
+      break;
+    }
+
+    if (!DriverEntry->Dependent) {
+      if (!DriverEntry->Scheduled && !DriverEntry->Initialized) {
+        break;
+      }
+      //
+      // Already scheduled from the A Priori file or by a BEFORE or AFTER dependency
+      //
+      mPlanCursor++;
+      continue;
+    }
+
+    if (DriverEntry->Before || DriverEntry->After) {
+      mPlanCursor++;
+      continue;
+    }
+
+    if (DriverEntry->DepexProtocolError) {
+      CoreGetDepexSectionAndPreProccess (DriverEntry);
+    }
+    if (!CoreIsSchedulable (DriverEntry)) {
+      break;
+    }
+
+    CoreInsertOnScheduledQueueWhileProcessingBeforeAndAfter (DriverEntry);
+    mPlanCursor++;
+    Scheduled = TRUE;
+  }
+
+  if (!Scheduled) {
+    CoreDispatchPlanStopReplay (
+      (mPlanCursor == mPlan->DriverCount) ? "plan complete" : "plan diverged"
+      );
+  }
+
+  return Scheduled;
+}
+
+/**
+  Save the order in which drivers were scheduled during this boot at
+  ReadyToBoot, if it differs from the stored plan and the variable services
+  are available.
+
+  @param  Event                  Event whose notification function is being invoked.
+  @param  Context                Pointer to the notification function's context.
+
+**/
+VOID
+EFIAPI
+CoreDispatchPlanSave (
+  IN EFI_EVENT  Event,
+  IN VOID       *Context
+  )
+{
+  EFI_STATUS               Status;
+  VOID                     *Interface;
+  EDKII_DXE_DISPATCH_PLAN  *Plan;
+  UINTN                    Size;
+  UINTN                    FvHashSize;
+  UINTN                    BytesPerPart;
+  UINT64                   Hash;
+
+  //
+  // The plan is only saved at the first ReadyToBoot, later boot options do not
+  // dispatch more drivers.
+  //
+  CoreCloseEvent (Event);
+
+  if (!mPlanRecordValid || (mPlanRecordCount == 0)) {
+    return;
+  }
+
+  Status = CoreLocateProtocol (&gEfiVariableWriteArchProtocolGuid, NULL, &Interface);
+  if (EFI_ERROR (Status)) {
+    return;
+  }
+
+  FvHashSize = mPlanFvCount * sizeof (UINT64);
+  Size       = sizeof (EDKII_DXE_DISPATCH_PLAN) + FvHashSize +
+               mPlanRecordCount * sizeof (EDKII_DXE_DISPATCH_PLAN_DRIVER);
+
+  BytesPerPart = CoreDispatchPlanBytesPerPart ();
+  if (BytesPerPart == 0) {
+    DEBUG ((DEBUG_ERROR, "DXE dispatch plan: PcdMaxVariableSize is too small, plan not saved\n"));
+    return;
+  }
+
+  Plan = AllocatePool (Size);
+  if (Plan == NULL) {
+    return;
+  }
+
+  Plan->Signature   = EDKII_DXE_DISPATCH_PLAN_SIGNATURE;
+  Plan->Length      = (UINT32) Size;
+  Plan->FvCount     = mPlanFvCount;
+  Plan->DriverCount = mPlanRecordCount;
+  CopyMem (Plan + 1, mPlanFvHash, FvHashSize);
+  CopyMem (
+    (UINT8 *) (Plan + 1) + FvHashSize,
+    mPlanRecord,
+    mPlanRecordCount * sizeof (EDKII_DXE_DISPATCH_PLAN_DRIVER)
+    );
+
+  Hash = CoreDispatchPlanHash (0, Plan, Size);
+  if (Hash != mPlanStoredHash) {
+    Status = CoreDispatchPlanWrite (Plan, Size, Hash, BytesPerPart);
+    if (Status == EFI_BAD_BUFFER_SIZE) {
+      DEBUG ((
+        DEBUG_ERROR,
+        "DXE dispatch plan: %d drivers need %d bytes, more than %d variables hold, plan not saved\n",
+        mPlanRecordCount,
+        Size,
+        DISPATCH_PLAN_MAX_PARTS
+        ));
+    } else if (EFI_ERROR (Status)) {
+      DEBUG ((DEBUG_ERROR, "DXE dispatch plan: saving %d drivers failed - %r\n", mPlanRecordCount, Status));
+    } else {
+      mPlanStoredHash = Hash;
+    }
+  }
+
+  CoreFreePool (Plan);
+}
+
+/**
+  Initialize the dispatch plan support: register the save of the plan at
+  ReadyToBoot.
+
+**/
+VOID
+CoreInitializeDispatchPlan (
+  VOID
+  )
+{
+  EFI_STATUS  Status;
+  EFI_EVENT   ReadyToBootEvent;
+
+  if (!FeaturePcdGet (PcdDxeDispatchPlanEnable)) {
+    return;
+  }
+
+  Status = CoreCreateEventEx (
+             EVT_NOTIFY_SIGNAL,
+             TPL_CALLBACK,
+             CoreDispatchPlanSave,
+             NULL,
+             &gEfiEventReadyToBootGuid,
+             &ReadyToBootEvent
+             );
+  ASSERT_EFI_ERROR (Status);
+}
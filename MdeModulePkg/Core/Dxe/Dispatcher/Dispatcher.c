@@ -443,6 +443,11 @@ CoreDispatcher (
 
   ReturnStatus = EFI_NOT_FOUND;
   do {
+    //
+    // Decode the sections of the upcoming drivers on the APs
+    //
+    CoreStartDispatchPrefetch (&mScheduledQueue);
+
     //
     // Drain the Scheduled Queue
     //
@@ -539,6 +544,8 @@ CoreDispatcher (
       ReturnStatus = EFI_SUCCESS;
     }
 
+    CoreEndDispatchPrefetch ();
+
     //
     // Now DXE Dispatcher finished one round of dispatch, signal an event group
     // so that SMM Dispatcher get chance to dispatch SMM Drivers which depend
@@ -548,6 +555,15 @@ CoreDispatcher (
       CoreSignalEvent (DxeDispatchEvent);
     }
 
+    //
+    // Replay the dispatch plan of the previous boot while it still matches
+    //
+    CoreDispatchPlanLoad ();
+    if (CoreDispatchPlanSchedule ()) {
+      ReadyToRun = TRUE;
+      continue;
+    }
+
     //
     // Search DriverList for items to place on Scheduled Queue
     //
@@ -638,6 +654,8 @@ CoreInsertOnScheduledQueueWhileProcessingBeforeAndAfter (
 
   CoreReleaseDispatcherLock ();
 
+  CoreDispatchPlanRecord (InsertedDriverEntry);
+
   //
   // Process After Dependency
   //
@@ -1124,6 +1142,7 @@ CoreFwVolEventProtocolNotify (
   UINTN                         SizeOfBuffer;
   VOID                          *DepexBuffer;
   KNOWN_HANDLE                  *KnownHandle;
+  UINT64                        FvHash;
 
   FvHandle = NULL;
 
@@ -1185,6 +1204,7 @@ CoreFwVolEventProtocolNotify (
     //  EFI_FV_FILETYPE_DXE_CORE is processed to produce a Loaded Image protocol for the core
     //  EFI_FV_FILETYPE_FIRMWARE_VOLUME_IMAGE is processed to create a Fvb
     //
+    FvHash = 0;
     for (Index = 0; Index < sizeof (mDxeFileTypes) / sizeof (EFI_FV_FILETYPE); Index++) {
       //
       // Initialize the search key
@@ -1201,6 +1221,7 @@ CoreFwVolEventProtocolNotify (
                                   &Size
                                   );
         if (!EFI_ERROR (GetNextFileStatus)) {
+          FvHash = CoreDispatchPlanHashFile (FvHash, &NameGuid, Type, Size);
           if (Type == EFI_FV_FILETYPE_DXE_CORE) {
             //
             // If this is the DXE core fill in it's DevicePath & DeviceHandle
@@ -1287,6 +1308,7 @@ CoreFwVolEventProtocolNotify (
         }
       } while (!EFI_ERROR (GetNextFileStatus));
     }
+    CoreDispatchPlanAddFv (FvHandle, FvHash);
 
     //
     // Read the array of GUIDs from the Apriori file if it is present in the firmware volume
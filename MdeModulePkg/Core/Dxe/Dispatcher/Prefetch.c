@@ -0,0 +1,532 @@
+/** @file
+  DXE Dispatcher section prefetch.
+
+  Before each round of the DXE Dispatcher drains the mScheduledQueue, the
+  encapsulation sections of the next scheduled drivers are decoded in one burst
+  on all enabled APs. Only pure decode work runs on the APs: the FV file
+  is read, the sections are located and all buffers are allocated on the BSP,
+  and the APs only run the standard UEFI decompression or the LZMA GUIDed
+  section decoder on the buffers they are handed. The APs are idle again before
+  the first driver of the round is started, so drivers that use MP services
+  themselves are not affected.
+
+  When CoreLoadImage() later opens the same section, the section extraction
+  code picks up the already decoded data instead of decoding it again. Loading,
+  relocation, security and authentication stay on the BSP and are unchanged,
+  since the decoded data is byte for byte the data the BSP would have produced.
+
+  When the MP Services Protocol is not available, or no APs are enabled, the
+  dispatcher simply runs serially.
+
+Copyright (c) 2006 - 2017, Intel Corporation. All rights reserved.<BR>
+This program and the accompanying materials
+are licensed and made available under the terms and conditions of the BSD License
+which accompanies this distribution.  The full text of the license may be found at
+http://opensource.org/licenses/bsd-license.php
+
+THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+**/
+
+#include "DxeMain.h"
+
+#define PREFETCH_JOB_PENDING   0
+#define PREFETCH_JOB_RUNNING   1
+#define PREFETCH_JOB_DONE      2
+
+typedef struct {
+  EFI_GUID                    FileName;
+  VOID                        *FileBuffer;
+  EFI_COMMON_SECTION_HEADER   *Section;
+  UINTN                       SectionSize;
+  VOID                        *Source;
+  VOID                        *OutputBuffer;
+  UINT32                      OutputSize;
+  VOID                        *ScratchBuffer;
+  UINT32                      AuthenticationStatus;
+  EFI_STATUS                  Status;
+  UINT64                      DecodeStart;
+  UINT64                      DecodeEnd;
+  volatile UINT32             State;
+} DISPATCH_PREFETCH_JOB;
+
+typedef struct {
+  DISPATCH_PREFETCH_JOB       *Jobs;
+  UINT32                      JobCount;
+  volatile UINT32             NextJob;
+} DISPATCH_PREFETCH_BATCH;
+
+//
+// The prefetch batch of the current dispatch round
+//
+DISPATCH_PREFETCH_BATCH  mPrefetchBatch;
+
+/**
+  Convert the performance counter values taken around a decode into microseconds.
+
+  @param  Start                  The performance counter value before the decode.
+  @param  End                    The performance counter value after the decode.
+
+  @return The elapsed time in microseconds.
+
+**/
+UINT64
+CorePrefetchElapsedTime (
+  IN UINT64  Start,
+  IN UINT64  End
+  )
+{
+  UINT64  CounterStart;
+  UINT64  CounterEnd;
+  UINT64  Ticks;
+
+  GetPerformanceCounterProperties (&CounterStart, &CounterEnd);
+  if (CounterEnd < CounterStart) {
+    //
+    // The counter counts down.
+    //
+    Ticks = (Start >= End) ? (Start - End) : (Start - CounterEnd) + (CounterStart - End);
+  } else {
+    Ticks = (End >= Start) ? (End - Start) : (CounterEnd - Start) + (End - CounterStart);
+  }
+
+  return DivU64x32 (GetTimeInNanoSecond (Ticks), 1000);
+}
+
+/**
+  Decode the section of a prefetch job into the buffers allocated for it.
+
+  This function may run on an AP, so it must not use any DXE services.
+
+  @param  Job                    The prefetch job to decode.
+
+**/
+VOID
+CoreDecodePrefetchJob (
+  IN OUT DISPATCH_PREFETCH_JOB  *Job
+  )
+{
+  VOID  *Output;
+
+  Job->DecodeStart = GetPerformanceCounter ();
+  if (Job->Section->Type == EFI_SECTION_COMPRESSION) {
+    Job->Status = UefiDecompress (Job->Source, Job->OutputBuffer, Job->ScratchBuffer);
+  } else {
+    Output = Job->OutputBuffer;
+    Job->Status = ExtractGuidedSectionDecode (
+                    Job->Section,
+                    &Output,
+                    Job->ScratchBuffer,
+                    &Job->AuthenticationStatus
+                    );
+    if (!EFI_ERROR (Job->Status) && (Output != Job->OutputBuffer)) {
+      CopyMem (Job->OutputBuffer, Output, Job->OutputSize);
+    }
+  }
+  Job->DecodeEnd = GetPerformanceCounter ();
+
+  MemoryFence ();
+  Job->State = PREFETCH_JOB_DONE;
+}
+
+/**
+  Pick up pending prefetch jobs until none is left. Runs on every enabled AP,
+  and on the BSP when the APs could not be started.
+
+  @param  Buffer                 Pointer to the DISPATCH_PREFETCH_BATCH.
+
+**/
+VOID
+EFIAPI
+CorePrefetchWorker (
+  IN OUT VOID  *Buffer
+  )
+{
+  DISPATCH_PREFETCH_BATCH  *Batch;
+  DISPATCH_PREFETCH_JOB    *Job;
+  UINT32                   Index;
+
+  Batch = (DISPATCH_PREFETCH_BATCH *) Buffer;
+  for (;;) {
+    Index = InterlockedIncrement (&Batch->NextJob) - 1;
+    if (Index >= Batch->JobCount) {
+      break;
+    }
+
+    Job = &Batch->Jobs[Index];
+    if (InterlockedCompareExchange32 (&Job->State, PREFETCH_JOB_PENDING, PREFETCH_JOB_RUNNING) == PREFETCH_JOB_PENDING) {
+      CoreDecodePrefetchJob (Job);
+    }
+  }
+}
+
+/**
+  Check whether a section can be decoded on an AP, and allocate the buffers
+  for it if so.
+
+  Only the standard UEFI compression and the LZMA GUIDed sections are decoded
+  on APs. Their decoders only touch the buffers they are handed, while other
+  GUIDed section handlers may call boot services.
+
+  @param  Job                    The prefetch job to fill in.
+  @param  Section                The section in the file buffer.
+  @param  SectionSize            The size of the section in bytes.
+
+  @retval TRUE                   The job is ready to be decoded.
+  @retval FALSE                  The section is not decoded ahead of time.
+
+**/
+BOOLEAN
+CorePreparePrefetchJob (
+  IN OUT DISPATCH_PREFETCH_JOB      *Job,
+  IN     EFI_COMMON_SECTION_HEADER  *Section,
+  IN     UINTN                      SectionSize
+  )
+{
+  EFI_STATUS  Status;
+  UINTN       HeaderSize;
+  UINT32      UncompressedLength;
+  UINT8       CompressionType;
+  EFI_GUID    *SectionDefinitionGuid;
+  UINT16      Attributes;
+  UINT32      OutputSize;
+  UINT32      ScratchSize;
+
+  if (Section->Type == EFI_SECTION_COMPRESSION) {
+    if (IS_SECTION2 (Section)) {
+      HeaderSize         = sizeof (EFI_COMPRESSION_SECTION2);
+      UncompressedLength = ((EFI_COMPRESSION_SECTION2 *) Section)->UncompressedLength;
+      CompressionType    = ((EFI_COMPRESSION_SECTION2 *) Section)->CompressionType;
+    } else {
+      HeaderSize         = sizeof (EFI_COMPRESSION_SECTION);
+      UncompressedLength = ((EFI_COMPRESSION_SECTION *) Section)->UncompressedLength;
+      CompressionType    = ((EFI_COMPRESSION_SECTION *) Section)->CompressionType;
+    }
+    if ((SectionSize <= HeaderSize) || (UncompressedLength == 0) ||
+        (CompressionType != EFI_STANDARD_COMPRESSION)) {
+      return FALSE;
+    }
+
+    Job->Source = (UINT8 *) Section + HeaderSize;
+    Status = UefiDecompressGetInfo (
+               Job->Source,
+               (UINT32) (SectionSize - HeaderSize),
+               &OutputSize,
+               &ScratchSize
+               );
+    if (EFI_ERROR (Status) || (OutputSize != UncompressedLength)) {
+      return FALSE;
+    }
+  } else if (Section->Type == EFI_SECTION_GUID_DEFINED) {
+    if (IS_SECTION2 (Section)) {
+      SectionDefinitionGuid = &((EFI_GUID_DEFINED_SECTION2 *) Section)->SectionDefinitionGuid;
+      Attributes            = ((EFI_GUID_DEFINED_SECTION2 *) Section)->Attributes;
+    } else {
+      SectionDefinitionGuid = &((EFI_GUID_DEFINED_SECTION *) Section)->SectionDefinitionGuid;
+      Attributes            = ((EFI_GUID_DEFINED_SECTION *) Section)->Attributes;
+    }
+    if (((Attributes & EFI_GUIDED_SECTION_PROCESSING_REQUIRED) == 0) ||
+        (!CompareGuid (SectionDefinitionGuid, &gLzmaCustomDecompressGuid) &&
+         !CompareGuid (SectionDefinitionGuid, &gLzmaF86CustomDecompressGuid))) {
+      return FALSE;
+    }
+
+    Status = ExtractGuidedSectionGetInfo (Section, &OutputSize, &ScratchSize, &Attributes);
+    if (EFI_ERROR (Status) || (OutputSize == 0)) {
+      return FALSE;
+    }
+  } else {
+    return FALSE;
+  }
+
+  Job->OutputBuffer = AllocatePool (OutputSize);
+  if (Job->OutputBuffer == NULL) {
+    return FALSE;
+  }
+  Job->ScratchBuffer = NULL;
+  if (ScratchSize > 0) {
+    Job->ScratchBuffer = AllocatePool (ScratchSize);
+    if (Job->ScratchBuffer == NULL) {
+      CoreFreePool (Job->OutputBuffer);
+      Job->OutputBuffer = NULL;
+      return FALSE;
+    }
+  }
+
+  Job->Section     = Section;
+  Job->SectionSize = SectionSize;
+  Job->OutputSize  = OutputSize;
+  Job->State       = PREFETCH_JOB_PENDING;
+  return TRUE;
+}
+
+/**
+  Read a scheduled driver from its FV and find the first section of the file
+  that can be decoded ahead of time.
+
+  @param  DriverEntry            The scheduled driver.
+  @param  Job                    The prefetch job to fill in.
+
+  @retval TRUE                   The job is ready to be decoded.
+  @retval FALSE                  The driver has nothing to prefetch.
+
+**/
+BOOLEAN
+CoreReadPrefetchFile (
+  IN     EFI_CORE_DRIVER_ENTRY  *DriverEntry,
+  IN OUT DISPATCH_PREFETCH_JOB  *Job
+  )
+{
+  EFI_STATUS                 Status;
+  UINTN                      FileSize;
+  EFI_FV_FILETYPE            FileType;
+  EFI_FV_FILE_ATTRIBUTES     FileAttributes;
+  UINT32                     AuthenticationStatus;
+  EFI_COMMON_SECTION_HEADER  *Section;
+  UINTN                      SectionSize;
+  UINTN                      Offset;
+
+  Job->FileBuffer = NULL;
+  Status = DriverEntry->Fv->ReadFile (
+                              DriverEntry->Fv,
+                              &DriverEntry->FileName,
+                              &Job->FileBuffer,
+                              &FileSize,
+                              &FileType,
+                              &FileAttributes,
+                              &AuthenticationStatus
+                              );
+  if (EFI_ERROR (Status)) {
+    return FALSE;
+  }
+
+  //
+  // Only the top level sections are looked at. A driver is typically a
+  // DEPEX section followed by one compressed or GUIDed section.
+  //
+  Offset = 0;
+  while (Offset + sizeof (EFI_COMMON_SECTION_HEADER2) <= FileSize) {
+    Section = (EFI_COMMON_SECTION_HEADER *) ((UINT8 *) Job->FileBuffer + Offset);
+    if (IS_SECTION2 (Section)) {
+      SectionSize = SECTION2_SIZE (Section);
+    } else {
+      SectionSize = SECTION_SIZE (Section);
+    }
+    if ((SectionSize < sizeof (EFI_COMMON_SECTION_HEADER)) || (SectionSize > FileSize - Offset)) {
+      break;
+    }
+
+    if (CorePreparePrefetchJob (Job, Section, SectionSize)) {
+      CopyGuid (&Job->FileName, &DriverEntry->FileName);
+      return TRUE;
+    }
+
+    Offset += ALIGN_VALUE (SectionSize, 4);
+  }
+
+  CoreFreePool (Job->FileBuffer);
+  Job->FileBuffer = NULL;
+  return FALSE;
+}
+
+/**
+  Decode the encapsulation sections of the next drivers on the scheduled queue
+  on all enabled processors.
+
+  The number of drivers looked at is limited by PcdDxeDispatcherPrefetchDepth.
+  The APs are started in blocking mode, which returns as soon as all of them are
+  idle again, so no AP is busy while a driver runs. In non-blocking mode the
+  completion would only be noticed by the periodic AP check of the MP services,
+  which takes longer than the decoding it saves.
+
+  @param  ScheduledQueue         The queue of scheduled drivers.
+
+**/
+VOID
+CoreStartDispatchPrefetch (
+  IN LIST_ENTRY  *ScheduledQueue
+  )
+{
+  EFI_STATUS                Status;
+  EFI_MP_SERVICES_PROTOCOL  *MpServices;
+  UINTN                     NumberOfProcessors;
+  UINTN                     NumberOfEnabledProcessors;
+  UINT32                    Depth;
+  LIST_ENTRY                *Link;
+  EFI_CORE_DRIVER_ENTRY     *DriverEntry;
+  UINT64                    BurstStart;
+  UINT64                    BurstTime;
+  UINT64                    DecodeTime;
+  UINT32                    Index;
+
+  Depth = PcdGet32 (PcdDxeDispatcherPrefetchDepth);
+  if ((Depth == 0) || (mPrefetchBatch.Jobs != NULL)) {
+    return;
+  }
+
+  Status = CoreLocateProtocol (&gEfiMpServiceProtocolGuid, NULL, (VOID **) &MpServices);
+  if (EFI_ERROR (Status)) {
+    return;
+  }
+  Status = MpServices->GetNumberOfProcessors (MpServices, &NumberOfProcessors, &NumberOfEnabledProcessors);
+  if (EFI_ERROR (Status) || (NumberOfEnabledProcessors < 2)) {
+    return;
+  }
+
+  mPrefetchBatch.Jobs = AllocateZeroPool (Depth * sizeof (DISPATCH_PREFETCH_JOB));
+  if (mPrefetchBatch.Jobs == NULL) {
+    return;
+  }
+  mPrefetchBatch.JobCount = 0;
+  mPrefetchBatch.NextJob  = 0;
+
+  for (Link = ScheduledQueue->ForwardLink;
+       (Link != ScheduledQueue) && (mPrefetchBatch.JobCount < Depth);
+       Link = Link->ForwardLink) {
+    DriverEntry = CR (Link, EFI_CORE_DRIVER_ENTRY, ScheduledLink, EFI_CORE_DRIVER_ENTRY_SIGNATURE);
+    if ((DriverEntry->ImageHandle != NULL) || DriverEntry->IsFvImage) {
+      continue;
+    }
+    if (CoreReadPrefetchFile (DriverEntry, &mPrefetchBatch.Jobs[mPrefetchBatch.JobCount])) {
+      mPrefetchBatch.JobCount++;
+    }
+  }
+
+  if (mPrefetchBatch.JobCount == 0) {
+    CoreFreePool (mPrefetchBatch.Jobs);
+    mPrefetchBatch.Jobs = NULL;
+    return;
+  }
+
+  BurstStart = GetPerformanceCounter ();
+
+  Status = MpServices->StartupAllAPs (
+                         MpServices,
+                         CorePrefetchWorker,
+                         FALSE,
+                         NULL,
+                         0,
+                         &mPrefetchBatch,
+                         NULL
+                         );
+  if (EFI_ERROR (Status)) {
+    //
+    // The APs are busy or gone. The sections already read are decoded on the BSP.
+    //
+    CorePrefetchWorker (&mPrefetchBatch);
+  }
+
+  BurstTime  = CorePrefetchElapsedTime (BurstStart, GetPerformanceCounter ());
+  DecodeTime = 0;
+  for (Index = 0; Index < mPrefetchBatch.JobCount; Index++) {
+    if (mPrefetchBatch.Jobs[Index].State == PREFETCH_JOB_DONE) {
+      DecodeTime += CorePrefetchElapsedTime (mPrefetchBatch.Jobs[Index].DecodeStart, mPrefetchBatch.Jobs[Index].DecodeEnd);
+    }
+  }
+  DEBUG ((
+    DEBUG_INFO,
+    "Dispatch prefetch: %d sections decoded on %d processors in %ld us (%ld us serial)\n",
+    mPrefetchBatch.JobCount,
+    EFI_ERROR (Status) ? 1 : NumberOfEnabledProcessors - 1,
+    BurstTime,
+    DecodeTime
+    ));
+}
+
+/**
+  Release the prefetch jobs of the current dispatch round that were not used.
+
+**/
+VOID
+CoreEndDispatchPrefetch (
+  VOID
+  )
+{
+  DISPATCH_PREFETCH_JOB  *Job;
+  UINT32                 Index;
+
+  if (mPrefetchBatch.Jobs == NULL) {
+    return;
+  }
+
+  for (Index = 0; Index < mPrefetchBatch.JobCount; Index++) {
+    Job = &mPrefetchBatch.Jobs[Index];
+    if (Job->OutputBuffer != NULL) {
+      CoreFreePool (Job->OutputBuffer);
+    }
+    if (Job->ScratchBuffer != NULL) {
+      CoreFreePool (Job->ScratchBuffer);
+    }
+    if (Job->FileBuffer != NULL) {
+      CoreFreePool (Job->FileBuffer);
+    }
+  }
+
+  CoreFreePool (mPrefetchBatch.Jobs);
+  mPrefetchBatch.Jobs     = NULL;
+  mPrefetchBatch.JobCount = 0;
+}
+
+/**
+  Return the data of an encapsulation section that was already decoded by the
+  dispatch prefetch.
+
+  The section is matched by its contents, so the returned data is identical to
+  the data the caller would have decoded itself. On success the ownership of
+  the returned buffer passes to the caller.
+
+  @param  Section                The encapsulation section to decode.
+  @param  SectionSize            The size of the section in bytes.
+  @param  OutputBuffer           Returns the decoded data.
+  @param  OutputSize             Returns the size of the decoded data.
+  @param  AuthenticationStatus   Returns the authentication status reported by
+                                 the GUIDed section decoder.
+
+  @retval TRUE                   The decoded data was returned.
+  @retval FALSE                  The section was not prefetched, or its decode
+                                 failed. The caller decodes it itself.
+
+**/
+BOOLEAN
+CoreGetPrefetchedSection (
+  IN  CONST VOID  *Section,
+  IN  UINTN       SectionSize,
+  OUT VOID        **OutputBuffer,
+  OUT UINTN       *OutputSize,
+  OUT UINT32      *AuthenticationStatus
+  )
+{
+  DISPATCH_PREFETCH_JOB  *Job;
+  UINT32                 Index;
+
+  for (Index = 0; Index < mPrefetchBatch.JobCount; Index++) {
+    Job = &mPrefetchBatch.Jobs[Index];
+    if ((Job->OutputBuffer == NULL) || (Job->SectionSize != SectionSize) ||
+        (CompareMem (Job->Section, Section, SectionSize) != 0)) {
+      continue;
+    }
+
+    if (InterlockedCompareExchange32 (&Job->State, PREFETCH_JOB_PENDING, PREFETCH_JOB_RUNNING) == PREFETCH_JOB_PENDING) {
+      CoreDecodePrefetchJob (Job);
+    }
+    if (EFI_ERROR (Job->Status)) {
+      return FALSE;
+    }
+
+    DEBUG ((
+      DEBUG_INFO,
+      "Section of driver %g was decoded ahead of time (%ld us)\n",
+      &Job->FileName,
+      CorePrefetchElapsedTime (Job->DecodeStart, Job->DecodeEnd)
+      ));
+
+    *OutputBuffer         = Job->OutputBuffer;
+    *OutputSize           = Job->OutputSize;
+    *AuthenticationStatus = Job->AuthenticationStatus;
+    Job->OutputBuffer     = NULL;
+    return TRUE;
+  }
+
+  return FALSE;
+}
@@ -53,6 +53,8 @@ WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
 #include <Protocol/TcgService.h>
 #include <Protocol/HiiPackageList.h>
 #include <Protocol/SmmBase2.h>
+#include <Protocol/MpService.h>
+#include <Protocol/MemorySpaceAttributes.h>
 #include <Guid/MemoryTypeInformation.h>
 #include <Guid/FirmwareFileSystem2.h>
 #include <Guid/FirmwareFileSystem3.h>
@@ -70,6 +72,9 @@ WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
 #include <Guid/VectorHandoffTable.h>
 #include <Ppi/VectorHandoffInfo.h>
 #include <Guid/MemoryProfile.h>
+#include <Guid/LzmaDecompress.h>
+#include <Guid/DxeDispatchPlan.h>
+#include <Guid/VariableFormat.h>
 
 #include <Library/DxeCoreEntryPoint.h>
 #include <Library/DebugLib.h>
@@ -93,6 +98,7 @@ WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
 #include <Library/DxeServicesLib.h>
 #include <Library/DebugAgentLib.h>
 #include <Library/CpuExceptionHandlerLib.h>
+#include <Library/SynchronizationLib.h>
 
 
 //
@@ -179,7 +185,8 @@ typedef struct {
 //The data structure of GCD memory map entry
 //
 #define EFI_GCD_MAP_SIGNATURE  SIGNATURE_32('g','c','d','m')
-typedef struct {
+typedef struct _EFI_GCD_MAP_ENTRY EFI_GCD_MAP_ENTRY;
+struct _EFI_GCD_MAP_ENTRY {
   UINTN                 Signature;
   LIST_ENTRY            Link;
   EFI_PHYSICAL_ADDRESS  BaseAddress;
@@ -190,7 +197,17 @@ typedef struct {
   EFI_GCD_IO_TYPE       GcdIoType;
   EFI_HANDLE            ImageHandle;
   EFI_HANDLE            DeviceHandle;
-} EFI_GCD_MAP_ENTRY;
+
+  //
+  // Address ordered AVL tree over all entries of the map. FreeTypes has bit
+  // GcdMemoryType and bit (16 + GcdIoType) set for every entry of the subtree
+  // that is not allocated.
+  //
+  EFI_GCD_MAP_ENTRY     *Left;
+  EFI_GCD_MAP_ENTRY     *Right;
+  UINTN                 Height;
+  UINT32                FreeTypes;
+};
 
 
 #define LOADED_IMAGE_PRIVATE_DATA_SIGNATURE   SIGNATURE_32('l','d','r','i')
@@ -312,6 +329,26 @@ CoreInitializePool (
   );
 
 
+/**
+  Dump the slab allocator counters.
+
+**/
+VOID
+CoreDumpPoolSlabStatistics (
+  VOID
+  );
+
+
+/**
+  Dump the event notification and timer counters.
+
+**/
+VOID
+CoreDumpEventStatistics (
+  VOID
+  );
+
+
 /**
   Called to initialize the memory map and add descriptors to
   the current descriptor list.
@@ -356,6 +393,20 @@ CoreAcquireGcdMemoryLock (
   );
 
 
+/**
+  Refreshes the index of the GCD memory space map after the type or owner of
+  one of its entries has been changed in place.  The caller must hold the GCD
+  memory lock.
+
+  @param  Entry                  The entry that has been updated
+
+**/
+VOID
+CoreGcdMemoryMapEntryUpdated (
+  IN EFI_GCD_MAP_ENTRY  *Entry
+  );
+
+
 /**
   External function. Initializes memory services based on the memory
   descriptor HOBs.  This function is responsible for priming the memory
@@ -402,6 +453,17 @@ CoreInitializeGcdServices (
   );
 
 
+/**
+  Install the Memory Space Attributes Protocol, so drivers can set the
+  attributes of several memory regions in one call.
+
+**/
+VOID
+CoreInstallMemorySpaceAttributesProtocol (
+  VOID
+  );
+
+
 /**
   Initializes "event" support.
 
@@ -509,6 +571,41 @@ CoreIsSchedulable (
   );
 
 
+/**
+  Read Depex and pre-process the Depex for Before and After. If Section Extraction
+  protocol returns an error via ReadSection defer the reading of the Depex.
+
+  @param  DriverEntry           Driver to work on.
+
+  @retval EFI_SUCCESS           Depex read and preprossesed
+  @retval EFI_PROTOCOL_ERROR    The section extraction protocol returned an error
+                                and  Depex reading needs to be retried.
+  @retval Error                 DEPEX not found.
+
+**/
+EFI_STATUS
+CoreGetDepexSectionAndPreProccess (
+  IN  EFI_CORE_DRIVER_ENTRY   *DriverEntry
+  );
+
+
+/**
+  Insert InsertedDriverEntry onto the mScheduledQueue. To do this you
+  must add any driver with a before dependency on InsertedDriverEntry first.
+  You do this by recursively calling this routine. After all the Befores are
+  processed you can add InsertedDriverEntry to the mScheduledQueue.
+  Then you can add any driver with an After dependency on InsertedDriverEntry
+  by recursively calling this routine.
+
+  @param  InsertedDriverEntry   The driver to insert on the ScheduledLink Queue
+
+**/
+VOID
+CoreInsertOnScheduledQueueWhileProcessingBeforeAndAfter (
+  IN  EFI_CORE_DRIVER_ENTRY   *InsertedDriverEntry
+  );
+
+
 /**
   Preprocess dependency expression and update DriverEntry to reflect the
   state of  Before, After, and SOR dependencies. If DriverEntry->Before
@@ -1858,6 +1955,38 @@ CoreSetMemorySpaceAttributes (
   );
 
 
+/**
+  Modifies the attributes of several memory regions in the global coherency
+  domain of the processor.
+
+  @param  This                   The protocol instance pointer.
+  @param  RangeCount             The number of entries in Ranges.
+  @param  Ranges                 The regions and the attributes to set on them.
+  @param  FailedIndex            Returns the index of the region that caused
+                                 the error. Optional.
+
+  @retval EFI_SUCCESS           The attributes were set for all the regions.
+  @retval EFI_INVALID_PARAMETER RangeCount is zero, Ranges is NULL or the
+                                length of a region is zero.
+  @retval EFI_UNSUPPORTED       The processor does not support one or more bytes
+                                of a region, or the attributes of a region are
+                                not supported by its capabilities.
+  @retval EFI_OUT_OF_RESOURCES  There are not enough system resources to modify
+                                the attributes.
+  @retval EFI_NOT_AVAILABLE_YET The attributes cannot be set because CPU
+                                architectural protocol is not available yet.
+
+**/
+EFI_STATUS
+EFIAPI
+CoreSetMemorySpaceAttributesBatch (
+  IN  EDKII_MEMORY_SPACE_ATTRIBUTES_PROTOCOL  *This,
+  IN  UINTN                                   RangeCount,
+  IN  EDKII_MEMORY_SPACE_ATTRIBUTES_RANGE     *Ranges,
+  OUT UINTN                                   *FailedIndex OPTIONAL
+  );
+
+
 /**
   Modifies the capabilities for a memory region in the global coherency domain of the
   processor.
@@ -2047,6 +2176,132 @@ CoreDispatcher (
   VOID
   );
 
+/**
+  Decode the encapsulation sections of the next drivers on the scheduled queue
+  on the enabled APs.
+
+  @param  ScheduledQueue         The queue of scheduled drivers.
+
+**/
+VOID
+CoreStartDispatchPrefetch (
+  IN LIST_ENTRY  *ScheduledQueue
+  );
+
+/**
+  Release the prefetch jobs of the current dispatch round that were not used.
+
+**/
+VOID
+CoreEndDispatchPrefetch (
+  VOID
+  );
+
+/**
+  Return the data of an encapsulation section that was already decoded by the
+  dispatch prefetch. On success the ownership of the returned buffer passes to
+  the caller.
+
+  @param  Section                The encapsulation section to decode.
+  @param  SectionSize            The size of the section in bytes.
+  @param  OutputBuffer           Returns the decoded data.
+  @param  OutputSize             Returns the size of the decoded data.
+  @param  AuthenticationStatus   Returns the authentication status reported by
+                                 the GUIDed section decoder.
+
+  @retval TRUE                   The decoded data was returned.
+  @retval FALSE                  The section was not prefetched, or its decode
+                                 failed. The caller decodes it itself.
+
+**/
+BOOLEAN
+CoreGetPrefetchedSection (
+  IN  CONST VOID  *Section,
+  IN  UINTN       SectionSize,
+  OUT VOID        **OutputBuffer,
+  OUT UINTN       *OutputSize,
+  OUT UINT32      *AuthenticationStatus
+  );
+
+/**
+  Add a file found in a firmware volume to the hash of the firmware volume.
+
+  @param  FvHash                 The hash of the firmware volume so far, or 0
+                                 for the first file.
+  @param  NameGuid               The name of the file.
+  @param  Type                   The type of the file.
+  @param  Size                   The size of the file.
+
+  @return The updated hash of the firmware volume.
+
+**/
+UINT64
+CoreDispatchPlanHashFile (
+  IN UINT64           FvHash,
+  IN EFI_GUID         *NameGuid,
+  IN EFI_FV_FILETYPE  Type,
+  IN UINTN            Size
+  );
+
+/**
+  Record a firmware volume that was processed by the dispatcher.
+
+  @param  FvHandle               The handle of the firmware volume.
+  @param  FvHash                 The hash of the files of the firmware volume.
+
+**/
+VOID
+CoreDispatchPlanAddFv (
+  IN EFI_HANDLE  FvHandle,
+  IN UINT64      FvHash
+  );
+
+/**
+  Record a driver that was placed on the mScheduledQueue.
+
+  @param  DriverEntry            The driver that was scheduled.
+
+**/
+VOID
+CoreDispatchPlanRecord (
+  IN EFI_CORE_DRIVER_ENTRY  *DriverEntry
+  );
+
+/**
+  Load the plan of the previous boot, from a GUIDed HOB if the platform
+  provided one, or else from the variable once the variable services are
+  available.
+
+**/
+VOID
+CoreDispatchPlanLoad (
+  VOID
+  );
+
+/**
+  Place the next drivers of the plan of the previous boot on the
+  mScheduledQueue, as long as they are schedulable.
+
+  @retval TRUE                   One or more drivers were scheduled.
+  @retval FALSE                  Nothing was scheduled from the plan. The
+                                 caller has to evaluate the mDiscoveredList.
+
+**/
+BOOLEAN
+CoreDispatchPlanSchedule (
+  VOID
+  );
+
+/**
+  Initialize the dispatch plan support: register the save of the plan at
+  ReadyToBoot.
+
+**/
+VOID
+CoreInitializeDispatchPlan (
+  VOID
+  );
+
 /**
   Check every driver and locate a matching one. If the driver is found, the Unrequested
   state flag is cleared.
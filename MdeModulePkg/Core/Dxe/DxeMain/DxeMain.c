@@ -395,10 +395,12 @@ DxeMain (
   ASSERT_EFI_ERROR (Status);
 
   MemoryProfileInstallProtocol ();
+  CoreInstallMemorySpaceAttributesProtocol ();
 
   CoreInitializePropertiesTable ();
   CoreInitializeMemoryAttributesTable ();
   CoreInitializeMemoryProtection ();
+  CoreInitializeDispatchPlan ();
 
   //
   // Get persisted vector hand-off info from GUIDeed HOB again due to HobStart may be updated,
@@ -759,6 +761,9 @@ CoreExitBootServices (
 
   gMemoryMapTerminated = TRUE;
 
+  CoreDumpPoolSlabStatistics ();
+  CoreDumpEventStatistics ();
+
   //
   // Notify other drivers that we are exiting boot services.
   //
@@ -37,6 +37,15 @@ LIST_ENTRY      gEventQueue[TPL_HIGH_LEVEL + 1];
 ///
 UINTN           gEventPending = 0;
 
+///
+/// mEventStatistics - Notification counters for each priority level, only
+/// collected when performance measurement is enabled
+///
+BOOLEAN               mEventStatisticsEnabled = FALSE;
+EVENT_TPL_STATISTICS  mEventStatistics[TPL_HIGH_LEVEL + 1];
+UINT64                mEventCounterStart;
+UINT64                mEventCounterEnd;
+
 ///
 /// gEventSignalQueue - A list of events to signal based on EventGroup type
 ///
@@ -138,6 +147,11 @@ CoreInitializeEventServices (
     InitializeListHead (&gEventQueue[Index]);
   }
 
+  if (PerformanceMeasurementEnabled ()) {
+    GetPerformanceCounterProperties (&mEventCounterStart, &mEventCounterEnd);
+    mEventStatisticsEnabled = TRUE;
+  }
+
   CoreInitializeTimer ();
 
   CoreCreateEventEx (
@@ -154,6 +168,73 @@ CoreInitializeEventServices (
 
 
 
+/**
+  Returns the number of performance counter ticks between two counter values.
+
+  @param  Start                  The earlier performance counter value.
+  @param  End                    The later performance counter value.
+
+  @return The number of ticks elapsed.
+
+**/
+UINT64
+CoreEventElapsedTicks (
+  IN UINT64  Start,
+  IN UINT64  End
+  )
+{
+  if (mEventCounterEnd < mEventCounterStart) {
+    //
+    // The counter counts down
+    //
+    return (Start >= End) ? (Start - End) : (Start - mEventCounterEnd) + (mEventCounterStart - End);
+  }
+  return (End >= Start) ? (End - Start) : (mEventCounterEnd - Start) + (End - mEventCounterStart);
+}
+
+
+/**
+  Dump the event notification and timer counters.
+
+**/
+VOID
+CoreDumpEventStatistics (
+  VOID
+  )
+{
+  EFI_TPL               Tpl;
+  EVENT_TPL_STATISTICS  *Stats;
+
+  if (!mEventStatisticsEnabled) {
+    return;
+  }
+
+  for (Tpl = 0; Tpl <= TPL_HIGH_LEVEL; Tpl++) {
+    Stats = &mEventStatistics[Tpl];
+    if (Stats->NotifyCount == 0) {
+      continue;
+    }
+    DEBUG ((
+      DEBUG_INFO,
+      "Event: TPL %d - %ld notifications, latency %ld ns average %ld ns max, %ld ns average in notify functions\n",
+      Tpl,
+      Stats->NotifyCount,
+      DivU64x64Remainder (GetTimeInNanoSecond (Stats->LatencyTicks), Stats->NotifyCount, NULL),
+      GetTimeInNanoSecond (Stats->MaxLatencyTicks),
+      DivU64x64Remainder (GetTimeInNanoSecond (Stats->NotifyTicks), Stats->NotifyCount, NULL)
+      ));
+  }
+
+  DEBUG ((
+    DEBUG_INFO,
+    "Event: %ld timers set, %ld expired, %ld moved between timer wheel levels\n",
+    mEfiTimerStatistics.InsertCount,
+    mEfiTimerStatistics.ExpireCount,
+    mEfiTimerStatistics.CascadeCount
+    ));
+}
+
+
 /**
   Dispatches all pending events.
 
@@ -168,6 +249,8 @@ CoreDispatchEventNotifies (
 {
   IEVENT          *Event;
   LIST_ENTRY      *Head;
+  UINT64          StartTime;
+  UINT64          Latency;
 
   CoreAcquireEventLock ();
   ASSERT (gEventQueueLock.OwnerTpl == Priority);
@@ -197,7 +280,20 @@ CoreDispatchEventNotifies (
     // Notify this event
     //
     ASSERT (Event->NotifyFunction != NULL);
-    Event->NotifyFunction (Event, Event->NotifyContext);
+    if (mEventStatisticsEnabled) {
+      StartTime = GetPerformanceCounter ();
+      Latency   = CoreEventElapsedTicks (Event->NotifyQueueTime, StartTime);
+      Event->NotifyFunction (Event, Event->NotifyContext);
+
+      mEventStatistics[Priority].NotifyCount++;
+      mEventStatistics[Priority].LatencyTicks += Latency;
+      if (Latency > mEventStatistics[Priority].MaxLatencyTicks) {
+        mEventStatistics[Priority].MaxLatencyTicks = Latency;
+      }
+      mEventStatistics[Priority].NotifyTicks += CoreEventElapsedTicks (StartTime, GetPerformanceCounter ());
+    } else {
+      Event->NotifyFunction (Event, Event->NotifyContext);
+    }
 
     //
     // Check for next pending event
@@ -243,6 +339,10 @@ CoreNotifyEvent (
 
   InsertTailList (&gEventQueue[Event->NotifyTpl], &Event->NotifyLink);
   gEventPending |= (UINTN)(1 << Event->NotifyTpl);
+
+  if (mEventStatisticsEnabled) {
+    Event->NotifyQueueTime = GetPerformanceCounter ();
+  }
 }
 
 
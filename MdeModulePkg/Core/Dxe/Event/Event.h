@@ -40,6 +40,10 @@ typedef struct {
   LIST_ENTRY      Link;
   UINT64          TriggerTime;
   UINT64          Period;
+  ///
+  /// Level and slot of the timer wheel the timer is queued to
+  ///
+  UINT32          WheelIndex;
 } TIMER_EVENT_INFO;
 
 #define EVENT_SIGNATURE         SIGNATURE_32('e','v','n','t')
@@ -59,6 +63,10 @@ typedef struct {
   VOID                    *NotifyContext;
   EFI_GUID                EventGroup;
   LIST_ENTRY              NotifyLink;
+  ///
+  /// Performance counter value when the notification was queued
+  ///
+  UINT64                  NotifyQueueTime;
   UINT8                   ExFlag;
   ///
   /// A list of all runtime events
@@ -67,6 +75,27 @@ typedef struct {
   TIMER_EVENT_INFO        Timer;
 } IEVENT;
 
+///
+/// Event notification counters of one TPL
+///
+typedef struct {
+  UINT64                  NotifyCount;
+  UINT64                  LatencyTicks;
+  UINT64                  MaxLatencyTicks;
+  UINT64                  NotifyTicks;
+} EVENT_TPL_STATISTICS;
+
+///
+/// Timer wheel counters
+///
+typedef struct {
+  UINT64                  InsertCount;
+  UINT64                  ExpireCount;
+  UINT64                  CascadeCount;
+} TIMER_WHEEL_STATISTICS;
+
+extern TIMER_WHEEL_STATISTICS  mEfiTimerStatistics;
+
 //
 // Internal prototypes
 //
@@ -16,20 +16,64 @@ WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
 #include "DxeMain.h"
 #include "Event.h"
 
+//
+// The timer database is a hierarchical timer wheel. Time is divided into
+// ticks of 2^TIMER_WHEEL_TICK_SHIFT 100ns units. Level 0 has one slot per tick
+// for the current block of TIMER_WHEEL_SLOTS ticks, and each higher level has
+// one slot per block of the level below it. A timer is queued to the lowest
+// level whose current block contains its trigger tick, and moves down one
+// level each time the wheel enters the block of its slot. Timers beyond the
+// top level are kept on mEfiTimerOverflowList.
+//
+#define TIMER_WHEEL_TICK_SHIFT  14
+#define TIMER_WHEEL_SLOT_BITS   6
+#define TIMER_WHEEL_SLOTS       (1 << TIMER_WHEEL_SLOT_BITS)
+#define TIMER_WHEEL_SLOT_MASK   (TIMER_WHEEL_SLOTS - 1)
+#define TIMER_WHEEL_LEVELS      4
+#define TIMER_WHEEL_OVERFLOW    MAX_UINT32
+
+#define TIMER_WHEEL_INDEX(Level, Slot)  ((UINT32) ((Level) * TIMER_WHEEL_SLOTS + (Slot)))
+
 //
 // Internal data
 //
 
-LIST_ENTRY       mEfiTimerList = INITIALIZE_LIST_HEAD_VARIABLE (mEfiTimerList);
+LIST_ENTRY       mEfiTimerWheel[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+UINT64           mEfiTimerWheelOccupied[TIMER_WHEEL_LEVELS];
+LIST_ENTRY       mEfiTimerOverflowList = INITIALIZE_LIST_HEAD_VARIABLE (mEfiTimerOverflowList);
+UINT64           mEfiTimerWheelTick = 0;
+UINT64           mEfiTimerNextCheck = MAX_UINT64;
 EFI_LOCK         mEfiTimerLock = EFI_INITIALIZE_LOCK_VARIABLE (TPL_HIGH_LEVEL - 1);
 EFI_EVENT        mEfiCheckTimerEvent = NULL;
 
 EFI_LOCK         mEfiSystemTimeLock = EFI_INITIALIZE_LOCK_VARIABLE (TPL_HIGH_LEVEL);
 UINT64           mEfiSystemTime = 0;
 
+TIMER_WHEEL_STATISTICS  mEfiTimerStatistics;
+
 //
 // Timer functions
 //
+/**
+  Publishes the earliest system time at which a timer may expire.
+
+  CoreTimerTick() reads mEfiTimerNextCheck from the timer interrupt, so it is
+  written under mEfiSystemTimeLock, where a 64-bit access cannot be torn.
+
+  @param  NextCheck              The new value of mEfiTimerNextCheck
+
+**/
+STATIC
+VOID
+CoreSetTimerNextCheck (
+  IN UINT64   NextCheck
+  )
+{
+  CoreAcquireLock (&mEfiSystemTimeLock);
+  mEfiTimerNextCheck = NextCheck;
+  CoreReleaseLock (&mEfiSystemTimeLock);
+}
+
 /**
   Inserts the timer event.
 
@@ -42,91 +86,237 @@ CoreInsertEventTimer (
   IN IEVENT   *Event
   )
 {
-  UINT64          TriggerTime;
-  LIST_ENTRY      *Link;
-  IEVENT          *Event2;
+  UINT64          TriggerTick;
+  UINTN           Level;
+  UINTN           Shift;
+  UINTN           Slot;
 
   ASSERT_LOCKED (&mEfiTimerLock);
 
   //
-  // Get the timer's trigger time
+  // A timer that is already due is queued to the current tick
   //
-  TriggerTime = Event->Timer.TriggerTime;
+  TriggerTick = RShiftU64 (Event->Timer.TriggerTime, TIMER_WHEEL_TICK_SHIFT);
+  if (TriggerTick < mEfiTimerWheelTick) {
+    TriggerTick = mEfiTimerWheelTick;
+  }
 
-  //
-  // Insert the timer into the timer database in assending sorted order
-  //
-  for (Link = mEfiTimerList.ForwardLink; Link != &mEfiTimerList; Link = Link->ForwardLink) {
-    Event2 = CR (Link, IEVENT, Timer.Link, EVENT_SIGNATURE);
+  if (Event->Timer.TriggerTime < mEfiTimerNextCheck) {
+    CoreSetTimerNextCheck (Event->Timer.TriggerTime);
+  }
 
-    if (Event2->Timer.TriggerTime > TriggerTime) {
-      break;
+  for (Level = 0; Level < TIMER_WHEEL_LEVELS; Level++) {
+    Shift = TIMER_WHEEL_SLOT_BITS * (Level + 1);
+    if (RShiftU64 (TriggerTick, Shift) == RShiftU64 (mEfiTimerWheelTick, Shift)) {
+      Slot = (UINTN) RShiftU64 (TriggerTick, Shift - TIMER_WHEEL_SLOT_BITS) & TIMER_WHEEL_SLOT_MASK;
+      InsertTailList (&mEfiTimerWheel[Level][Slot], &Event->Timer.Link);
+      mEfiTimerWheelOccupied[Level] |= LShiftU64 (1, Slot);
+      Event->Timer.WheelIndex = TIMER_WHEEL_INDEX (Level, Slot);
+      return;
     }
   }
 
-  InsertTailList (Link, &Event->Timer.Link);
+  InsertTailList (&mEfiTimerOverflowList, &Event->Timer.Link);
+  Event->Timer.WheelIndex = TIMER_WHEEL_OVERFLOW;
 }
 
 /**
-  Returns the current system time.
+  Removes the timer event from the timer database.
 
-  @return The current system time
+  @param  Event                  Points to the internal structure of a queued
+                                 timer event
 
 **/
-UINT64
-CoreCurrentSystemTime (
-  VOID
+VOID
+CoreRemoveEventTimer (
+  IN IEVENT   *Event
   )
 {
-  UINT64          SystemTime;
+  UINTN       Level;
+  UINTN       Slot;
 
-  CoreAcquireLock (&mEfiSystemTimeLock);
-  SystemTime = mEfiSystemTime;
-  CoreReleaseLock (&mEfiSystemTimeLock);
+  ASSERT_LOCKED (&mEfiTimerLock);
 
-  return SystemTime;
+  RemoveEntryList (&Event->Timer.Link);
+  Event->Timer.Link.ForwardLink = NULL;
+
+  if (Event->Timer.WheelIndex != TIMER_WHEEL_OVERFLOW) {
+    Level = Event->Timer.WheelIndex / TIMER_WHEEL_SLOTS;
+    Slot  = Event->Timer.WheelIndex % TIMER_WHEEL_SLOTS;
+    if (IsListEmpty (&mEfiTimerWheel[Level][Slot])) {
+      mEfiTimerWheelOccupied[Level] &= ~LShiftU64 (1, Slot);
+    }
+  }
 }
 
 /**
-  Checks the sorted timer list against the current system time.
-  Signals any expired event timer.
+  Moves all timers of a list back into the timer database, so they are
+  queued relative to the current tick.
 
-  @param  CheckEvent             Not used
-  @param  Context                Not used
+  @param  List                   The list of timers to requeue.
 
 **/
 VOID
-EFIAPI
-CoreCheckTimers (
-  IN EFI_EVENT            CheckEvent,
-  IN VOID                 *Context
+CoreRequeueEventTimers (
+  IN LIST_ENTRY  *List
   )
 {
-  UINT64                  SystemTime;
-  IEVENT                  *Event;
+  LIST_ENTRY      Pending;
+  IEVENT          *Event;
+
+  if (IsListEmpty (List)) {
+    return;
+  }
 
   //
-  // Check the timer database for expired timers
+  // Move the timers to a private list first, since they may be queued
+  // back to List
   //
-  CoreAcquireLock (&mEfiTimerLock);
-  SystemTime = CoreCurrentSystemTime ();
+  Pending.ForwardLink = List->ForwardLink;
+  Pending.BackLink    = List->BackLink;
+  Pending.ForwardLink->BackLink = &Pending;
+  Pending.BackLink->ForwardLink = &Pending;
+  InitializeListHead (List);
+
+  while (!IsListEmpty (&Pending)) {
+    Event = CR (Pending.ForwardLink, IEVENT, Timer.Link, EVENT_SIGNATURE);
+    RemoveEntryList (&Event->Timer.Link);
+    CoreInsertEventTimer (Event);
+    mEfiTimerStatistics.CascadeCount++;
+  }
+}
+
+/**
+  Moves the timers of the higher levels down, when the wheel enters a new
+  block of level 0 ticks.
+
+**/
+VOID
+CoreCascadeEventTimers (
+  VOID
+  )
+{
+  UINTN       Level;
+  UINTN       Slot;
+
+  ASSERT ((mEfiTimerWheelTick & TIMER_WHEEL_SLOT_MASK) == 0);
+
+  if ((mEfiTimerWheelTick & (LShiftU64 (1, TIMER_WHEEL_SLOT_BITS * TIMER_WHEEL_LEVELS) - 1)) == 0) {
+    CoreRequeueEventTimers (&mEfiTimerOverflowList);
+  }
+
+  for (Level = TIMER_WHEEL_LEVELS - 1; Level > 0; Level--) {
+    if ((mEfiTimerWheelTick & (LShiftU64 (1, TIMER_WHEEL_SLOT_BITS * Level) - 1)) != 0) {
+      continue;
+    }
+    Slot = (UINTN) RShiftU64 (mEfiTimerWheelTick, TIMER_WHEEL_SLOT_BITS * Level) & TIMER_WHEEL_SLOT_MASK;
+    mEfiTimerWheelOccupied[Level] &= ~LShiftU64 (1, Slot);
+    CoreRequeueEventTimers (&mEfiTimerWheel[Level][Slot]);
+  }
+}
 
-  while (!IsListEmpty (&mEfiTimerList)) {
-    Event = CR (mEfiTimerList.ForwardLink, IEVENT, Timer.Link, EVENT_SIGNATURE);
+/**
+  Computes the earliest system time at which a timer may expire, so
+  CoreTimerTick() only signals the check event when there is work to do.
+
+**/
+VOID
+CoreUpdateTimerNextCheck (
+  VOID
+  )
+{
+  UINTN           Slot;
+  UINT64          Pending;
+  UINTN           Level;
+  LIST_ENTRY      *Link;
+  IEVENT          *Event;
+  UINT64          NextCheck;
 
+  //
+  // CoreTimerTick() may read mEfiTimerNextCheck at any time, so it is only
+  // written once, through CoreSetTimerNextCheck()
+  //
+  Slot      = (UINTN) (mEfiTimerWheelTick & TIMER_WHEEL_SLOT_MASK);
+  NextCheck = MAX_UINT64;
+
+  if ((mEfiTimerWheelOccupied[0] & LShiftU64 (1, Slot)) != 0) {
     //
-    // If this timer is not expired, then we're done
+    // The current slot holds timers that are not expired yet
     //
-    if (Event->Timer.TriggerTime > SystemTime) {
-      break;
+    for (Link = mEfiTimerWheel[0][Slot].ForwardLink; Link != &mEfiTimerWheel[0][Slot]; Link = Link->ForwardLink) {
+      Event = CR (Link, IEVENT, Timer.Link, EVENT_SIGNATURE);
+      if (Event->Timer.TriggerTime < NextCheck) {
+        NextCheck = Event->Timer.TriggerTime;
+      }
     }
+  } else {
+    Pending = mEfiTimerWheelOccupied[0] & LShiftU64 (MAX_UINT64, Slot);
+    if (Pending != 0) {
+      NextCheck = LShiftU64 (
+                    (mEfiTimerWheelTick & ~((UINT64) TIMER_WHEEL_SLOT_MASK)) + (UINT64) LowBitSet64 (Pending),
+                    TIMER_WHEEL_TICK_SHIFT
+                    );
+    } else {
+      for (Level = 1; Level < TIMER_WHEEL_LEVELS; Level++) {
+        if (mEfiTimerWheelOccupied[Level] != 0) {
+          break;
+        }
+      }
+      if ((Level < TIMER_WHEEL_LEVELS) || !IsListEmpty (&mEfiTimerOverflowList)) {
+        //
+        // Check again when the wheel enters the next block of level 0 ticks
+        //
+        NextCheck = LShiftU64 ((mEfiTimerWheelTick | TIMER_WHEEL_SLOT_MASK) + 1, TIMER_WHEEL_TICK_SHIFT);
+      }
+    }
+  }
+
+  CoreSetTimerNextCheck (NextCheck);
+}
+
+/**
+  Signals the expired timers of a level 0 slot, and queues the ones that
+  are not expired yet back to the timer database.
+
+  @param  Slot                   The level 0 slot to process.
+  @param  SystemTime             The current system time.
+
+**/
+VOID
+CoreExpireEventTimers (
+  IN UINTN    Slot,
+  IN UINT64   SystemTime
+  )
+{
+  LIST_ENTRY      Pending;
+  IEVENT          *Event;
+
+  mEfiTimerWheelOccupied[0] &= ~LShiftU64 (1, Slot);
+
+  //
+  // Move the timers to a private list first, since periodic timers may be
+  // queued back to this slot
+  //
+  Pending.ForwardLink = mEfiTimerWheel[0][Slot].ForwardLink;
+  Pending.BackLink    = mEfiTimerWheel[0][Slot].BackLink;
+  Pending.ForwardLink->BackLink = &Pending;
+  Pending.BackLink->ForwardLink = &Pending;
+  InitializeListHead (&mEfiTimerWheel[0][Slot]);
+
+  while (!IsListEmpty (&Pending)) {
+    Event = CR (Pending.ForwardLink, IEVENT, Timer.Link, EVENT_SIGNATURE);
+    RemoveEntryList (&Event->Timer.Link);
 
     //
-    // Remove this timer from the timer queue
+    // If this timer is not expired, then queue it back
     //
+    if (Event->Timer.TriggerTime > SystemTime) {
+      CoreInsertEventTimer (Event);
+      continue;
+    }
 
-    RemoveEntryList (&Event->Timer.Link);
     Event->Timer.Link.ForwardLink = NULL;
+    mEfiTimerStatistics.ExpireCount++;
 
     //
     // Signal it
@@ -156,6 +346,93 @@ CoreCheckTimers (
       CoreInsertEventTimer (Event);
     }
   }
+}
+
+/**
+  Returns the current system time.
+
+  @return The current system time
+
+**/
+UINT64
+CoreCurrentSystemTime (
+  VOID
+  )
+{
+  UINT64          SystemTime;
+
+  CoreAcquireLock (&mEfiSystemTimeLock);
+  SystemTime = mEfiSystemTime;
+  CoreReleaseLock (&mEfiSystemTimeLock);
+
+  return SystemTime;
+}
+
+/**
+  Advances the timer wheel to the current system time.
+  Signals any expired event timer.
+
+  @param  CheckEvent             Not used
+  @param  Context                Not used
+
+**/
+VOID
+EFIAPI
+CoreCheckTimers (
+  IN EFI_EVENT            CheckEvent,
+  IN VOID                 *Context
+  )
+{
+  UINT64                  SystemTime;
+  UINT64                  Now;
+  UINT64                  Pending;
+  UINT64                  NextTick;
+
+  //
+  // Check the timer database for expired timers
+  //
+  CoreAcquireLock (&mEfiTimerLock);
+  SystemTime = CoreCurrentSystemTime ();
+  Now        = RShiftU64 (SystemTime, TIMER_WHEEL_TICK_SHIFT);
+
+  for (;;) {
+    //
+    // Find the next occupied level 0 slot, or the start of the next block
+    //
+    Pending = mEfiTimerWheelOccupied[0] & LShiftU64 (MAX_UINT64, (UINTN) (mEfiTimerWheelTick & TIMER_WHEEL_SLOT_MASK));
+    if (Pending == 0) {
+      NextTick = (mEfiTimerWheelTick | TIMER_WHEEL_SLOT_MASK) + 1;
+    } else {
+      NextTick = (mEfiTimerWheelTick & ~((UINT64) TIMER_WHEEL_SLOT_MASK)) + (UINT64) LowBitSet64 (Pending);
+    }
+
+    if (NextTick > Now) {
+      mEfiTimerWheelTick = Now;
+      break;
+    }
+
+    mEfiTimerWheelTick = NextTick;
+    if (Pending == 0) {
+      CoreCascadeEventTimers ();
+      continue;
+    }
+
+    CoreExpireEventTimers ((UINTN) (mEfiTimerWheelTick & TIMER_WHEEL_SLOT_MASK), SystemTime);
+
+    //
+    // Timers of the current tick that are not expired yet stay queued
+    //
+    if (mEfiTimerWheelTick == Now) {
+      break;
+    }
+
+    mEfiTimerWheelTick++;
+    if ((mEfiTimerWheelTick & TIMER_WHEEL_SLOT_MASK) == 0) {
+      CoreCascadeEventTimers ();
+    }
+  }
+
+  CoreUpdateTimerNextCheck ();
 
   CoreReleaseLock (&mEfiTimerLock);
 }
@@ -171,6 +448,14 @@ CoreInitializeTimer (
   )
 {
   EFI_STATUS  Status;
+  UINTN       Level;
+  UINTN       Slot;
+
+  for (Level = 0; Level < TIMER_WHEEL_LEVELS; Level++) {
+    for (Slot = 0; Slot < TIMER_WHEEL_SLOTS; Slot++) {
+      InitializeListHead (&mEfiTimerWheel[Level][Slot]);
+    }
+  }
 
   Status = CoreCreateEventInternal (
              EVT_NOTIFY_SIGNAL,
@@ -197,8 +482,6 @@ CoreTimerTick (
   IN UINT64   Duration
   )
 {
-  IEVENT          *Event;
-
   //
   // Check runtiem flag in case there are ticks while exiting boot services
   //
@@ -210,15 +493,11 @@ CoreTimerTick (
   mEfiSystemTime += Duration;
 
   //
-  // If the head of the list is expired, fire the timer event
+  // If a timer may have expired, fire the timer event
   // to process it
   //
-  if (!IsListEmpty (&mEfiTimerList)) {
-    Event = CR (mEfiTimerList.ForwardLink, IEVENT, Timer.Link, EVENT_SIGNATURE);
-
-    if (Event->Timer.TriggerTime <= mEfiSystemTime) {
-      CoreSignalEvent (mEfiCheckTimerEvent);
-    }
+  if (mEfiTimerNextCheck <= mEfiSystemTime) {
+    CoreSignalEvent (mEfiCheckTimerEvent);
   }
 
   CoreReleaseLock (&mEfiSystemTimeLock);
@@ -271,8 +550,7 @@ CoreSetTimer (
   // If the timer is queued to the timer database, remove it
   //
   if (Event->Timer.Link.ForwardLink != NULL) {
-    RemoveEntryList (&Event->Timer.Link);
-    Event->Timer.Link.ForwardLink = NULL;
+    CoreRemoveEventTimer (Event);
   }
 
   Event->Timer.TriggerTime = 0;
@@ -289,6 +567,7 @@ CoreSetTimer (
 
     Event->Timer.TriggerTime = CoreCurrentSystemTime () + TriggerTime;
     CoreInsertEventTimer (Event);
+    mEfiTimerStatistics.InsertCount++;
 
     if (TriggerTime == 0) {
       CoreSignalEvent (mEfiCheckTimerEvent);
@@ -50,6 +50,17 @@ EFI_LOCK           mGcdIoSpaceLock     = EFI_INITIALIZE_LOCK_VARIABLE (TPL_NOTIF
 LIST_ENTRY         mGcdMemorySpaceMap  = INITIALIZE_LIST_HEAD_VARIABLE (mGcdMemorySpaceMap);
 LIST_ENTRY         mGcdIoSpaceMap      = INITIALIZE_LIST_HEAD_VARIABLE (mGcdIoSpaceMap);
 
+//
+// Roots of the AVL trees that index mGcdMemorySpaceMap and mGcdIoSpaceMap
+//
+EFI_GCD_MAP_ENTRY  *mGcdMemorySpaceRoot = NULL;
+EFI_GCD_MAP_ENTRY  *mGcdIoSpaceRoot     = NULL;
+
+EDKII_MEMORY_SPACE_ATTRIBUTES_PROTOCOL  mMemorySpaceAttributesProtocol = {
+  EDKII_MEMORY_SPACE_ATTRIBUTES_PROTOCOL_REVISION,
+  CoreSetMemorySpaceAttributesBatch
+};
+
 EFI_GCD_MAP_ENTRY mGcdMemorySpaceMapEntryTemplate = {
   EFI_GCD_MAP_SIGNATURE,
   {
@@ -368,6 +379,499 @@ PageAlignLength (
 // GCD Memory Space Worker Functions
 //
 
+/**
+  Internal function.  Returns the root of the AVL tree that indexes a GCD map.
+
+  @param  Map                    mGcdMemorySpaceMap or mGcdIoSpaceMap
+
+  @return The address of the root pointer of the tree
+
+**/
+STATIC
+EFI_GCD_MAP_ENTRY **
+CoreGcdMapIndexRoot (
+  IN LIST_ENTRY  *Map
+  )
+{
+  if (Map == &mGcdMemorySpaceMap) {
+    return &mGcdMemorySpaceRoot;
+  }
+  ASSERT (Map == &mGcdIoSpaceMap);
+  return &mGcdIoSpaceRoot;
+}
+
+/**
+  Internal function.  Returns the height of a GCD map index subtree.
+
+  @param  Node                   The root of the subtree, or NULL
+
+  @return The height of the subtree
+
+**/
+STATIC
+UINTN
+CoreGcdMapIndexHeight (
+  IN EFI_GCD_MAP_ENTRY  *Node
+  )
+{
+  return (Node == NULL) ? 0 : Node->Height;
+}
+
+/**
+  Internal function.  Returns the FreeTypes bits of a single GCD map entry.
+
+  @param  Entry                  The entry
+
+  @return The bits for the memory and I/O type of the entry if it is not
+          allocated, or 0
+
+**/
+STATIC
+UINT32
+CoreGcdMapEntryFreeTypes (
+  IN EFI_GCD_MAP_ENTRY  *Entry
+  )
+{
+  if (Entry->ImageHandle != NULL) {
+    return 0;
+  }
+  return (UINT32) (LShiftU64 (1, Entry->GcdMemoryType) | LShiftU64 (1, 16 + Entry->GcdIoType));
+}
+
+/**
+  Internal function.  Returns the FreeTypes bit an allocation searches for.
+
+  @param  Operation              Allocate memory or IO
+  @param  GcdMemoryType          The desired memory type
+  @param  GcdIoType              The desired IO type
+
+  @return The bit to look for in FreeTypes
+
+**/
+STATIC
+UINT32
+CoreGcdMapAllocateFreeType (
+  IN UINTN                Operation,
+  IN EFI_GCD_MEMORY_TYPE  GcdMemoryType,
+  IN EFI_GCD_IO_TYPE      GcdIoType
+  )
+{
+  if (Operation == GCD_ALLOCATE_MEMORY_OPERATION) {
+    return (UINT32) LShiftU64 (1, GcdMemoryType);
+  }
+  return (UINT32) LShiftU64 (1, 16 + GcdIoType);
+}
+
+/**
+  Internal function.  Recomputes the height and the FreeTypes bits of a GCD map
+  index node from its own entry and its children.
+
+  @param  Node                   The node to refresh
+
+**/
+STATIC
+VOID
+CoreGcdMapIndexRefresh (
+  IN OUT EFI_GCD_MAP_ENTRY  *Node
+  )
+{
+  UINTN   LeftHeight;
+  UINTN   RightHeight;
+
+  LeftHeight   = CoreGcdMapIndexHeight (Node->Left);
+  RightHeight  = CoreGcdMapIndexHeight (Node->Right);
+  Node->Height = MAX (LeftHeight, RightHeight) + 1;
+
+  Node->FreeTypes = CoreGcdMapEntryFreeTypes (Node);
+  if (Node->Left != NULL) {
+    Node->FreeTypes |= Node->Left->FreeTypes;
+  }
+  if (Node->Right != NULL) {
+    Node->FreeTypes |= Node->Right->FreeTypes;
+  }
+}
+
+/**
+  Internal function.  Restores the AVL balance of a GCD map index subtree whose
+  children differ in height by at most two.
+
+  @param  Node                   The root of the subtree
+
+  @return The new root of the subtree
+
+**/
+STATIC
+EFI_GCD_MAP_ENTRY *
+CoreGcdMapIndexRebalance (
+  IN OUT EFI_GCD_MAP_ENTRY  *Node
+  )
+{
+  EFI_GCD_MAP_ENTRY  *Pivot;
+
+  CoreGcdMapIndexRefresh (Node);
+
+  if (CoreGcdMapIndexHeight (Node->Left) > CoreGcdMapIndexHeight (Node->Right) + 1) {
+    if (CoreGcdMapIndexHeight (Node->Left->Left) < CoreGcdMapIndexHeight (Node->Left->Right)) {
+      Pivot              = Node->Left->Right;
+      Node->Left->Right  = Pivot->Left;
+      Pivot->Left        = Node->Left;
+      CoreGcdMapIndexRefresh (Pivot->Left);
+      Node->Left         = Pivot;
+    }
+    Pivot        = Node->Left;
+    Node->Left   = Pivot->Right;
+    Pivot->Right = Node;
+    CoreGcdMapIndexRefresh (Node);
+    CoreGcdMapIndexRefresh (Pivot);
+    return Pivot;
+  }
+
+  if (CoreGcdMapIndexHeight (Node->Right) > CoreGcdMapIndexHeight (Node->Left) + 1) {
+    if (CoreGcdMapIndexHeight (Node->Right->Right) < CoreGcdMapIndexHeight (Node->Right->Left)) {
+      Pivot              = Node->Right->Left;
+      Node->Right->Left  = Pivot->Right;
+      Pivot->Right       = Node->Right;
+      CoreGcdMapIndexRefresh (Pivot->Right);
+      Node->Right        = Pivot;
+    }
+    Pivot        = Node->Right;
+    Node->Right  = Pivot->Left;
+    Pivot->Left  = Node;
+    CoreGcdMapIndexRefresh (Node);
+    CoreGcdMapIndexRefresh (Pivot);
+    return Pivot;
+  }
+
+  return Node;
+}
+
+/**
+  Internal function.  Inserts an entry into a GCD map index subtree.
+
+  @param  Root                   The root of the subtree, or NULL
+  @param  Entry                  The entry to insert
+
+  @return The new root of the subtree
+
+**/
+STATIC
+EFI_GCD_MAP_ENTRY *
+CoreGcdMapIndexInsertNode (
+  IN OUT EFI_GCD_MAP_ENTRY  *Root,
+  IN OUT EFI_GCD_MAP_ENTRY  *Entry
+  )
+{
+  if (Root == NULL) {
+    Entry->Left  = NULL;
+    Entry->Right = NULL;
+    CoreGcdMapIndexRefresh (Entry);
+    return Entry;
+  }
+
+  if (Entry->BaseAddress < Root->BaseAddress) {
+    Root->Left = CoreGcdMapIndexInsertNode (Root->Left, Entry);
+  } else {
+    Root->Right = CoreGcdMapIndexInsertNode (Root->Right, Entry);
+  }
+  return CoreGcdMapIndexRebalance (Root);
+}
+
+/**
+  Internal function.  Unlinks the lowest entry of a GCD map index subtree.
+
+  @param  Root                   The root of the subtree
+  @param  Lowest                 Returns the unlinked entry
+
+  @return The new root of the subtree
+
+**/
+STATIC
+EFI_GCD_MAP_ENTRY *
+CoreGcdMapIndexRemoveLowest (
+  IN OUT EFI_GCD_MAP_ENTRY  *Root,
+  OUT    EFI_GCD_MAP_ENTRY  **Lowest
+  )
+{
+  if (Root->Left == NULL) {
+    *Lowest = Root;
+    return Root->Right;
+  }
+
+  Root->Left = CoreGcdMapIndexRemoveLowest (Root->Left, Lowest);
+  return CoreGcdMapIndexRebalance (Root);
+}
+
+/**
+  Internal function.  Removes an entry from a GCD map index subtree.
+
+  @param  Root                   The root of the subtree
+  @param  Entry                  The entry to remove
+
+  @return The new root of the subtree
+
+**/
+STATIC
+EFI_GCD_MAP_ENTRY *
+CoreGcdMapIndexRemoveNode (
+  IN OUT EFI_GCD_MAP_ENTRY  *Root,
+  IN     EFI_GCD_MAP_ENTRY  *Entry
+  )
+{
+  EFI_GCD_MAP_ENTRY  *Successor;
+
+  ASSERT (Root != NULL);
+  if (Root == NULL) {
+    return NULL;
+  }
+
+  if (Root == Entry) {
+    if (Root->Left == NULL) {
+      return Root->Right;
+    }
+    if (Root->Right == NULL) {
+      return Root->Left;
+    }
+    Successor        = NULL;
+    Root->Right      = CoreGcdMapIndexRemoveLowest (Root->Right, &Successor);
+    Successor->Left  = Root->Left;
+    Successor->Right = Root->Right;
+    return CoreGcdMapIndexRebalance (Successor);
+  }
+
+  if (Entry->BaseAddress < Root->BaseAddress) {
+    Root->Left = CoreGcdMapIndexRemoveNode (Root->Left, Entry);
+  } else {
+    Root->Right = CoreGcdMapIndexRemoveNode (Root->Right, Entry);
+  }
+  return CoreGcdMapIndexRebalance (Root);
+}
+
+/**
+  Internal function.  Inserts an entry into the index of a GCD map.
+
+  @param  Map                    The GCD map the entry belongs to
+  @param  Entry                  The entry to insert
+
+**/
+STATIC
+VOID
+CoreGcdMapIndexInsert (
+  IN     LIST_ENTRY         *Map,
+  IN OUT EFI_GCD_MAP_ENTRY  *Entry
+  )
+{
+  EFI_GCD_MAP_ENTRY  **Root;
+
+  Root  = CoreGcdMapIndexRoot (Map);
+  *Root = CoreGcdMapIndexInsertNode (*Root, Entry);
+}
+
+/**
+  Internal function.  Removes an entry from the index of a GCD map.
+
+  @param  Map                    The GCD map the entry belongs to
+  @param  Entry                  The entry to remove
+
+**/
+STATIC
+VOID
+CoreGcdMapIndexRemove (
+  IN LIST_ENTRY         *Map,
+  IN EFI_GCD_MAP_ENTRY  *Entry
+  )
+{
+  EFI_GCD_MAP_ENTRY  **Root;
+
+  Root  = CoreGcdMapIndexRoot (Map);
+  *Root = CoreGcdMapIndexRemoveNode (*Root, Entry);
+}
+
+/**
+  Internal function.  Refreshes the index of a GCD map along the path to an
+  entry whose type or owner has changed in place.
+
+  @param  Map                    The GCD map the entry belongs to
+  @param  Entry                  The entry that has been updated
+
+**/
+STATIC
+VOID
+CoreGcdMapIndexUpdate (
+  IN LIST_ENTRY         *Map,
+  IN EFI_GCD_MAP_ENTRY  *Entry
+  )
+{
+  EFI_GCD_MAP_ENTRY  *Path[2 * 64];
+  EFI_GCD_MAP_ENTRY  *Node;
+  UINTN              Depth;
+
+  Depth = 0;
+  Node  = *CoreGcdMapIndexRoot (Map);
+  while (Node != NULL && Depth < ARRAY_SIZE (Path)) {
+    Path[Depth++] = Node;
+    if (Node == Entry) {
+      break;
+    }
+    Node = (Entry->BaseAddress < Node->BaseAddress) ? Node->Left : Node->Right;
+  }
+  ASSERT (Node == Entry);
+
+  while (Depth > 0) {
+    CoreGcdMapIndexRefresh (Path[--Depth]);
+  }
+}
+
+/**
+  Refreshes the index of the GCD memory space map after the type or owner of
+  one of its entries has been changed in place.  The caller must hold the GCD
+  memory lock.
+
+  @param  Entry                  The entry that has been updated
+
+**/
+VOID
+CoreGcdMemoryMapEntryUpdated (
+  IN EFI_GCD_MAP_ENTRY  *Entry
+  )
+{
+  CoreGcdMapIndexUpdate (&mGcdMemorySpaceMap, Entry);
+}
+
+/**
+  Internal function.  Finds the GCD map entry that covers an address.
+
+  @param  Map                    The GCD map to search
+  @param  Address                The address to look up
+
+  @return The entry covering Address, or NULL if there is none
+
+**/
+STATIC
+EFI_GCD_MAP_ENTRY *
+CoreGcdMapIndexLookup (
+  IN LIST_ENTRY            *Map,
+  IN EFI_PHYSICAL_ADDRESS  Address
+  )
+{
+  EFI_GCD_MAP_ENTRY  *Node;
+  EFI_GCD_MAP_ENTRY  *Entry;
+
+  //
+  // Find the entry with the highest base address not above Address
+  //
+  Entry = NULL;
+  Node  = *CoreGcdMapIndexRoot (Map);
+  while (Node != NULL) {
+    if (Node->BaseAddress <= Address) {
+      Entry = Node;
+      Node  = Node->Right;
+    } else {
+      Node  = Node->Left;
+    }
+  }
+
+  if (Entry == NULL || Entry->EndAddress < Address) {
+    return NULL;
+  }
+  return Entry;
+}
+
+/**
+  Internal function.  Finds the closest unallocated entry of a GCD map index
+  subtree with a given type, starting at an address and moving up or down.
+  Subtrees without an unallocated entry of that type are skipped.
+
+  @param  Node                   The root of the subtree, or NULL
+  @param  FreeType               The FreeTypes bit to look for
+  @param  Address                The lowest base address to accept when moving
+                                 up, or the highest when moving down
+  @param  TopDown                TRUE to move down, FALSE to move up
+
+  @return The entry found, or NULL if there is none
+
+**/
+STATIC
+EFI_GCD_MAP_ENTRY *
+CoreGcdMapIndexFindFreeNode (
+  IN EFI_GCD_MAP_ENTRY     *Node,
+  IN UINT32                FreeType,
+  IN EFI_PHYSICAL_ADDRESS  Address,
+  IN BOOLEAN               TopDown
+  )
+{
+  EFI_GCD_MAP_ENTRY  *Entry;
+
+  if (Node == NULL || (Node->FreeTypes & FreeType) == 0) {
+    return NULL;
+  }
+
+  if (TopDown) {
+    if (Node->BaseAddress > Address) {
+      return CoreGcdMapIndexFindFreeNode (Node->Left, FreeType, Address, TopDown);
+    }
+    Entry = CoreGcdMapIndexFindFreeNode (Node->Right, FreeType, Address, TopDown);
+    if (Entry == NULL && (CoreGcdMapEntryFreeTypes (Node) & FreeType) != 0) {
+      Entry = Node;
+    }
+    if (Entry == NULL) {
+      Entry = CoreGcdMapIndexFindFreeNode (Node->Left, FreeType, Address, TopDown);
+    }
+  } else {
+    if (Node->BaseAddress < Address) {
+      return CoreGcdMapIndexFindFreeNode (Node->Right, FreeType, Address, TopDown);
+    }
+    Entry = CoreGcdMapIndexFindFreeNode (Node->Left, FreeType, Address, TopDown);
+    if (Entry == NULL && (CoreGcdMapEntryFreeTypes (Node) & FreeType) != 0) {
+      Entry = Node;
+    }
+    if (Entry == NULL) {
+      Entry = CoreGcdMapIndexFindFreeNode (Node->Right, FreeType, Address, TopDown);
+    }
+  }
+  return Entry;
+}
+
+/**
+  Internal function.  Finds the next unallocated entry of a GCD map with a
+  given type, in search order.
+
+  @param  Map                    The GCD map to search
+  @param  Entry                  The entry to continue the search from, or
+                                 NULL to start at Address
+  @param  FreeType               The FreeTypes bit to look for
+  @param  Address                Where the search starts if Entry is NULL
+  @param  TopDown                TRUE to search down, FALSE to search up
+
+  @return The entry found, or NULL if there is none
+
+**/
+STATIC
+EFI_GCD_MAP_ENTRY *
+CoreGcdMapIndexNextFree (
+  IN LIST_ENTRY            *Map,
+  IN EFI_GCD_MAP_ENTRY     *Entry,
+  IN UINT32                FreeType,
+  IN EFI_PHYSICAL_ADDRESS  Address,
+  IN BOOLEAN               TopDown
+  )
+{
+  if (Entry != NULL) {
+    if (TopDown) {
+      if (Entry->BaseAddress == 0) {
+        return NULL;
+      }
+      Address = Entry->BaseAddress - 1;
+    } else {
+      if (Entry->EndAddress == MAX_UINT64) {
+        return NULL;
+      }
+      Address = Entry->EndAddress + 1;
+    }
+  }
+
+  return CoreGcdMapIndexFindFreeNode (*CoreGcdMapIndexRoot (Map), FreeType, Address, TopDown);
+}
+
 /**
   Allocate pool for two entries.
 
@@ -409,6 +913,7 @@ CoreAllocateGcdMapEntry (
   @param  Length                 The length of the new range in bytes
   @param  TopEntry               Top pad entry to insert if needed.
   @param  BottomEntry            Bottom pad entry to insert if needed.
+  @param  Map                    The GCD map Link belongs to.
 
   @retval EFI_SUCCESS            The new range was inserted into the linked list
 
@@ -420,7 +925,8 @@ CoreInsertGcdMapEntry (
   IN EFI_PHYSICAL_ADDRESS  BaseAddress,
   IN UINT64                Length,
   IN EFI_GCD_MAP_ENTRY     *TopEntry,
-  IN EFI_GCD_MAP_ENTRY     *BottomEntry
+  IN EFI_GCD_MAP_ENTRY     *BottomEntry,
+  IN LIST_ENTRY            *Map
   )
 {
   ASSERT (Length != 0);
@@ -432,6 +938,7 @@ CoreInsertGcdMapEntry (
     Entry->BaseAddress      = BaseAddress;
     BottomEntry->EndAddress = BaseAddress - 1;
     InsertTailList (Link, &BottomEntry->Link);
+    CoreGcdMapIndexInsert (Map, BottomEntry);
   }
 
   if ((BaseAddress + Length - 1) < Entry->EndAddress) {
@@ -441,6 +948,7 @@ CoreInsertGcdMapEntry (
     TopEntry->BaseAddress = BaseAddress + Length;
     Entry->EndAddress     = BaseAddress + Length - 1;
     InsertHeadList (Link, &TopEntry->Link);
+    CoreGcdMapIndexInsert (Map, TopEntry);
   }
 
   return EFI_SUCCESS;
@@ -508,6 +1016,7 @@ CoreMergeGcdMapEntry (
     return EFI_UNSUPPORTED;
   }
 
+  CoreGcdMapIndexRemove (Map, AdjacentEntry);
   if (Forward) {
     Entry->EndAddress  = AdjacentEntry->EndAddress;
   } else {
@@ -593,18 +1102,19 @@ CoreSearchGcdMapEntry (
   *StartLink = NULL;
   *EndLink   = NULL;
 
-  Link = Map->ForwardLink;
+  Entry = CoreGcdMapIndexLookup (Map, BaseAddress);
+  if (Entry == NULL) {
+    return EFI_NOT_FOUND;
+  }
+
+  *StartLink = &Entry->Link;
+  Link = &Entry->Link;
   while (Link != Map) {
     Entry = CR (Link, EFI_GCD_MAP_ENTRY, Link, EFI_GCD_MAP_SIGNATURE);
-    if (BaseAddress >= Entry->BaseAddress && BaseAddress <= Entry->EndAddress) {
-      *StartLink = Link;
-    }
-    if (*StartLink != NULL) {
-      if ((BaseAddress + Length - 1) >= Entry->BaseAddress &&
-          (BaseAddress + Length - 1) <= Entry->EndAddress     ) {
-        *EndLink = Link;
-        return EFI_SUCCESS;
-      }
+    if ((BaseAddress + Length - 1) >= Entry->BaseAddress &&
+        (BaseAddress + Length - 1) <= Entry->EndAddress     ) {
+      *EndLink = Link;
+      return EFI_SUCCESS;
     }
     Link = Link->ForwardLink;
   }
@@ -679,6 +1189,232 @@ ConverToCpuArchAttributes (
 }
 
 
+/**
+  Internal function.  Checks that the GCD map entries covering a segment allow
+  an operation (add, free, remove, change attribute ...).
+
+  @param  Operation              The type of the operation
+  @param  BaseAddress            Start address of the segment
+  @param  Length                 length of the segment
+  @param  Capabilities           The alterable attributes of a newly added entry
+  @param  Attributes             The attributes needs to be set
+  @param  StartLink              The first GCD entry of the segment
+  @param  EndLink                The last GCD entry of the segment
+
+  @retval EFI_SUCCESS            The operation is allowed.
+  @retval EFI_INVALID_PARAMETER  Address (length) not aligned when setting attribute.
+  @retval EFI_UNSUPPORTED        Set an upsupported attribute.
+  @retval EFI_ACCESS_DENIED      Operate on an space non-exist or is used for an
+                                 image.
+  @retval EFI_NOT_FOUND          Free a non-using space or remove a non-exist
+                                 space, and so on.
+
+**/
+STATIC
+EFI_STATUS
+CoreConvertSpaceCheckEntries (
+  IN UINTN                 Operation,
+  IN EFI_PHYSICAL_ADDRESS  BaseAddress,
+  IN UINT64                Length,
+  IN UINT64                Capabilities,
+  IN UINT64                Attributes,
+  IN LIST_ENTRY            *StartLink,
+  IN LIST_ENTRY            *EndLink
+  )
+{
+  LIST_ENTRY         *Link;
+  EFI_GCD_MAP_ENTRY  *Entry;
+
+  //
+  // Verify that the list of descriptors are unallocated non-existent memory.
+  //
+  Link = StartLink;
+  while (Link != EndLink->ForwardLink) {
+    Entry = CR (Link, EFI_GCD_MAP_ENTRY, Link, EFI_GCD_MAP_SIGNATURE);
+    switch (Operation) {
+    //
+    // Add operations
+    //
+    case GCD_ADD_MEMORY_OPERATION:
+      if (Entry->GcdMemoryType != EfiGcdMemoryTypeNonExistent ||
+          Entry->ImageHandle   != NULL                           ) {
+        return EFI_ACCESS_DENIED;
+      }
+      break;
+    case GCD_ADD_IO_OPERATION:
+      if (Entry->GcdIoType   != EfiGcdIoTypeNonExistent ||
+          Entry->ImageHandle != NULL                       ) {
+        return EFI_ACCESS_DENIED;
+      }
+      break;
+    //
+    // Free operations
+    //
+    case GCD_FREE_MEMORY_OPERATION:
+    case GCD_FREE_IO_OPERATION:
+      if (Entry->ImageHandle == NULL) {
+        return EFI_NOT_FOUND;
+      }
+      break;
+    //
+    // Remove operations
+    //
+    case GCD_REMOVE_MEMORY_OPERATION:
+      if (Entry->GcdMemoryType == EfiGcdMemoryTypeNonExistent) {
+        return EFI_NOT_FOUND;
+      }
+      if (Entry->ImageHandle != NULL) {
+        return EFI_ACCESS_DENIED;
+      }
+      break;
+    case GCD_REMOVE_IO_OPERATION:
+      if (Entry->GcdIoType == EfiGcdIoTypeNonExistent) {
+        return EFI_NOT_FOUND;
+      }
+      if (Entry->ImageHandle != NULL) {
+        return EFI_ACCESS_DENIED;
+      }
+      break;
+    //
+    // Set attributes operation
+    //
+    case GCD_SET_ATTRIBUTES_MEMORY_OPERATION:
+      if ((Attributes & EFI_MEMORY_RUNTIME) != 0) {
+        if ((BaseAddress & EFI_PAGE_MASK) != 0 || (Length & EFI_PAGE_MASK) != 0) {
+          return EFI_INVALID_PARAMETER;
+        }
+      }
+      if ((Entry->Capabilities & Attributes) != Attributes) {
+        return EFI_UNSUPPORTED;
+      }
+      break;
+    //
+    // Set capabilities operation
+    //
+    case GCD_SET_CAPABILITIES_MEMORY_OPERATION:
+      if ((BaseAddress & EFI_PAGE_MASK) != 0 || (Length & EFI_PAGE_MASK) != 0) {
+        return EFI_INVALID_PARAMETER;
+      }
+      //
+      // Current attributes must still be supported with new capabilities
+      //
+      if ((Capabilities & Entry->Attributes) != Entry->Attributes) {
+        return EFI_UNSUPPORTED;
+      }
+      break;
+    }
+    Link = Link->ForwardLink;
+  }
+
+  return EFI_SUCCESS;
+}
+
+
+/**
+  Internal function.  Applies an operation (add, free, remove, change attribute ...)
+  to the GCD map entries covering a segment, splitting the first and the last
+  entry and merging the result with its neighbors.
+
+  @param  Operation              The type of the operation
+  @param  GcdMemoryType          Additional information for the operation
+  @param  GcdIoType              Additional information for the operation
+  @param  BaseAddress            Start address of the segment
+  @param  Length                 length of the segment
+  @param  Capabilities           The alterable attributes of a newly added entry
+  @param  Attributes             The attributes needs to be set
+  @param  StartLink              The first GCD entry of the segment
+  @param  EndLink                The last GCD entry of the segment
+  @param  Map                    The GCD map
+  @param  TopEntry               Top pad entry to insert if needed.
+  @param  BottomEntry            Bottom pad entry to insert if needed.
+
+  @retval EFI_SUCCESS            Action successfully done.
+
+**/
+STATIC
+EFI_STATUS
+CoreConvertSpaceEntries (
+  IN UINTN                 Operation,
+  IN EFI_GCD_MEMORY_TYPE   GcdMemoryType,
+  IN EFI_GCD_IO_TYPE       GcdIoType,
+  IN EFI_PHYSICAL_ADDRESS  BaseAddress,
+  IN UINT64                Length,
+  IN UINT64                Capabilities,
+  IN UINT64                Attributes,
+  IN LIST_ENTRY            *StartLink,
+  IN LIST_ENTRY            *EndLink,
+  IN LIST_ENTRY            *Map,
+  IN EFI_GCD_MAP_ENTRY     *TopEntry,
+  IN EFI_GCD_MAP_ENTRY     *BottomEntry
+  )
+{
+  LIST_ENTRY         *Link;
+  EFI_GCD_MAP_ENTRY  *Entry;
+
+  //
+  // Convert/Insert the list of descriptors from StartLink to EndLink
+  //
+  Link = StartLink;
+  while (Link != EndLink->ForwardLink) {
+    Entry = CR (Link, EFI_GCD_MAP_ENTRY, Link, EFI_GCD_MAP_SIGNATURE);
+    CoreInsertGcdMapEntry (Link, Entry, BaseAddress, Length, TopEntry, BottomEntry, Map);
+    switch (Operation) {
+    //
+    // Add operations
+    //
+    case GCD_ADD_MEMORY_OPERATION:
+      Entry->GcdMemoryType = GcdMemoryType;
+      if (GcdMemoryType == EfiGcdMemoryTypeMemoryMappedIo) {
+        Entry->Capabilities  = Capabilities | EFI_MEMORY_RUNTIME | EFI_MEMORY_PORT_IO;
+      } else {
+        Entry->Capabilities  = Capabilities | EFI_MEMORY_RUNTIME;
+      }
+      break;
+    case GCD_ADD_IO_OPERATION:
+      Entry->GcdIoType = GcdIoType;
+      break;
+    //
+    // Free operations
+    //
+    case GCD_FREE_MEMORY_OPERATION:
+    case GCD_FREE_IO_OPERATION:
+      Entry->ImageHandle  = NULL;
+      Entry->DeviceHandle = NULL;
+      break;
+    //
+    // Remove operations
+    //
+    case GCD_REMOVE_MEMORY_OPERATION:
+      Entry->GcdMemoryType = EfiGcdMemoryTypeNonExistent;
+      Entry->Capabilities  = 0;
+      break;
+    case GCD_REMOVE_IO_OPERATION:
+      Entry->GcdIoType = EfiGcdIoTypeNonExistent;
+      break;
+    //
+    // Set attributes operation
+    //
+    case GCD_SET_ATTRIBUTES_MEMORY_OPERATION:
+      Entry->Attributes = Attributes;
+      break;
+    //
+    // Set capabilities operation
+    //
+    case GCD_SET_CAPABILITIES_MEMORY_OPERATION:
+      Entry->Capabilities = Capabilities;
+      break;
+    }
+    CoreGcdMapIndexUpdate (Map, Entry);
+    Link = Link->ForwardLink;
+  }
+
+  //
+  // Cleanup
+  //
+  return CoreCleanupGcdMapEntry (TopEntry, BottomEntry, StartLink, EndLink, Map);
+}
+
+
 /**
   Do operation on a segment of memory space specified (add, free, remove, change attribute ...).
 
@@ -716,8 +1452,6 @@ CoreConvertSpace (
 {
   EFI_STATUS         Status;
   LIST_ENTRY         *Map;
-  LIST_ENTRY         *Link;
-  EFI_GCD_MAP_ENTRY  *Entry;
   EFI_GCD_MAP_ENTRY  *TopEntry;
   EFI_GCD_MAP_ENTRY  *BottomEntry;
   LIST_ENTRY         *StartLink;
@@ -751,97 +1485,9 @@ CoreConvertSpace (
   }
   ASSERT (StartLink != NULL && EndLink != NULL);
 
-  //
-  // Verify that the list of descriptors are unallocated non-existent memory.
-  //
-  Link = StartLink;
-  while (Link != EndLink->ForwardLink) {
-    Entry = CR (Link, EFI_GCD_MAP_ENTRY, Link, EFI_GCD_MAP_SIGNATURE);
-    switch (Operation) {
-    //
-    // Add operations
-    //
-    case GCD_ADD_MEMORY_OPERATION:
-      if (Entry->GcdMemoryType != EfiGcdMemoryTypeNonExistent ||
-          Entry->ImageHandle   != NULL                           ) {
-        Status = EFI_ACCESS_DENIED;
-        goto Done;
-      }
-      break;
-    case GCD_ADD_IO_OPERATION:
-      if (Entry->GcdIoType   != EfiGcdIoTypeNonExistent ||
-          Entry->ImageHandle != NULL                       ) {
-        Status = EFI_ACCESS_DENIED;
-        goto Done;
-      }
-      break;
-    //
-    // Free operations
-    //
-    case GCD_FREE_MEMORY_OPERATION:
-    case GCD_FREE_IO_OPERATION:
-      if (Entry->ImageHandle == NULL) {
-        Status = EFI_NOT_FOUND;
-        goto Done;
-      }
-      break;
-    //
-    // Remove operations
-    //
-    case GCD_REMOVE_MEMORY_OPERATION:
-      if (Entry->GcdMemoryType == EfiGcdMemoryTypeNonExistent) {
-        Status = EFI_NOT_FOUND;
-        goto Done;
-      }
-      if (Entry->ImageHandle != NULL) {
-        Status = EFI_ACCESS_DENIED;
-        goto Done;
-      }
-      break;
-    case GCD_REMOVE_IO_OPERATION:
-      if (Entry->GcdIoType == EfiGcdIoTypeNonExistent) {
-        Status = EFI_NOT_FOUND;
-        goto Done;
-      }
-      if (Entry->ImageHandle != NULL) {
-        Status = EFI_ACCESS_DENIED;
-        goto Done;
-      }
-      break;
-    //
-    // Set attributes operation
-    //
-    case GCD_SET_ATTRIBUTES_MEMORY_OPERATION:
-      if ((Attributes & EFI_MEMORY_RUNTIME) != 0) {
-        if ((BaseAddress & EFI_PAGE_MASK) != 0 || (Length & EFI_PAGE_MASK) != 0) {
-          Status = EFI_INVALID_PARAMETER;
-          goto Done;
-        }
-      }
-      if ((Entry->Capabilities & Attributes) != Attributes) {
-        Status = EFI_UNSUPPORTED;
-        goto Done;
-      }
-      break;
-    //
-    // Set capabilities operation
-    //
-    case GCD_SET_CAPABILITIES_MEMORY_OPERATION:
-      if ((BaseAddress & EFI_PAGE_MASK) != 0 || (Length & EFI_PAGE_MASK) != 0) {
-        Status = EFI_INVALID_PARAMETER;
-
-        goto Done;
-      }
-      //
-      // Current attributes must still be supported with new capabilities
-      //
-      if ((Capabilities & Entry->Attributes) != Entry->Attributes) {
-        Status = EFI_UNSUPPORTED;
-        goto Done;
-      }
-      break;
-    }
-    Link = Link->ForwardLink;
+  Status = CoreConvertSpaceCheckEntries (Operation, BaseAddress, Length, Capabilities, Attributes, StartLink, EndLink);
+  if (EFI_ERROR (Status)) {
+    goto Done;
   }
 
   //
@@ -878,66 +1524,20 @@ CoreConvertSpace (
     }
   }
 
-  //
-  // Convert/Insert the list of descriptors from StartLink to EndLink
-  //
-  Link = StartLink;
-  while (Link != EndLink->ForwardLink) {
-    Entry = CR (Link, EFI_GCD_MAP_ENTRY, Link, EFI_GCD_MAP_SIGNATURE);
-    CoreInsertGcdMapEntry (Link, Entry, BaseAddress, Length, TopEntry, BottomEntry);
-    switch (Operation) {
-    //
-    // Add operations
-    //
-    case GCD_ADD_MEMORY_OPERATION:
-      Entry->GcdMemoryType = GcdMemoryType;
-      if (GcdMemoryType == EfiGcdMemoryTypeMemoryMappedIo) {
-        Entry->Capabilities  = Capabilities | EFI_MEMORY_RUNTIME | EFI_MEMORY_PORT_IO;
-      } else {
-        Entry->Capabilities  = Capabilities | EFI_MEMORY_RUNTIME;
-      }
-      break;
-    case GCD_ADD_IO_OPERATION:
-      Entry->GcdIoType = GcdIoType;
-      break;
-    //
-    // Free operations
-    //
-    case GCD_FREE_MEMORY_OPERATION:
-    case GCD_FREE_IO_OPERATION:
-      Entry->ImageHandle  = NULL;
-      Entry->DeviceHandle = NULL;
-      break;
-    //
-    // Remove operations
-    //
-    case GCD_REMOVE_MEMORY_OPERATION:
-      Entry->GcdMemoryType = EfiGcdMemoryTypeNonExistent;
-      Entry->Capabilities  = 0;
-      break;
-    case GCD_REMOVE_IO_OPERATION:
-      Entry->GcdIoType = EfiGcdIoTypeNonExistent;
-      break;
-    //
-    // Set attributes operation
-    //
-    case GCD_SET_ATTRIBUTES_MEMORY_OPERATION:
-      Entry->Attributes = Attributes;
-      break;
-    //
-    // Set capabilities operation
-    //
-    case GCD_SET_CAPABILITIES_MEMORY_OPERATION:
-      Entry->Capabilities = Capabilities;
-      break;
-    }
-    Link = Link->ForwardLink;
-  }
-
-  //
-  // Cleanup
-  //
-  Status = CoreCleanupGcdMapEntry (TopEntry, BottomEntry, StartLink, EndLink, Map);
+  Status = CoreConvertSpaceEntries (
+             Operation,
+             GcdMemoryType,
+             GcdIoType,
+             BaseAddress,
+             Length,
+             Capabilities,
+             Attributes,
+             StartLink,
+             EndLink,
+             Map,
+             TopEntry,
+             BottomEntry
+             );
 
 Done:
   DEBUG ((DEBUG_GCD, "  Status = %r\n", Status));
@@ -1042,6 +1642,8 @@ CoreAllocateSpace (
   LIST_ENTRY            *StartLink;
   LIST_ENTRY            *EndLink;
   BOOLEAN               Found;
+  BOOLEAN               TopDown;
+  UINT32                FreeType;
 
   //
   // Make sure parameters are valid
@@ -1141,31 +1743,21 @@ CoreAllocateSpace (
     }
 
     //
-    // Verify that the list of descriptors are unallocated memory matching GcdMemoryType.
+    // Visit the unallocated descriptors matching GcdMemoryType in search order.
+    // The index skips all other descriptors. A top down search starts with the
+    // descriptor covering MaxAddress, since the ones above it cannot be used.
     //
-    if (GcdAllocateType == EfiGcdAllocateMaxAddressSearchTopDown ||
-        GcdAllocateType == EfiGcdAllocateAnySearchTopDown ) {
-      Link = Map->BackLink;
-    } else {
-      Link = Map->ForwardLink;
-    }
-    while (Link != Map) {
-      Entry = CR (Link, EFI_GCD_MAP_ENTRY, Link, EFI_GCD_MAP_SIGNATURE);
-
-      if (GcdAllocateType == EfiGcdAllocateMaxAddressSearchTopDown ||
-          GcdAllocateType == EfiGcdAllocateAnySearchTopDown           ) {
-        Link = Link->BackLink;
-      } else {
-        Link = Link->ForwardLink;
-      }
+    TopDown  = (BOOLEAN) (GcdAllocateType == EfiGcdAllocateMaxAddressSearchTopDown ||
+                          GcdAllocateType == EfiGcdAllocateAnySearchTopDown);
+    FreeType = CoreGcdMapAllocateFreeType (Operation, GcdMemoryType, GcdIoType);
+    for (Entry = CoreGcdMapIndexNextFree (Map, NULL, FreeType, TopDown ? MaxAddress : 0, TopDown);
+         Entry != NULL;
+         Entry = CoreGcdMapIndexNextFree (Map, Entry, FreeType, 0, TopDown)) {
 
       Status = CoreAllocateSpaceCheckEntry (Operation, Entry, GcdMemoryType, GcdIoType);
-      if (EFI_ERROR (Status)) {
-        continue;
-      }
+      ASSERT_EFI_ERROR (Status);
 
-      if (GcdAllocateType == EfiGcdAllocateMaxAddressSearchTopDown ||
-          GcdAllocateType == EfiGcdAllocateAnySearchTopDown) {
+      if (TopDown) {
         if ((Entry->BaseAddress + Length) > MaxAddress) {
           continue;
         }
@@ -1197,9 +1789,9 @@ CoreAllocateSpace (
       }
       ASSERT (StartLink != NULL && EndLink != NULL);
 
-      Link = StartLink;
       //
       // Verify that the list of descriptors are unallocated memory matching GcdMemoryType.
+      // If not, the search continues from the descriptor that does not match.
       //
       Found = TRUE;
       SubLink = StartLink;
@@ -1207,7 +1799,6 @@ CoreAllocateSpace (
         Entry = CR (SubLink, EFI_GCD_MAP_ENTRY, Link, EFI_GCD_MAP_SIGNATURE);
         Status = CoreAllocateSpaceCheckEntry (Operation, Entry, GcdMemoryType, GcdIoType);
         if (EFI_ERROR (Status)) {
-          Link = SubLink;
           Found = FALSE;
           break;
         }
@@ -1239,9 +1830,10 @@ CoreAllocateSpace (
   Link = StartLink;
   while (Link != EndLink->ForwardLink) {
     Entry = CR (Link, EFI_GCD_MAP_ENTRY, Link, EFI_GCD_MAP_SIGNATURE);
-    CoreInsertGcdMapEntry (Link, Entry, *BaseAddress, Length, TopEntry, BottomEntry);
+    CoreInsertGcdMapEntry (Link, Entry, *BaseAddress, Length, TopEntry, BottomEntry, Map);
     Entry->ImageHandle  = ImageHandle;
     Entry->DeviceHandle = DeviceHandle;
+    CoreGcdMapIndexUpdate (Map, Entry);
     Link = Link->ForwardLink;
   }
 
@@ -1596,6 +2188,203 @@ CoreSetMemorySpaceAttributes (
 }
 
 
+/**
+  Modifies the attributes of several memory regions in the global coherency
+  domain of the processor.
+
+  All the regions are checked before any of them is changed. Regions that are
+  adjacent in the array and in memory and that map to the same CPU
+  architectural attribute are passed to the CPU Architectural Protocol in a
+  single call.
+
+  @param  This                   The protocol instance pointer.
+  @param  RangeCount             The number of entries in Ranges.
+  @param  Ranges                 The regions and the attributes to set on them.
+  @param  FailedIndex            Returns the index of the region that caused
+                                 the error. Optional.
+
+  @retval EFI_SUCCESS           The attributes were set for all the regions.
+  @retval EFI_INVALID_PARAMETER RangeCount is zero, Ranges is NULL or the
+                                length of a region is zero.
+  @retval EFI_UNSUPPORTED       The processor does not support one or more bytes
+                                of a region, or the attributes of a region are
+                                not supported by its capabilities.
+  @retval EFI_OUT_OF_RESOURCES  There are not enough system resources to modify
+                                the attributes.
+  @retval EFI_NOT_AVAILABLE_YET The attributes cannot be set because CPU
+                                architectural protocol is not available yet.
+
+**/
+EFI_STATUS
+EFIAPI
+CoreSetMemorySpaceAttributesBatch (
+  IN  EDKII_MEMORY_SPACE_ATTRIBUTES_PROTOCOL  *This,
+  IN  UINTN                                   RangeCount,
+  IN  EDKII_MEMORY_SPACE_ATTRIBUTES_RANGE     *Ranges,
+  OUT UINTN                                   *FailedIndex OPTIONAL
+  )
+{
+  EFI_STATUS         Status;
+  EFI_GCD_MAP_ENTRY  *TopEntry;
+  EFI_GCD_MAP_ENTRY  *BottomEntry;
+  LIST_ENTRY         *StartLink;
+  LIST_ENTRY         *EndLink;
+  UINT64             CpuArchAttributes;
+  UINT64             RunLength;
+  UINTN              RunEnd;
+  UINTN              Index;
+  UINTN              CpuCalls;
+
+  DEBUG ((DEBUG_GCD, "GCD:SetMemorySpaceAttributesBatch(Count=%d)\n", RangeCount));
+
+  if (RangeCount == 0 || Ranges == NULL) {
+    DEBUG ((DEBUG_GCD, "  Status = %r\n", EFI_INVALID_PARAMETER));
+    return EFI_INVALID_PARAMETER;
+  }
+
+  CoreAcquireGcdMemoryLock ();
+
+  //
+  // Check every region before changing any of them
+  //
+  Status = EFI_SUCCESS;
+  for (Index = 0; Index < RangeCount; Index++) {
+    DEBUG ((
+      DEBUG_GCD,
+      "  Base=%016lx Length=%016lx Attributes=%016lx\n",
+      Ranges[Index].BaseAddress,
+      Ranges[Index].Length,
+      Ranges[Index].Attributes
+      ));
+    if (Ranges[Index].Length == 0) {
+      Status = EFI_INVALID_PARAMETER;
+      goto Done;
+    }
+    Status = CoreSearchGcdMapEntry (Ranges[Index].BaseAddress, Ranges[Index].Length, &StartLink, &EndLink, &mGcdMemorySpaceMap);
+    if (EFI_ERROR (Status)) {
+      Status = EFI_UNSUPPORTED;
+      goto Done;
+    }
+    Status = CoreConvertSpaceCheckEntries (
+               GCD_SET_ATTRIBUTES_MEMORY_OPERATION,
+               Ranges[Index].BaseAddress,
+               Ranges[Index].Length,
+               0,
+               Ranges[Index].Attributes,
+               StartLink,
+               EndLink
+               );
+    if (EFI_ERROR (Status)) {
+      goto Done;
+    }
+  }
+
+  //
+  // Apply the regions one run of adjacent regions with the same CPU
+  // architectural attribute at a time
+  //
+  CpuCalls = 0;
+  for (Index = 0; Index < RangeCount; Index = RunEnd) {
+    CpuArchAttributes = ConverToCpuArchAttributes (Ranges[Index].Attributes);
+    RunLength         = Ranges[Index].Length;
+    for (RunEnd = Index + 1; RunEnd < RangeCount; RunEnd++) {
+      if ((Ranges[RunEnd].BaseAddress != Ranges[RunEnd - 1].BaseAddress + Ranges[RunEnd - 1].Length) ||
+          (ConverToCpuArchAttributes (Ranges[RunEnd].Attributes) != CpuArchAttributes)) {
+        break;
+      }
+      RunLength += Ranges[RunEnd].Length;
+    }
+
+    if (CpuArchAttributes != INVALID_CPU_ARCH_ATTRIBUTES) {
+      if (gCpu == NULL) {
+        Status = EFI_NOT_AVAILABLE_YET;
+      } else {
+        Status = gCpu->SetMemoryAttributes (
+                         gCpu,
+                         Ranges[Index].BaseAddress,
+                         RunLength,
+                         CpuArchAttributes
+                         );
+        CpuCalls++;
+      }
+      if (EFI_ERROR (Status)) {
+        goto Done;
+      }
+    }
+
+    for (; Index < RunEnd; Index++) {
+      Status = CoreSearchGcdMapEntry (Ranges[Index].BaseAddress, Ranges[Index].Length, &StartLink, &EndLink, &mGcdMemorySpaceMap);
+      ASSERT_EFI_ERROR (Status);
+      if (EFI_ERROR (Status)) {
+        Status = EFI_UNSUPPORTED;
+        goto Done;
+      }
+
+      Status = CoreAllocateGcdMapEntry (&TopEntry, &BottomEntry);
+      if (EFI_ERROR (Status)) {
+        Status = EFI_OUT_OF_RESOURCES;
+        goto Done;
+      }
+
+      Status = CoreConvertSpaceEntries (
+                 GCD_SET_ATTRIBUTES_MEMORY_OPERATION,
+                 (EFI_GCD_MEMORY_TYPE) 0,
+                 (EFI_GCD_IO_TYPE) 0,
+                 Ranges[Index].BaseAddress,
+                 Ranges[Index].Length,
+                 0,
+                 Ranges[Index].Attributes,
+                 StartLink,
+                 EndLink,
+                 &mGcdMemorySpaceMap,
+                 TopEntry,
+                 BottomEntry
+                 );
+      if (EFI_ERROR (Status)) {
+        goto Done;
+      }
+    }
+  }
+
+  DEBUG ((DEBUG_GCD, "  %d regions, %d CPU Arch Protocol calls\n", RangeCount, CpuCalls));
+
+Done:
+  DEBUG ((DEBUG_GCD, "  Status = %r\n", Status));
+  if (EFI_ERROR (Status) && FailedIndex != NULL) {
+    *FailedIndex = Index;
+  }
+
+  CoreReleaseGcdMemoryLock ();
+  CoreDumpGcdMemorySpaceMap (FALSE);
+
+  return Status;
+}
+
+
+/**
+  Install the Memory Space Attributes Protocol, so drivers can set the
+  attributes of several memory regions in one call.
+
+**/
+VOID
+CoreInstallMemorySpaceAttributesProtocol (
+  VOID
+  )
+{
+  EFI_HANDLE    Handle;
+  EFI_STATUS    Status;
+
+  Handle = NULL;
+  Status = CoreInstallMultipleProtocolInterfaces (
+             &Handle,
+             &gEdkiiMemorySpaceAttributesProtocolGuid,
+             &mMemorySpaceAttributesProtocol,
+             NULL
+             );
+  ASSERT_EFI_ERROR (Status);
+}
+
+
 /**
   Modifies the capabilities for a memory region in the global coherency domain of the
   processor.
@@ -2364,6 +3153,7 @@ CoreInitializeGcdServices (
   Entry->EndAddress = LShiftU64 (1, SizeOfMemorySpace) - 1;
 
   InsertHeadList (&mGcdMemorySpaceMap, &Entry->Link);
+  CoreGcdMapIndexInsert (&mGcdMemorySpaceMap, Entry);
 
   CoreDumpGcdMemorySpaceMap (TRUE);
   
@@ -2376,6 +3166,7 @@ CoreInitializeGcdServices (
   Entry->EndAddress = LShiftU64 (1, SizeOfIoSpace) - 1;
 
   InsertHeadList (&mGcdIoSpaceMap, &Entry->Link);
+  CoreGcdMapIndexInsert (&mGcdIoSpaceMap, Entry);
 
   CoreDumpGcdIoSpaceMap (TRUE);
   
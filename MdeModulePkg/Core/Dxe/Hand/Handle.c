@@ -16,18 +16,132 @@ WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
 #include "Handle.h"
 
 
+//
+// Number of buckets of the protocol and handle hash tables, powers of 2
+//
+#define PROTOCOL_HASH_BUCKETS   128
+#define HANDLE_HASH_BUCKETS     512
+
 //
 // mProtocolDatabase     - A list of all protocols in the system.  (simple list for now)
+// mProtocolHashTable    - The protocols of mProtocolDatabase hashed by GUID
 // gHandleList           - A list of all the handles in the system
+// mHandleHashTable      - The handles of gHandleList hashed by address
 // gProtocolDatabaseLock - Lock to protect the mProtocolDatabase
 // gHandleDatabaseKey    -  The Key to show that the handle has been created/modified
 //
 LIST_ENTRY      mProtocolDatabase     = INITIALIZE_LIST_HEAD_VARIABLE (mProtocolDatabase);
+PROTOCOL_ENTRY  *mProtocolHashTable[PROTOCOL_HASH_BUCKETS];
 LIST_ENTRY      gHandleList           = INITIALIZE_LIST_HEAD_VARIABLE (gHandleList);
+IHANDLE         *mHandleHashTable[HANDLE_HASH_BUCKETS];
 EFI_LOCK        gProtocolDatabaseLock = EFI_INITIALIZE_LOCK_VARIABLE (TPL_NOTIFY);
 UINT64          gHandleDatabaseKey    = 0;
 
 
+/**
+  Get the protocol hash table bucket of a protocol GUID.
+
+  @param  Protocol               The ID of the protocol
+
+  @return The index of the bucket
+
+**/
+STATIC
+UINTN
+CoreProtocolHash (
+  IN EFI_GUID   *Protocol
+  )
+{
+  UINT32  Hash;
+
+  Hash = ReadUnaligned32 ((UINT32 *) Protocol) ^
+         ReadUnaligned32 ((UINT32 *) Protocol + 1) ^
+         ReadUnaligned32 ((UINT32 *) Protocol + 2) ^
+         ReadUnaligned32 ((UINT32 *) Protocol + 3);
+  Hash ^= Hash >> 16;
+  Hash ^= Hash >> 8;
+  return Hash & (PROTOCOL_HASH_BUCKETS - 1);
+}
+
+
+/**
+  Get the handle hash table bucket of a handle.
+
+  @param  Handle                 The handle
+
+  @return The index of the bucket
+
+**/
+STATIC
+UINTN
+CoreHandleHash (
+  IN EFI_HANDLE   Handle
+  )
+{
+  UINTN   Hash;
+
+  //
+  // Handles are pool allocations, so the low bits carry no information
+  //
+  Hash = (UINTN) Handle >> 3;
+  Hash ^= Hash >> 9;
+  return Hash & (HANDLE_HASH_BUCKETS - 1);
+}
+
+
+/**
+  Add a handle to the handle database.
+  The gProtocolDatabaseLock must be owned
+
+  @param  Handle                 The handle to add
+
+**/
+STATIC
+VOID
+CoreInsertHandle (
+  IN IHANDLE    *Handle
+  )
+{
+  UINTN   Index;
+
+  ASSERT_LOCKED (&gProtocolDatabaseLock);
+
+  InsertTailList (&gHandleList, &Handle->AllHandles);
+
+  Index = CoreHandleHash (Handle);
+  Handle->HashNext        = mHandleHashTable[Index];
+  mHandleHashTable[Index] = Handle;
+}
+
+
+/**
+  Remove a handle from the handle database.
+  The gProtocolDatabaseLock must be owned
+
+  @param  Handle                 The handle to remove
+
+**/
+STATIC
+VOID
+CoreRemoveHandle (
+  IN IHANDLE    *Handle
+  )
+{
+  IHANDLE   **Link;
+
+  ASSERT_LOCKED (&gProtocolDatabaseLock);
+
+  RemoveEntryList (&Handle->AllHandles);
+
+  for (Link = &mHandleHashTable[CoreHandleHash (Handle)]; *Link != NULL; Link = &(*Link)->HashNext) {
+    if (*Link == Handle) {
+      *Link = Handle->HashNext;
+      break;
+    }
+  }
+}
+
+
 
 /**
   Acquire lock on gProtocolDatabaseLock.
@@ -72,14 +186,12 @@ CoreValidateHandle (
   )
 {
   IHANDLE             *Handle;
-  LIST_ENTRY          *Link;
 
   if (UserHandle == NULL) {
     return EFI_INVALID_PARAMETER;
   }
 
-  for (Link = gHandleList.BackLink; Link != &gHandleList; Link = Link->BackLink) {
-    Handle = CR (Link, IHANDLE, AllHandles, EFI_HANDLE_SIGNATURE);
+  for (Handle = mHandleHashTable[CoreHandleHash (UserHandle)]; Handle != NULL; Handle = Handle->HashNext) {
     if (Handle == (IHANDLE *) UserHandle) {
       return EFI_SUCCESS;
     }
@@ -106,9 +218,9 @@ CoreFindProtocolEntry (
   IN BOOLEAN    Create
   )
 {
-  LIST_ENTRY          *Link;
   PROTOCOL_ENTRY      *Item;
   PROTOCOL_ENTRY      *ProtEntry;
+  UINTN               Index;
 
   ASSERT_LOCKED(&gProtocolDatabaseLock);
 
@@ -117,11 +229,10 @@ CoreFindProtocolEntry (
   //
 
   ProtEntry = NULL;
-  for (Link = mProtocolDatabase.ForwardLink;
-       Link != &mProtocolDatabase;
-       Link = Link->ForwardLink) {
+  Index     = CoreProtocolHash (Protocol);
+  for (Item = mProtocolHashTable[Index]; Item != NULL; Item = Item->HashNext) {
 
-    Item = CR(Link, PROTOCOL_ENTRY, AllEntries, PROTOCOL_ENTRY_SIGNATURE);
+    ASSERT (Item->Signature == PROTOCOL_ENTRY_SIGNATURE);
     if (CompareGuid (&Item->ProtocolID, Protocol)) {
 
       //
@@ -153,6 +264,8 @@ CoreFindProtocolEntry (
       // Add it to protocol database
       //
       InsertTailList (&mProtocolDatabase, &ProtEntry->AllEntries);
+      ProtEntry->HashNext       = mProtocolHashTable[Index];
+      mProtocolHashTable[Index] = ProtEntry;
     }
   }
 
@@ -432,7 +545,7 @@ CoreInstallProtocolInterfaceNotify (
     // Add this handle to the list global list of all handles
     // in the system
     //
-    InsertTailList (&gHandleList, &Handle->AllHandles);
+    CoreInsertHandle (Handle);
   } else {
     Status = CoreValidateHandle (Handle);
     if (EFI_ERROR (Status)) {
@@ -794,7 +907,7 @@ CoreUninstallProtocolInterface (
   //
   if (IsListEmpty (&Handle->Protocols)) {
     Handle->Signature = 0;
-    RemoveEntryList (&Handle->AllHandles);
+    CoreRemoveHandle (Handle);
     CoreFreePool (Handle);
   }
 
@@ -21,7 +21,7 @@ WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
 ///
 /// IHANDLE - contains a list of protocol handles
 ///
-typedef struct {
+typedef struct _IHANDLE {
   UINTN               Signature;
   /// All handles list of IHANDLE
   LIST_ENTRY          AllHandles;
@@ -30,6 +30,8 @@ typedef struct {
   UINTN               LocateRequest;
   /// The Handle Database Key value when this handle was last created or modified
   UINT64              Key;
+  /// Next handle in the same bucket of the handle hash table
+  struct _IHANDLE     *HashNext;
 } IHANDLE;
 
 #define ASSERT_IS_HANDLE(a)  ASSERT((a)->Signature == EFI_HANDLE_SIGNATURE)
@@ -41,7 +43,7 @@ typedef struct {
 /// database.  Each handler that supports this protocol is listed, along
 /// with a list of registered notifies.
 ///
-typedef struct {
+typedef struct _PROTOCOL_ENTRY {
   UINTN               Signature;
   /// Link Entry inserted to mProtocolDatabase
   LIST_ENTRY          AllEntries;  
@@ -51,6 +53,8 @@ typedef struct {
   LIST_ENTRY          Protocols;     
   /// Registerd notification handlers
   LIST_ENTRY          Notify;                 
+  /// Next protocol entry in the same bucket of the protocol hash table
+  struct _PROTOCOL_ENTRY  *HashNext;
 } PROTOCOL_ENTRY;
 
 
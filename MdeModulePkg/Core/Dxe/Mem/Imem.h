@@ -36,7 +36,8 @@ WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
 //
 
 #define MEMORY_MAP_SIGNATURE   SIGNATURE_32('m','m','a','p')
-typedef struct {
+typedef struct _MEMORY_MAP MEMORY_MAP;
+struct _MEMORY_MAP {
   UINTN           Signature;
   LIST_ENTRY      Link;
   BOOLEAN         FromPages;
@@ -47,7 +48,16 @@ typedef struct {
 
   UINT64          VirtualStart;
   UINT64          Attribute;
-} MEMORY_MAP;
+
+  //
+  // Address ordered AVL tree over all entries of gMemoryMap. MaxFreeBytes is
+  // the size of the largest EfiConventionalMemory entry in the subtree.
+  //
+  MEMORY_MAP      *Left;
+  MEMORY_MAP      *Right;
+  UINTN           Height;
+  UINT64          MaxFreeBytes;
+};
 
 //
 // Internal prototypes
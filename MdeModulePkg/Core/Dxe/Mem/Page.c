@@ -48,6 +48,11 @@ UINTN         mFreeMapStack = 0;
 /// This list maintain the free memory map list
 ///
 LIST_ENTRY   mFreeMemoryMapEntryList = INITIALIZE_LIST_HEAD_VARIABLE (mFreeMemoryMapEntryList);
+///
+/// Root of the address ordered index over gMemoryMap. gMemoryMap itself keeps
+/// the order in which descriptors are reported by CoreGetMemoryMap ().
+///
+MEMORY_MAP   *mMemoryMapRoot = NULL;
 BOOLEAN      mMemoryTypeInformationInitialized = FALSE;
 
 EFI_MEMORY_TYPE_STATISTICS mMemoryTypeStatistics[EfiMaxMemoryType + 1] = {
@@ -126,6 +131,379 @@ CoreReleaseMemoryLock (
 
 
 
+/**
+  Internal function.  Compares the address ranges of two descriptor entries.
+  Descriptor entries never overlap, so the start address orders them; the end
+  address only breaks the tie with an entry that has just been emptied.
+
+  @param  Entry1                 The first entry
+  @param  Entry2                 The second entry
+
+  @retval <0                     Entry1 is below Entry2
+  @retval 0                      Entry1 and Entry2 cover the same range
+  @retval >0                     Entry1 is above Entry2
+
+**/
+STATIC
+INTN
+CompareMemoryMapEntry (
+  IN MEMORY_MAP      *Entry1,
+  IN MEMORY_MAP      *Entry2
+  )
+{
+  if (Entry1->Start != Entry2->Start) {
+    return (Entry1->Start < Entry2->Start) ? -1 : 1;
+  }
+  if (Entry1->End != Entry2->End) {
+    return (Entry1->End < Entry2->End) ? -1 : 1;
+  }
+  return 0;
+}
+
+/**
+  Internal function.  Returns the height of a memory map index subtree.
+
+  @param  Node                   The root of the subtree, or NULL
+
+  @return The height of the subtree
+
+**/
+STATIC
+UINTN
+MemoryMapIndexHeight (
+  IN MEMORY_MAP      *Node
+  )
+{
+  return (Node == NULL) ? 0 : Node->Height;
+}
+
+/**
+  Internal function.  Recomputes the height and the largest free run of a
+  memory map index node from its own range and its children.
+
+  @param  Node                   The node to refresh
+
+**/
+STATIC
+VOID
+MemoryMapIndexRefresh (
+  IN OUT MEMORY_MAP  *Node
+  )
+{
+  UINTN   LeftHeight;
+  UINTN   RightHeight;
+
+  LeftHeight   = MemoryMapIndexHeight (Node->Left);
+  RightHeight  = MemoryMapIndexHeight (Node->Right);
+  Node->Height = MAX (LeftHeight, RightHeight) + 1;
+
+  Node->MaxFreeBytes = 0;
+  if (Node->Type == EfiConventionalMemory && Node->End >= Node->Start) {
+    Node->MaxFreeBytes = Node->End - Node->Start + 1;
+  }
+  if (Node->Left != NULL && Node->Left->MaxFreeBytes > Node->MaxFreeBytes) {
+    Node->MaxFreeBytes = Node->Left->MaxFreeBytes;
+  }
+  if (Node->Right != NULL && Node->Right->MaxFreeBytes > Node->MaxFreeBytes) {
+    Node->MaxFreeBytes = Node->Right->MaxFreeBytes;
+  }
+}
+
+/**
+  Internal function.  Restores the AVL balance of a memory map index subtree
+  whose children differ in height by at most two.
+
+  @param  Node                   The root of the subtree
+
+  @return The new root of the subtree
+
+**/
+STATIC
+MEMORY_MAP *
+MemoryMapIndexRebalance (
+  IN OUT MEMORY_MAP  *Node
+  )
+{
+  MEMORY_MAP  *Pivot;
+
+  MemoryMapIndexRefresh (Node);
+
+  if (MemoryMapIndexHeight (Node->Left) > MemoryMapIndexHeight (Node->Right) + 1) {
+    if (MemoryMapIndexHeight (Node->Left->Left) < MemoryMapIndexHeight (Node->Left->Right)) {
+      Pivot              = Node->Left->Right;
+      Node->Left->Right  = Pivot->Left;
+      Pivot->Left        = Node->Left;
+      MemoryMapIndexRefresh (Pivot->Left);
+      Node->Left         = Pivot;
+    }
+    Pivot        = Node->Left;
+    Node->Left   = Pivot->Right;
+    Pivot->Right = Node;
+    MemoryMapIndexRefresh (Node);
+    MemoryMapIndexRefresh (Pivot);
+    return Pivot;
+  }
+
+  if (MemoryMapIndexHeight (Node->Right) > MemoryMapIndexHeight (Node->Left) + 1) {
+    if (MemoryMapIndexHeight (Node->Right->Right) < MemoryMapIndexHeight (Node->Right->Left)) {
+      Pivot              = Node->Right->Left;
+      Node->Right->Left  = Pivot->Right;
+      Pivot->Right       = Node->Right;
+      MemoryMapIndexRefresh (Pivot->Right);
+      Node->Right        = Pivot;
+    }
+    Pivot        = Node->Right;
+    Node->Right  = Pivot->Left;
+    Pivot->Left  = Node;
+    MemoryMapIndexRefresh (Node);
+    MemoryMapIndexRefresh (Pivot);
+    return Pivot;
+  }
+
+  return Node;
+}
+
+/**
+  Internal function.  Inserts a descriptor entry into a memory map index
+  subtree.
+
+  @param  Root                   The root of the subtree, or NULL
+  @param  Entry                  The entry to insert
+
+  @return The new root of the subtree
+
+**/
+STATIC
+MEMORY_MAP *
+MemoryMapIndexInsertNode (
+  IN OUT MEMORY_MAP  *Root,
+  IN OUT MEMORY_MAP  *Entry
+  )
+{
+  if (Root == NULL) {
+    Entry->Left  = NULL;
+    Entry->Right = NULL;
+    MemoryMapIndexRefresh (Entry);
+    return Entry;
+  }
+
+  if (CompareMemoryMapEntry (Entry, Root) < 0) {
+    Root->Left = MemoryMapIndexInsertNode (Root->Left, Entry);
+  } else {
+    Root->Right = MemoryMapIndexInsertNode (Root->Right, Entry);
+  }
+  return MemoryMapIndexRebalance (Root);
+}
+
+/**
+  Internal function.  Unlinks the lowest entry of a memory map index subtree.
+
+  @param  Root                   The root of the subtree
+  @param  Lowest                 Returns the unlinked entry
+
+  @return The new root of the subtree
+
+**/
+STATIC
+MEMORY_MAP *
+MemoryMapIndexRemoveLowest (
+  IN OUT MEMORY_MAP  *Root,
+  OUT    MEMORY_MAP  **Lowest
+  )
+{
+  if (Root->Left == NULL) {
+    *Lowest = Root;
+    return Root->Right;
+  }
+
+  Root->Left = MemoryMapIndexRemoveLowest (Root->Left, Lowest);
+  return MemoryMapIndexRebalance (Root);
+}
+
+/**
+  Internal function.  Removes a descriptor entry from a memory map index
+  subtree.
+
+  @param  Root                   The root of the subtree
+  @param  Entry                  The entry to remove
+
+  @return The new root of the subtree
+
+**/
+STATIC
+MEMORY_MAP *
+MemoryMapIndexRemoveNode (
+  IN OUT MEMORY_MAP  *Root,
+  IN     MEMORY_MAP  *Entry
+  )
+{
+  MEMORY_MAP  *Successor;
+
+  ASSERT (Root != NULL);
+  if (Root == NULL) {
+    return NULL;
+  }
+
+  if (Root == Entry) {
+    if (Root->Left == NULL) {
+      return Root->Right;
+    }
+    if (Root->Right == NULL) {
+      return Root->Left;
+    }
+    Successor        = NULL;
+    Root->Right      = MemoryMapIndexRemoveLowest (Root->Right, &Successor);
+    Successor->Left  = Root->Left;
+    Successor->Right = Root->Right;
+    return MemoryMapIndexRebalance (Successor);
+  }
+
+  if (CompareMemoryMapEntry (Entry, Root) < 0) {
+    Root->Left = MemoryMapIndexRemoveNode (Root->Left, Entry);
+  } else {
+    Root->Right = MemoryMapIndexRemoveNode (Root->Right, Entry);
+  }
+  return MemoryMapIndexRebalance (Root);
+}
+
+/**
+  Internal function.  Refreshes the memory map index along the path to a
+  descriptor entry whose range has shrunk in place. Shrinking a range never
+  changes its position relative to the other entries.
+
+  @param  Root                   The root of the subtree
+  @param  Entry                  The entry that has been updated
+
+**/
+STATIC
+VOID
+MemoryMapIndexRefreshPath (
+  IN OUT MEMORY_MAP  *Root,
+  IN     MEMORY_MAP  *Entry
+  )
+{
+  ASSERT (Root != NULL);
+  if (Root == NULL) {
+    return;
+  }
+
+  if (Root != Entry) {
+    if (CompareMemoryMapEntry (Entry, Root) < 0) {
+      MemoryMapIndexRefreshPath (Root->Left, Entry);
+    } else {
+      MemoryMapIndexRefreshPath (Root->Right, Entry);
+    }
+  }
+  MemoryMapIndexRefresh (Root);
+}
+
+/**
+  Internal function.  Finds the descriptor entry that covers an address.
+
+  @param  Address                The address to look up
+
+  @return The entry covering Address, or NULL if there is none
+
+**/
+STATIC
+MEMORY_MAP *
+MemoryMapIndexLookup (
+  IN UINT64          Address
+  )
+{
+  MEMORY_MAP  *Node;
+  MEMORY_MAP  *Entry;
+
+  //
+  // Find the entry with the highest start address not above Address
+  //
+  Entry = NULL;
+  Node  = mMemoryMapRoot;
+  while (Node != NULL) {
+    if (Node->Start <= Address) {
+      Entry = Node;
+      Node  = Node->Right;
+    } else {
+      Node  = Node->Left;
+    }
+  }
+
+  if (Entry == NULL || Entry->End < Address) {
+    return NULL;
+  }
+  return Entry;
+}
+
+/**
+  Internal function.  Finds the lowest descriptor entry that has been moved
+  to heap and starts above an address.
+
+  @param  Address                The address to look up
+
+  @return The entry found, or NULL if there is none
+
+**/
+STATIC
+MEMORY_MAP *
+MemoryMapIndexNextFromPages (
+  IN UINT64          Address
+  )
+{
+  MEMORY_MAP  *Node;
+  MEMORY_MAP  *Entry;
+
+  do {
+    Entry = NULL;
+    Node  = mMemoryMapRoot;
+    while (Node != NULL) {
+      if (Node->Start > Address) {
+        Entry = Node;
+        Node  = Node->Left;
+      } else {
+        Node  = Node->Right;
+      }
+    }
+
+    //
+    // Skip the few entries still living on the temporary descriptor stack
+    //
+    if (Entry == NULL || Entry->FromPages) {
+      return Entry;
+    }
+    Address = Entry->Start;
+  } while (TRUE);
+}
+
+/**
+  Internal function.  Inserts a descriptor entry into the memory map index.
+
+  @param  Entry                  The entry to insert
+
+**/
+STATIC
+VOID
+MemoryMapIndexInsert (
+  IN OUT MEMORY_MAP  *Entry
+  )
+{
+  mMemoryMapRoot = MemoryMapIndexInsertNode (mMemoryMapRoot, Entry);
+}
+
+/**
+  Internal function.  Removes a descriptor entry from the memory map index.
+
+  @param  Entry                  The entry to remove
+
+**/
+STATIC
+VOID
+MemoryMapIndexRemove (
+  IN MEMORY_MAP      *Entry
+  )
+{
+  mMemoryMapRoot = MemoryMapIndexRemoveNode (mMemoryMapRoot, Entry);
+}
+
 /**
   Internal function.  Removes a descriptor entry.
 
@@ -137,6 +515,7 @@ RemoveMemoryMapEntry (
   IN OUT MEMORY_MAP      *Entry
   )
 {
+  MemoryMapIndexRemove (Entry);
   RemoveEntryList (&Entry->Link);
   Entry->Link.ForwardLink = NULL;
 
@@ -168,7 +547,6 @@ CoreAddRange (
   IN UINT64                   Attribute
   )
 {
-  LIST_ENTRY        *Link;
   MEMORY_MAP        *Entry;
 
   ASSERT ((Start & EFI_PAGE_MASK) == 0);
@@ -212,29 +590,23 @@ CoreAddRange (
   //
 
   // Two memory descriptors can only be merged if they have the same Type
-  // and the same Attribute
+  // and the same Attribute. Descriptors do not overlap, so the only
+  // candidates are the ones covering Start - 1 and End + 1.
   //
 
-  Link = gMemoryMap.ForwardLink;
-  while (Link != &gMemoryMap) {
-    Entry = CR (Link, MEMORY_MAP, Link, MEMORY_MAP_SIGNATURE);
-    Link  = Link->ForwardLink;
-
-    if (Entry->Type != Type) {
-      continue;
-    }
-
-    if (Entry->Attribute != Attribute) {
-      continue;
-    }
-
-    if (Entry->End + 1 == Start) {
-
+  if (Start != 0) {
+    Entry = MemoryMapIndexLookup (Start - 1);
+    if (Entry != NULL && Entry->Type == Type && Entry->Attribute == Attribute) {
+      ASSERT (Entry->End + 1 == Start);
       Start = Entry->Start;
       RemoveMemoryMapEntry (Entry);
+    }
+  }
 
-    } else if (Entry->Start == End + 1) {
-
+  if (End != MAX_UINT64) {
+    Entry = MemoryMapIndexLookup (End + 1);
+    if (Entry != NULL && Entry->Type == Type && Entry->Attribute == Attribute) {
+      ASSERT (Entry->Start == End + 1);
       End = Entry->End;
       RemoveMemoryMapEntry (Entry);
     }
@@ -252,6 +624,7 @@ CoreAddRange (
   mMapStack[mMapDepth].VirtualStart  = 0;
   mMapStack[mMapDepth].Attribute     = Attribute;
   InsertTailList (&gMemoryMap, &mMapStack[mMapDepth].Link);
+  MemoryMapIndexInsert (&mMapStack[mMapDepth]);
 
   mMapDepth += 1;
   ASSERT (mMapDepth < MAX_MAP_DEPTH);
@@ -322,7 +695,6 @@ CoreFreeMemoryMapStack (
 {
   MEMORY_MAP      *Entry;
   MEMORY_MAP      *Entry2;
-  LIST_ENTRY      *Link2;
 
   ASSERT_LOCKED (&gMemoryLock);
 
@@ -356,6 +728,7 @@ CoreFreeMemoryMapStack (
       //
       // Move this entry to general memory
       //
+      MemoryMapIndexRemove (&mMapStack[mMapDepth]);
       RemoveEntryList (&mMapStack[mMapDepth].Link);
       mMapStack[mMapDepth].Link.ForwardLink = NULL;
 
@@ -363,16 +736,16 @@ CoreFreeMemoryMapStack (
       Entry->FromPages = TRUE;
 
       //
-      // Find insertion location
+      // Find insertion location: in front of the first heap entry above it,
+      // which keeps the heap entries of gMemoryMap sorted by address
       //
-      for (Link2 = gMemoryMap.ForwardLink; Link2 != &gMemoryMap; Link2 = Link2->ForwardLink) {
-        Entry2 = CR (Link2, MEMORY_MAP, Link, MEMORY_MAP_SIGNATURE);
-        if (Entry2->FromPages && Entry2->Start > Entry->Start) {
-          break;
-        }
+      Entry2 = MemoryMapIndexNextFromPages (Entry->Start);
+      if (Entry2 == NULL) {
+        InsertTailList (&gMemoryMap, &Entry->Link);
+      } else {
+        InsertTailList (&Entry2->Link, &Entry->Link);
       }
-
-      InsertTailList (Link2, &Entry->Link);
+      MemoryMapIndexInsert (Entry);
 
     } else {
       //
@@ -424,6 +797,7 @@ PromoteMemoryResource (
       Entry->Capabilities |= EFI_MEMORY_TESTED;
       Entry->ImageHandle  = gDxeCoreImageHandle;
       Entry->DeviceHandle = NULL;
+      CoreGcdMemoryMapEntryUpdated (Entry);
 
       //
       // Add to allocable system memory resource
@@ -715,7 +1089,6 @@ CoreConvertPagesEx (
   UINT64          RangeEnd;
   UINT64          Attribute;
   EFI_MEMORY_TYPE MemType;
-  LIST_ENTRY      *Link;
   MEMORY_MAP      *Entry;
 
   Entry = NULL;
@@ -741,15 +1114,8 @@ CoreConvertPagesEx (
     //
     // Find the entry that the covers the range
     //
-    for (Link = gMemoryMap.ForwardLink; Link != &gMemoryMap; Link = Link->ForwardLink) {
-      Entry = CR (Link, MEMORY_MAP, Link, MEMORY_MAP_SIGNATURE);
-
-      if (Entry->Start <= Start && Entry->End > Start) {
-        break;
-      }
-    }
-
-    if (Link == &gMemoryMap) {
+    Entry = MemoryMapIndexLookup (Start);
+    if (Entry == NULL) {
       DEBUG ((DEBUG_ERROR | DEBUG_PAGE, "ConvertPages: failed to find range %lx - %lx\n", Start, End));
       return EFI_NOT_FOUND;
     }
@@ -831,6 +1197,7 @@ CoreConvertPagesEx (
       // Clip start
       //
       Entry->Start = RangeEnd + 1;
+      MemoryMapIndexRefreshPath (mMemoryMapRoot, Entry);
 
     } else if (Entry->End == RangeEnd) {
 
@@ -838,6 +1205,7 @@ CoreConvertPagesEx (
       // Clip end
       //
       Entry->End = Start - 1;
+      MemoryMapIndexRefreshPath (mMemoryMapRoot, Entry);
 
     } else {
 
@@ -861,9 +1229,11 @@ CoreConvertPagesEx (
 
       Entry->End = Start - 1;
       ASSERT (Entry->Start < Entry->End);
+      MemoryMapIndexRefreshPath (mMemoryMapRoot, Entry);
 
       Entry = &mMapStack[mMapDepth];
       InsertTailList (&gMemoryMap, &Entry->Link);
+      MemoryMapIndexInsert (Entry);
 
       mMapDepth += 1;
       ASSERT (mMapDepth < MAX_MAP_DEPTH);
@@ -981,6 +1351,85 @@ CoreUpdateMemoryAttributes (
 }
 
 
+/**
+  Internal function.  Searches a memory map index subtree for the highest
+  free range that satisfies an allocation request.
+
+  Descriptor entries do not overlap, so the highest entry that can hold the
+  request also yields the highest base address. Subtrees whose largest free
+  entry is too small, or which lie entirely outside of [MinAddress,
+  MaxAddress], are skipped.
+
+  @param  Node                   The root of the subtree, or NULL
+  @param  MaxAddress             The address that the range must be below,
+                                 the last byte of a page
+  @param  MinAddress             The address that the range must be above
+  @param  NumberOfBytes          Number of bytes needed
+  @param  Alignment              Bits to align with
+
+  @return The last address of the range found, or 0 if none was found
+
+**/
+STATIC
+UINT64
+CoreFindFreePagesInIndex (
+  IN MEMORY_MAP       *Node,
+  IN UINT64           MaxAddress,
+  IN UINT64           MinAddress,
+  IN UINT64           NumberOfBytes,
+  IN UINTN            Alignment
+  )
+{
+  UINT64          Target;
+  UINT64          DescEnd;
+
+  if (Node == NULL || Node->MaxFreeBytes < NumberOfBytes) {
+    return 0;
+  }
+
+  if (Node->Start < MaxAddress) {
+    //
+    // Entries above this one are preferred
+    //
+    Target = CoreFindFreePagesInIndex (Node->Right, MaxAddress, MinAddress, NumberOfBytes, Alignment);
+    if (Target != 0) {
+      return Target;
+    }
+
+    if (Node->Type == EfiConventionalMemory && Node->End >= MinAddress) {
+      //
+      // If desc ends past max allowed address, clip the end
+      //
+      DescEnd = Node->End;
+      if (DescEnd >= MaxAddress) {
+        DescEnd = MaxAddress;
+      }
+
+      DescEnd = ((DescEnd + 1) & (~(Alignment - 1))) - 1;
+
+      //
+      // Check the aligned descriptor is large enough, and the start of the
+      // allocated range is not below the min address allowed
+      //
+      if (DescEnd >= Node->Start &&
+          DescEnd - Node->Start + 1 >= NumberOfBytes &&
+          DescEnd - NumberOfBytes + 1 >= MinAddress) {
+        return DescEnd;
+      }
+    }
+  }
+
+  //
+  // Entries below one ending under MinAddress cannot be used
+  //
+  if (Node->End < MinAddress) {
+    return 0;
+  }
+
+  return CoreFindFreePagesInIndex (Node->Left, MaxAddress, MinAddress, NumberOfBytes, Alignment);
+}
+
+
 /**
   Internal function. Finds a consecutive free page range below
   the requested address.
@@ -1006,11 +1455,6 @@ CoreFindFreePagesI (
 {
   UINT64          NumberOfBytes;
   UINT64          Target;
-  UINT64          DescStart;
-  UINT64          DescEnd;
-  UINT64          DescNumberOfBytes;
-  LIST_ENTRY      *Link;
-  MEMORY_MAP      *Entry;
 
   if ((MaxAddress < EFI_PAGE_MASK) ||(NumberOfPages == 0)) {
     return 0;
@@ -1039,64 +1483,11 @@ CoreFindFreePagesI (
   }
 
   NumberOfBytes = LShiftU64 (NumberOfPages, EFI_PAGE_SHIFT);
-  Target = 0;
-
-  for (Link = gMemoryMap.ForwardLink; Link != &gMemoryMap; Link = Link->ForwardLink) {
-    Entry = CR (Link, MEMORY_MAP, Link, MEMORY_MAP_SIGNATURE);
 
-    //
-    // If it's not a free entry, don't bother with it
-    //
-    if (Entry->Type != EfiConventionalMemory) {
-      continue;
-    }
-
-    DescStart = Entry->Start;
-    DescEnd = Entry->End;
-
-    //
-    // If desc is past max allowed address or below min allowed address, skip it
-    //
-    if ((DescStart >= MaxAddress) || (DescEnd < MinAddress)) {
-      continue;
-    }
-
-    //
-    // If desc ends past max allowed address, clip the end
-    //
-    if (DescEnd >= MaxAddress) {
-      DescEnd = MaxAddress;
-    }
-
-    DescEnd = ((DescEnd + 1) & (~(Alignment - 1))) - 1;
-
-    // Skip if DescEnd is less than DescStart after alignment clipping
-    if (DescEnd < DescStart) {
-      continue;
-    }
-
-    //
-    // Compute the number of bytes we can used from this
-    // descriptor, and see it's enough to satisfy the request
-    //
-    DescNumberOfBytes = DescEnd - DescStart + 1;
-
-    if (DescNumberOfBytes >= NumberOfBytes) {
-      //
-      // If the start of the allocated range is below the min address allowed, skip it
-      //
-      if ((DescEnd - NumberOfBytes + 1) < MinAddress) {
-        continue;
-      }
-
-      //
-      // If this is the best match so far remember it
-      //
-      if (DescEnd > Target) {
-        Target = DescEnd;
-      }
-    }
-  }
+  //
+  // Search the index for the highest free descriptor that can hold the request
+  //
+  Target = CoreFindFreePagesInIndex (mMemoryMapRoot, MaxAddress, MinAddress, NumberOfBytes, Alignment);
 
   //
   // If this is a grow down, adjust target to be the allocation base
@@ -1390,7 +1781,6 @@ CoreInternalFreePages (
   )
 {
   EFI_STATUS      Status;
-  LIST_ENTRY      *Link;
   MEMORY_MAP      *Entry;
   UINTN           Alignment;
 
@@ -1402,14 +1792,8 @@ CoreInternalFreePages (
   //
   // Find the entry that the covers the range
   //
-  Entry = NULL;
-  for (Link = gMemoryMap.ForwardLink; Link != &gMemoryMap; Link = Link->ForwardLink) {
-    Entry = CR(Link, MEMORY_MAP, Link, MEMORY_MAP_SIGNATURE);
-    if (Entry->Start <= Memory && Entry->End > Memory) {
-        break;
-    }
-  }
-  if (Link == &gMemoryMap) {
+  Entry = MemoryMapIndexLookup (Memory);
+  if (Entry == NULL) {
     Status = EFI_NOT_FOUND;
     goto Done;
   }
@@ -64,6 +64,74 @@ STATIC CONST UINT16 mPoolSizeTable[] = {
 
 #define MAX_POOL_SIZE     (MAX_ADDRESS - POOL_OVERHEAD)
 
+//
+// Size classes of the slab allocator. Each class is either a power of 2 or
+// 1.5 times a power of 2, so the class of a request can be computed from its
+// highest set bit and the internal fragmentation stays below 1/3.
+//
+STATIC CONST UINT16 mPoolSlabSizeTable[] = {
+  64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048, 3072, 4096, 6144,
+  8192, 12288, 16384
+};
+
+#define POOL_SLAB_MIN_SHIFT       6
+
+#define SIZE_TO_SLAB_LIST(a)      (GetPoolSlabIndexFromSize (a))
+#define SLAB_LIST_TO_SIZE(a)      (mPoolSlabSizeTable [a])
+
+#define MAX_POOL_SLAB_LIST        (ARRAY_SIZE (mPoolSlabSizeTable))
+
+//
+// Minimum number of objects a newly created slab is sized for
+//
+#define POOL_SLAB_MIN_OBJECTS     8
+
+//
+// A slab is a run of pool pages carved into objects of one size class. The
+// slab header sits at the start of the run and every object handed out from
+// it records its offset from the header in POOL_HEAD.Reserved, so the owning
+// slab can be found in O(1) on free. Objects that have never been handed out
+// are carved lazily from the end of the used part of the slab, objects that
+// were freed are kept on the slab free list.
+//
+#define POOL_SLAB_SIGNATURE   SIGNATURE_32('p','s','l','b')
+typedef struct {
+  UINT32          Signature;
+  UINT32          Index;
+  LIST_ENTRY      Link;
+  LIST_ENTRY      FreeList;
+  UINTN           NoPages;
+  UINT32          ObjectCount;
+  UINT32          CarvedCount;
+  UINT32          InUse;
+} POOL_SLAB;
+
+#define SIZE_OF_POOL_SLAB     (ALIGN_VARIABLE (sizeof (POOL_SLAB)))
+
+//
+// Per size class slab cache. PartialList holds the slabs that still have free
+// objects; full slabs are not linked anywhere until one of their objects is
+// freed. At most one completely free slab is kept per cache.
+//
+typedef struct {
+  LIST_ENTRY      PartialList;
+  UINTN           EmptyCount;
+} POOL_SLAB_CACHE;
+
+//
+// Slab allocator counters, used to judge reuse rate and fragmentation.
+//
+typedef struct {
+  UINT64          AllocationCount;
+  UINT64          ReuseCount;
+  UINT64          FreeCount;
+  UINT64          SlabCreateCount;
+  UINT64          SlabReleaseCount;
+  UINT64          PagesInUse;
+  UINT64          ObjectBytesInUse;
+  UINT64          RequestBytesInUse;
+} POOL_SLAB_STATISTICS;
+
 //
 // Globals
 //
@@ -74,6 +142,7 @@ typedef struct {
     UINTN            Used;
     EFI_MEMORY_TYPE  MemoryType;
     LIST_ENTRY       FreeList[MAX_POOL_LIST];
+    POOL_SLAB_CACHE  SlabCache[MAX_POOL_SLAB_LIST];
     LIST_ENTRY       Link;
 } POOL;
 
@@ -87,6 +156,14 @@ POOL            mPoolHead[EfiMaxMemoryType];
 //
 LIST_ENTRY      mPoolHeadList = INITIALIZE_LIST_HEAD_VARIABLE (mPoolHeadList);
 
+//
+// Largest request size, in bytes, served from slabs. Zero disables the slab
+// allocator.
+//
+UINTN                 mPoolSlabMaxSize;
+
+POOL_SLAB_STATISTICS  mPoolSlabStatistics;
+
 /**
   Get pool size table index from the specified size.
 
@@ -111,6 +188,66 @@ GetPoolIndexFromSize (
   return MAX_POOL_LIST;
 }
 
+/**
+  Get slab size table index from the specified size.
+
+  @param  Size          The specified size to get index from slab size table.
+                        It must not be larger than the largest slab size class.
+
+  @return               The index of slab size table.
+
+**/
+STATIC
+UINTN
+GetPoolSlabIndexFromSize (
+  UINTN   Size
+  )
+{
+  UINTN   Bit;
+  UINTN   Index;
+
+  if (Size <= SLAB_LIST_TO_SIZE (0)) {
+    return 0;
+  }
+
+  //
+  // 2^Bit <= Size - 1 < 2^(Bit + 1), so Size fits either the 1.5 * 2^Bit
+  // class or the 2^(Bit + 1) class.
+  //
+  Bit   = (UINTN) HighBitSet64 (Size - 1);
+  Index = ((Bit - POOL_SLAB_MIN_SHIFT) << 1) + 1;
+  if (Size > ((UINTN) 3 << (Bit - 1))) {
+    Index++;
+  }
+
+  ASSERT (Index < MAX_POOL_SLAB_LIST);
+  ASSERT (SLAB_LIST_TO_SIZE (Index) >= Size);
+  return Index;
+}
+
+/**
+  Initialize the free lists and slab caches of a pool head.
+
+  @param  Pool          The pool head to initialize.
+
+**/
+STATIC
+VOID
+CoreInitializePoolLists (
+  IN POOL   *Pool
+  )
+{
+  UINTN  Index;
+
+  for (Index = 0; Index < MAX_POOL_LIST; Index++) {
+    InitializeListHead (&Pool->FreeList[Index]);
+  }
+  for (Index = 0; Index < MAX_POOL_SLAB_LIST; Index++) {
+    InitializeListHead (&Pool->SlabCache[Index].PartialList);
+    Pool->SlabCache[Index].EmptyCount = 0;
+  }
+}
+
 /**
   Called to initialize the pool.
 
@@ -121,18 +258,64 @@ CoreInitializePool (
   )
 {
   UINTN  Type;
-  UINTN  Index;
 
   for (Type=0; Type < EfiMaxMemoryType; Type++) {
     mPoolHead[Type].Signature  = 0;
     mPoolHead[Type].Used       = 0;
     mPoolHead[Type].MemoryType = (EFI_MEMORY_TYPE) Type;
-    for (Index=0; Index < MAX_POOL_LIST; Index++) {
-      InitializeListHead (&mPoolHead[Type].FreeList[Index]);
-    }
+    CoreInitializePoolLists (&mPoolHead[Type]);
+  }
+
+  //
+  // The slab size classes include the pool head and tail
+  //
+  mPoolSlabMaxSize = PcdGet32 (PcdDxeCorePoolSlabMaxSize);
+  if (mPoolSlabMaxSize > SLAB_LIST_TO_SIZE (MAX_POOL_SLAB_LIST - 1) - POOL_OVERHEAD) {
+    mPoolSlabMaxSize = SLAB_LIST_TO_SIZE (MAX_POOL_SLAB_LIST - 1) - POOL_OVERHEAD;
   }
 }
 
+/**
+  Dump the slab allocator counters.
+
+**/
+VOID
+CoreDumpPoolSlabStatistics (
+  VOID
+  )
+{
+  POOL_SLAB_STATISTICS  *Stats;
+
+  if (mPoolSlabMaxSize == 0) {
+    return;
+  }
+
+  Stats = &mPoolSlabStatistics;
+  DEBUG ((
+    DEBUG_INFO,
+    "PoolSlab: %ld allocations (%ld reused, %ld%%), %ld frees\n",
+    Stats->AllocationCount,
+    Stats->ReuseCount,
+    (Stats->AllocationCount == 0) ? 0 :
+      DivU64x64Remainder (MultU64x32 (Stats->ReuseCount, 100), Stats->AllocationCount, NULL),
+    Stats->FreeCount
+    ));
+  DEBUG ((
+    DEBUG_INFO,
+    "PoolSlab: %ld slabs created, %ld released, %ld pages in use\n",
+    Stats->SlabCreateCount,
+    Stats->SlabReleaseCount,
+    Stats->PagesInUse
+    ));
+  DEBUG ((
+    DEBUG_INFO,
+    "PoolSlab: %ld bytes requested, %ld bytes in objects, %ld bytes in slab pages\n",
+    Stats->RequestBytesInUse,
+    Stats->ObjectBytesInUse,
+    LShiftU64 (Stats->PagesInUse, EFI_PAGE_SHIFT)
+    ));
+}
+
 
 /**
   Look up pool head for specified memory type.
@@ -149,7 +332,6 @@ LookupPoolHead (
 {
   LIST_ENTRY      *Link;
   POOL            *Pool;
-  UINTN           Index;
 
   if ((UINT32)MemoryType < EfiMaxMemoryType) {
     return &mPoolHead[MemoryType];
@@ -177,9 +359,7 @@ LookupPoolHead (
     Pool->Signature = POOL_SIGNATURE;
     Pool->Used      = 0;
     Pool->MemoryType = MemoryType;
-    for (Index=0; Index < MAX_POOL_LIST; Index++) {
-      InitializeListHead (&Pool->FreeList[Index]);
-    }
+    CoreInitializePoolLists (Pool);
 
     InsertHeadList (&mPoolHeadList, &Pool->Link);
 
@@ -328,6 +508,97 @@ CoreAllocatePoolPagesI (
   return Buffer;
 }
 
+/**
+  Internal function.  Allocates an object from the slab cache of the given
+  size class, creating a new slab if no slab of the class has a free object.
+
+  @param  Pool                   The pool head of the memory type to allocate
+  @param  Index                  The slab size class
+  @param  Granularity            Bits to align.
+
+  @return The allocated object, or NULL
+
+**/
+STATIC
+POOL_HEAD *
+CoreAllocatePoolSlabObject (
+  IN POOL     *Pool,
+  IN UINTN    Index,
+  IN UINTN    Granularity
+  )
+{
+  POOL_SLAB_CACHE   *Cache;
+  POOL_SLAB         *Slab;
+  POOL_FREE         *Free;
+  POOL_HEAD         *Head;
+  UINTN             ObjectSize;
+  UINTN             NoPages;
+
+  Cache      = &Pool->SlabCache[Index];
+  ObjectSize = SLAB_LIST_TO_SIZE (Index);
+
+  if (IsListEmpty (&Cache->PartialList)) {
+    //
+    // Size the new slab for a few objects, rounded up to the allocation
+    // granularity so the tail of the run is not wasted
+    //
+    NoPages = EFI_SIZE_TO_PAGES (SIZE_OF_POOL_SLAB + ObjectSize * POOL_SLAB_MIN_OBJECTS);
+    NoPages = ALIGN_VALUE (NoPages, EFI_SIZE_TO_PAGES (Granularity));
+
+    Slab = CoreAllocatePoolPagesI (Pool->MemoryType, NoPages, Granularity);
+    if (Slab == NULL) {
+      return NULL;
+    }
+
+    Slab->Signature   = POOL_SLAB_SIGNATURE;
+    Slab->Index       = (UINT32) Index;
+    Slab->NoPages     = NoPages;
+    Slab->ObjectCount = (UINT32) ((EFI_PAGES_TO_SIZE (NoPages) - SIZE_OF_POOL_SLAB) / ObjectSize);
+    Slab->CarvedCount = 0;
+    Slab->InUse       = 0;
+    InitializeListHead (&Slab->FreeList);
+    InsertHeadList (&Cache->PartialList, &Slab->Link);
+    Cache->EmptyCount++;
+
+    mPoolSlabStatistics.SlabCreateCount++;
+    mPoolSlabStatistics.PagesInUse += NoPages;
+  }
+
+  Slab = CR (Cache->PartialList.ForwardLink, POOL_SLAB, Link, POOL_SLAB_SIGNATURE);
+
+  //
+  // Prefer the most recently freed object, it is the most likely to be cached
+  //
+  if (!IsListEmpty (&Slab->FreeList)) {
+    Free = CR (Slab->FreeList.ForwardLink, POOL_FREE, Link, POOL_FREE_SIGNATURE);
+    RemoveEntryList (&Free->Link);
+    Head = (POOL_HEAD *) Free;
+    mPoolSlabStatistics.ReuseCount++;
+  } else {
+    ASSERT (Slab->CarvedCount < Slab->ObjectCount);
+    Head = (POOL_HEAD *) ((CHAR8 *) Slab + SIZE_OF_POOL_SLAB + Slab->CarvedCount * ObjectSize);
+    Slab->CarvedCount++;
+  }
+
+  if (Slab->InUse == 0) {
+    Cache->EmptyCount--;
+  }
+  Slab->InUse++;
+
+  //
+  // Full slabs are unlinked until one of their objects is freed
+  //
+  if (Slab->InUse == Slab->ObjectCount) {
+    RemoveEntryList (&Slab->Link);
+  }
+
+  Head->Reserved = (UINT32) ((UINTN) Head - (UINTN) Slab);
+
+  mPoolSlabStatistics.AllocationCount++;
+  mPoolSlabStatistics.ObjectBytesInUse += ObjectSize;
+  return Head;
+}
+
 /**
   Internal function to allocate pool of a particular type.
   Caller must have the memory lock held
@@ -387,6 +658,17 @@ CoreAllocatePoolI (
   }
   Head = NULL;
 
+  //
+  // Serve small and medium requests from the slab caches if enabled
+  //
+  if ((mPoolSlabMaxSize != 0) && (Size - POOL_OVERHEAD <= mPoolSlabMaxSize)) {
+    Head = CoreAllocatePoolSlabObject (Pool, SIZE_TO_SLAB_LIST (Size), Granularity);
+    if (Head != NULL) {
+      mPoolSlabStatistics.RequestBytesInUse += Size;
+    }
+    goto Done;
+  }
+
   //
   // If allocation is over max size, just allocate pages for the request
   // (slow)
@@ -469,8 +751,12 @@ Done:
   if (Head != NULL) {
 
     //
-    // If we have a pool buffer, fill in the header & tail info
+    // If we have a pool buffer, fill in the header & tail info. Slab objects
+    // have already recorded their slab offset in the reserved field.
     //
+    if ((mPoolSlabMaxSize == 0) || (Size - POOL_OVERHEAD > mPoolSlabMaxSize)) {
+      Head->Reserved = 0;
+    }
     Head->Signature = POOL_HEAD_SIGNATURE;
     Head->Size      = Size;
     Head->Type      = (EFI_MEMORY_TYPE) PoolType;
@@ -588,6 +874,68 @@ CoreFreePoolPagesI (
     (EFI_PHYSICAL_ADDRESS)(UINTN)Memory, EFI_PAGES_TO_SIZE (NoPages));
 }
 
+/**
+  Internal function.  Returns an object to its slab, and gives the slab pages
+  back to the page allocator once all of its objects are free and the cache
+  already holds an empty slab.
+
+  @param  Pool                   The pool head of the memory type of the object
+  @param  Slab                   The slab the object was allocated from
+  @param  Head                   The object to free
+
+**/
+STATIC
+VOID
+CoreFreePoolSlabObject (
+  IN POOL       *Pool,
+  IN POOL_SLAB  *Slab,
+  IN POOL_HEAD  *Head
+  )
+{
+  POOL_SLAB_CACHE   *Cache;
+  POOL_FREE         *Free;
+  UINTN             NoPages;
+
+  Cache = &Pool->SlabCache[Slab->Index];
+
+  if (Slab->InUse == Slab->ObjectCount) {
+    InsertTailList (&Cache->PartialList, &Slab->Link);
+  }
+
+  Free = (POOL_FREE *) Head;
+  Free->Signature = POOL_FREE_SIGNATURE;
+  Free->Index     = Slab->Index;
+  InsertHeadList (&Slab->FreeList, &Free->Link);
+
+  mPoolSlabStatistics.FreeCount++;
+  mPoolSlabStatistics.ObjectBytesInUse -= SLAB_LIST_TO_SIZE (Slab->Index);
+
+  ASSERT (Slab->InUse > 0);
+  Slab->InUse--;
+  if (Slab->InUse != 0) {
+    return;
+  }
+
+  //
+  // Keep one empty slab per cache to avoid page allocator churn, except for
+  // OS/OEM specific memory types whose pool head goes away with the last
+  // allocation
+  //
+  if (Cache->EmptyCount == 0 && (UINT32) Pool->MemoryType < MEMORY_TYPE_OEM_RESERVED_MIN) {
+    Cache->EmptyCount++;
+    return;
+  }
+
+  RemoveEntryList (&Slab->Link);
+  NoPages = Slab->NoPages;
+  Slab->Signature = 0;
+
+  mPoolSlabStatistics.SlabReleaseCount++;
+  mPoolSlabStatistics.PagesInUse -= NoPages;
+
+  CoreFreePoolPagesI (Pool->MemoryType, (EFI_PHYSICAL_ADDRESS) (UINTN) Slab, NoPages);
+}
+
 /**
   Internal function to free a pool entry.
   Caller must have the memory lock held
@@ -609,6 +957,7 @@ CoreFreePoolI (
   POOL_HEAD   *Head;
   POOL_TAIL   *Tail;
   POOL_FREE   *Free;
+  POOL_SLAB   *Slab;
   UINTN       Index;
   UINTN       NoPages;
   UINTN       Size;
@@ -646,6 +995,18 @@ CoreFreePoolI (
     return EFI_INVALID_PARAMETER;
   }
 
+  //
+  // Slab objects record the offset of their slab header
+  //
+  Slab = NULL;
+  if (Head->Reserved != 0) {
+    Slab = (POOL_SLAB *) ((CHAR8 *) Head - Head->Reserved);
+    ASSERT (Slab->Signature == POOL_SLAB_SIGNATURE);
+    if (Slab->Signature != POOL_SLAB_SIGNATURE) {
+      return EFI_INVALID_PARAMETER;
+    }
+  }
+
   //
   // Determine the pool type and account for it
   //
@@ -678,9 +1039,15 @@ CoreFreePoolI (
   DEBUG_CLEAR_MEMORY (Head, Size);
 
   //
-  // If it's not on the list, it must be pool pages
+  // Slab objects go back to their slab, anything else that is not on the
+  // list must be pool pages
   //
-  if (Index >= SIZE_TO_LIST (Granularity)) {
+  if (Slab != NULL) {
+
+    mPoolSlabStatistics.RequestBytesInUse -= Size;
+    CoreFreePoolSlabObject (Pool, Slab, Head);
+
+  } else if (Index >= SIZE_TO_LIST (Granularity)) {
 
     //
     // Return the memory pages back to free memory
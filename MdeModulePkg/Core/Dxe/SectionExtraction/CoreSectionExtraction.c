@@ -749,7 +749,13 @@ CreateChildNode (
       //
       // Allocate space for the new stream
       //
-      if (UncompressedLength > 0) {
+      if ((UncompressedLength > 0) && (CompressionType == EFI_STANDARD_COMPRESSION) &&
+          CoreGetPrefetchedSection (SectionHeader, Node->Size, &NewStreamBuffer, &NewStreamBufferSize, &AuthenticationStatus)) {
+        //
+        // The dispatcher already decompressed this section on an AP.
+        //
+        ASSERT (NewStreamBufferSize == UncompressedLength);
+      } else if (UncompressedLength > 0) {
         NewStreamBufferSize = UncompressedLength;
         NewStreamBuffer = AllocatePool (NewStreamBufferSize);
         if (NewStreamBuffer == NULL) {
@@ -1513,6 +1519,7 @@ CustomGuidedSectionExtract (
   UINT32          OutputBufferSize;
   UINT32          ScratchBufferSize;
   UINT16          SectionAttribute;
+  UINTN           InputSectionSize;
 
   //
   // Init local variable
@@ -1520,6 +1527,18 @@ CustomGuidedSectionExtract (
   ScratchBuffer         = NULL;
   AllocatedOutputBuffer = NULL;
 
+  //
+  // The dispatcher may already have decoded this section on an AP.
+  //
+  if (IS_SECTION2 (InputSection)) {
+    InputSectionSize = SECTION2_SIZE (InputSection);
+  } else {
+    InputSectionSize = SECTION_SIZE (InputSection);
+  }
+  if (CoreGetPrefetchedSection (InputSection, InputSectionSize, OutputBuffer, OutputSize, AuthenticationStatus)) {
+    return EFI_SUCCESS;
+  }
+
   //
   // Call GetInfo to get the size and attribute of input guided section data.
   //
@@ -0,0 +1,79 @@
+/** @file
+  The DXE dispatch plan records the order in which the DXE Dispatcher scheduled
+  the drivers of the firmware volumes it processed, so that the next boot can
+  replay that order instead of evaluating every dependency expression again.
+
+  The plan is saved by the DXE Core under gEdkiiDxeDispatchPlanGuid, split
+  across the variables L"DxeDispatchPlan0000", L"DxeDispatchPlan0001" and so on
+  so that each fits in PcdMaxVariableSize. Every variable starts with an
+  EDKII_DXE_DISPATCH_PLAN_PART header followed by the next bytes of the plan.
+  A platform may hand the whole plan to the DXE Core in a GUIDed HOB with the
+  same GUID, so the plan is available before the variable services are.
+
+  Copyright (c) 2017, Intel Corporation. All rights reserved.<BR>
+  This program and the accompanying materials
+  are licensed and made available under the terms and conditions of the BSD License
+  which accompanies this distribution.  The full text of the license may be found at
+  http://opensource.org/licenses/bsd-license.php
+
+  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+**/
+
+#ifndef __DXE_DISPATCH_PLAN_GUID_H__
+#define __DXE_DISPATCH_PLAN_GUID_H__
+
+#define EDKII_DXE_DISPATCH_PLAN_GUID \
+  { 0x0e6f092c, 0xffce, 0x4804, { 0xb7, 0xb8, 0xaa, 0xab, 0x06, 0x5f, 0xac, 0x1e } }
+
+#define EDKII_DXE_DISPATCH_PLAN_VARIABLE_NAME  L"DxeDispatchPlan"
+
+#define EDKII_DXE_DISPATCH_PLAN_SIGNATURE      SIGNATURE_32 ('D', 'X', 'D', 'P')
+
+#define EDKII_DXE_DISPATCH_PLAN_PART_SIGNATURE SIGNATURE_32 ('D', 'X', 'D', 'p')
+
+typedef struct {
+  ///
+  /// The name of the driver file.
+  ///
+  EFI_GUID  FileName;
+  ///
+  /// The index in FvHash[] of the firmware volume the driver was found in.
+  ///
+  UINT32    FvIndex;
+} EDKII_DXE_DISPATCH_PLAN_DRIVER;
+
+typedef struct {
+  UINT32    Signature;
+  ///
+  /// The size of the plan in bytes, including FvHash[] and Driver[].
+  ///
+  UINT32    Length;
+  UINT32    FvCount;
+  UINT32    DriverCount;
+  //
+  // UINT64                          FvHash[FvCount];
+  // EDKII_DXE_DISPATCH_PLAN_DRIVER  Driver[DriverCount];
+  //
+} EDKII_DXE_DISPATCH_PLAN;
+
+typedef struct {
+  UINT32    Signature;
+  ///
+  /// The index of this part, and the number of parts of the plan.
+  ///
+  UINT16    PartIndex;
+  UINT16    PartCount;
+  ///
+  /// The hash of the whole plan, the same in all its parts.
+  ///
+  UINT64    PlanHash;
+  //
+  // UINT8                           Data[];
+  //
+} EDKII_DXE_DISPATCH_PLAN_PART;
+
+extern EFI_GUID gEdkiiDxeDispatchPlanGuid;
+
+#endif
@@ -0,0 +1,70 @@
+/** @file
+  The PCI enumeration snapshot records what the PCI bus driver learned by
+  probing the BARs and bridge windows of every function during a full
+  enumeration, so that a boot which assumes no configuration changes can
+  skip writing all-ones to those registers again.
+
+  The PCI bus driver saves the snapshot in variables under
+  gEdkiiPciEnumerationSnapshotGuid. So that no variable exceeds the maximum
+  variable size, the probes are split into parts, saved in the variables
+  "PciEnumerationSnapshot0000", "PciEnumerationSnapshot0001" and so on. Each
+  probe is keyed by the location of the function and its identity, so a probe
+  is only reused for the same device in the same place. The fingerprint of a
+  part covers the probes it holds.
+
+  Copyright (c) 2017, Intel Corporation. All rights reserved.<BR>
+  This program and the accompanying materials
+  are licensed and made available under the terms and conditions of the BSD License
+  which accompanies this distribution.  The full text of the license may be found at
+  http://opensource.org/licenses/bsd-license.php
+
+  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+**/
+
+#ifndef __PCI_ENUMERATION_SNAPSHOT_GUID_H__
+#define __PCI_ENUMERATION_SNAPSHOT_GUID_H__
+
+#define EDKII_PCI_ENUMERATION_SNAPSHOT_GUID \
+  { 0xab6acff0, 0x0b66, 0x4086, { 0xbd, 0x2c, 0xc0, 0xa0, 0x36, 0x85, 0xa1, 0xbc } }
+
+#define EDKII_PCI_ENUMERATION_SNAPSHOT_VARIABLE_NAME  L"PciEnumerationSnapshot"
+
+#define EDKII_PCI_ENUMERATION_SNAPSHOT_SIGNATURE  SIGNATURE_32 ('P', 'E', 'S', 'S')
+
+///
+/// One probe of a BAR or bridge window register.
+///
+typedef struct {
+  UINT16    Segment;
+  UINT8     Bus;
+  UINT8     DevFunc;          ///< Device number << 3 | function number
+  UINT16    Offset;           ///< Configuration space offset of the register
+  UINT16    Reserved;
+  UINT32    VendorDeviceId;   ///< Configuration space dword at offset 0x00
+  UINT32    RevisionClass;    ///< Configuration space dword at offset 0x08
+  UINT32    SubsystemId;      ///< Configuration space dword at offset 0x2C, 0 for bridges
+  UINT32    Value;            ///< The value read back after writing all ones
+} EDKII_PCI_ENUMERATION_SNAPSHOT_PROBE;
+
+///
+/// The header of one part of the snapshot.
+///
+typedef struct {
+  UINT32    Signature;
+  ///
+  /// The CRC32 of the probes of this part.
+  ///
+  UINT32    Fingerprint;
+  UINT16    PartIndex;
+  UINT16    PartCount;
+  UINT32    ProbeCount;       ///< The number of probes in this part
+  //
+  // EDKII_PCI_ENUMERATION_SNAPSHOT_PROBE  Probe[ProbeCount];
+  //
+} EDKII_PCI_ENUMERATION_SNAPSHOT;
+
+extern EFI_GUID gEdkiiPciEnumerationSnapshotGuid;
+
+#endif
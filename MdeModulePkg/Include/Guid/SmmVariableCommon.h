@@ -72,6 +72,10 @@ typedef struct {
 #define SMM_VARIABLE_FUNCTION_VAR_CHECK_VARIABLE_PROPERTY_GET  10
 
 #define SMM_VARIABLE_FUNCTION_GET_PAYLOAD_SIZE        11
+//
+// The payload for this function is SMM_VARIABLE_COMMUNICATE_RUNTIME_VARIABLE_CACHE.
+//
+#define SMM_VARIABLE_FUNCTION_INIT_RUNTIME_VARIABLE_CACHE  12
 
 ///
 /// Size of SMM communicate header, without including the payload.
@@ -126,4 +130,46 @@ typedef struct {
   UINTN                         VariablePayloadSize;
 } SMM_VARIABLE_COMMUNICATE_GET_PAYLOAD_SIZE;
 
+///
+/// This structure is used to communicate with SMI handler by InitRuntimeVariableCache.
+/// If CacheSize is too small, the handler returns EFI_BUFFER_TOO_SMALL and the size
+/// the cache needs in CacheSize.
+///
+typedef struct {
+  EFI_PHYSICAL_ADDRESS          CacheBuffer;
+  UINT64                        CacheSize;
+} SMM_VARIABLE_COMMUNICATE_RUNTIME_VARIABLE_CACHE;
+
+///
+/// Header of the runtime variable cache.
+///
+/// The SMM variable driver fills the cache with the runtime accessible variables
+/// at ExitBootServices and refreshes it after each SetVariable(), so the OS can
+/// read them without an SMI. Sequence is odd while the cache is refreshed; a
+/// reader that sees it odd or changed must get the variable through SMM instead.
+///
+typedef struct {
+  UINT32                        Sequence;
+  UINT32                        Ready;
+  UINT64                        EntriesSize;
+  //
+  // SMM_VARIABLE_RUNTIME_CACHE_ENTRY Entries[];
+  //
+} SMM_VARIABLE_RUNTIME_CACHE_HEADER;
+
+///
+/// A variable in the runtime variable cache, followed by its name and data.
+/// Entries are in GetNextVariableName() order and aligned on 4 bytes.
+///
+typedef struct {
+  EFI_GUID                      VendorGuid;
+  UINT32                        Attributes;
+  UINT32                        NameSize;
+  UINT32                        DataSize;
+  //
+  // CHAR16                     Name[NameSize / sizeof (CHAR16)];
+  // UINT8                      Data[DataSize];
+  //
+} SMM_VARIABLE_RUNTIME_CACHE_ENTRY;
+
 #endif // _SMM_VARIABLE_COMMON_H_
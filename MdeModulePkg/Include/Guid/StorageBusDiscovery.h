@@ -0,0 +1,67 @@
+/** @file
+  The storage bus discovery cache records which devices answered the last full
+  scan of a SCSI or ATA controller, so that a boot which assumes no
+  configuration changes can probe only those devices.
+
+  The SCSI and ATA bus drivers save one variable per controller under
+  gEdkiiStorageBusDiscoveryGuid. The variable name is the bus prefix followed
+  by the CRC32 of the controller device path, in hexadecimal; the device path
+  itself is stored in the variable as well, to rule out collisions.
+
+  Copyright (c) 2017, Intel Corporation. All rights reserved.<BR>
+  This program and the accompanying materials
+  are licensed and made available under the terms and conditions of the BSD License
+  which accompanies this distribution.  The full text of the license may be found at
+  http://opensource.org/licenses/bsd-license.php
+
+  THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+  WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+**/
+
+#ifndef __STORAGE_BUS_DISCOVERY_GUID_H__
+#define __STORAGE_BUS_DISCOVERY_GUID_H__
+
+#define EDKII_STORAGE_BUS_DISCOVERY_GUID \
+  { 0x82d1b7d3, 0x1146, 0x42c0, { 0x92, 0x18, 0x5d, 0x03, 0xf0, 0x89, 0x1b, 0xa1 } }
+
+#define EDKII_STORAGE_BUS_DISCOVERY_SIGNATURE  SIGNATURE_32 ('S', 'B', 'D', 'C')
+
+///
+/// The address of a device on a SCSI bus. Target holds TARGET_MAX_BYTES bytes,
+/// as in EFI_EXT_SCSI_PASS_THRU_PROTOCOL.
+///
+typedef struct {
+  UINT8     Target[16];
+  UINT64    Lun;
+} EDKII_STORAGE_BUS_DISCOVERY_SCSI_DEVICE;
+
+///
+/// The address of a device on an ATA bus.
+///
+typedef struct {
+  UINT16    Port;
+  UINT16    PortMultiplierPort;
+} EDKII_STORAGE_BUS_DISCOVERY_ATA_DEVICE;
+
+typedef struct {
+  UINT32    Signature;
+  ///
+  /// The size of the controller device path in bytes, including the end node.
+  ///
+  UINT32    DevicePathSize;
+  ///
+  /// The size of one device address, EDKII_STORAGE_BUS_DISCOVERY_SCSI_DEVICE
+  /// or EDKII_STORAGE_BUS_DISCOVERY_ATA_DEVICE.
+  ///
+  UINT32    DeviceSize;
+  UINT32    DeviceCount;
+  //
+  // EFI_DEVICE_PATH_PROTOCOL  ControllerPath;   // DevicePathSize bytes
+  // UINT8                     Device[DeviceCount][DeviceSize];
+  //
+} EDKII_STORAGE_BUS_DISCOVERY;
+
+extern EFI_GUID gEdkiiStorageBusDiscoveryGuid;
+
+#endif
@@ -0,0 +1,90 @@
+/** @file
+  EDKII Memory Space Attributes Protocol.
+
+  This protocol is produced by the DXE Core. It sets the attributes of several
+  memory regions of the GCD memory space map in one call, so the CPU
+  Architectural Protocol is invoked once per run of adjacent regions that
+  share a cache attribute instead of once per region.
+
+Copyright (c) 2017, Intel Corporation. All rights reserved.<BR>
+This program and the accompanying materials are licensed and made available under
+the terms and conditions of the BSD License that accompanies this distribution.
+The full text of the license may be found at
+http://opensource.org/licenses/bsd-license.php.
+
+THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+**/
+
+#ifndef __MEMORY_SPACE_ATTRIBUTES_H__
+#define __MEMORY_SPACE_ATTRIBUTES_H__
+
+#define EDKII_MEMORY_SPACE_ATTRIBUTES_PROTOCOL_GUID \
+    { \
+      0x5b5e2cf8, 0x8e7c, 0x4b19, { 0x9f, 0x3d, 0x61, 0xa4, 0x0c, 0x2e, 0xd7, 0x93 } \
+    }
+
+typedef struct _EDKII_MEMORY_SPACE_ATTRIBUTES_PROTOCOL  EDKII_MEMORY_SPACE_ATTRIBUTES_PROTOCOL;
+
+#define EDKII_MEMORY_SPACE_ATTRIBUTES_PROTOCOL_REVISION 0x00010000
+
+///
+/// One memory region of a batch.
+///
+typedef struct {
+  EFI_PHYSICAL_ADDRESS  BaseAddress;
+  UINT64                Length;
+  UINT64                Attributes;
+} EDKII_MEMORY_SPACE_ATTRIBUTES_RANGE;
+
+/**
+  Modify the attributes of several memory regions in the global coherency
+  domain of the processor.
+
+  Every region is checked against the GCD memory space map before any of them
+  is changed. Regions that are adjacent in the array and in memory, and that
+  request the same cache attribute, are passed to the CPU Architectural
+  Protocol as a single region, so callers should list the regions in
+  ascending address order.
+
+  @param[in]  This              The protocol instance pointer.
+  @param[in]  RangeCount        The number of entries in Ranges.
+  @param[in]  Ranges            The regions and the attributes to set on them.
+  @param[out] FailedIndex       Returns the index of the region that caused the
+                                error. Unless the error was found while the
+                                regions were checked, the regions before it
+                                may already have been updated. Optional.
+
+  @retval EFI_SUCCESS           The attributes were set for all the regions.
+  @retval EFI_INVALID_PARAMETER RangeCount is zero, Ranges is NULL or the
+                                length of a region is zero.
+  @retval EFI_UNSUPPORTED       The processor does not support one or more bytes
+                                of a region, or the attributes of a region are
+                                not supported by its capabilities.
+  @retval EFI_OUT_OF_RESOURCES  There are not enough system resources to modify
+                                the attributes.
+  @retval EFI_NOT_AVAILABLE_YET The attributes cannot be set because the CPU
+                                Architectural Protocol is not available yet.
+
+**/
+typedef
+EFI_STATUS
+(EFIAPI *EDKII_SET_MEMORY_SPACE_ATTRIBUTES_BATCH)(
+  IN  EDKII_MEMORY_SPACE_ATTRIBUTES_PROTOCOL  *This,
+  IN  UINTN                                   RangeCount,
+  IN  EDKII_MEMORY_SPACE_ATTRIBUTES_RANGE     *Ranges,
+  OUT UINTN                                   *FailedIndex OPTIONAL
+  );
+
+///
+/// Memory Space Attributes Protocol structure.
+///
+struct _EDKII_MEMORY_SPACE_ATTRIBUTES_PROTOCOL {
+  UINT64                                    Revision;
+  EDKII_SET_MEMORY_SPACE_ATTRIBUTES_BATCH   SetMemorySpaceAttributesBatch;
+};
+
+extern EFI_GUID gEdkiiMemorySpaceAttributesProtocolGuid;
+
+#endif
@@ -191,6 +191,8 @@ DiskIoDriverBindingStart (
     goto ErrorExit;
   }
 
+  DiskIoCacheInit (Instance);
+
   //
   // Install protocol interfaces for the Disk IO device.
   //
@@ -219,6 +221,7 @@ ErrorExit:
     }
 
     if (Instance != NULL) {
+      DiskIoCacheFree (Instance);
       FreePool (Instance);
     }
 
@@ -292,6 +295,12 @@ DiskIoDriverBindingStop (
   
   Instance = DISK_IO_PRIVATE_DATA_FROM_DISK_IO (DiskIo);
 
+  //
+  // The Block I/O protocol may be going to be reinstalled for a different
+  // media. Drop the cache in case the driver stays on the controller.
+  //
+  DiskIoCacheInvalidate (Instance, 0, MAX_UINTN);
+
   if (DiskIo2 != NULL) {
     //
     // Call BlockIo2::Reset() to terminate any in-flight non-blocking I/O requests
@@ -343,7 +352,8 @@ DiskIoDriverBindingStop (
                       );
       ASSERT_EFI_ERROR (Status);
     }
-    
+
+    DiskIoCacheFree (Instance);
     FreePool (Instance);
   }
 
@@ -351,6 +361,29 @@ DiskIoDriverBindingStop (
 }
 
 
+/**
+  Return the number of bytes that the subtask transfers from or to the device.
+
+  A subtask with a working buffer transfers the whole blocks that hold the
+  bytes from Offset to Offset + Length of the working buffer.
+
+  @param Subtask      Subtask.
+  @param BlockSize    The block size of the device.
+
+  @return The number of bytes to transfer.
+**/
+UINTN
+DiskIoSubtaskTransferSize (
+  IN DISK_IO_SUBTASK          *Subtask,
+  IN UINT32                   BlockSize
+  )
+{
+  if (Subtask->WorkingBuffer == NULL) {
+    return Subtask->Length;
+  }
+  return (Subtask->Offset + Subtask->Length + BlockSize - 1) / BlockSize * BlockSize;
+}
+
 /**
   Destroy the sub task.
 
@@ -378,10 +411,8 @@ DiskIoDestroySubtask (
   if (!Subtask->Blocking) {
     if (Subtask->WorkingBuffer != NULL) {
       FreeAlignedPages (
-        Subtask->WorkingBuffer, 
-        Subtask->Length < Instance->BlockIo->Media->BlockSize
-        ? EFI_SIZE_TO_PAGES (Instance->BlockIo->Media->BlockSize)
-        : EFI_SIZE_TO_PAGES (Subtask->Length)
+        Subtask->WorkingBuffer,
+        EFI_SIZE_TO_PAGES (DiskIoSubtaskTransferSize (Subtask, Instance->BlockIo->Media->BlockSize))
         );
     }
     if (Subtask->BlockIo2Token.Event != NULL) {
@@ -542,6 +573,7 @@ DiskIoCreateSubtaskList (
   UINT8                 *BufferPtr;
   UINTN                 Length;
   UINTN                 DataBufferSize;
+  UINTN                 SpanBlocks;
   DISK_IO_SUBTASK       *Subtask;
   VOID                  *WorkingBuffer;
   LIST_ENTRY            *Link;
@@ -569,6 +601,54 @@ DiskIoCreateSubtaskList (
     return TRUE;
   }
 
+  //
+  // An unaligned write spanning a few blocks is coalesced into a single write
+  // of all of them: the partial blocks at either end are read into a working
+  // buffer, the data is copied over them, and the buffer is written at once,
+  // instead of writing the ends and the middle separately.
+  //
+  SpanBlocks = (UnderRun + BufferSize + BlockSize - 1) / BlockSize;
+  if (Write && (SpanBlocks > 1) && (SpanBlocks <= PcdGet32 (PcdDiskIoDataBufferBlockNum)) &&
+      ((UnderRun != 0) || ((BufferSize % BlockSize) != 0))) {
+    if (Blocking) {
+      WorkingBuffer = SharedWorkingBuffer;
+    } else {
+      WorkingBuffer = AllocateAlignedPages (EFI_SIZE_TO_PAGES (SpanBlocks * BlockSize), IoAlign);
+    }
+    if (WorkingBuffer != NULL) {
+      if (UnderRun != 0) {
+        Subtask = DiskIoCreateSubtask (FALSE, Lba, 0, BlockSize, NULL, WorkingBuffer, TRUE);
+        if (Subtask == NULL) {
+          goto FreeCoalescingBuffer;
+        }
+        InsertTailList (Subtasks, &Subtask->Link);
+      }
+      if (((UnderRun + BufferSize) % BlockSize) != 0) {
+        Subtask = DiskIoCreateSubtask (
+                    FALSE, Lba + SpanBlocks - 1, 0, BlockSize, NULL,
+                    (UINT8 *) WorkingBuffer + (SpanBlocks - 1) * BlockSize, TRUE
+                    );
+        if (Subtask == NULL) {
+          goto FreeCoalescingBuffer;
+        }
+        InsertTailList (Subtasks, &Subtask->Link);
+      }
+
+      Subtask = DiskIoCreateSubtask (TRUE, Lba, UnderRun, BufferSize, WorkingBuffer, BufferPtr, Blocking);
+      if (Subtask == NULL) {
+        goto FreeCoalescingBuffer;
+      }
+      InsertTailList (Subtasks, &Subtask->Link);
+      return TRUE;
+
+FreeCoalescingBuffer:
+      if (!Blocking) {
+        FreeAlignedPages (WorkingBuffer, EFI_SIZE_TO_PAGES (SpanBlocks * BlockSize));
+      }
+      goto Done;
+    }
+  }
+
   if (UnderRun != 0) {
     Length = MIN (BlockSize - UnderRun, BufferSize);
     if (Blocking) {
@@ -825,6 +905,7 @@ DiskIo2ReadWriteDisk (
   BOOLEAN                Blocking;
   BOOLEAN                SubtaskBlocking;
   LIST_ENTRY             *SubtasksPtr;
+  UINTN                  TransferSize;
 
   Task      = NULL;
   BlockIo   = Instance->BlockIo;
@@ -833,6 +914,19 @@ DiskIo2ReadWriteDisk (
   Status    = EFI_SUCCESS;
   Blocking  = (BOOLEAN) ((Token == NULL) || (Token->Event == NULL));
 
+  //
+  // Serve small reads from the block cache when it holds all the data.
+  // Pending non-blocking writes have dropped the blocks they cover from the
+  // cache, so the data cannot be older than theirs.
+  //
+  if (!Write && DiskIoCacheRead (Instance, MediaId, Offset, BufferSize, Buffer)) {
+    if (!Blocking) {
+      Token->TransactionStatus = EFI_SUCCESS;
+      gBS->SignalEvent (Token->Event);
+    }
+    return EFI_SUCCESS;
+  }
+
   if (Blocking) {
     //
     // Wait till pending async task is completed.
@@ -877,7 +971,9 @@ DiskIo2ReadWriteDisk (
     Subtask->Task   = Task;
     SubtaskBlocking = Subtask->Blocking;
 
-    ASSERT ((Subtask->Length % Media->BlockSize == 0) || (Subtask->Length < Media->BlockSize));
+    TransferSize    = DiskIoSubtaskTransferSize (Subtask, Media->BlockSize);
+
+    ASSERT (TransferSize % Media->BlockSize == 0);
 
     if (Subtask->Write) {
       //
@@ -891,20 +987,24 @@ DiskIo2ReadWriteDisk (
       }
 
       if (SubtaskBlocking) {
-        Status = BlockIo->WriteBlocks (
-                            BlockIo,
-                            MediaId,
-                            Subtask->Lba,
-                            (Subtask->Length % Media->BlockSize == 0) ? Subtask->Length : Media->BlockSize,
-                            (Subtask->WorkingBuffer != NULL) ? Subtask->WorkingBuffer : Subtask->Buffer
-                            );
+        Status = DiskIoCacheWriteBlocks (
+                   Instance,
+                   MediaId,
+                   Subtask->Lba,
+                   TransferSize,
+                   (Subtask->WorkingBuffer != NULL) ? Subtask->WorkingBuffer : Subtask->Buffer
+                   );
       } else {
+        //
+        // The cached copy would be wrong if the write failed.
+        //
+        DiskIoCacheInvalidate (Instance, Subtask->Lba, TransferSize);
         Status = BlockIo2->WriteBlocksEx (
                              BlockIo2,
                              MediaId,
                              Subtask->Lba,
                              &Subtask->BlockIo2Token,
-                             (Subtask->Length % Media->BlockSize == 0) ? Subtask->Length : Media->BlockSize,
+                             TransferSize,
                              (Subtask->WorkingBuffer != NULL) ? Subtask->WorkingBuffer : Subtask->Buffer
                              );
       }
@@ -914,13 +1014,13 @@ DiskIo2ReadWriteDisk (
       // Read
       //
       if (SubtaskBlocking) {
-        Status = BlockIo->ReadBlocks (
-                            BlockIo,
-                            MediaId,
-                            Subtask->Lba,
-                            (Subtask->Length % Media->BlockSize == 0) ? Subtask->Length : Media->BlockSize,
-                            (Subtask->WorkingBuffer != NULL) ? Subtask->WorkingBuffer : Subtask->Buffer
-                            );
+        Status = DiskIoCacheReadBlocks (
+                   Instance,
+                   MediaId,
+                   Subtask->Lba,
+                   TransferSize,
+                   (Subtask->WorkingBuffer != NULL) ? Subtask->WorkingBuffer : Subtask->Buffer
+                   );
         if (!EFI_ERROR (Status) && (Subtask->WorkingBuffer != NULL)) {
           CopyMem (Subtask->Buffer, Subtask->WorkingBuffer + Subtask->Offset, Subtask->Length);
         }
@@ -930,7 +1030,7 @@ DiskIo2ReadWriteDisk (
                              MediaId,
                              Subtask->Lba,
                              &Subtask->BlockIo2Token,
-                             (Subtask->Length % Media->BlockSize == 0) ? Subtask->Length : Media->BlockSize,
+                             TransferSize,
                              (Subtask->WorkingBuffer != NULL) ? Subtask->WorkingBuffer : Subtask->Buffer
                              );
       }
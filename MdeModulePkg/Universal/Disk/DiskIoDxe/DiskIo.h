@@ -30,6 +30,24 @@ WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
 #include <Library/MemoryAllocationLib.h>
 #include <Library/UefiBootServicesTableLib.h>
 
+//
+// The block cache is organized in lines of DISK_IO_CACHE_LINE_SIZE bytes, or
+// one block if blocks are larger. Blocking reads of up to
+// DISK_IO_CACHE_MAX_READ_LINES lines go through the cache, and up to
+// DISK_IO_CACHE_MAX_READ_AHEAD_LINES lines are read ahead of sequential ones.
+//
+#define DISK_IO_CACHE_LINE_SIZE             SIZE_4KB
+#define DISK_IO_CACHE_MAX_READ_LINES        16
+#define DISK_IO_CACHE_MAX_READ_AHEAD_LINES  16
+
+typedef struct {
+  LIST_ENTRY                      LruLink;  /// < link in the LRU list, most recently used first
+  LIST_ENTRY                      HashLink; /// < link in the hash bucket, valid lines only
+  BOOLEAN                         Valid;
+  UINT64                          Line;     /// < index of the line on the device
+  UINT8                           *Data;
+} DISK_IO_CACHE_LINE;
+
 #define DISK_IO_PRIVATE_DATA_SIGNATURE  SIGNATURE_32 ('d', 's', 'k', 'I')
 typedef struct {
   UINT32                          Signature;
@@ -43,6 +61,29 @@ typedef struct {
 
   EFI_LOCK                        TaskQueueLock;
   LIST_ENTRY                      TaskQueue;
+
+  //
+  // Block cache. CacheLineCount is zero when the cache is disabled.
+  //
+  EFI_LOCK                        CacheLock;
+  UINTN                           CacheLineCount;
+  UINT32                          CacheLineBlocks;
+  UINT32                          CacheLineSize;
+  DISK_IO_CACHE_LINE              *CacheLines;
+  UINT8                           *CacheData;
+  UINTN                           CacheBucketCount;
+  LIST_ENTRY                      *CacheBuckets;
+  LIST_ENTRY                      CacheLru;
+  UINT8                           *CacheStaging;      /// < buffer for filling lines
+  BOOLEAN                         CacheStagingBusy;  /// < a fill is using CacheStaging
+  UINTN                           CacheMaxReadAhead;
+  UINT32                          CacheMediaId;
+  UINT64                          CacheGeneration;    /// < incremented whenever lines are changed
+  UINT64                          CacheNextLine;      /// < the line after the last fill
+  UINTN                           CacheReadAhead;     /// < current read-ahead window in lines
+  UINT64                          CacheHits;
+  UINT64                          CacheMisses;
+  UINT64                          CacheReadAheadLines;
 } DISK_IO_PRIVATE_DATA;
 #define DISK_IO_PRIVATE_DATA_FROM_DISK_IO(a)  CR (a, DISK_IO_PRIVATE_DATA, DiskIo,  DISK_IO_PRIVATE_DATA_SIGNATURE)
 #define DISK_IO_PRIVATE_DATA_FROM_DISK_IO2(a) CR (a, DISK_IO_PRIVATE_DATA, DiskIo2, DISK_IO_PRIVATE_DATA_SIGNATURE)
@@ -469,5 +510,111 @@ DiskIoComponentNameGetControllerName (
   OUT CHAR16                                          **ControllerName
   );
 
+/**
+  Set up the block cache of a Disk I/O instance, as configured by
+  PcdDiskIoCacheSize. The cache stays disabled if it is not configured, if the
+  Block I/O device is a logical partition (its parent device is cached), or if
+  there is not enough memory.
+
+  @param Instance    Pointer to the DISK_IO_PRIVATE_DATA.
+**/
+VOID
+DiskIoCacheInit (
+  IN DISK_IO_PRIVATE_DATA     *Instance
+  );
+
+/**
+  Report the cache statistics of a Disk I/O instance and release its block
+  cache.
+
+  @param Instance    Pointer to the DISK_IO_PRIVATE_DATA.
+**/
+VOID
+DiskIoCacheFree (
+  IN DISK_IO_PRIVATE_DATA     *Instance
+  );
+
+/**
+  Drop the cached copy of a range of blocks, or of all blocks.
+
+  @param Instance    Pointer to the DISK_IO_PRIVATE_DATA.
+  @param Lba         The first block to drop.
+  @param BufferSize  The number of bytes to drop, or MAX_UINTN for all blocks
+                     from Lba on.
+**/
+VOID
+DiskIoCacheInvalidate (
+  IN DISK_IO_PRIVATE_DATA     *Instance,
+  IN UINT64                   Lba,
+  IN UINTN                    BufferSize
+  );
+
+/**
+  Copy a byte range from the cache if all of it is cached.
+
+  @param Instance    Pointer to the DISK_IO_PRIVATE_DATA.
+  @param MediaId     ID of the medium to be read.
+  @param Offset      The starting byte offset on the device.
+  @param BufferSize  The number of bytes to read.
+  @param Buffer      The buffer to receive the data.
+
+  @retval TRUE       Buffer has been filled from the cache.
+  @retval FALSE      The range is not cached entirely; the content of Buffer
+                     is undefined.
+**/
+BOOLEAN
+DiskIoCacheRead (
+  IN  DISK_IO_PRIVATE_DATA    *Instance,
+  IN  UINT32                  MediaId,
+  IN  UINT64                  Offset,
+  IN  UINTN                   BufferSize,
+  OUT UINT8                   *Buffer
+  );
+
+/**
+  Read blocks through the cache. Missing lines are read from the device, along
+  with the lines that follow them when the reads are sequential, and kept in
+  the cache. Large reads go to the device directly.
+
+  The function uses a buffer shared by the Disk I/O instance, so it must not
+  be re-entered for the same instance, like the blocking subtasks that use
+  SharedWorkingBuffer.
+
+  @param Instance    Pointer to the DISK_IO_PRIVATE_DATA.
+  @param MediaId     ID of the medium to be read.
+  @param Lba         The starting logical block address to read from.
+  @param BufferSize  The number of bytes to read, a multiple of the block size.
+  @param Buffer      The buffer to receive the data.
+
+  @return The status of BlockIo->ReadBlocks().
+**/
+EFI_STATUS
+DiskIoCacheReadBlocks (
+  IN  DISK_IO_PRIVATE_DATA    *Instance,
+  IN  UINT32                  MediaId,
+  IN  UINT64                  Lba,
+  IN  UINTN                   BufferSize,
+  OUT VOID                    *Buffer
+  );
+
+/**
+  Write blocks to the device, and update the cached copy of them.
+
+  @param Instance    Pointer to the DISK_IO_PRIVATE_DATA.
+  @param MediaId     ID of the medium to be written.
+  @param Lba         The starting logical block address to write to.
+  @param BufferSize  The number of bytes to write, a multiple of the block size.
+  @param Buffer      The data to write.
+
+  @return The status of BlockIo->WriteBlocks().
+**/
+EFI_STATUS
+DiskIoCacheWriteBlocks (
+  IN DISK_IO_PRIVATE_DATA     *Instance,
+  IN UINT32                   MediaId,
+  IN UINT64                   Lba,
+  IN UINTN                    BufferSize,
+  IN VOID                     *Buffer
+  );
 
 #endif
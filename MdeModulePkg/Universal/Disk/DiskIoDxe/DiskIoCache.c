@@ -0,0 +1,620 @@
+/** @file
+  Block cache of the DiskIo driver.
+
+  The cache keeps recently read blocks of a Block I/O device in lines of
+  DISK_IO_CACHE_LINE_SIZE bytes, replaced in LRU order. It is write-through:
+  every write goes to the device, and the cached copy of the blocks written is
+  updated (blocking writes) or dropped (non-blocking writes), so the cache
+  never holds data that is not on the device. When small reads are found to be
+  sequential, the lines after them are read with the same Block I/O request.
+
+  The cache is dropped when the media ID of the device changes. When the Block
+  I/O protocol is reinstalled, the driver is stopped and started again, which
+  releases the cache.
+
+Copyright (c) 2017, Intel Corporation. All rights reserved.<BR>
+This program and the accompanying materials
+are licensed and made available under the terms and conditions of the BSD License
+which accompanies this distribution.  The full text of the license may be found at
+http://opensource.org/licenses/bsd-license.php
+
+THE PROGRAM IS DISTRIBUTED UNDER THE BSD LICENSE ON AN "AS IS" BASIS,
+WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
+
+**/
+
+#include "DiskIo.h"
+
+/**
+  Find a valid cache line.
+
+  @param Instance    Pointer to the DISK_IO_PRIVATE_DATA.
+  @param Line        The index of the line on the device.
+
+  @return The cache line holding Line, or NULL if Line is not cached.
+**/
+DISK_IO_CACHE_LINE *
+DiskIoCacheLookup (
+  IN DISK_IO_PRIVATE_DATA     *Instance,
+  IN UINT64                   Line
+  )
+{
+  LIST_ENTRY                  *Bucket;
+  LIST_ENTRY                  *Link;
+  DISK_IO_CACHE_LINE          *CacheLine;
+
+  Bucket = &Instance->CacheBuckets[(UINTN) Line & (Instance->CacheBucketCount - 1)];
+  for (Link = GetFirstNode (Bucket); !IsNull (Bucket, Link); Link = GetNextNode (Bucket, Link)) {
+    CacheLine = BASE_CR (Link, DISK_IO_CACHE_LINE, HashLink);
+    if (CacheLine->Line == Line) {
+      return CacheLine;
+    }
+  }
+  return NULL;
+}
+
+/**
+  Drop a cache line, making it the first candidate for replacement.
+
+  @param Instance    Pointer to the DISK_IO_PRIVATE_DATA.
+  @param CacheLine   The cache line to drop.
+**/
+VOID
+DiskIoCacheDropLine (
+  IN DISK_IO_PRIVATE_DATA     *Instance,
+  IN DISK_IO_CACHE_LINE       *CacheLine
+  )
+{
+  if (CacheLine->Valid) {
+    RemoveEntryList (&CacheLine->HashLink);
+    CacheLine->Valid = FALSE;
+  }
+  RemoveEntryList (&CacheLine->LruLink);
+  InsertTailList (&Instance->CacheLru, &CacheLine->LruLink);
+}
+
+/**
+  Store a line in the cache, replacing the least recently used line if the
+  line is not cached yet.
+
+  @param Instance    Pointer to the DISK_IO_PRIVATE_DATA.
+  @param Line        The index of the line on the device.
+  @param Data        The content of the line.
+**/
+VOID
+DiskIoCacheInsertLine (
+  IN DISK_IO_PRIVATE_DATA     *Instance,
+  IN UINT64                   Line,
+  IN UINT8                    *Data
+  )
+{
+  DISK_IO_CACHE_LINE          *CacheLine;
+
+  CacheLine = DiskIoCacheLookup (Instance, Line);
+  if (CacheLine == NULL) {
+    CacheLine = BASE_CR (GetPreviousNode (&Instance->CacheLru, &Instance->CacheLru), DISK_IO_CACHE_LINE, LruLink);
+    DiskIoCacheDropLine (Instance, CacheLine);
+    CacheLine->Line  = Line;
+    CacheLine->Valid = TRUE;
+    InsertHeadList (
+      &Instance->CacheBuckets[(UINTN) Line & (Instance->CacheBucketCount - 1)],
+      &CacheLine->HashLink
+      );
+  }
+  CopyMem (CacheLine->Data, Data, Instance->CacheLineSize);
+
+  RemoveEntryList (&CacheLine->LruLink);
+  InsertHeadList (&Instance->CacheLru, &CacheLine->LruLink);
+}
+
+/**
+  Check that the cache may be used for a request, and drop all of it if the
+  media has changed since it was filled.
+
+  The caller is responsible for holding the CacheLock.
+
+  @param Instance    Pointer to the DISK_IO_PRIVATE_DATA.
+  @param MediaId     ID of the medium the request is for.
+
+  @retval TRUE       The cache may be used.
+  @retval FALSE      The request must go to the device, which will report the
+                     media condition.
+**/
+BOOLEAN
+DiskIoCacheCheckMedia (
+  IN DISK_IO_PRIVATE_DATA     *Instance,
+  IN UINT32                   MediaId
+  )
+{
+  EFI_BLOCK_IO_MEDIA          *Media;
+  UINTN                       Index;
+
+  Media = Instance->BlockIo->Media;
+  if (Media->MediaId != Instance->CacheMediaId) {
+    for (Index = 0; Index < Instance->CacheLineCount; Index++) {
+      DiskIoCacheDropLine (Instance, &Instance->CacheLines[Index]);
+    }
+    Instance->CacheGeneration++;
+    Instance->CacheMediaId   = Media->MediaId;
+    Instance->CacheNextLine  = 0;
+    Instance->CacheReadAhead = 0;
+  }
+
+  return (BOOLEAN) (Media->MediaPresent && (MediaId == Media->MediaId) &&
+                    (Media->BlockSize * Instance->CacheLineBlocks == Instance->CacheLineSize));
+}
+
+/**
+  Update or drop the cached copy of a range of blocks.
+
+  The caller is responsible for holding the CacheLock.
+
+  @param Instance    Pointer to the DISK_IO_PRIVATE_DATA.
+  @param Lba         The first block of the range.
+  @param BlockCount  The number of blocks in the range.
+  @param Buffer      The new content of the range, or NULL to drop it.
+**/
+VOID
+DiskIoCacheUpdateRange (
+  IN DISK_IO_PRIVATE_DATA     *Instance,
+  IN UINT64                   Lba,
+  IN UINT64                   BlockCount,
+  IN UINT8                    *Buffer     OPTIONAL
+  )
+{
+  DISK_IO_CACHE_LINE          *CacheLine;
+  UINT64                      LastLba;
+  UINT64                      LineLba;
+  UINT64                      Start;
+  UINT64                      End;
+  UINT32                      BlockSize;
+  UINTN                       Index;
+
+  if (BlockCount == 0) {
+    return;
+  }
+  LastLba   = (BlockCount > MAX_UINT64 - Lba) ? MAX_UINT64 : Lba + BlockCount - 1;
+  BlockSize = Instance->CacheLineSize / Instance->CacheLineBlocks;
+
+  for (Index = 0; Index < Instance->CacheLineCount; Index++) {
+    CacheLine = &Instance->CacheLines[Index];
+    if (!CacheLine->Valid) {
+      continue;
+    }
+    LineLba = MultU64x32 (CacheLine->Line, Instance->CacheLineBlocks);
+    if ((LineLba > LastLba) || (LineLba + Instance->CacheLineBlocks - 1 < Lba)) {
+      continue;
+    }
+    if (Buffer == NULL) {
+      DiskIoCacheDropLine (Instance, CacheLine);
+      continue;
+    }
+    Start = MAX (Lba, LineLba);
+    End   = MIN (LastLba, LineLba + Instance->CacheLineBlocks - 1);
+    CopyMem (
+      CacheLine->Data + (UINTN) (Start - LineLba) * BlockSize,
+      Buffer + (UINTN) (Start - Lba) * BlockSize,
+      (UINTN) (End - Start + 1) * BlockSize
+      );
+  }
+  Instance->CacheGeneration++;
+}
+
+/**
+  Copy a byte range out of the cache if all of it is cached.
+
+  The caller is responsible for holding the CacheLock.
+
+  @param Instance    Pointer to the DISK_IO_PRIVATE_DATA.
+  @param Line        The line holding the first byte.
+  @param LineOffset  The offset of the first byte in Line.
+  @param BufferSize  The number of bytes to copy.
+  @param Buffer      The buffer to receive the data.
+  @param MissLine    Returns the first line that is not cached. Optional.
+
+  @retval TRUE       Buffer has been filled from the cache.
+  @retval FALSE      A line is not cached.
+**/
+BOOLEAN
+DiskIoCacheCopyOut (
+  IN  DISK_IO_PRIVATE_DATA    *Instance,
+  IN  UINT64                  Line,
+  IN  UINT32                  LineOffset,
+  IN  UINTN                   BufferSize,
+  OUT UINT8                   *Buffer,
+  OUT UINT64                  *MissLine   OPTIONAL
+  )
+{
+  DISK_IO_CACHE_LINE          *CacheLine;
+  UINTN                       Length;
+
+  while (BufferSize > 0) {
+    CacheLine = DiskIoCacheLookup (Instance, Line);
+    if (CacheLine == NULL) {
+      if (MissLine != NULL) {
+        *MissLine = Line;
+      }
+      return FALSE;
+    }
+    Length = MIN (Instance->CacheLineSize - LineOffset, BufferSize);
+    CopyMem (Buffer, CacheLine->Data + LineOffset, Length);
+    RemoveEntryList (&CacheLine->LruLink);
+    InsertHeadList (&Instance->CacheLru, &CacheLine->LruLink);
+
+    Buffer     += Length;
+    BufferSize -= Length;
+    LineOffset  = 0;
+    Line++;
+  }
+  return TRUE;
+}
+
+/**
+  Set up the block cache of a Disk I/O instance, as configured by
+  PcdDiskIoCacheSize. The cache stays disabled if it is not configured, if the
+  Block I/O device is a logical partition (its parent device is cached), or if
+  there is not enough memory.
+
+  @param Instance    Pointer to the DISK_IO_PRIVATE_DATA.
+**/
+VOID
+DiskIoCacheInit (
+  IN DISK_IO_PRIVATE_DATA     *Instance
+  )
+{
+  EFI_BLOCK_IO_MEDIA          *Media;
+  UINTN                       LineCount;
+  UINTN                       Index;
+
+  Media = Instance->BlockIo->Media;
+  if ((PcdGet32 (PcdDiskIoCacheSize) == 0) || Media->LogicalPartition || (Media->BlockSize == 0)) {
+    return;
+  }
+
+  Instance->CacheLineBlocks = MAX (1, DISK_IO_CACHE_LINE_SIZE / Media->BlockSize);
+  Instance->CacheLineSize   = Instance->CacheLineBlocks * Media->BlockSize;
+  LineCount                 = PcdGet32 (PcdDiskIoCacheSize) / Instance->CacheLineSize;
+  if (LineCount == 0) {
+    return;
+  }
+  Instance->CacheMaxReadAhead = MIN (DISK_IO_CACHE_MAX_READ_AHEAD_LINES, LineCount / 4);
+
+  Instance->CacheBucketCount = 1;
+  while (Instance->CacheBucketCount < LineCount) {
+    Instance->CacheBucketCount <<= 1;
+  }
+
+  Instance->CacheLines   = AllocateZeroPool (LineCount * sizeof (DISK_IO_CACHE_LINE));
+  Instance->CacheBuckets = AllocatePool (Instance->CacheBucketCount * sizeof (LIST_ENTRY));
+  Instance->CacheData    = AllocateAlignedPages (
+                             EFI_SIZE_TO_PAGES (LineCount * Instance->CacheLineSize),
+                             Media->IoAlign
+                             );
+  //
+  // A fill covers the lines of the largest cached read, which need not be
+  // line aligned, and the lines read ahead.
+  //
+  Instance->CacheStaging = AllocateAlignedPages (
+                             EFI_SIZE_TO_PAGES ((DISK_IO_CACHE_MAX_READ_LINES + 1 + Instance->CacheMaxReadAhead) * Instance->CacheLineSize),
+                             Media->IoAlign
+                             );
+  if ((Instance->CacheLines == NULL) || (Instance->CacheBuckets == NULL) ||
+      (Instance->CacheData == NULL) || (Instance->CacheStaging == NULL)) {
+    DEBUG ((EFI_D_WARN, "DiskIo: No enough memory for the block cache\n"));
+    Instance->CacheLineCount = LineCount;
+    DiskIoCacheFree (Instance);
+    return;
+  }
+
+  EfiInitializeLock (&Instance->CacheLock, TPL_NOTIFY);
+  InitializeListHead (&Instance->CacheLru);
+  for (Index = 0; Index < Instance->CacheBucketCount; Index++) {
+    InitializeListHead (&Instance->CacheBuckets[Index]);
+  }
+  for (Index = 0; Index < LineCount; Index++) {
+    Instance->CacheLines[Index].Data = Instance->CacheData + Index * Instance->CacheLineSize;
+    InsertTailList (&Instance->CacheLru, &Instance->CacheLines[Index].LruLink);
+  }
+  Instance->CacheMediaId   = Media->MediaId;
+  Instance->CacheLineCount = LineCount;
+}
+
+/**
+  Report the cache statistics of a Disk I/O instance and release its block
+  cache.
+
+  @param Instance    Pointer to the DISK_IO_PRIVATE_DATA.
+**/
+VOID
+DiskIoCacheFree (
+  IN DISK_IO_PRIVATE_DATA     *Instance
+  )
+{
+  if (Instance->CacheLineCount == 0) {
+    return;
+  }
+
+  DEBUG ((
+    EFI_D_INFO,
+    "DiskIo: BlockIo %p cache hits/misses/read-ahead lines = %ld/%ld/%ld\n",
+    Instance->BlockIo, Instance->CacheHits, Instance->CacheMisses, Instance->CacheReadAheadLines
+    ));
+
+  if (Instance->CacheLines != NULL) {
+    FreePool (Instance->CacheLines);
+  }
+  if (Instance->CacheBuckets != NULL) {
+    FreePool (Instance->CacheBuckets);
+  }
+  if (Instance->CacheData != NULL) {
+    FreeAlignedPages (
+      Instance->CacheData,
+      EFI_SIZE_TO_PAGES (Instance->CacheLineCount * Instance->CacheLineSize)
+      );
+  }
+  if (Instance->CacheStaging != NULL) {
+    FreeAlignedPages (
+      Instance->CacheStaging,
+      EFI_SIZE_TO_PAGES ((DISK_IO_CACHE_MAX_READ_LINES + 1 + Instance->CacheMaxReadAhead) * Instance->CacheLineSize)
+      );
+  }
+  Instance->CacheLines     = NULL;
+  Instance->CacheBuckets   = NULL;
+  Instance->CacheData      = NULL;
+  Instance->CacheStaging   = NULL;
+  Instance->CacheLineCount = 0;
+}
+
+/**
+  Drop the cached copy of a range of blocks, or of all blocks.
+
+  @param Instance    Pointer to the DISK_IO_PRIVATE_DATA.
+  @param Lba         The first block to drop.
+  @param BufferSize  The number of bytes to drop, or MAX_UINTN for all blocks
+                     from Lba on.
+**/
+VOID
+DiskIoCacheInvalidate (
+  IN DISK_IO_PRIVATE_DATA     *Instance,
+  IN UINT64                   Lba,
+  IN UINTN                    BufferSize
+  )
+{
+  UINT32                      BlockSize;
+
+  if (Instance->CacheLineCount == 0) {
+    return;
+  }
+
+  BlockSize = Instance->CacheLineSize / Instance->CacheLineBlocks;
+  EfiAcquireLock (&Instance->CacheLock);
+  DiskIoCacheUpdateRange (
+    Instance,
+    Lba,
+    (BufferSize == MAX_UINTN) ? MAX_UINT64 : (BufferSize + BlockSize - 1) / BlockSize,
+    NULL
+    );
+  EfiReleaseLock (&Instance->CacheLock);
+}
+
+/**
+  Copy a byte range from the cache if all of it is cached.
+
+  @param Instance    Pointer to the DISK_IO_PRIVATE_DATA.
+  @param MediaId     ID of the medium to be read.
+  @param Offset      The starting byte offset on the device.
+  @param BufferSize  The number of bytes to read.
+  @param Buffer      The buffer to receive the data.
+
+  @retval TRUE       Buffer has been filled from the cache.
+  @retval FALSE      The range is not cached entirely; the content of Buffer
+                     is undefined.
+**/
+BOOLEAN
+DiskIoCacheRead (
+  IN  DISK_IO_PRIVATE_DATA    *Instance,
+  IN  UINT32                  MediaId,
+  IN  UINT64                  Offset,
+  IN  UINTN                   BufferSize,
+  OUT UINT8                   *Buffer
+  )
+{
+  UINT64                      Line;
+  UINT32                      LineOffset;
+  BOOLEAN                     Hit;
+
+  if ((Instance->CacheLineCount == 0) || (BufferSize == 0) ||
+      (BufferSize > DISK_IO_CACHE_MAX_READ_LINES * Instance->CacheLineSize)) {
+    return FALSE;
+  }
+
+  EfiAcquireLock (&Instance->CacheLock);
+  Hit = DiskIoCacheCheckMedia (Instance, MediaId);
+  if (Hit) {
+    Line = DivU64x32Remainder (Offset, Instance->CacheLineSize, &LineOffset);
+    Hit  = DiskIoCacheCopyOut (Instance, Line, LineOffset, BufferSize, Buffer, NULL);
+    if (Hit) {
+      Instance->CacheHits++;
+    }
+  }
+  EfiReleaseLock (&Instance->CacheLock);
+
+  return Hit;
+}
+
+/**
+  Read blocks through the cache. Missing lines are read from the device, along
+  with the lines that follow them when the reads are sequential, and kept in
+  the cache. Large reads go to the device directly.
+
+  Lines are filled through a buffer shared by the Disk I/O instance. A caller
+  that preempts a fill in progress, such as a non-blocking subtask running at
+  TPL_CALLBACK, reads from the device directly instead of using the buffer.
+
+  @param Instance    Pointer to the DISK_IO_PRIVATE_DATA.
+  @param MediaId     ID of the medium to be read.
+  @param Lba         The starting logical block address to read from.
+  @param BufferSize  The number of bytes to read, a multiple of the block size.
+  @param Buffer      The buffer to receive the data.
+
+  @return The status of BlockIo->ReadBlocks().
+**/
+EFI_STATUS
+DiskIoCacheReadBlocks (
+  IN  DISK_IO_PRIVATE_DATA    *Instance,
+  IN  UINT32                  MediaId,
+  IN  UINT64                  Lba,
+  IN  UINTN                   BufferSize,
+  OUT VOID                    *Buffer
+  )
+{
+  EFI_STATUS                  Status;
+  EFI_BLOCK_IO_PROTOCOL       *BlockIo;
+  UINT32                      BlockSize;
+  UINT64                      FirstLine;
+  UINT64                      LastLine;
+  UINT64                      MissLine;
+  UINT64                      MediaLines;
+  UINT32                      Skip;
+  UINTN                       ReadLines;
+  UINTN                       Index;
+  UINT64                      Generation;
+
+  BlockIo   = Instance->BlockIo;
+  BlockSize = BlockIo->Media->BlockSize;
+  if ((Instance->CacheLineCount == 0) || (BufferSize == 0) ||
+      (BufferSize > DISK_IO_CACHE_MAX_READ_LINES * Instance->CacheLineSize)) {
+    return BlockIo->ReadBlocks (BlockIo, MediaId, Lba, BufferSize, Buffer);
+  }
+
+  EfiAcquireLock (&Instance->CacheLock);
+  if (!DiskIoCacheCheckMedia (Instance, MediaId)) {
+    EfiReleaseLock (&Instance->CacheLock);
+    return BlockIo->ReadBlocks (BlockIo, MediaId, Lba, BufferSize, Buffer);
+  }
+
+  FirstLine = DivU64x32Remainder (Lba, Instance->CacheLineBlocks, &Skip);
+  if (DiskIoCacheCopyOut (Instance, FirstLine, Skip * BlockSize, BufferSize, Buffer, &MissLine)) {
+    Instance->CacheHits++;
+    EfiReleaseLock (&Instance->CacheLock);
+    return EFI_SUCCESS;
+  }
+
+  //
+  // Only whole lines are cached, so a read touching the partial line at the
+  // end of the media goes to the device directly.
+  //
+  LastLine   = DivU64x32 (Lba + BufferSize / BlockSize - 1, Instance->CacheLineBlocks);
+  MediaLines = DivU64x32 (BlockIo->Media->LastBlock + 1, Instance->CacheLineBlocks);
+  if (LastLine >= MediaLines) {
+    EfiReleaseLock (&Instance->CacheLock);
+    return BlockIo->ReadBlocks (BlockIo, MediaId, Lba, BufferSize, Buffer);
+  }
+
+  //
+  // Widen the read-ahead window while the misses continue where the last fill
+  // ended, and close it when they don't.
+  //
+  if (MissLine == Instance->CacheNextLine) {
+    Instance->CacheReadAhead = MIN (MAX (Instance->CacheReadAhead * 2, 1), Instance->CacheMaxReadAhead);
+  } else {
+    Instance->CacheReadAhead = 0;
+  }
+  ReadLines = (UINTN) (LastLine - FirstLine + 1) + Instance->CacheReadAhead;
+  if (FirstLine + ReadLines > MediaLines) {
+    ReadLines = (UINTN) (MediaLines - FirstLine);
+  }
+
+  //
+  // The staging buffer belongs to the fill this call may have preempted.
+  //
+  if (Instance->CacheStagingBusy) {
+    EfiReleaseLock (&Instance->CacheLock);
+    return BlockIo->ReadBlocks (BlockIo, MediaId, Lba, BufferSize, Buffer);
+  }
+  Instance->CacheStagingBusy = TRUE;
+  Generation = Instance->CacheGeneration;
+  Instance->CacheMisses++;
+  EfiReleaseLock (&Instance->CacheLock);
+
+  Status = BlockIo->ReadBlocks (
+                      BlockIo,
+                      MediaId,
+                      MultU64x32 (FirstLine, Instance->CacheLineBlocks),
+                      ReadLines * Instance->CacheLineSize,
+                      Instance->CacheStaging
+                      );
+  if (EFI_ERROR (Status)) {
+    //
+    // The lines around the request may be unreadable; retry the request
+    // alone, which also reports the media condition.
+    //
+    EfiAcquireLock (&Instance->CacheLock);
+    Instance->CacheReadAhead   = 0;
+    Instance->CacheStagingBusy = FALSE;
+    EfiReleaseLock (&Instance->CacheLock);
+    return BlockIo->ReadBlocks (BlockIo, MediaId, Lba, BufferSize, Buffer);
+  }
+
+  EfiAcquireLock (&Instance->CacheLock);
+  //
+  // Lines written or dropped during the read may be stale in the staging
+  // buffer, so they are only kept if nothing changed meanwhile.
+  //
+  if (Generation == Instance->CacheGeneration) {
+    for (Index = 0; Index < ReadLines; Index++) {
+      DiskIoCacheInsertLine (Instance, FirstLine + Index, Instance->CacheStaging + Index * Instance->CacheLineSize);
+    }
+  }
+  Instance->CacheNextLine        = FirstLine + ReadLines;
+  Instance->CacheReadAheadLines += ReadLines - (UINTN) (LastLine - FirstLine + 1);
+  CopyMem (Buffer, Instance->CacheStaging + Skip * BlockSize, BufferSize);
+  Instance->CacheStagingBusy = FALSE;
+  EfiReleaseLock (&Instance->CacheLock);
+
+  return EFI_SUCCESS;
+}
+
+/**
+  Write blocks to the device, and update the cached copy of them.
+
+  @param Instance    Pointer to the DISK_IO_PRIVATE_DATA.
+  @param MediaId     ID of the medium to be written.
+  @param Lba         The starting logical block address to write to.
+  @param BufferSize  The number of bytes to write, a multiple of the block size.
+  @param Buffer      The data to write.
+
+  @return The status of BlockIo->WriteBlocks().
+**/
+EFI_STATUS
+DiskIoCacheWriteBlocks (
+  IN DISK_IO_PRIVATE_DATA     *Instance,
+  IN UINT32                   MediaId,
+  IN UINT64                   Lba,
+  IN UINTN                    BufferSize,
+  IN VOID                     *Buffer
+  )
+{
+  EFI_STATUS                  Status;
+  EFI_BLOCK_IO_PROTOCOL       *BlockIo;
+
+  BlockIo = Instance->BlockIo;
+  Status  = BlockIo->WriteBlocks (BlockIo, MediaId, Lba, BufferSize, Buffer);
+  if (Instance->CacheLineCount == 0) {
+    return Status;
+  }
+
+  //
+  // A failed write leaves the blocks in an unknown state.
+  //
+  EfiAcquireLock (&Instance->CacheLock);
+  DiskIoCacheUpdateRange (
+    Instance,
+    Lba,
+    BufferSize / BlockIo->Media->BlockSize,
+    EFI_ERROR (Status) ? NULL : (UINT8 *) Buffer
+    );
+  EfiReleaseLock (&Instance->CacheLock);
+
+  return Status;
+}
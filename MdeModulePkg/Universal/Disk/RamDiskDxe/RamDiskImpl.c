@@ -193,7 +193,7 @@ UnregisterAllRamDisks (
         // driver is responsible for freeing the allocated memory for the
         // RAM disk.
         //
-        FreePool ((VOID *)(UINTN) PrivateData->StartingAddr);
+        RamDiskFreeMemory (PrivateData);
       }
 
       FreePool (PrivateData->DevicePath);
@@ -281,6 +281,77 @@ RamDiskRouteConfig (
 }
 
 
+/**
+  Allocate the memory of a RAM disk created within HII.
+
+  The memory is aligned on the largest of the 1GB, 2MB and 4KB boundaries that
+  does not exceed the RAM disk size, so that the RAM disk can be mapped with
+  large pages.
+
+  @param[in] Size            The size of the RAM disk.
+  @param[in] MemoryType      Type of memory to be used to create RAM Disk.
+
+  @return A pointer to the allocated memory or NULL if the allocation fails.
+
+**/
+VOID *
+RamDiskAllocateMemory (
+  IN UINTN                        Size,
+  IN UINT8                        MemoryType
+  )
+{
+  VOID                            *Buffer;
+  UINTN                           Pages;
+  UINTN                           Alignment;
+
+  Pages = EFI_SIZE_TO_PAGES (Size);
+  if (Size >= SIZE_1GB) {
+    Alignment = SIZE_1GB;
+  } else if (Size >= SIZE_2MB) {
+    Alignment = SIZE_2MB;
+  } else {
+    Alignment = EFI_PAGE_SIZE;
+  }
+
+  //
+  // Fall back to a smaller alignment if the memory map is too fragmented for
+  // a larger one.
+  //
+  for (;;) {
+    if (MemoryType == RAM_DISK_BOOT_SERVICE_DATA_MEMORY) {
+      Buffer = AllocateAlignedPages (Pages, Alignment);
+    } else if (MemoryType == RAM_DISK_RESERVED_MEMORY) {
+      Buffer = AllocateAlignedReservedPages (Pages, Alignment);
+    } else {
+      return NULL;
+    }
+
+    if ((Buffer != NULL) || (Alignment == EFI_PAGE_SIZE)) {
+      return Buffer;
+    }
+    Alignment = (Alignment == SIZE_1GB) ? SIZE_2MB : EFI_PAGE_SIZE;
+  }
+}
+
+
+/**
+  Free the memory of a RAM disk created within HII.
+
+  @param[in] PrivateData     Points to RAM disk private data.
+
+**/
+VOID
+RamDiskFreeMemory (
+  IN RAM_DISK_PRIVATE_DATA        *PrivateData
+  )
+{
+  FreeAlignedPages (
+    (VOID *)(UINTN) PrivateData->StartingAddr,
+    EFI_SIZE_TO_PAGES ((UINTN) PrivateData->Size)
+    );
+}
+
+
 /**
   Allocate memory and register the RAM disk created within RamDiskDxe
   driver HII.
@@ -357,23 +428,8 @@ HiiCreateRamDisk (
     return EFI_OUT_OF_RESOURCES;
   }
 
-  if (MemoryType == RAM_DISK_BOOT_SERVICE_DATA_MEMORY) {
-    Status = gBS->AllocatePool (
-                    EfiBootServicesData,
-                    (UINTN)Size,
-                    (VOID**)&StartingAddr
-                    );
-  } else if (MemoryType == RAM_DISK_RESERVED_MEMORY) {
-    Status = gBS->AllocatePool (
-                    EfiReservedMemoryType,
-                    (UINTN)Size,
-                    (VOID**)&StartingAddr
-                    );
-  } else {
-    Status = EFI_INVALID_PARAMETER;
-  }
-
-  if ((StartingAddr == NULL) || EFI_ERROR(Status)) {
+  StartingAddr = RamDiskAllocateMemory ((UINTN) Size, MemoryType);
+  if (StartingAddr == NULL) {
     do {
       CreatePopUp (
         EFI_LIGHTGRAY | EFI_BACKGROUND_BLUE,
@@ -412,6 +468,7 @@ HiiCreateRamDisk (
           );
       } while (Key.UnicodeChar != CHAR_CARRIAGE_RETURN);
 
+      FreeAlignedPages (StartingAddr, EFI_SIZE_TO_PAGES ((UINTN) Size));
       return EFI_DEVICE_ERROR;
     }
   }
@@ -439,6 +496,7 @@ HiiCreateRamDisk (
         );
     } while (Key.UnicodeChar != CHAR_CARRIAGE_RETURN);
 
+    FreeAlignedPages (StartingAddr, EFI_SIZE_TO_PAGES ((UINTN) Size));
     return Status;
   }
 
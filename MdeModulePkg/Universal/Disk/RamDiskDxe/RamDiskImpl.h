@@ -659,4 +659,36 @@ RamDiskPublishNfit (
   IN RAM_DISK_PRIVATE_DATA        *PrivateData
   );
 
+
+/**
+  Allocate the memory of a RAM disk created within HII.
+
+  The memory is aligned on the largest of the 1GB, 2MB and 4KB boundaries that
+  does not exceed the RAM disk size, so that the RAM disk can be mapped with
+  large pages.
+
+  @param[in] Size            The size of the RAM disk.
+  @param[in] MemoryType      Type of memory to be used to create RAM Disk.
+
+  @return A pointer to the allocated memory or NULL if the allocation fails.
+
+**/
+VOID *
+RamDiskAllocateMemory (
+  IN UINTN                        Size,
+  IN UINT8                        MemoryType
+  );
+
+
+/**
+  Free the memory of a RAM disk created within HII.
+
+  @param[in] PrivateData     Points to RAM disk private data.
+
+**/
+VOID
+RamDiskFreeMemory (
+  IN RAM_DISK_PRIVATE_DATA        *PrivateData
+  );
+
 #endif
@@ -841,7 +841,7 @@ RamDiskUnregister (
           // driver is responsible for freeing the allocated memory for the
           // RAM disk.
           //
-          FreePool ((VOID *)(UINTN) PrivateData->StartingAddr);
+          RamDiskFreeMemory (PrivateData);
         }
 
         FreePool (PrivateData->DevicePath);
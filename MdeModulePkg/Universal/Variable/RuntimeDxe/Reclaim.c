@@ -92,14 +92,17 @@ GetLbaAndOffsetByAddress (
 }
 
 /**
-  Writes a buffer to variable storage space, in the working block.
+  Writes a buffer to a range of the variable storage space.
 
-  This function writes a buffer to variable storage space into a firmware
-  volume block device. The destination is specified by parameter
-  VariableBase. Fault Tolerant Write protocol is used for writing.
+  This function writes a buffer to a range of the variable storage space in
+  a firmware volume block device, starting at Offset from VariableBase.
+  Fault Tolerant Write protocol is used for writing, so the range is either
+  fully updated or left unchanged.
 
-  @param  VariableBase   Base address of variable to write
-  @param  VariableBuffer Point to the variable data buffer.
+  @param  VariableBase   Base address of the variable store.
+  @param  Offset         Offset in the variable store of the range to write.
+  @param  Buffer         Point to the data to write.
+  @param  Length         Size of the range in bytes.
 
   @retval EFI_SUCCESS    The function completed successfully.
   @retval EFI_NOT_FOUND  Fail to locate Fault Tolerant Write protocol.
@@ -107,16 +110,17 @@ GetLbaAndOffsetByAddress (
 
 **/
 EFI_STATUS
-FtwVariableSpace (
+FtwVariableRange (
   IN EFI_PHYSICAL_ADDRESS   VariableBase,
-  IN VARIABLE_STORE_HEADER  *VariableBuffer
+  IN UINTN                  Offset,
+  IN UINT8                  *Buffer,
+  IN UINTN                  Length
   )
 {
   EFI_STATUS                         Status;
   EFI_HANDLE                         FvbHandle;
   EFI_LBA                            VarLba;
   UINTN                              VarOffset;
-  UINTN                              FtwBufferSize;
   EFI_FAULT_TOLERANT_WRITE_PROTOCOL  *FtwProtocol;
 
   //
@@ -136,14 +140,11 @@ FtwVariableSpace (
   //
   // Get LBA and Offset by address.
   //
-  Status = GetLbaAndOffsetByAddress (VariableBase, &VarLba, &VarOffset);
+  Status = GetLbaAndOffsetByAddress (VariableBase + Offset, &VarLba, &VarOffset);
   if (EFI_ERROR (Status)) {
     return EFI_ABORTED;
   }
 
-  FtwBufferSize = ((VARIABLE_STORE_HEADER *) ((UINTN) VariableBase))->Size;
-  ASSERT (FtwBufferSize == VariableBuffer->Size);
-
   //
   // FTW write record.
   //
@@ -151,11 +152,40 @@ FtwVariableSpace (
                           FtwProtocol,
                           VarLba,         // LBA
                           VarOffset,      // Offset
-                          FtwBufferSize,  // NumBytes
+                          Length,         // NumBytes
                           NULL,           // PrivateData NULL
                           FvbHandle,      // Fvb Handle
-                          (VOID *) VariableBuffer // write buffer
+                          (VOID *) Buffer // write buffer
                           );
 
   return Status;
 }
+
+/**
+  Writes a buffer to variable storage space, in the working block.
+
+  This function writes a buffer to variable storage space into a firmware
+  volume block device. The destination is specified by parameter
+  VariableBase. Fault Tolerant Write protocol is used for writing.
+
+  @param  VariableBase   Base address of variable to write
+  @param  VariableBuffer Point to the variable data buffer.
+
+  @retval EFI_SUCCESS    The function completed successfully.
+  @retval EFI_NOT_FOUND  Fail to locate Fault Tolerant Write protocol.
+  @retval EFI_ABORTED    The function could not complete successfully.
+
+**/
+EFI_STATUS
+FtwVariableSpace (
+  IN EFI_PHYSICAL_ADDRESS   VariableBase,
+  IN VARIABLE_STORE_HEADER  *VariableBuffer
+  )
+{
+  UINTN                              FtwBufferSize;
+
+  FtwBufferSize = ((VARIABLE_STORE_HEADER *) ((UINTN) VariableBase))->Size;
+  ASSERT (FtwBufferSize == VariableBuffer->Size);
+
+  return FtwVariableRange (VariableBase, 0, (UINT8 *) VariableBuffer, FtwBufferSize);
+}
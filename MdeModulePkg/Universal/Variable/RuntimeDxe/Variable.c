@@ -978,6 +978,219 @@ InitializeVariableQuota (
   CalculateCommonUserVariableTotalSize ();
 }
 
+/**
+  Compute the index hash of a variable name and vendor GUID.
+
+  @param[in] VariableName       Pointer to the variable name.
+  @param[in] NameSize           Size of the variable name in bytes, including the terminator.
+  @param[in] VendorGuid         Pointer to the vendor GUID.
+
+  @return The hash, never 0 as 0 marks an empty slot of the index.
+
+**/
+UINT32
+VariableIndexHash (
+  IN CONST VOID             *VariableName,
+  IN UINTN                  NameSize,
+  IN CONST EFI_GUID         *VendorGuid
+  )
+{
+  CONST UINT8               *Byte;
+  UINTN                     Index;
+  UINT32                    Hash;
+
+  //
+  // FNV-1a over the name, then over the GUID.
+  //
+  Hash = 0x811c9dc5;
+  Byte = (CONST UINT8 *) VariableName;
+  for (Index = 0; Index < NameSize; Index++) {
+    Hash = (Hash ^ Byte[Index]) * 0x01000193;
+  }
+  Byte = (CONST UINT8 *) VendorGuid;
+  for (Index = 0; Index < sizeof (EFI_GUID); Index++) {
+    Hash = (Hash ^ Byte[Index]) * 0x01000193;
+  }
+
+  return (Hash == 0) ? 1 : Hash;
+}
+
+/**
+  Allocate the name and GUID index of every variable store.
+
+  The indexes are sized for the largest number of variables a store can hold,
+  as no memory can be allocated once the variable services run at OS runtime.
+  A store whose index cannot be allocated is searched linearly.
+
+**/
+VOID
+InitializeVariableStoreIndex (
+  VOID
+  )
+{
+  VARIABLE_STORE_HEADER     *VariableStoreHeader[VariableStoreTypeMax];
+  VARIABLE_STORE_INDEX      *StoreIndex;
+  VARIABLE_STORE_TYPE       Type;
+  UINT32                    MaxCount;
+
+  VariableStoreHeader[VariableStoreTypeVolatile] = (VARIABLE_STORE_HEADER *) (UINTN) mVariableModuleGlobal->VariableGlobal.VolatileVariableBase;
+  VariableStoreHeader[VariableStoreTypeHob]      = (VARIABLE_STORE_HEADER *) (UINTN) mVariableModuleGlobal->VariableGlobal.HobVariableBase;
+  VariableStoreHeader[VariableStoreTypeNv]       = mNvVariableCache;
+
+  for (Type = (VARIABLE_STORE_TYPE) 0; Type < VariableStoreTypeMax; Type++) {
+    StoreIndex = &mVariableModuleGlobal->StoreIndex[Type];
+    if (VariableStoreHeader[Type] == NULL) {
+      continue;
+    }
+
+    //
+    // Each variable takes more than a variable header, keep the load factor under 2/3.
+    //
+    MaxCount = VariableStoreHeader[Type]->Size / (UINT32) GetVariableHeaderSize ();
+    StoreIndex->Capacity = GetPowerOfTwo32 (MaxCount + MaxCount / 2) * 2;
+    StoreIndex->Table    = AllocateRuntimeZeroPool (StoreIndex->Capacity * sizeof (VARIABLE_INDEX_ENTRY));
+    if (StoreIndex->Table == NULL) {
+      DEBUG ((EFI_D_INFO, "Variable: No index for variable store %d\n", Type));
+      StoreIndex->Capacity = 0;
+    }
+  }
+}
+
+/**
+  Drop the index of a variable store, so that it is rebuilt on the next lookup.
+
+  @param[in] Type               The variable store whose content has been rewritten.
+
+**/
+VOID
+InvalidateVariableStoreIndex (
+  IN VARIABLE_STORE_TYPE    Type
+  )
+{
+  mVariableModuleGlobal->StoreIndex[Type].IndexedOffset = 0;
+}
+
+/**
+  Get the index of the variable store a variable search runs over, and bring
+  it up to date with the variables appended to the store since the last lookup.
+
+  The index is taken for the caller, who must release it by clearing Busy.
+
+  @param[in]  PtrTrack          The range to search.
+  @param[out] Store             The variable store header of the range.
+
+  @return The index of the variable store, or NULL if the range must be
+          searched linearly.
+
+**/
+VARIABLE_STORE_INDEX *
+AcquireVariableStoreIndex (
+  IN  VARIABLE_POINTER_TRACK  *PtrTrack,
+  OUT VARIABLE_STORE_HEADER   **Store
+  )
+{
+  VARIABLE_STORE_HEADER     *VariableStoreHeader[VariableStoreTypeMax];
+  VARIABLE_STORE_INDEX      *StoreIndex;
+  VARIABLE_STORE_TYPE       Type;
+  VARIABLE_HEADER           *Variable;
+  VARIABLE_HEADER           *EndPtr;
+  UINT32                    Hash;
+  UINT32                    Slot;
+
+  if (mVariableModuleGlobal == NULL) {
+    return NULL;
+  }
+
+  VariableStoreHeader[VariableStoreTypeVolatile] = (VARIABLE_STORE_HEADER *) (UINTN) mVariableModuleGlobal->VariableGlobal.VolatileVariableBase;
+  VariableStoreHeader[VariableStoreTypeHob]      = (VARIABLE_STORE_HEADER *) (UINTN) mVariableModuleGlobal->VariableGlobal.HobVariableBase;
+  VariableStoreHeader[VariableStoreTypeNv]       = mNvVariableCache;
+
+  for (Type = (VARIABLE_STORE_TYPE) 0; Type < VariableStoreTypeMax; Type++) {
+    if ((VariableStoreHeader[Type] != NULL) &&
+        (PtrTrack->StartPtr == GetStartPointer (VariableStoreHeader[Type])) &&
+        (PtrTrack->EndPtr == GetEndPointer (VariableStoreHeader[Type]))) {
+      break;
+    }
+  }
+  if (Type == VariableStoreTypeMax) {
+    return NULL;
+  }
+
+  StoreIndex = &mVariableModuleGlobal->StoreIndex[Type];
+  if (StoreIndex->Table == NULL) {
+    return NULL;
+  }
+
+  //
+  // A search reentered from MCA/INIT/NMI falls back to the linear walk.
+  //
+  if (InterlockedCompareExchange32 ((UINT32 *) &StoreIndex->Busy, 0, 1) != 0) {
+    return NULL;
+  }
+
+  *Store = VariableStoreHeader[Type];
+  if (StoreIndex->IndexedOffset == 0) {
+    ZeroMem (StoreIndex->Table, StoreIndex->Capacity * sizeof (VARIABLE_INDEX_ENTRY));
+    StoreIndex->Count         = 0;
+    StoreIndex->IndexedOffset = (UINTN) GetStartPointer (*Store) - (UINTN) *Store;
+  }
+
+  EndPtr = GetEndPointer (*Store);
+  for ( Variable = (VARIABLE_HEADER *) ((UINTN) *Store + StoreIndex->IndexedOffset)
+      ; IsValidVariableHeader (Variable, EndPtr)
+      ; Variable = GetNextVariablePtr (Variable)
+      ) {
+    if (StoreIndex->Count >= StoreIndex->Capacity - 1) {
+      //
+      // Cannot happen with the capacity computed from the store size, but never loop forever.
+      //
+      StoreIndex->IndexedOffset = 0;
+      StoreIndex->Busy          = 0;
+      return NULL;
+    }
+
+    Hash = VariableIndexHash (GetVariableNamePtr (Variable), NameSizeOfVariable (Variable), GetVendorGuidPtr (Variable));
+    for (Slot = Hash & (StoreIndex->Capacity - 1); StoreIndex->Table[Slot].Hash != 0; Slot = (Slot + 1) & (StoreIndex->Capacity - 1)) {
+    }
+    StoreIndex->Table[Slot].Offset = (UINT32) ((UINTN) Variable - (UINTN) *Store);
+    StoreIndex->Table[Slot].Hash   = Hash;
+    StoreIndex->Count++;
+  }
+  StoreIndex->IndexedOffset = (UINTN) Variable - (UINTN) *Store;
+
+  return StoreIndex;
+}
+
+/**
+  Record a reclaim of the non-volatile variable store in the reclaim statistics.
+
+  @param[in] StartTick          Performance counter value when the reclaim started.
+  @param[in] BytesWritten       Number of bytes written to the variable store.
+
+**/
+VOID
+RecordVariableReclaim (
+  IN UINT64                 StartTick,
+  IN UINTN                  BytesWritten
+  )
+{
+  UINT64                    Ticks;
+  UINT64                    StartValue;
+  UINT64                    EndValue;
+
+  Ticks = GetPerformanceCounter ();
+  GetPerformanceCounterProperties (&StartValue, &EndValue);
+  if (EndValue >= StartValue) {
+    Ticks = Ticks - StartTick;
+  } else {
+    Ticks = StartTick - Ticks;
+  }
+
+  mVariableModuleGlobal->ReclaimCount++;
+  mVariableModuleGlobal->ReclaimBytesWritten += BytesWritten;
+  mVariableModuleGlobal->ReclaimTime += GetTimeInNanoSecond (Ticks);
+}
+
 /**
 
   Variable store garbage collection and reclaim operation.
@@ -1024,7 +1237,9 @@ Reclaim (
   UINTN                 HwErrVariableTotalSize;
   VARIABLE_HEADER       *UpdatingVariable;
   VARIABLE_HEADER       *UpdatingInDeletedTransition;
+  UINT64                StartTick;
 
+  StartTick = GetPerformanceCounter ();
   UpdatingVariable = NULL;
   UpdatingInDeletedTransition = NULL;
   if (UpdatingPtrTrack != NULL) {
@@ -1227,6 +1442,7 @@ Reclaim (
       mVariableModuleGlobal->HwErrVariableTotalSize = HwErrVariableTotalSize;
       mVariableModuleGlobal->CommonVariableTotalSize = CommonVariableTotalSize;
       mVariableModuleGlobal->CommonUserVariableTotalSize = CommonUserVariableTotalSize;
+      RecordVariableReclaim (StartTick, VariableStoreHeader->Size);
     } else {
       mVariableModuleGlobal->HwErrVariableTotalSize = 0;
       mVariableModuleGlobal->CommonVariableTotalSize = 0;
@@ -1253,11 +1469,13 @@ Reclaim (
 Done:
   if (IsVolatile) {
     FreePool (ValidBuffer);
+    InvalidateVariableStoreIndex (VariableStoreTypeVolatile);
   } else {
     //
     // For NV variable reclaim, we use mNvVariableCache as the buffer, so copy the data back.
     //
     CopyMem (mNvVariableCache, (UINT8 *)(UINTN)VariableBase, VariableStoreHeader->Size);
+    InvalidateVariableStoreIndex (VariableStoreTypeNv);
   }
 
   return Status;
@@ -1285,6 +1503,10 @@ FindVariableEx (
 {
   VARIABLE_HEADER                *InDeletedVariable;
   VOID                           *Point;
+  VARIABLE_STORE_INDEX           *StoreIndex;
+  VARIABLE_STORE_HEADER          *Store;
+  UINT32                         Hash;
+  UINT32                         Slot;
 
   PtrTrack->InDeletedTransitionPtr = NULL;
 
@@ -1293,6 +1515,49 @@ FindVariableEx (
   //
   InDeletedVariable  = NULL;
 
+  StoreIndex = NULL;
+  if (VariableName[0] != 0) {
+    StoreIndex = AcquireVariableStoreIndex (PtrTrack, &Store);
+  }
+  if (StoreIndex != NULL) {
+    //
+    // Variables with the same name and GUID hash are probed in the order they
+    // were indexed, which is their order in the store, so the result matches
+    // the linear walk below.
+    //
+    Hash = VariableIndexHash (VariableName, StrSize (VariableName), VendorGuid);
+    for (Slot = Hash & (StoreIndex->Capacity - 1); StoreIndex->Table[Slot].Hash != 0; Slot = (Slot + 1) & (StoreIndex->Capacity - 1)) {
+      if (StoreIndex->Table[Slot].Hash != Hash) {
+        continue;
+      }
+      PtrTrack->CurrPtr = (VARIABLE_HEADER *) ((UINTN) Store + StoreIndex->Table[Slot].Offset);
+      if (PtrTrack->CurrPtr->State == VAR_ADDED ||
+          PtrTrack->CurrPtr->State == (VAR_IN_DELETED_TRANSITION & VAR_ADDED)
+         ) {
+        if (IgnoreRtCheck || !AtRuntime () || ((PtrTrack->CurrPtr->Attributes & EFI_VARIABLE_RUNTIME_ACCESS) != 0)) {
+          if (CompareGuid (VendorGuid, GetVendorGuidPtr (PtrTrack->CurrPtr))) {
+            Point = (VOID *) GetVariableNamePtr (PtrTrack->CurrPtr);
+
+            ASSERT (NameSizeOfVariable (PtrTrack->CurrPtr) != 0);
+            if (CompareMem (VariableName, Point, NameSizeOfVariable (PtrTrack->CurrPtr)) == 0) {
+              if (PtrTrack->CurrPtr->State == (VAR_IN_DELETED_TRANSITION & VAR_ADDED)) {
+                InDeletedVariable     = PtrTrack->CurrPtr;
+              } else {
+                PtrTrack->InDeletedTransitionPtr = InDeletedVariable;
+                StoreIndex->Busy = 0;
+                return EFI_SUCCESS;
+              }
+            }
+          }
+        }
+      }
+    }
+
+    StoreIndex->Busy = 0;
+    PtrTrack->CurrPtr = InDeletedVariable;
+    return (PtrTrack->CurrPtr  == NULL) ? EFI_NOT_FOUND : EFI_SUCCESS;
+  }
+
   for ( PtrTrack->CurrPtr = PtrTrack->StartPtr
       ; IsValidVariableHeader (PtrTrack->CurrPtr, PtrTrack->EndPtr)
       ; PtrTrack->CurrPtr = GetNextVariablePtr (PtrTrack->CurrPtr)
@@ -1332,6 +1597,305 @@ FindVariableEx (
 }
 
 
+/**
+  Check whether a reclaim of the non-volatile variable store drops a variable.
+
+  @param[in] Variable           Pointer to a variable in the non-volatile variable cache.
+
+  @retval TRUE                  The variable is deleted, or it is in delete transition
+                                and an added copy of it exists.
+  @retval FALSE                 The variable is kept by a reclaim.
+
+**/
+BOOLEAN
+IsReclaimDroppedVariable (
+  IN VARIABLE_HEADER        *Variable
+  )
+{
+  VARIABLE_POINTER_TRACK    PtrTrack;
+  EFI_STATUS                Status;
+
+  if (Variable->State == VAR_ADDED) {
+    return FALSE;
+  }
+  if (Variable->State != (VAR_IN_DELETED_TRANSITION & VAR_ADDED)) {
+    return TRUE;
+  }
+
+  PtrTrack.StartPtr = GetStartPointer (mNvVariableCache);
+  PtrTrack.EndPtr   = GetEndPointer (mNvVariableCache);
+  Status = FindVariableEx (GetVariableNamePtr (Variable), GetVendorGuidPtr (Variable), TRUE, &PtrTrack);
+  return (BOOLEAN) (!EFI_ERROR (Status) && (PtrTrack.CurrPtr != Variable));
+}
+
+/**
+  Add the size of a non-volatile variable to the variable space totals, or
+  remove it from them.
+
+  @param[in] Variable           Pointer to the variable header.
+  @param[in] VariableSize       Size of the variable in the store.
+  @param[in] Add                TRUE to add the size, FALSE to remove it.
+
+**/
+VOID
+UpdateVariableTotalSize (
+  IN VARIABLE_HEADER        *Variable,
+  IN UINTN                  VariableSize,
+  IN BOOLEAN                Add
+  )
+{
+  UINTN                     *TotalSize;
+
+  if ((Variable->Attributes & EFI_VARIABLE_HARDWARE_ERROR_RECORD) == EFI_VARIABLE_HARDWARE_ERROR_RECORD) {
+    TotalSize = &mVariableModuleGlobal->HwErrVariableTotalSize;
+  } else {
+    TotalSize = &mVariableModuleGlobal->CommonVariableTotalSize;
+    if (IsUserVariable (Variable)) {
+      if (Add) {
+        mVariableModuleGlobal->CommonUserVariableTotalSize += VariableSize;
+      } else {
+        //
+        // The user variable total is only counted for the whole store at EndOfDxe.
+        //
+        mVariableModuleGlobal->CommonUserVariableTotalSize -= MIN (VariableSize, mVariableModuleGlobal->CommonUserVariableTotalSize);
+      }
+    }
+  }
+
+  if (Add) {
+    *TotalSize += VariableSize;
+  } else {
+    *TotalSize -= MIN (VariableSize, *TotalSize);
+  }
+}
+
+/**
+  Run one bounded step of the incremental reclaim of the non-volatile variable store.
+
+  A step finds the first variable a full reclaim would drop. If variables to keep
+  follow it, the step packs as many of them as the budget allows over the dropped
+  ones, and covers the remaining gap with a deleted filler variable that later
+  steps push further. When only dropped variables are left, the step erases the
+  end of the store instead, so the space is returned to the free area. Each step
+  is a single fault tolerant write of the range it changes, and leaves a valid
+  store whatever the steps after it do.
+
+  The store is fully compacted once this function returns EFI_NOT_FOUND.
+
+  @param[in] Budget             The largest number of bytes to write. At least
+                                one variable is moved, even if it is larger.
+
+  @retval EFI_SUCCESS           The step has been done.
+  @retval EFI_NOT_FOUND         The store has nothing left to reclaim.
+  @retval EFI_OUT_OF_RESOURCES  No memory for the write buffer.
+  @return Others                The write to the variable store failed.
+
+**/
+EFI_STATUS
+ReclaimNonVolatileStep (
+  IN UINTN                  Budget
+  )
+{
+  VARIABLE_HEADER           *LastEnd;
+  VARIABLE_HEADER           *Hole;
+  VARIABLE_HEADER           *WindowEnd;
+  VARIABLE_HEADER           *Variable;
+  VARIABLE_HEADER           *NextVariable;
+  VARIABLE_HEADER           *Filler;
+  UINT8                     *Buffer;
+  UINT8                     *WriteStart;
+  UINT8                     *WriteEnd;
+  UINTN                     FillerHeaderSize;
+  UINTN                     PackedSize;
+  UINTN                     VariableSize;
+  UINT64                    StartTick;
+  EFI_STATUS                Status;
+
+  StartTick = GetPerformanceCounter ();
+  LastEnd   = (VARIABLE_HEADER *) ((UINTN) mNvVariableCache + mVariableModuleGlobal->NonVolatileLastVariableOffset);
+  Filler    = NULL;
+
+  //
+  // Find the first variable to drop.
+  //
+  for (Hole = GetStartPointer (mNvVariableCache); IsValidVariableHeader (Hole, LastEnd); Hole = GetNextVariablePtr (Hole)) {
+    if (IsReclaimDroppedVariable (Hole)) {
+      break;
+    }
+  }
+  if (!IsValidVariableHeader (Hole, LastEnd)) {
+    return EFI_NOT_FOUND;
+  }
+
+  //
+  // Size the window of the step: the variables to keep after the hole are packed
+  // while the write fits in the budget, the dropped ones in between are skipped.
+  //
+  FillerHeaderSize = GetVariableHeaderSize () + sizeof (CHAR16) + GET_PAD_SIZE (sizeof (CHAR16));
+  PackedSize = 0;
+  for (Variable = Hole; IsValidVariableHeader (Variable, LastEnd); Variable = NextVariable) {
+    NextVariable = GetNextVariablePtr (Variable);
+    if (!IsReclaimDroppedVariable (Variable)) {
+      VariableSize = (UINTN) NextVariable - (UINTN) Variable;
+      if ((PackedSize != 0) && (PackedSize + VariableSize + FillerHeaderSize > Budget)) {
+        break;
+      }
+      PackedSize += VariableSize;
+    }
+  }
+  WindowEnd = Variable;
+
+  if (PackedSize == 0) {
+    //
+    // Only dropped variables are left. Erase them from the end of the store, which
+    // shortens the variable chain without ever cutting it in front of a valid header.
+    // The erase starts at the first variable whose end of the store fits in the
+    // budget, or at the last variable if even that one does not fit.
+    //
+    WriteEnd = (UINT8 *) LastEnd;
+    while ((WriteEnd > (UINT8 *) Hole) && (WriteEnd[-1] == 0xff)) {
+      WriteEnd--;
+    }
+    WriteStart = (UINT8 *) Hole;
+    for (Variable = Hole; IsValidVariableHeader (Variable, LastEnd); Variable = GetNextVariablePtr (Variable)) {
+      WriteStart = (UINT8 *) Variable;
+      if ((UINTN) (WriteEnd - WriteStart) <= Budget) {
+        break;
+      }
+    }
+    ASSERT (WriteStart < WriteEnd);
+
+    Buffer = AllocatePool (WriteEnd - WriteStart);
+    if (Buffer == NULL) {
+      return EFI_OUT_OF_RESOURCES;
+    }
+    SetMem (Buffer, WriteEnd - WriteStart, 0xff);
+  } else {
+    //
+    // Pack the variables to keep at the hole, and cover the rest of the window with
+    // a deleted filler variable. The hole itself is dropped, so the gap always has
+    // room for the filler header.
+    //
+    WriteStart = (UINT8 *) Hole;
+    WriteEnd   = (UINT8 *) Hole + PackedSize + FillerHeaderSize;
+
+    Buffer = AllocateZeroPool (WriteEnd - WriteStart);
+    if (Buffer == NULL) {
+      return EFI_OUT_OF_RESOURCES;
+    }
+    PackedSize = 0;
+    for (Variable = Hole; Variable < WindowEnd; Variable = NextVariable) {
+      NextVariable = GetNextVariablePtr (Variable);
+      if (!IsReclaimDroppedVariable (Variable)) {
+        VariableSize = (UINTN) NextVariable - (UINTN) Variable;
+        CopyMem (Buffer + PackedSize, Variable, VariableSize);
+        PackedSize += VariableSize;
+      }
+    }
+
+    Filler = (VARIABLE_HEADER *) (Buffer + PackedSize);
+    Filler->StartId = VARIABLE_DATA;
+    Filler->State   = VAR_ADDED & VAR_DELETED;
+    SetNameSizeOfVariable (Filler, sizeof (CHAR16));
+    SetDataSizeOfVariable (Filler, (UINTN) WindowEnd - (UINTN) Hole - PackedSize - FillerHeaderSize);
+    ASSERT ((UINTN) GetNextVariablePtr (Filler) - (UINTN) Buffer == (UINTN) WindowEnd - (UINTN) Hole);
+  }
+
+  Status = FtwVariableRange (
+             mVariableModuleGlobal->VariableGlobal.NonVolatileVariableBase,
+             (UINTN) WriteStart - (UINTN) mNvVariableCache,
+             Buffer,
+             WriteEnd - WriteStart
+             );
+  if (!EFI_ERROR (Status)) {
+    //
+    // Move the dropped variables out of the space totals, the filler takes their place.
+    //
+    for (Variable = Hole; IsValidVariableHeader (Variable, WindowEnd); Variable = NextVariable) {
+      NextVariable = GetNextVariablePtr (Variable);
+      if ((PackedSize == 0) ? ((UINT8 *) Variable >= WriteStart) : IsReclaimDroppedVariable (Variable)) {
+        UpdateVariableTotalSize (Variable, (UINTN) NextVariable - (UINTN) Variable, FALSE);
+      }
+    }
+    if (PackedSize != 0) {
+      UpdateVariableTotalSize (Filler, (UINTN) WindowEnd - (UINTN) Hole - PackedSize, TRUE);
+    }
+
+    RecordVariableReclaim (StartTick, WriteEnd - WriteStart);
+  }
+  FreePool (Buffer);
+
+  //
+  // Refresh the cache from the store, whether or not the write went through.
+  //
+  CopyMem (
+    WriteStart,
+    (UINT8 *) (UINTN) mVariableModuleGlobal->VariableGlobal.NonVolatileVariableBase + ((UINTN) WriteStart - (UINTN) mNvVariableCache),
+    WriteEnd - WriteStart
+    );
+  InvalidateVariableStoreIndex (VariableStoreTypeNv);
+
+  if (!EFI_ERROR (Status) && (PackedSize == 0)) {
+    //
+    // The chain now ends where the erase started, which is inside the old chain.
+    //
+    ASSERT ((VARIABLE_HEADER *) WriteStart < LastEnd);
+    mVariableModuleGlobal->NonVolatileLastVariableOffset = (UINTN) WriteStart - (UINTN) mNvVariableCache;
+  }
+
+  return Status;
+}
+
+/**
+  Run the incremental reclaim of the non-volatile variable store when it is
+  short of space.
+
+  The store is compacted when less than a quarter of the common variable space
+  is left and at least an eighth of it can be reclaimed. Nothing is done at
+  runtime, or when PcdVariableReclaimStepSize is 0.
+
+  The caller must hold the variable services lock.
+
+  @param[in] StepCount          The largest number of steps to run.
+
+**/
+VOID
+ReclaimNonVolatileIncrementally (
+  IN UINTN                  StepCount
+  )
+{
+  VARIABLE_HEADER           *LastEnd;
+  VARIABLE_HEADER           *Variable;
+  VARIABLE_HEADER           *NextVariable;
+  UINTN                     ReclaimableSize;
+  UINTN                     Step;
+
+  if ((PcdGet32 (PcdVariableReclaimStepSize) == 0) || AtRuntime () ||
+      (mVariableModuleGlobal->FvbInstance == NULL) ||
+      (mVariableModuleGlobal->CommonVariableTotalSize < mVariableModuleGlobal->CommonVariableSpace - mVariableModuleGlobal->CommonVariableSpace / 4)) {
+    return;
+  }
+
+  LastEnd = (VARIABLE_HEADER *) ((UINTN) mNvVariableCache + mVariableModuleGlobal->NonVolatileLastVariableOffset);
+  ReclaimableSize = 0;
+  for (Variable = GetStartPointer (mNvVariableCache); IsValidVariableHeader (Variable, LastEnd); Variable = NextVariable) {
+    NextVariable = GetNextVariablePtr (Variable);
+    if (IsReclaimDroppedVariable (Variable)) {
+      ReclaimableSize += (UINTN) NextVariable - (UINTN) Variable;
+    }
+  }
+  if (ReclaimableSize < mVariableModuleGlobal->CommonVariableSpace / 8) {
+    return;
+  }
+
+  for (Step = 0; Step < StepCount; Step++) {
+    if (EFI_ERROR (ReclaimNonVolatileStep (PcdGet32 (PcdVariableReclaimStepSize)))) {
+      break;
+    }
+  }
+}
+
+
 /**
   Finds variable in storage blocks of volatile and non-volatile storage areas.
 
@@ -3352,6 +3916,10 @@ VariableServiceSetVariable (
   }
 
 Done:
+  if (!EFI_ERROR (Status) && (mVariableModuleGlobal->VariableGlobal.ReentrantState == 1)) {
+    ReclaimNonVolatileIncrementally (1);
+  }
+  SynchronizeRuntimeVariableCache ();
   InterlockedDecrement (&mVariableModuleGlobal->VariableGlobal.ReentrantState);
   ReleaseLockOnlyAtBootTime (&mVariableModuleGlobal->VariableGlobal.VariableServicesLock);
 
@@ -3661,16 +4229,35 @@ ReclaimForOS(
        (RemainingCommonRuntimeVariableSpace < mVariableModuleGlobal->MaxAuthVariableSize)) ||
       ((PcdGet32 (PcdHwErrStorageSize) != 0) &&
        (RemainingHwErrVariableSpace < PcdGet32 (PcdMaxHardwareErrorVariableSize)))){
-    Status = Reclaim (
-            mVariableModuleGlobal->VariableGlobal.NonVolatileVariableBase,
-            &mVariableModuleGlobal->NonVolatileLastVariableOffset,
-            FALSE,
-            NULL,
-            NULL,
-            0
-            );
-    ASSERT_EFI_ERROR (Status);
+    Status = EFI_UNSUPPORTED;
+    if (PcdGet32 (PcdVariableReclaimStepSize) != 0) {
+      //
+      // Compact the store in bounded steps, and only fall back to the full reclaim on error.
+      //
+      do {
+        Status = ReclaimNonVolatileStep (PcdGet32 (PcdVariableReclaimStepSize));
+      } while (!EFI_ERROR (Status));
+    }
+    if (Status != EFI_NOT_FOUND) {
+      Status = Reclaim (
+              mVariableModuleGlobal->VariableGlobal.NonVolatileVariableBase,
+              &mVariableModuleGlobal->NonVolatileLastVariableOffset,
+              FALSE,
+              NULL,
+              NULL,
+              0
+              );
+      ASSERT_EFI_ERROR (Status);
+    }
   }
+
+  DEBUG ((
+    EFI_D_INFO,
+    "Variable: %d reclaims wrote 0x%lx bytes in %ld us\n",
+    mVariableModuleGlobal->ReclaimCount,
+    mVariableModuleGlobal->ReclaimBytesWritten,
+    DivU64x32 (mVariableModuleGlobal->ReclaimTime, 1000)
+    ));
 }
 
 /**
@@ -4179,6 +4766,8 @@ VariableCommonInitialize (
   VolatileVariableStore->Reserved    = 0;
   VolatileVariableStore->Reserved1   = 0;
 
+  InitializeVariableStoreIndex ();
+
   return EFI_SUCCESS;
 }
 
@@ -37,6 +37,7 @@ WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
 #include <Library/MemoryAllocationLib.h>
 #include <Library/AuthVariableLib.h>
 #include <Library/VarCheckLib.h>
+#include <Library/TimerLib.h>
 #include <Guid/GlobalVariable.h>
 #include <Guid/EventGroup.h>
 #include <Guid/VariableFormat.h>
@@ -88,6 +89,31 @@ typedef struct {
   BOOLEAN               AuthSupport;
 } VARIABLE_GLOBAL;
 
+///
+/// One slot of a variable store index. Offset is relative to the variable
+/// store header, so the index needs no conversion on SetVirtualAddressMap().
+///
+typedef struct {
+  UINT32  Hash;
+  UINT32  Offset;
+} VARIABLE_INDEX_ENTRY;
+
+///
+/// Name and GUID hash index of a variable store.
+/// Between two reclaims variables are only appended to a store, so the index
+/// remembers how far the store has been parsed and catches up on lookup.
+///
+typedef struct {
+  VARIABLE_INDEX_ENTRY  *Table;
+  UINT32                Capacity;
+  UINT32                Count;
+  //
+  // Offset of the first variable not in the index yet, 0 if the index must be rebuilt.
+  //
+  UINTN                 IndexedOffset;
+  volatile UINT32       Busy;
+} VARIABLE_STORE_INDEX;
+
 typedef struct {
   VARIABLE_GLOBAL VariableGlobal;
   UINTN           VolatileLastVariableOffset;
@@ -106,6 +132,13 @@ typedef struct {
   CHAR8           *PlatformLang;
   CHAR8           Lang[ISO_639_2_ENTRY_SIZE + 1];
   EFI_FIRMWARE_VOLUME_BLOCK_PROTOCOL *FvbInstance;
+  VARIABLE_STORE_INDEX            StoreIndex[VariableStoreTypeMax];
+  //
+  // Statistics of the reclaims of the non-volatile variable store, full or incremental.
+  //
+  UINTN           ReclaimCount;
+  UINT64          ReclaimBytesWritten;
+  UINT64          ReclaimTime;
 } VARIABLE_MODULE_GLOBAL;
 
 /**
@@ -142,6 +175,32 @@ FtwVariableSpace (
   IN VARIABLE_STORE_HEADER  *VariableBuffer
   );
 
+/**
+  Writes a buffer to a range of the variable storage space.
+
+  This function writes a buffer to a range of the variable storage space in
+  a firmware volume block device, starting at Offset from VariableBase.
+  Fault Tolerant Write protocol is used for writing, so the range is either
+  fully updated or left unchanged.
+
+  @param  VariableBase   Base address of the variable store.
+  @param  Offset         Offset in the variable store of the range to write.
+  @param  Buffer         Point to the data to write.
+  @param  Length         Size of the range in bytes.
+
+  @retval EFI_SUCCESS    The function completed successfully.
+  @retval EFI_NOT_FOUND  Fail to locate Fault Tolerant Write protocol.
+  @retval EFI_ABORTED    The function could not complete successfully.
+
+**/
+EFI_STATUS
+FtwVariableRange (
+  IN EFI_PHYSICAL_ADDRESS   VariableBase,
+  IN UINTN                  Offset,
+  IN UINT8                  *Buffer,
+  IN UINTN                  Length
+  );
+
 /**
   Finds variable in storage blocks of volatile and non-volatile storage areas.
 
@@ -260,6 +319,20 @@ DataSizeOfVariable (
   IN  VARIABLE_HEADER   *Variable
   );
 
+/**
+
+  This code gets the size of name of variable.
+
+  @param Variable        Pointer to the Variable Header.
+
+  @return UINTN          Size of variable in bytes.
+
+**/
+UINTN
+NameSizeOfVariable (
+  IN  VARIABLE_HEADER   *Variable
+  );
+
 /**
   This function is to check if the remaining variable space is enough to set
   all Variables from argument list successfully. The purpose of the check
@@ -330,6 +403,16 @@ AtRuntime (
   VOID
   );
 
+/**
+  Bring the runtime variable cache up to date after the variable stores have
+  been updated. Only the SMM variable driver keeps a runtime variable cache.
+
+**/
+VOID
+SynchronizeRuntimeVariableCache (
+  VOID
+  );
+
 /**
   Initializes a basic mutual exclusion lock.
 
@@ -448,6 +531,24 @@ ReclaimForOS(
   VOID
   );
 
+/**
+  Run the incremental reclaim of the non-volatile variable store when it is
+  short of space.
+
+  The store is compacted when less than a quarter of the common variable space
+  is left and at least an eighth of it can be reclaimed. Nothing is done at
+  runtime, or when PcdVariableReclaimStepSize is 0.
+
+  The caller must hold the variable services lock.
+
+  @param[in] StepCount          The largest number of steps to run.
+
+**/
+VOID
+ReclaimNonVolatileIncrementally (
+  IN UINTN                  StepCount
+  );
+
 /**
   Get non-volatile maximum variable size.
 
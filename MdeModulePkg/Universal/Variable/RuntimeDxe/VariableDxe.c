@@ -16,6 +16,7 @@ WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
 **/
 
 #include "Variable.h"
+#include <Guid/IdleLoopEvent.h>
 
 extern VARIABLE_STORE_HEADER        *mNvVariableCache;
 extern EFI_FIRMWARE_VOLUME_HEADER   *mNvFvHeaderCache;
@@ -23,6 +24,9 @@ extern VARIABLE_INFO_ENTRY          *gVariableInfo;
 EFI_HANDLE                          mHandle                    = NULL;
 EFI_EVENT                           mVirtualAddressChangeEvent = NULL;
 EFI_EVENT                           mFtwRegistration           = NULL;
+EFI_EVENT                           mVariableReclaimTimer      = NULL;
+EFI_EVENT                           mVariableReclaimIdleEvent  = NULL;
+BOOLEAN                             mVariableReclaimPending    = FALSE;
 extern BOOLEAN                      mEndOfDxe;
 VOID                                ***mVarCheckAddressPointer = NULL;
 UINTN                               mVarCheckAddressPointerCount = 0;
@@ -55,6 +59,21 @@ AtRuntime (
   return EfiAtRuntime ();
 }
 
+/**
+  Bring the runtime variable cache up to date after the variable stores have
+  been updated.
+
+  The variable stores of this driver are in runtime memory already, so there
+  is no runtime variable cache to update.
+
+**/
+VOID
+SynchronizeRuntimeVariableCache (
+  VOID
+  )
+{
+}
+
 
 /**
   Initializes a basic mutual exclusion lock.
@@ -254,6 +273,9 @@ VariableClassAddressChangeEvent (
   EfiConvertPointer (0x0, (VOID **) &mVariableModuleGlobal->VariableGlobal.NonVolatileVariableBase);
   EfiConvertPointer (0x0, (VOID **) &mVariableModuleGlobal->VariableGlobal.VolatileVariableBase);
   EfiConvertPointer (0x0, (VOID **) &mVariableModuleGlobal->VariableGlobal.HobVariableBase);
+  for (Index = 0; Index < VariableStoreTypeMax; Index++) {
+    EfiConvertPointer (0x0, (VOID **) &mVariableModuleGlobal->StoreIndex[Index].Table);
+  }
   EfiConvertPointer (0x0, (VOID **) &mVariableModuleGlobal);
   EfiConvertPointer (0x0, (VOID **) &mNvVariableCache);
   EfiConvertPointer (0x0, (VOID **) &mNvFvHeaderCache);
@@ -301,6 +323,14 @@ OnReadyToBoot (
     //
     InitializeVariableQuota ();
   }
+  if (mVariableReclaimTimer != NULL) {
+    gBS->CloseEvent (mVariableReclaimTimer);
+    mVariableReclaimTimer = NULL;
+  }
+  if (mVariableReclaimIdleEvent != NULL) {
+    gBS->CloseEvent (mVariableReclaimIdleEvent);
+    mVariableReclaimIdleEvent = NULL;
+  }
   ReclaimForOS ();
   if (FeaturePcdGet (PcdVariableCollectStatistics)) {
     if (mVariableModuleGlobal->VariableGlobal.AuthFormat) {
@@ -343,6 +373,54 @@ OnEndOfDxe (
   gBS->CloseEvent (Event);
 }
 
+/**
+  Notification function of the variable reclaim timer.
+
+  It only requests a step of the incremental reclaim, the flash is written from
+  the idle loop.
+
+  @param  Event        Event whose notification function is being invoked.
+  @param  Context      Pointer to the notification function's context.
+
+**/
+VOID
+EFIAPI
+OnVariableReclaimTimer (
+  EFI_EVENT                               Event,
+  VOID                                    *Context
+  )
+{
+  mVariableReclaimPending = TRUE;
+}
+
+/**
+  Notification function of the idle loop event group.
+
+  While the boot manager has not been reached, it runs the step of the incremental
+  reclaim of the non-volatile variable store requested by the reclaim timer, so
+  the store is compacted before a SetVariable() has to wait for a full reclaim.
+
+  @param  Event        Event whose notification function is being invoked.
+  @param  Context      Pointer to the notification function's context.
+
+**/
+VOID
+EFIAPI
+OnVariableReclaimIdle (
+  EFI_EVENT                               Event,
+  VOID                                    *Context
+  )
+{
+  if (!mVariableReclaimPending) {
+    return;
+  }
+  mVariableReclaimPending = FALSE;
+
+  AcquireLockOnlyAtBootTime (&mVariableModuleGlobal->VariableGlobal.VariableServicesLock);
+  ReclaimNonVolatileIncrementally (1);
+  ReleaseLockOnlyAtBootTime (&mVariableModuleGlobal->VariableGlobal.VariableServicesLock);
+}
+
 /**
   Fault Tolerant Write protocol notification event handler.
 
@@ -425,6 +503,32 @@ FtwNotificationEvent (
     DEBUG ((DEBUG_ERROR, "Variable write service initialization failed. Status = %r\n", Status));
   }
 
+  if (PcdGet32 (PcdVariableReclaimStepSize) != 0) {
+    Status = gBS->CreateEvent (
+                    EVT_TIMER | EVT_NOTIFY_SIGNAL,
+                    TPL_CALLBACK,
+                    OnVariableReclaimTimer,
+                    NULL,
+                    &mVariableReclaimTimer
+                    );
+    if (!EFI_ERROR (Status)) {
+      Status = gBS->CreateEventEx (
+                      EVT_NOTIFY_SIGNAL,
+                      TPL_CALLBACK,
+                      OnVariableReclaimIdle,
+                      NULL,
+                      &gIdleLoopEventGuid,
+                      &mVariableReclaimIdleEvent
+                      );
+      if (EFI_ERROR (Status)) {
+        gBS->CloseEvent (mVariableReclaimTimer);
+        mVariableReclaimTimer = NULL;
+      } else {
+        gBS->SetTimer (mVariableReclaimTimer, TimerPeriodic, EFI_TIMER_PERIOD_MILLISECONDS (100));
+      }
+    }
+  }
+
   //
   // Some Secure Boot Policy Var (SecureBoot, etc) updates following other
   // Secure Boot Policy Variable change. Record their initial value.
@@ -45,6 +45,9 @@ UINT8                                                *mVariableBufferPayload = N
 UINTN                                                mVariableBufferPayloadSize;
 extern BOOLEAN                                       mEndOfDxe;
 extern VAR_CHECK_REQUEST_SOURCE                      mRequestSource;
+extern VARIABLE_STORE_HEADER                         *mNvVariableCache;
+SMM_VARIABLE_RUNTIME_CACHE_HEADER                    *mVariableRuntimeCache  = NULL;
+UINTN                                                mVariableRuntimeCacheSize;
 
 /**
   SecureBoot Hook for SetVariable.
@@ -132,6 +135,178 @@ AtRuntime (
   return mAtRuntime;
 }
 
+/**
+  Check whether the variables of a vendor GUID are kept in the runtime variable cache.
+
+  @param[in] VendorGuid     Variable vendor GUID.
+
+  @retval TRUE              The variables of VendorGuid are cached.
+  @retval FALSE             The variables of VendorGuid are not cached.
+
+**/
+BOOLEAN
+IsRuntimeCacheVendorGuid (
+  IN EFI_GUID               *VendorGuid
+  )
+{
+  EFI_GUID                  *GuidList;
+  UINTN                     Count;
+  UINTN                     Index;
+
+  GuidList = (EFI_GUID *) PcdGetPtr (PcdVariableRuntimeCacheVendorGuids);
+  Count    = PcdGetSize (PcdVariableRuntimeCacheVendorGuids) / sizeof (EFI_GUID);
+  for (Index = 0; Index < Count; Index++) {
+    if (IsZeroGuid (&GuidList[Index]) || CompareGuid (&GuidList[Index], VendorGuid)) {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+/**
+  Bring the runtime variable cache up to date after the variable stores have
+  been updated.
+
+  The cache is rebuilt from the runtime accessible variables of the cached
+  vendor GUIDs, in the order VariableServiceGetNextVariableName() returns them.
+  Nothing is done before ExitBootServices(), as the boot time only variables
+  must not be copied out of SMRAM.
+
+**/
+VOID
+SynchronizeRuntimeVariableCache (
+  VOID
+  )
+{
+  EFI_STATUS                        Status;
+  SMM_VARIABLE_RUNTIME_CACHE_ENTRY  *Entry;
+  VARIABLE_HEADER                   *Variable;
+  CHAR16                            EmptyName;
+  CHAR16                            *VariableName;
+  EFI_GUID                          *VendorGuid;
+  UINTN                             NameSize;
+  UINTN                             DataSize;
+  UINTN                             EntrySize;
+  UINTN                             Offset;
+  UINT32                            Ready;
+
+  if ((mVariableRuntimeCache == NULL) || !AtRuntime ()) {
+    return;
+  }
+
+  //
+  // An odd sequence tells the readers that the cache is being rebuilt.
+  //
+  mVariableRuntimeCache->Sequence++;
+  MemoryFence ();
+
+  EmptyName    = L'\0';
+  VariableName = &EmptyName;
+  VendorGuid   = NULL;
+  Offset       = sizeof (SMM_VARIABLE_RUNTIME_CACHE_HEADER);
+  Ready        = 1;
+  while (TRUE) {
+    Status = VariableServiceGetNextVariableInternal (VariableName, VendorGuid, &Variable);
+    if (EFI_ERROR (Status)) {
+      break;
+    }
+    VariableName = GetVariableNamePtr (Variable);
+    VendorGuid   = GetVendorGuidPtr (Variable);
+    if (((Variable->Attributes & EFI_VARIABLE_RUNTIME_ACCESS) == 0) || !IsRuntimeCacheVendorGuid (VendorGuid)) {
+      continue;
+    }
+
+    NameSize  = NameSizeOfVariable (Variable);
+    DataSize  = DataSizeOfVariable (Variable);
+    EntrySize = ALIGN_VALUE (sizeof (SMM_VARIABLE_RUNTIME_CACHE_ENTRY) + NameSize + DataSize, sizeof (UINT32));
+    if (EntrySize > mVariableRuntimeCacheSize - Offset) {
+      //
+      // Cannot happen with the size computed from the variable stores, but
+      // an incomplete cache must not be used.
+      //
+      Ready = 0;
+      break;
+    }
+
+    Entry = (SMM_VARIABLE_RUNTIME_CACHE_ENTRY *) ((UINTN) mVariableRuntimeCache + Offset);
+    CopyGuid (&Entry->VendorGuid, VendorGuid);
+    Entry->Attributes = Variable->Attributes;
+    Entry->NameSize   = (UINT32) NameSize;
+    Entry->DataSize   = (UINT32) DataSize;
+    CopyMem (Entry + 1, VariableName, NameSize);
+    CopyMem ((UINT8 *) (Entry + 1) + NameSize, GetVariableDataPtr (Variable), DataSize);
+    Offset += EntrySize;
+  }
+
+  mVariableRuntimeCache->EntriesSize = Offset - sizeof (SMM_VARIABLE_RUNTIME_CACHE_HEADER);
+  mVariableRuntimeCache->Ready       = Ready;
+  MemoryFence ();
+  mVariableRuntimeCache->Sequence++;
+}
+
+/**
+  Register the runtime variable cache buffer provided by the non-SMM variable driver.
+
+  Caution: This function may receive untrusted input.
+  The cache buffer is external input, so this function will validate it is outside SMRAM.
+
+  @param[in]      CacheBuffer       The physical address of the cache.
+  @param[in, out] CacheSize         On input, the size of the cache in bytes.
+                                    On output, the size the cache needs if it is too small.
+
+  @retval EFI_SUCCESS               The cache is registered.
+  @retval EFI_UNSUPPORTED           The runtime variable cache is disabled.
+  @retval EFI_BUFFER_TOO_SMALL      The cache is too small, CacheSize returns the size it needs.
+  @retval EFI_ACCESS_DENIED         A cache is registered already, the End of DXE
+                                    event has been signaled or the buffer is not valid.
+
+**/
+EFI_STATUS
+InitRuntimeVariableCache (
+  IN     EFI_PHYSICAL_ADDRESS       CacheBuffer,
+  IN OUT UINT64                     *CacheSize
+  )
+{
+  UINT64                            Size;
+  UINTN                             RequiredSize;
+
+  if (PcdGetSize (PcdVariableRuntimeCacheVendorGuids) < sizeof (EFI_GUID)) {
+    return EFI_UNSUPPORTED;
+  }
+
+  if (mEndOfDxe || (mVariableRuntimeCache != NULL)) {
+    return EFI_ACCESS_DENIED;
+  }
+
+  //
+  // A cache entry is smaller than the variable header it is copied from.
+  //
+  RequiredSize = sizeof (SMM_VARIABLE_RUNTIME_CACHE_HEADER) +
+                 ((VARIABLE_STORE_HEADER *) (UINTN) mVariableModuleGlobal->VariableGlobal.VolatileVariableBase)->Size +
+                 mNvVariableCache->Size;
+  if (mVariableModuleGlobal->VariableGlobal.HobVariableBase != 0) {
+    RequiredSize += ((VARIABLE_STORE_HEADER *) (UINTN) mVariableModuleGlobal->VariableGlobal.HobVariableBase)->Size;
+  }
+
+  Size = *CacheSize;
+  if (Size < RequiredSize) {
+    *CacheSize = RequiredSize;
+    return EFI_BUFFER_TOO_SMALL;
+  }
+
+  if ((CacheBuffer == 0) || (Size > MAX_UINTN) ||
+      !SmmIsBufferOutsideSmmValid ((UINTN) CacheBuffer, (UINTN) Size)) {
+    return EFI_ACCESS_DENIED;
+  }
+
+  mVariableRuntimeCache     = (SMM_VARIABLE_RUNTIME_CACHE_HEADER *) (UINTN) CacheBuffer;
+  mVariableRuntimeCacheSize = (UINTN) Size;
+  ZeroMem (mVariableRuntimeCache, sizeof (SMM_VARIABLE_RUNTIME_CACHE_HEADER));
+
+  return EFI_SUCCESS;
+}
+
 /**
   Initializes a basic mutual exclusion lock.
 
@@ -476,6 +651,7 @@ SmmVariableHandler (
   VARIABLE_INFO_ENTRY                              *VariableInfo;
   SMM_VARIABLE_COMMUNICATE_LOCK_VARIABLE           *VariableToLock;
   SMM_VARIABLE_COMMUNICATE_VAR_CHECK_VARIABLE_PROPERTY *CommVariableProperty;
+  SMM_VARIABLE_COMMUNICATE_RUNTIME_VARIABLE_CACHE  *RuntimeVariableCache;
   UINTN                                            InfoSize;
   UINTN                                            NameBufferSize;
   UINTN                                            CommBufferPayloadSize;
@@ -692,6 +868,7 @@ SmmVariableHandler (
 
     case SMM_VARIABLE_FUNCTION_EXIT_BOOT_SERVICE:
       mAtRuntime = TRUE;
+      SynchronizeRuntimeVariableCache ();
       Status = EFI_SUCCESS;
       break;
 
@@ -781,6 +958,23 @@ SmmVariableHandler (
       CopyMem (SmmVariableFunctionHeader->Data, mVariableBufferPayload, CommBufferPayloadSize);
       break;
 
+    case SMM_VARIABLE_FUNCTION_INIT_RUNTIME_VARIABLE_CACHE:
+      if (CommBufferPayloadSize < sizeof (SMM_VARIABLE_COMMUNICATE_RUNTIME_VARIABLE_CACHE)) {
+        DEBUG ((EFI_D_ERROR, "InitRuntimeVariableCache: SMM communication buffer size invalid!\n"));
+        return EFI_SUCCESS;
+      }
+      //
+      // Copy the input communicate buffer payload to pre-allocated SMM variable buffer payload.
+      //
+      CopyMem (mVariableBufferPayload, SmmVariableFunctionHeader->Data, CommBufferPayloadSize);
+      RuntimeVariableCache = (SMM_VARIABLE_COMMUNICATE_RUNTIME_VARIABLE_CACHE *) mVariableBufferPayload;
+      Status = InitRuntimeVariableCache (
+                 RuntimeVariableCache->CacheBuffer,
+                 &RuntimeVariableCache->CacheSize
+                 );
+      CopyMem (SmmVariableFunctionHeader->Data, mVariableBufferPayload, CommBufferPayloadSize);
+      break;
+
     default:
       Status = EFI_UNSUPPORTED;
   }
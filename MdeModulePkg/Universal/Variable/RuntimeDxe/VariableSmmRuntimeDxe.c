@@ -40,6 +40,7 @@ WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
 #include <Library/DebugLib.h>
 #include <Library/UefiLib.h>
 #include <Library/BaseLib.h>
+#include <Library/PcdLib.h>
 
 #include <Guid/EventGroup.h>
 #include <Guid/SmmVariableCommon.h>
@@ -55,6 +56,8 @@ UINTN                            mVariableBufferPayloadSize;
 EFI_LOCK                         mVariableServicesLock;
 EDKII_VARIABLE_LOCK_PROTOCOL     mVariableLock;
 EDKII_VAR_CHECK_PROTOCOL         mVarCheck;
+SMM_VARIABLE_RUNTIME_CACHE_HEADER *mVariableRuntimeCache    = NULL;
+UINTN                            mVariableRuntimeCacheSize;
 
 /**
   SecureBoot Hook for SetVariable.
@@ -442,6 +445,292 @@ Done:
   return Status;
 }
 
+/**
+  Check whether the variables of a vendor GUID are kept in the runtime variable cache.
+
+  @param[in] VendorGuid     Variable vendor GUID, or NULL to check whether the
+                            variables of all vendor GUIDs are cached.
+
+  @retval TRUE              The variables of VendorGuid are cached.
+  @retval FALSE             The variables of VendorGuid are not cached.
+
+**/
+BOOLEAN
+IsRuntimeCacheVendorGuid (
+  IN EFI_GUID               *VendorGuid OPTIONAL
+  )
+{
+  EFI_GUID                  *GuidList;
+  UINTN                     Count;
+  UINTN                     Index;
+
+  GuidList = (EFI_GUID *) PcdGetPtr (PcdVariableRuntimeCacheVendorGuids);
+  Count    = PcdGetSize (PcdVariableRuntimeCacheVendorGuids) / sizeof (EFI_GUID);
+  for (Index = 0; Index < Count; Index++) {
+    if (IsZeroGuid (&GuidList[Index]) ||
+        ((VendorGuid != NULL) && CompareGuid (&GuidList[Index], VendorGuid))) {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+/**
+  Find a variable in the runtime variable cache.
+
+  The cache is written by SMM, so every entry is checked to be inside the cache
+  before it is used.
+
+  @param[in]  VariableName  Name of the variable, or an empty string for the first variable.
+  @param[in]  VendorGuid    Vendor GUID of the variable.
+  @param[in]  Next          TRUE to return the variable after the one found.
+
+  @return The cache entry, or NULL if the variable is not in the cache. If
+          VariableName is not empty and is not in the cache, Next is ignored.
+
+**/
+SMM_VARIABLE_RUNTIME_CACHE_ENTRY *
+FindRuntimeCacheEntry (
+  IN CHAR16                 *VariableName,
+  IN EFI_GUID               *VendorGuid,
+  IN BOOLEAN                Next
+  )
+{
+  SMM_VARIABLE_RUNTIME_CACHE_ENTRY  *Entry;
+  UINTN                             EntriesSize;
+  UINTN                             Offset;
+  UINTN                             NameSize;
+  UINTN                             DataSize;
+  UINTN                             VariableNameSize;
+  BOOLEAN                           Found;
+
+  EntriesSize = (UINTN) MIN (mVariableRuntimeCache->EntriesSize, mVariableRuntimeCacheSize - sizeof (SMM_VARIABLE_RUNTIME_CACHE_HEADER));
+  VariableNameSize = StrSize (VariableName);
+  Found = (BOOLEAN) (VariableName[0] == 0);
+
+  for (Offset = 0; EntriesSize - Offset >= sizeof (SMM_VARIABLE_RUNTIME_CACHE_ENTRY); ) {
+    Entry    = (SMM_VARIABLE_RUNTIME_CACHE_ENTRY *) ((UINTN) (mVariableRuntimeCache + 1) + Offset);
+    NameSize = Entry->NameSize;
+    DataSize = Entry->DataSize;
+    if ((NameSize > EntriesSize - Offset - sizeof (SMM_VARIABLE_RUNTIME_CACHE_ENTRY)) ||
+        (DataSize > EntriesSize - Offset - sizeof (SMM_VARIABLE_RUNTIME_CACHE_ENTRY) - NameSize)) {
+      return NULL;
+    }
+
+    if (Found) {
+      return Entry;
+    }
+    if ((NameSize == VariableNameSize) &&
+        CompareGuid (&Entry->VendorGuid, VendorGuid) &&
+        (CompareMem (Entry + 1, VariableName, NameSize) == 0)) {
+      if (!Next) {
+        return Entry;
+      }
+      Found = TRUE;
+    }
+
+    Offset += ALIGN_VALUE (sizeof (SMM_VARIABLE_RUNTIME_CACHE_ENTRY) + NameSize + DataSize, sizeof (UINT32));
+  }
+
+  return NULL;
+}
+
+/**
+  Start reading the runtime variable cache.
+
+  @param[out] Sequence      The sequence of the cache to check in EndRuntimeCacheRead().
+
+  @retval TRUE              The cache can be read.
+  @retval FALSE             The cache cannot be used, the variable must be read through SMM.
+
+**/
+BOOLEAN
+StartRuntimeCacheRead (
+  OUT UINT32                *Sequence
+  )
+{
+  if ((mVariableRuntimeCache == NULL) || !EfiAtRuntime ()) {
+    return FALSE;
+  }
+
+  *Sequence = *(volatile UINT32 *) &mVariableRuntimeCache->Sequence;
+  MemoryFence ();
+  return (BOOLEAN) (((*Sequence & BIT0) == 0) && (mVariableRuntimeCache->Ready != 0));
+}
+
+/**
+  Check that the runtime variable cache was not rebuilt while it was read.
+
+  @param[in] Sequence       The sequence returned by StartRuntimeCacheRead().
+
+  @retval TRUE              What was read from the cache is consistent.
+  @retval FALSE             The cache was rebuilt, the variable must be read through SMM.
+
+**/
+BOOLEAN
+EndRuntimeCacheRead (
+  IN UINT32                 Sequence
+  )
+{
+  MemoryFence ();
+  return (BOOLEAN) (*(volatile UINT32 *) &mVariableRuntimeCache->Sequence == Sequence);
+}
+
+/**
+  Get a variable from the runtime variable cache.
+
+  @param[in]      VariableName       Name of Variable to be found.
+  @param[in]      VendorGuid         Variable vendor GUID.
+  @param[out]     Attributes         Attribute value of the variable found.
+  @param[in, out] DataSize           Size of Data found. If size is less than the
+                                     data, this value contains the required size.
+  @param[out]     Data               Data pointer.
+  @param[out]     Status             The status of the GetVariable() call.
+
+  @retval TRUE                       The variable was read from the cache and Status is set.
+  @retval FALSE                      The variable must be read through SMM.
+
+**/
+BOOLEAN
+GetVariableFromRuntimeCache (
+  IN      CHAR16                            *VariableName,
+  IN      EFI_GUID                          *VendorGuid,
+  OUT     UINT32                            *Attributes OPTIONAL,
+  IN OUT  UINTN                             *DataSize,
+  OUT     VOID                              *Data,
+  OUT     EFI_STATUS                        *Status
+  )
+{
+  SMM_VARIABLE_RUNTIME_CACHE_ENTRY          *Entry;
+  UINT32                                    Sequence;
+  UINT32                                    EntryAttributes;
+  UINTN                                     EntryDataSize;
+
+  //
+  // The empty name is left to SMM to reject.
+  //
+  if ((VariableName[0] == 0) || !IsRuntimeCacheVendorGuid (VendorGuid) || !StartRuntimeCacheRead (&Sequence)) {
+    return FALSE;
+  }
+
+  EntryAttributes = 0;
+  EntryDataSize   = 0;
+  Entry = FindRuntimeCacheEntry (VariableName, VendorGuid, FALSE);
+  if (Entry == NULL) {
+    *Status = EFI_NOT_FOUND;
+  } else {
+    EntryAttributes = Entry->Attributes;
+    EntryDataSize   = Entry->DataSize;
+    if (*DataSize < EntryDataSize) {
+      *Status = EFI_BUFFER_TOO_SMALL;
+    } else if (Data == NULL) {
+      *Status = EFI_INVALID_PARAMETER;
+    } else {
+      CopyMem (Data, (UINT8 *) (Entry + 1) + Entry->NameSize, EntryDataSize);
+      *Status = EFI_SUCCESS;
+    }
+  }
+
+  //
+  // DataSize and Attributes are only updated once the cache is known to be
+  // consistent, as they are the input of the SMM request otherwise.
+  //
+  if (!EndRuntimeCacheRead (Sequence)) {
+    return FALSE;
+  }
+
+  if (Entry != NULL) {
+    *DataSize = EntryDataSize;
+    if (Attributes != NULL) {
+      *Attributes = EntryAttributes;
+    }
+  }
+  return TRUE;
+}
+
+/**
+  Get the next variable name from the runtime variable cache.
+
+  The name is copied to the caller only once the cache is known to be
+  consistent, as it is the input of the SMM request otherwise.
+
+  @param[in, out] VariableNameSize   Size of the variable name.
+  @param[in, out] VariableName       Pointer to variable name.
+  @param[in, out] VendorGuid         Variable Vendor Guid.
+  @param[out]     Status             The status of the GetNextVariableName() call.
+
+  @retval TRUE                       The name was read from the cache and Status is set.
+  @retval FALSE                      The name must be read through SMM.
+
+**/
+BOOLEAN
+GetNextVariableNameFromRuntimeCache (
+  IN OUT  UINTN                             *VariableNameSize,
+  IN OUT  CHAR16                            *VariableName,
+  IN OUT  EFI_GUID                          *VendorGuid,
+  OUT     EFI_STATUS                        *Status
+  )
+{
+  SMM_VARIABLE_RUNTIME_CACHE_ENTRY          *Entry;
+  UINT32                                    Sequence;
+  UINTN                                     NameSize;
+  EFI_GUID                                  NextGuid;
+  CHAR16                                    *NameBuffer;
+
+  //
+  // The cache only has all the variables if it has the variables of all vendor
+  // GUIDs. A name that does not fit in VariableNameSize is left to SMM to reject.
+  //
+  if (!IsRuntimeCacheVendorGuid (NULL) || (StrSize (VariableName) > *VariableNameSize) ||
+      !StartRuntimeCacheRead (&Sequence)) {
+    return FALSE;
+  }
+
+  //
+  // Stage the name in the communicate buffer, which is not in use at runtime.
+  //
+  NameBuffer = (CHAR16 *) (mVariableBuffer + SMM_COMMUNICATE_HEADER_SIZE + SMM_VARIABLE_COMMUNICATE_HEADER_SIZE);
+  NameSize   = 0;
+
+  if ((VariableName[0] != 0) && (FindRuntimeCacheEntry (VariableName, VendorGuid, FALSE) == NULL)) {
+    //
+    // There is no way to get the next variable of a variable that does not exist.
+    //
+    *Status = EFI_INVALID_PARAMETER;
+  } else {
+    Entry = FindRuntimeCacheEntry (VariableName, VendorGuid, TRUE);
+    if (Entry == NULL) {
+      *Status = EFI_NOT_FOUND;
+    } else {
+      NameSize = Entry->NameSize;
+      if (NameSize > mVariableBufferPayloadSize) {
+        return FALSE;
+      }
+      CopyGuid (&NextGuid, &Entry->VendorGuid);
+      if (*VariableNameSize < NameSize) {
+        *Status = EFI_BUFFER_TOO_SMALL;
+      } else {
+        CopyMem (NameBuffer, Entry + 1, NameSize);
+        *Status = EFI_SUCCESS;
+      }
+    }
+  }
+
+  if (!EndRuntimeCacheRead (Sequence)) {
+    return FALSE;
+  }
+
+  if ((*Status == EFI_SUCCESS) || (*Status == EFI_BUFFER_TOO_SMALL)) {
+    *VariableNameSize = NameSize;
+  }
+  if (*Status == EFI_SUCCESS) {
+    CopyMem (VariableName, NameBuffer, NameSize);
+    CopyGuid (VendorGuid, &NextGuid);
+  }
+  return TRUE;
+}
+
 /**
   This code finds variable in storage blocks (Volatile or Non-Volatile).
 
@@ -492,6 +781,10 @@ RuntimeServiceGetVariable (
     return EFI_INVALID_PARAMETER;
   }
 
+  if (GetVariableFromRuntimeCache (VariableName, VendorGuid, Attributes, DataSize, Data, &Status)) {
+    return Status;
+  }
+
   AcquireLockOnlyAtBootTime(&mVariableServicesLock);
 
   //
@@ -599,6 +892,10 @@ RuntimeServiceGetNextVariableName (
     return EFI_INVALID_PARAMETER;
   }
 
+  if (GetNextVariableNameFromRuntimeCache (VariableNameSize, VariableName, VendorGuid, &Status)) {
+    return Status;
+  }
+
   AcquireLockOnlyAtBootTime(&mVariableServicesLock);
 
   //
@@ -911,6 +1208,7 @@ VariableAddressChangeEvent (
 {
   EfiConvertPointer (0x0, (VOID **) &mVariableBuffer);
   EfiConvertPointer (0x0, (VOID **) &mSmmCommunication);
+  EfiConvertPointer (0x0, (VOID **) &mVariableRuntimeCache);
 }
 
 /**
@@ -987,6 +1285,80 @@ Done:
   return Status;
 }
 
+/**
+  Register a runtime variable cache with the SMM variable driver.
+
+  SMM fills the cache at ExitBootServices and refreshes it on each SetVariable(),
+  so GetVariable() and GetNextVariableName() can read it at OS runtime without
+  an SMI. The variable services fall back to SMM if the cache is not registered.
+
+**/
+VOID
+InitRuntimeVariableCache (
+  VOID
+  )
+{
+  EFI_STATUS                                      Status;
+  SMM_VARIABLE_COMMUNICATE_RUNTIME_VARIABLE_CACHE *SmmRuntimeVariableCache;
+  UINTN                                           CacheSize;
+  VOID                                            *CacheBuffer;
+
+  if (PcdGetSize (PcdVariableRuntimeCacheVendorGuids) < sizeof (EFI_GUID)) {
+    return;
+  }
+
+  CacheBuffer = NULL;
+  CacheSize   = 0;
+
+  AcquireLockOnlyAtBootTime (&mVariableServicesLock);
+
+  //
+  // Ask SMM for the size of the cache.
+  //
+  Status = InitCommunicateBuffer ((VOID **) &SmmRuntimeVariableCache, sizeof (*SmmRuntimeVariableCache), SMM_VARIABLE_FUNCTION_INIT_RUNTIME_VARIABLE_CACHE);
+  if (EFI_ERROR (Status)) {
+    goto Done;
+  }
+  ASSERT (SmmRuntimeVariableCache != NULL);
+
+  SmmRuntimeVariableCache->CacheBuffer = 0;
+  SmmRuntimeVariableCache->CacheSize   = 0;
+  Status = SendCommunicateBuffer (sizeof (*SmmRuntimeVariableCache));
+  if ((Status != EFI_BUFFER_TOO_SMALL) || (SmmRuntimeVariableCache->CacheSize > MAX_UINTN - EFI_PAGE_SIZE)) {
+    goto Done;
+  }
+
+  CacheSize   = EFI_PAGES_TO_SIZE (EFI_SIZE_TO_PAGES ((UINTN) SmmRuntimeVariableCache->CacheSize));
+  CacheBuffer = AllocateRuntimePages (EFI_SIZE_TO_PAGES (CacheSize));
+  if (CacheBuffer == NULL) {
+    Status = EFI_OUT_OF_RESOURCES;
+    goto Done;
+  }
+  ZeroMem (CacheBuffer, CacheSize);
+
+  //
+  // Register the cache.
+  //
+  Status = InitCommunicateBuffer ((VOID **) &SmmRuntimeVariableCache, sizeof (*SmmRuntimeVariableCache), SMM_VARIABLE_FUNCTION_INIT_RUNTIME_VARIABLE_CACHE);
+  ASSERT_EFI_ERROR (Status);
+  SmmRuntimeVariableCache->CacheBuffer = (EFI_PHYSICAL_ADDRESS) (UINTN) CacheBuffer;
+  SmmRuntimeVariableCache->CacheSize   = CacheSize;
+  Status = SendCommunicateBuffer (sizeof (*SmmRuntimeVariableCache));
+  if (EFI_ERROR (Status)) {
+    FreePages (CacheBuffer, EFI_SIZE_TO_PAGES (CacheSize));
+    goto Done;
+  }
+
+  mVariableRuntimeCache     = CacheBuffer;
+  mVariableRuntimeCacheSize = CacheSize;
+
+Done:
+  ReleaseLockOnlyAtBootTime (&mVariableServicesLock);
+  if (mVariableRuntimeCache == NULL) {
+    DEBUG ((EFI_D_INFO, "Variable: Runtime variable cache is not used - %r\n", Status));
+  }
+}
+
 /**
   Initialize variable service and install Variable Architectural protocol.
 
@@ -1025,6 +1397,8 @@ SmmVariableReady (
   //
   mVariableBufferPhysical = mVariableBuffer;
 
+  InitRuntimeVariableCache ();
+
   gRT->GetVariable         = RuntimeServiceGetVariable;
   gRT->GetNextVariableName = RuntimeServiceGetNextVariableName;
   gRT->SetVariable         = RuntimeServiceSetVariable;
@@ -136,7 +136,7 @@ typedef struct {
 //
 #define VRING_DESC_F_NEXT     BIT0 // more descriptors in this request
 #define VRING_DESC_F_WRITE    BIT1 // buffer to be written *by the host*
-#define VRING_DESC_F_INDIRECT BIT2 // unused
+#define VRING_DESC_F_INDIRECT BIT2 // buffer contains a descriptor table
 
 #pragma pack(1)
 typedef struct {
@@ -1,14 +1,16 @@
 /** @file
 
-  This driver produces Block I/O Protocol instances for virtio-blk devices.
+  This driver produces Block I/O and Block I/O 2 Protocol instances for
+  virtio-blk devices.
 
   The implementation is basic:
 
   - No attach/detach (ie. removable media).
 
-  - Although the non-blocking interfaces of EFI_BLOCK_IO2_PROTOCOL could be a
-    good match for multiple in-flight virtio-blk requests, we stick to
-    synchronous requests and EFI_BLOCK_IO_PROTOCOL for now.
+  - EFI_BLOCK_IO2_PROTOCOL requests with a token are queued to the virtqueue,
+    with several of them in flight, and retired by a timer event, as the host
+    doesn't interrupt us. Indirect descriptors are used when the host offers
+    them, so that every request needs a single descriptor of the virtqueue.
 
   Copyright (C) 2012, Red Hat, Inc.
   Copyright (c) 2012 - 2016, Intel Corporation. All rights reserved.<BR>
@@ -184,20 +186,244 @@ VerifyReadWriteRequest (
 
 /**
 
-  Format a read / write / flush request as three consecutive virtio
-  descriptors, push them to the host, and poll for the response.
+  Fill in a virtio descriptor.
 
-  This is the main workhorse function. Two use cases are supported, read/write
-  and flush. The function may only be called after the request parameters have
-  been verified by
-  - specific checks in ReadBlocks() / WriteBlocks() / FlushBlocks(), and
+  @param[out] Desc               The descriptor to fill in.
+
+  @param[in] BufferDeviceAddress (Bus master device) start address of the
+                                 buffer.
+
+  @param[in] BufferSize          Number of bytes in the buffer.
+
+  @param[in] Flags               A bitmask of VRING_DESC_F_* flags.
+
+  @param[in] Next                The index of the next descriptor in the same
+                                 table, interpreted by the host only if Flags
+                                 has VRING_DESC_F_NEXT set.
+
+**/
+
+STATIC
+VOID
+SetDesc (
+  OUT volatile VRING_DESC *Desc,
+  IN  UINT64              BufferDeviceAddress,
+  IN  UINT32              BufferSize,
+  IN  UINT16              Flags,
+  IN  UINT16              Next
+  )
+{
+  Desc->Addr  = BufferDeviceAddress;
+  Desc->Len   = BufferSize;
+  Desc->Flags = Flags;
+  Desc->Next  = Next;
+}
+
+
+/**
+
+  Retire a request that the host has marked as used.
+
+  The data buffer is unmapped, and the result of the request is derived from
+  the host status. Non-blocking requests report the result through their
+  token, whose event is signaled, and their slot is released. Blocking
+  requests leave the result in the slot, for SynchronousRequest() to collect.
+
+  The caller is responsible for running at TPL_NOTIFY.
+
+  @param[in,out] Dev   The virtio-blk device the request was targeted at.
+
+  @param[in] SlotIdx   The slot of the request.
+
+**/
+
+STATIC
+VOID
+CompleteRequest (
+  IN OUT VBLK_DEV *Dev,
+  IN     UINT16   SlotIdx
+  )
+{
+  VBLK_REQ_SLOT *Slot;
+  EFI_STATUS    Status;
+  EFI_STATUS    UnmapStatus;
+
+  Slot = &Dev->Slots[SlotIdx];
+  ASSERT (Slot->State == VblkSlotBusy);
+
+  Status = (Dev->SharedReqs[SlotIdx].HostStatus == VIRTIO_BLK_S_OK) ?
+           EFI_SUCCESS :
+           EFI_DEVICE_ERROR;
+
+  if (Slot->BufferSize > 0) {
+    UnmapStatus = Dev->VirtIo->UnmapSharedBuffer (Dev->VirtIo,
+                                 Slot->BufferMapping);
+    if (EFI_ERROR (UnmapStatus) && !Slot->RequestIsWrite &&
+        !EFI_ERROR (Status)) {
+      //
+      // Data from the bus master may not reach the caller; fail the request.
+      //
+      Status = EFI_DEVICE_ERROR;
+    }
+  }
+
+  if (Slot->Token == NULL) {
+    Slot->Status = Status;
+    Slot->State  = VblkSlotDone;
+    return;
+  }
+
+  Slot->Token->TransactionStatus = Status;
+  gBS->SignalEvent (Slot->Token->Event);
+  Slot->Token = NULL;
+  Slot->State = VblkSlotFree;
+
+  ASSERT (Dev->AsyncCount > 0);
+  if (--Dev->AsyncCount == 0) {
+    gBS->SetTimer (Dev->CompletionTimer, TimerCancel, 0);
+  }
+}
+
+
+/**
+
+  Retire all requests that the host has marked as used since the last call.
+
+  virtio-0.9.5, 2.4.2 Receiving Used Buffers From the Device. The head
+  descriptor index in each used element identifies the request slot, see
+  SubmitRequest().
+
+  The caller is responsible for running at TPL_NOTIFY.
+
+  @param[in,out] Dev  The virtio-blk device to process the used ring of.
+
+**/
+
+STATIC
+VOID
+ReapRequests (
+  IN OUT VBLK_DEV *Dev
+  )
+{
+  volatile CONST VRING_USED_ELEM *UsedElem;
+  UINT16                         UsedIdx;
+  UINT32                         HeadDescIdx;
+
+  MemoryFence ();
+  UsedIdx = *Dev->Ring.Used.Idx;
+  MemoryFence ();
+
+  while (Dev->LastUsedIdx != UsedIdx) {
+    UsedElem    = &Dev->Ring.Used.UsedElem[Dev->LastUsedIdx %
+                                           Dev->Ring.QueueSize];
+    HeadDescIdx = UsedElem->Id;
+    Dev->LastUsedIdx++;
+
+    if (!Dev->IndirectDesc) {
+      ASSERT (HeadDescIdx % 3 == 0);
+      HeadDescIdx /= 3;
+    }
+    ASSERT (HeadDescIdx < Dev->SlotCount);
+    CompleteRequest (Dev, (UINT16) HeadDescIdx);
+  }
+}
+
+
+/**
+
+  Timer event notification function that retires the non-blocking requests
+  the host has completed.
+
+  @param[in] Event    Event whose notification function is being invoked.
+
+  @param[in] Context  Pointer to the VBLK_DEV structure.
+
+**/
+
+STATIC
+VOID
+EFIAPI
+VirtioBlkCompletionTimer (
+  IN  EFI_EVENT Event,
+  IN  VOID      *Context
+  )
+{
+  ReapRequests (Context);
+}
+
+
+/**
+
+  Wait until no request is in flight in the virtqueue.
+
+  Blocking requests that complete meanwhile keep their slots, so this function
+  must not be called while the caller itself has a blocking request in flight.
+
+  @param[in,out] Dev  The virtio-blk device to drain.
+
+**/
+
+STATIC
+VOID
+DrainRequests (
+  IN OUT VBLK_DEV *Dev
+  )
+{
+  EFI_TPL OldTpl;
+  UINTN   AsyncCount;
+  UINTN   PollPeriodUsecs;
+
+  PollPeriodUsecs = 1;
+  for (;;) {
+    OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
+    ReapRequests (Dev);
+    AsyncCount = Dev->AsyncCount;
+    gBS->RestoreTPL (OldTpl);
+    if (AsyncCount == 0) {
+      break;
+    }
+
+    gBS->Stall (PollPeriodUsecs);
+    if (PollPeriodUsecs < 1024) {
+      PollPeriodUsecs *= 2;
+    }
+  }
+}
+
+
+/**
+
+  Format a read / write / flush request as a virtio descriptor chain, and push
+  it to the host without waiting for it to complete.
+
+  The request is placed in a free request slot. Slot N owns descriptor N of
+  the virtqueue if indirect descriptors have been negotiated, and descriptors
+  3*N to 3*N+2 otherwise, so the head descriptor index reported by the host
+  identifies the slot, and descriptors never need to be tracked individually.
+  If no slot is free but a non-blocking request holds one, the host is polled,
+  at the caller's TPL, until that request completes. Slots held by blocking
+  requests are only released by their callers, which the current caller has
+  preempted, so if all slots are held by blocking requests the function fails
+  rather than waiting for them.
+
+  The function may only be called after the request parameters have been
+  verified by
+  - specific checks in ReadBlocks() / WriteBlocks() / FlushBlocks() and their
+    BlockIo2 counterparts, and
   - VerifyReadWriteRequest() (for read/write only).
 
   Parameters handled commonly:
 
-    @param[in] Dev             The virtio-blk device the request is targeted
+    @param[in,out] Dev         The virtio-blk device the request is targeted
                                at.
 
+    @param[in] Token           The token to complete when the host has
+                               processed the request, or NULL if the caller
+                               will wait for the request with
+                               SynchronousRequest().
+
+    @param[out] SlotIdx        The slot the request was placed in.
+
   Flush request:
 
     @param[in] Lba             Must be zero.
@@ -223,44 +449,43 @@ VerifyReadWriteRequest (
     @param[in] RequestIsWrite  TRUE iff data transfer goes from guest to
                                device.
 
-  Return values are common to both use cases, and are appropriate to be
-  forwarded by the EFI_BLOCK_IO_PROTOCOL functions (ReadBlocks(),
-  WriteBlocks(), FlushBlocks()).
 
+  @retval EFI_SUCCESS          The request has been submitted.
 
-  @retval EFI_SUCCESS          Transfer complete.
+  @retval EFI_OUT_OF_RESOURCES All request slots are held by blocking requests
+                               that the caller has preempted.
 
   @retval EFI_DEVICE_ERROR     Failed to notify host side via VirtIo write, or
-                               unable to parse host response, or host response
-                               is not VIRTIO_BLK_S_OK or failed to map Buffer
-                               for a bus master operation.
+                               failed to map Buffer for a bus master
+                               operation.
 
 **/
 
 STATIC
 EFI_STATUS
-EFIAPI
-SynchronousRequest (
-  IN              VBLK_DEV *Dev,
-  IN              EFI_LBA  Lba,
-  IN              UINTN    BufferSize,
-  IN OUT volatile VOID     *Buffer,
-  IN              BOOLEAN  RequestIsWrite
+SubmitRequest (
+  IN OUT          VBLK_DEV            *Dev,
+  IN              EFI_LBA             Lba,
+  IN              UINTN               BufferSize,
+  IN OUT volatile VOID                *Buffer,
+  IN              BOOLEAN             RequestIsWrite,
+  IN              EFI_BLOCK_IO2_TOKEN *Token        OPTIONAL,
+  OUT             UINT16              *SlotIdx
   )
 {
-  UINT32                  BlockSize;
-  volatile VIRTIO_BLK_REQ Request;
-  volatile UINT8          *HostStatus;
-  VOID                    *HostStatusBuffer;
-  DESC_INDICES            Indices;
-  VOID                    *RequestMapping;
-  VOID                    *StatusMapping;
-  VOID                    *BufferMapping;
-  EFI_PHYSICAL_ADDRESS    BufferDeviceAddress;
-  EFI_PHYSICAL_ADDRESS    HostStatusDeviceAddress;
-  EFI_PHYSICAL_ADDRESS    RequestDeviceAddress;
-  EFI_STATUS              Status;
-  EFI_STATUS              UnmapStatus;
+  UINT32               BlockSize;
+  VOID                 *BufferMapping;
+  EFI_PHYSICAL_ADDRESS BufferDeviceAddress;
+  EFI_PHYSICAL_ADDRESS SharedReqAddress;
+  VBLK_SHARED_REQ      *SharedReq;
+  volatile VRING_DESC  *Desc;
+  UINT16               DescIdx;
+  UINT16               Idx;
+  UINT16               AvailIdx;
+  EFI_TPL              OldTpl;
+  BOOLEAN              AsyncBusy;
+  UINTN                PollPeriodUsecs;
+  EFI_STATUS           Status;
 
   BlockSize = Dev->BlockIoMedia.BlockSize;
 
@@ -276,51 +501,11 @@ SynchronousRequest (
   ASSERT (BufferSize % BlockSize == 0);
 
   //
-  // Prepare virtio-blk request header, setting zero size for flush.
-  // IO Priority is homogeneously 0.
-  //
-  Request.Type   = RequestIsWrite ?
-                   (BufferSize == 0 ? VIRTIO_BLK_T_FLUSH : VIRTIO_BLK_T_OUT) :
-                   VIRTIO_BLK_T_IN;
-  Request.IoPrio = 0;
-  Request.Sector = MultU64x32(Lba, BlockSize / 512);
-
-  //
-  // Host status is bi-directional (we preset with a value and expect the
-  // device to update it). Allocate a host status buffer which can be mapped
-  // to access equally by both processor and the device.
-  //
-  Status = Dev->VirtIo->AllocateSharedPages (
-                          Dev->VirtIo,
-                          EFI_SIZE_TO_PAGES (sizeof *HostStatus),
-                          &HostStatusBuffer
-                          );
-  if (EFI_ERROR (Status)) {
-    return EFI_DEVICE_ERROR;
-  }
-
-  HostStatus = HostStatusBuffer;
-
-  //
-  // Map virtio-blk request header (must be done after request header is
-  // populated)
-  //
-  Status = VirtioMapAllBytesInSharedBuffer (
-             Dev->VirtIo,
-             VirtioOperationBusMasterRead,
-             (VOID *) &Request,
-             sizeof Request,
-             &RequestDeviceAddress,
-             &RequestMapping
-             );
-  if (EFI_ERROR (Status)) {
-    Status = EFI_DEVICE_ERROR;
-    goto FreeHostStatusBuffer;
-  }
-
-  //
-  // Map data buffer
+  // Map data buffer before entering TPL_NOTIFY; the mapping may have to
+  // allocate a bounce buffer.
   //
+  BufferMapping       = NULL;
+  BufferDeviceAddress = 0;
   if (BufferSize > 0) {
     Status = VirtioMapAllBytesInSharedBuffer (
                Dev->VirtIo,
@@ -333,51 +518,96 @@ SynchronousRequest (
                &BufferMapping
                );
     if (EFI_ERROR (Status)) {
-      Status = EFI_DEVICE_ERROR;
-      goto UnmapRequestBuffer;
+      return EFI_DEVICE_ERROR;
     }
   }
 
   //
-  // preset a host status for ourselves that we do not accept as success
+  // The virtqueue, the slots and the completion timer are shared with
+  // VirtioBlkCompletionTimer().
   //
-  *HostStatus = VIRTIO_BLK_S_IOERR;
+  PollPeriodUsecs = 1;
+  for (;;) {
+    OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
+    ReapRequests (Dev);
+
+    AsyncBusy = FALSE;
+    for (Idx = 0; Idx < Dev->SlotCount; Idx++) {
+      if (Dev->Slots[Idx].State == VblkSlotFree) {
+        break;
+      }
+      if (Dev->Slots[Idx].Token != NULL) {
+        AsyncBusy = TRUE;
+      }
+    }
+    if (Idx < Dev->SlotCount) {
+      break;
+    }
+    gBS->RestoreTPL (OldTpl);
+
+    if (!AsyncBusy) {
+      if (BufferSize > 0) {
+        Dev->VirtIo->UnmapSharedBuffer (Dev->VirtIo, BufferMapping);
+      }
+      return EFI_OUT_OF_RESOURCES;
+    }
+
+    gBS->Stall (PollPeriodUsecs);
+    if (PollPeriodUsecs < 1024) {
+      PollPeriodUsecs *= 2;
+    }
+  }
+
+  Dev->Slots[Idx].State          = VblkSlotBusy;
+  Dev->Slots[Idx].RequestIsWrite = RequestIsWrite;
+  Dev->Slots[Idx].BufferSize     = BufferSize;
+  Dev->Slots[Idx].BufferMapping  = BufferMapping;
+  Dev->Slots[Idx].Token          = Token;
+  if (Token != NULL && Dev->AsyncCount++ == 0) {
+    gBS->SetTimer (Dev->CompletionTimer, TimerPeriodic,
+           VBLK_COMPLETION_POLL_PERIOD);
+  }
 
   //
-  // Map the Status Buffer with VirtioOperationBusMasterCommonBuffer so that
-  // both processor and device can access it.
+  // Prepare virtio-blk request header, setting zero size for flush.
+  // IO Priority is homogeneously 0. Preset a host status for ourselves that
+  // we do not accept as success.
   //
-  Status = VirtioMapAllBytesInSharedBuffer (
-             Dev->VirtIo,
-             VirtioOperationBusMasterCommonBuffer,
-             HostStatusBuffer,
-             sizeof *HostStatus,
-             &HostStatusDeviceAddress,
-             &StatusMapping
-             );
-  if (EFI_ERROR (Status)) {
-    Status = EFI_DEVICE_ERROR;
-    goto UnmapDataBuffer;
-  }
+  SharedReq = &Dev->SharedReqs[Idx];
+  SharedReq->Request.Type   = RequestIsWrite ?
+                              (BufferSize == 0 ?
+                               VIRTIO_BLK_T_FLUSH :
+                               VIRTIO_BLK_T_OUT) :
+                              VIRTIO_BLK_T_IN;
+  SharedReq->Request.IoPrio = 0;
+  SharedReq->Request.Sector = MultU64x32 (Lba, BlockSize / 512);
+  SharedReq->HostStatus     = VIRTIO_BLK_S_IOERR;
 
-  VirtioPrepare (&Dev->Ring, &Indices);
+  SharedReqAddress = Dev->SharedReqsAddress + Idx * sizeof *SharedReq;
 
   //
-  // ensured by VirtioBlkInit() -- this predicate, in combination with the
-  // lock-step progress, ensures we don't have to track free descriptors.
+  // The chain is built either in the indirect table of the slot, or in the
+  // descriptors of the virtqueue owned by the slot.
   //
-  ASSERT (Dev->Ring.QueueSize >= 3);
+  if (Dev->IndirectDesc) {
+    Desc    = SharedReq->Indirect;
+    DescIdx = 0;
+  } else {
+    Desc    = Dev->Ring.Desc;
+    DescIdx = (UINT16) (Idx * 3);
+  }
 
   //
   // virtio-blk header in first desc
   //
-  VirtioAppendDesc (
-    &Dev->Ring,
-    RequestDeviceAddress,
-    sizeof Request,
+  SetDesc (
+    &Desc[DescIdx],
+    SharedReqAddress + OFFSET_OF (VBLK_SHARED_REQ, Request),
+    sizeof SharedReq->Request,
     VRING_DESC_F_NEXT,
-    &Indices
+    (UINT16) (DescIdx + 1)
     );
+  DescIdx++;
 
   //
   // data buffer for read/write in second desc
@@ -396,61 +626,179 @@ SynchronousRequest (
     //
     // VRING_DESC_F_WRITE is interpreted from the host's point of view.
     //
-    VirtioAppendDesc (
-      &Dev->Ring,
+    SetDesc (
+      &Desc[DescIdx],
       BufferDeviceAddress,
       (UINT32) BufferSize,
       VRING_DESC_F_NEXT | (RequestIsWrite ? 0 : VRING_DESC_F_WRITE),
-      &Indices
+      (UINT16) (DescIdx + 1)
       );
+    DescIdx++;
   }
 
   //
   // host status in last (second or third) desc
   //
-  VirtioAppendDesc (
-    &Dev->Ring,
-    HostStatusDeviceAddress,
-    sizeof *HostStatus,
+  SetDesc (
+    &Desc[DescIdx],
+    SharedReqAddress + OFFSET_OF (VBLK_SHARED_REQ, HostStatus),
+    sizeof SharedReq->HostStatus,
     VRING_DESC_F_WRITE,
-    &Indices
+    0
     );
+  DescIdx++;
 
-  //
-  // virtio-blk's only virtqueue is #0, called "requestq" (see Appendix D).
-  //
-  if (VirtioFlush (Dev->VirtIo, 0, &Dev->Ring, &Indices,
-        NULL) == EFI_SUCCESS &&
-      *HostStatus == VIRTIO_BLK_S_OK) {
-    Status = EFI_SUCCESS;
+  if (Dev->IndirectDesc) {
+    //
+    // virtio-1.0, 2.4.5.3 Indirect Descriptors
+    //
+    SetDesc (
+      &Dev->Ring.Desc[Idx],
+      SharedReqAddress + OFFSET_OF (VBLK_SHARED_REQ, Indirect),
+      (UINT32) (DescIdx * sizeof *Desc),
+      VRING_DESC_F_INDIRECT,
+      0
+      );
+    DescIdx = Idx;
   } else {
-    Status = EFI_DEVICE_ERROR;
+    DescIdx = (UINT16) (Idx * 3);
   }
 
-  Dev->VirtIo->UnmapSharedBuffer (Dev->VirtIo, StatusMapping);
+  //
+  // virtio-0.9.5, 2.4.1.2 Updating the Available Ring, and 2.4.1.3 Updating
+  // the Index Field
+  //
+  AvailIdx = *Dev->Ring.Avail.Idx;
+  Dev->Ring.Avail.Ring[AvailIdx++ % Dev->Ring.QueueSize] = DescIdx;
+  MemoryFence ();
+  *Dev->Ring.Avail.Idx = AvailIdx;
 
-UnmapDataBuffer:
-  if (BufferSize > 0) {
-    UnmapStatus = Dev->VirtIo->UnmapSharedBuffer (Dev->VirtIo, BufferMapping);
-    if (EFI_ERROR (UnmapStatus) && !RequestIsWrite && !EFI_ERROR (Status)) {
-      //
-      // Data from the bus master may not reach the caller; fail the request.
-      //
-      Status = EFI_DEVICE_ERROR;
-    }
+  //
+  // virtio-0.9.5, 2.4.1.4 Notifying the Device. virtio-blk's only virtqueue
+  // is #0, called "requestq" (see Appendix D).
+  //
+  MemoryFence ();
+  Status = Dev->VirtIo->SetQueueNotify (Dev->VirtIo, 0);
+  if (EFI_ERROR (Status)) {
+    //
+    // The request is visible to the host, which picks it up with the next
+    // notification; the slot is retired through the used ring like any other.
+    //
+    DEBUG ((DEBUG_ERROR, "%a: SetQueueNotify: %r\n", __FUNCTION__, Status));
   }
 
-UnmapRequestBuffer:
-  Dev->VirtIo->UnmapSharedBuffer (Dev->VirtIo, RequestMapping);
+  gBS->RestoreTPL (OldTpl);
 
-FreeHostStatusBuffer:
-  Dev->VirtIo->FreeSharedPages (
-                 Dev->VirtIo,
-                 EFI_SIZE_TO_PAGES (sizeof *HostStatus),
-                 HostStatusBuffer
-                 );
+  *SlotIdx = Idx;
+  return EFI_SUCCESS;
+}
 
-  return Status;
+
+/**
+
+  Format a read / write / flush request as a virtio descriptor chain, push it
+  to the host, and poll for the response.
+
+  Other requests may be in flight at the same time; see SubmitRequest(). The
+  function may only be called after the request parameters have been verified
+  by
+  - specific checks in ReadBlocks() / WriteBlocks() / FlushBlocks(), and
+  - VerifyReadWriteRequest() (for read/write only).
+
+  Parameters handled commonly:
+
+    @param[in] Dev             The virtio-blk device the request is targeted
+                               at.
+
+  Flush request:
+
+    @param[in] Lba             Must be zero.
+
+    @param[in] BufferSize      Must be zero.
+
+    @param[in out] Buffer      Ignored by the function.
+
+    @param[in] RequestIsWrite  Must be TRUE.
+
+  Read/Write request:
+
+    @param[in] Lba             Logical Block Address: number of logical blocks
+                               to skip from the beginning of the device.
+
+    @param[in] BufferSize      Size of buffer to transfer, in bytes. The caller
+                               is responsible to ensure this parameter is
+                               positive.
+
+    @param[in out] Buffer      The guest side area to read data from the device
+                               into, or write data to the device from.
+
+    @param[in] RequestIsWrite  TRUE iff data transfer goes from guest to
+                               device.
+
+  Return values are common to both use cases, and are appropriate to be
+  forwarded by the EFI_BLOCK_IO_PROTOCOL functions (ReadBlocks(),
+  WriteBlocks(), FlushBlocks()).
+
+
+  @retval EFI_SUCCESS          Transfer complete.
+
+  @retval EFI_OUT_OF_RESOURCES All request slots are held by blocking requests
+                               that the caller has preempted.
+
+  @retval EFI_DEVICE_ERROR     Failed to notify host side via VirtIo write, or
+                               unable to parse host response, or host response
+                               is not VIRTIO_BLK_S_OK or failed to map Buffer
+                               for a bus master operation.
+
+**/
+
+STATIC
+EFI_STATUS
+EFIAPI
+SynchronousRequest (
+  IN              VBLK_DEV *Dev,
+  IN              EFI_LBA  Lba,
+  IN              UINTN    BufferSize,
+  IN OUT volatile VOID     *Buffer,
+  IN              BOOLEAN  RequestIsWrite
+  )
+{
+  UINT16        SlotIdx;
+  VBLK_REQ_SLOT *Slot;
+  EFI_TPL       OldTpl;
+  BOOLEAN       Done;
+  UINTN         PollPeriodUsecs;
+  EFI_STATUS    Status;
+
+  Status = SubmitRequest (Dev, Lba, BufferSize, Buffer, RequestIsWrite, NULL,
+             &SlotIdx);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  //
+  // Keep slowing down until we reach a poll period of slightly above 1 ms.
+  //
+  Slot            = &Dev->Slots[SlotIdx];
+  PollPeriodUsecs = 1;
+  for (;;) {
+    OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
+    ReapRequests (Dev);
+    Done = (BOOLEAN) (Slot->State == VblkSlotDone);
+    if (Done) {
+      Status      = Slot->Status;
+      Slot->State = VblkSlotFree;
+    }
+    gBS->RestoreTPL (OldTpl);
+    if (Done) {
+      return Status;
+    }
+
+    gBS->Stall (PollPeriodUsecs); // calls AcpiTimerLib::MicroSecondDelay
+    if (PollPeriodUsecs < 1024) {
+      PollPeriodUsecs *= 2;
+    }
+  }
 }
 
 
@@ -591,15 +939,247 @@ VirtioBlkFlushBlocks (
   VBLK_DEV *Dev;
 
   Dev = VIRTIO_BLK_FROM_BLOCK_IO (This);
-  return Dev->BlockIoMedia.WriteCaching ?
-           SynchronousRequest (
+  if (!Dev->BlockIoMedia.WriteCaching) {
+    return EFI_SUCCESS;
+  }
+
+  //
+  // Make sure the flush covers the non-blocking writes in flight.
+  //
+  DrainRequests (Dev);
+  return SynchronousRequest (
+           Dev,
+           0,    // Lba
+           0,    // BufferSize
+           NULL, // Buffer
+           TRUE  // RequestIsWrite
+           );
+}
+
+
+//
+// UEFI Spec 2.6, 13.10 EFI Block I/O 2 Protocol
+//
+EFI_STATUS
+EFIAPI
+VirtioBlkResetEx (
+  IN EFI_BLOCK_IO2_PROTOCOL *This,
+  IN BOOLEAN                ExtendedVerification
+  )
+{
+  //
+  // The device keeps working as initialized; just let the requests in flight
+  // complete, so that no token is signaled after the reset returns.
+  //
+  DrainRequests (VIRTIO_BLK_FROM_BLOCK_IO2 (This));
+  return EFI_SUCCESS;
+}
+
+
+/**
+
+  Common implementation of ReadBlocksEx() and WriteBlocksEx().
+
+  @param[in] Dev             The virtio-blk device the request is targeted at.
+
+  @param[in] Lba             Logical Block Address: number of logical blocks
+                             to skip from the beginning of the device.
+
+  @param[in,out] Token       The token of the request, or NULL for a blocking
+                             request.
+
+  @param[in] BufferSize      Size of buffer to transfer, in bytes.
+
+  @param[in,out] Buffer      The guest side area to read data from the device
+                             into, or write data to the device from.
+
+  @param[in] RequestIsWrite  TRUE iff data transfer goes from guest to device.
+
+  @return  Validation results from VerifyReadWriteRequest(), status codes from
+           SubmitRequest() for non-blocking requests, or from
+           SynchronousRequest() for blocking ones.
+
+**/
+
+STATIC
+EFI_STATUS
+ReadWriteBlocksEx (
+  IN     VBLK_DEV            *Dev,
+  IN     EFI_LBA             Lba,
+  IN OUT EFI_BLOCK_IO2_TOKEN *Token OPTIONAL,
+  IN     UINTN               BufferSize,
+  IN OUT VOID                *Buffer,
+  IN     BOOLEAN             RequestIsWrite
+  )
+{
+  EFI_STATUS Status;
+  UINT16     SlotIdx;
+
+  if (Token != NULL && Token->Event == NULL) {
+    Token = NULL;
+  }
+
+  if (BufferSize == 0) {
+    if (Token != NULL) {
+      Token->TransactionStatus = EFI_SUCCESS;
+      gBS->SignalEvent (Token->Event);
+    }
+    return EFI_SUCCESS;
+  }
+
+  Status = VerifyReadWriteRequest (
+             &Dev->BlockIoMedia,
+             Lba,
+             BufferSize,
+             RequestIsWrite
+             );
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  if (Token == NULL) {
+    return SynchronousRequest (Dev, Lba, BufferSize, Buffer, RequestIsWrite);
+  }
+
+  Token->TransactionStatus = EFI_NOT_READY;
+  return SubmitRequest (Dev, Lba, BufferSize, Buffer, RequestIsWrite, Token,
+           &SlotIdx);
+}
+
+
+/**
+
+  ReadBlocksEx() operation for virtio-blk.
+
+  See
+  - UEFI Spec 2.6, 13.10 EFI Block I/O 2 Protocol,
+    EFI_BLOCK_IO2_PROTOCOL.ReadBlocksEx().
+  - Driver Writer's Guide for UEFI 2.3.1 v1.01, 24.2.2. ReadBlocks() and
+    ReadBlocksEx() Implementation.
+
+  If Token is NULL or Token->Event is NULL, the request is blocking. Otherwise
+  it is queued to the device, and Token->Event is signaled when it completes.
+
+**/
+
+EFI_STATUS
+EFIAPI
+VirtioBlkReadBlocksEx (
+  IN     EFI_BLOCK_IO2_PROTOCOL *This,
+  IN     UINT32                 MediaId,
+  IN     EFI_LBA                Lba,
+  IN OUT EFI_BLOCK_IO2_TOKEN    *Token,
+  IN     UINTN                  BufferSize,
+  OUT    VOID                   *Buffer
+  )
+{
+  return ReadWriteBlocksEx (
+           VIRTIO_BLK_FROM_BLOCK_IO2 (This),
+           Lba,
+           Token,
+           BufferSize,
+           Buffer,
+           FALSE       // RequestIsWrite
+           );
+}
+
+
+/**
+
+  WriteBlocksEx() operation for virtio-blk.
+
+  See
+  - UEFI Spec 2.6, 13.10 EFI Block I/O 2 Protocol,
+    EFI_BLOCK_IO2_PROTOCOL.WriteBlocksEx().
+  - Driver Writer's Guide for UEFI 2.3.1 v1.01, 24.2.3 WriteBlocks() and
+    WriteBlockEx() Implementation.
+
+  If Token is NULL or Token->Event is NULL, the request is blocking. Otherwise
+  it is queued to the device, and Token->Event is signaled when it completes.
+
+**/
+
+EFI_STATUS
+EFIAPI
+VirtioBlkWriteBlocksEx (
+  IN     EFI_BLOCK_IO2_PROTOCOL *This,
+  IN     UINT32                 MediaId,
+  IN     EFI_LBA                Lba,
+  IN OUT EFI_BLOCK_IO2_TOKEN    *Token,
+  IN     UINTN                  BufferSize,
+  IN     VOID                   *Buffer
+  )
+{
+  return ReadWriteBlocksEx (
+           VIRTIO_BLK_FROM_BLOCK_IO2 (This),
+           Lba,
+           Token,
+           BufferSize,
+           Buffer,
+           TRUE        // RequestIsWrite
+           );
+}
+
+
+/**
+
+  FlushBlocksEx() operation for virtio-blk.
+
+  See
+  - UEFI Spec 2.6, 13.10 EFI Block I/O 2 Protocol,
+    EFI_BLOCK_IO2_PROTOCOL.FlushBlocksEx().
+  - Driver Writer's Guide for UEFI 2.3.1 v1.01, 24.2.4 FlushBlocks() and
+    FlushBlocksEx() Implementation.
+
+  Requests already in flight are completed before the flush is queued, so that
+  it covers their data too.
+
+**/
+
+EFI_STATUS
+EFIAPI
+VirtioBlkFlushBlocksEx (
+  IN     EFI_BLOCK_IO2_PROTOCOL *This,
+  IN OUT EFI_BLOCK_IO2_TOKEN    *Token
+  )
+{
+  VBLK_DEV *Dev;
+  UINT16   SlotIdx;
+
+  Dev = VIRTIO_BLK_FROM_BLOCK_IO2 (This);
+  if (Token != NULL && Token->Event == NULL) {
+    Token = NULL;
+  }
+
+  if (!Dev->BlockIoMedia.WriteCaching) {
+    if (Token != NULL) {
+      Token->TransactionStatus = EFI_SUCCESS;
+      gBS->SignalEvent (Token->Event);
+    }
+    return EFI_SUCCESS;
+  }
+
+  DrainRequests (Dev);
+  if (Token == NULL) {
+    return SynchronousRequest (
              Dev,
              0,    // Lba
              0,    // BufferSize
              NULL, // Buffer
              TRUE  // RequestIsWrite
-             ) :
-           EFI_SUCCESS;
+             );
+  }
+
+  Token->TransactionStatus = EFI_NOT_READY;
+  return SubmitRequest (
+           Dev,
+           0,      // Lba
+           0,      // BufferSize
+           NULL,   // Buffer
+           TRUE,   // RequestIsWrite
+           Token,
+           &SlotIdx
+           );
 }
 
 
@@ -722,6 +1302,7 @@ VirtioBlkInit (
   UINT32     OptIoSize;
   UINT16     QueueSize;
   UINT64     RingBaseShift;
+  UINTN      SharedReqsPages;
 
   PhysicalBlockExp = 0;
   AlignmentOffset = 0;
@@ -815,8 +1396,8 @@ VirtioBlkInit (
   }
 
   Features &= VIRTIO_BLK_F_BLK_SIZE | VIRTIO_BLK_F_TOPOLOGY | VIRTIO_BLK_F_RO |
-              VIRTIO_BLK_F_FLUSH | VIRTIO_F_VERSION_1 |
-              VIRTIO_F_IOMMU_PLATFORM;
+              VIRTIO_BLK_F_FLUSH | VIRTIO_F_RING_INDIRECT_DESC |
+              VIRTIO_F_VERSION_1 | VIRTIO_F_IOMMU_PLATFORM;
 
   //
   // In virtio-1.0, feature negotiation is expected to complete before queue
@@ -840,11 +1421,19 @@ VirtioBlkInit (
   if (EFI_ERROR (Status)) {
     goto Failed;
   }
-  if (QueueSize < 3) { // SynchronousRequest() uses at most three descriptors
+  if (QueueSize < 3) { // SubmitRequest() uses at most three descriptors
     Status = EFI_UNSUPPORTED;
     goto Failed;
   }
 
+  //
+  // With indirect descriptors, every request takes up a single descriptor of
+  // the virtqueue; see SubmitRequest().
+  //
+  Dev->IndirectDesc = (BOOLEAN) ((Features & VIRTIO_F_RING_INDIRECT_DESC) != 0);
+  Dev->SlotCount    = (UINT16) MIN (VBLK_MAX_REQUESTS,
+                                 Dev->IndirectDesc ? QueueSize : QueueSize / 3);
+
   Status = VirtioRingInit (Dev->VirtIo, QueueSize, &Dev->Ring);
   if (EFI_ERROR (Status)) {
     goto Failed;
@@ -863,18 +1452,56 @@ VirtioBlkInit (
     goto ReleaseQueue;
   }
 
+  //
+  // Allocate and map the request headers, host status bytes and indirect
+  // descriptor tables of all request slots, for access by both processor and
+  // device. If anything fails from here on, we must release them.
+  //
+  SharedReqsPages = EFI_SIZE_TO_PAGES (VBLK_MAX_REQUESTS *
+                                       sizeof (VBLK_SHARED_REQ));
+  Status = Dev->VirtIo->AllocateSharedPages (
+                          Dev->VirtIo,
+                          SharedReqsPages,
+                          (VOID **) &Dev->SharedReqs
+                          );
+  if (EFI_ERROR (Status)) {
+    goto UnmapQueue;
+  }
+  ZeroMem (Dev->SharedReqs, EFI_PAGES_TO_SIZE (SharedReqsPages));
+
+  Status = VirtioMapAllBytesInSharedBuffer (
+             Dev->VirtIo,
+             VirtioOperationBusMasterCommonBuffer,
+             Dev->SharedReqs,
+             EFI_PAGES_TO_SIZE (SharedReqsPages),
+             &Dev->SharedReqsAddress,
+             &Dev->SharedReqsMap
+             );
+  if (EFI_ERROR (Status)) {
+    goto FreeSharedReqs;
+  }
+
+  //
+  // Completions are polled for; virtio-0.9.5, 2.4.2 Receiving Used Buffers
+  // From the Device.
+  //
+  *Dev->Ring.Avail.Flags = (UINT16) VRING_AVAIL_F_NO_INTERRUPT;
+  Dev->LastUsedIdx       = 0;
+  Dev->AsyncCount        = 0;
+  ZeroMem (Dev->Slots, sizeof Dev->Slots);
+
   //
   // Additional steps for MMIO: align the queue appropriately, and set the
-  // size. If anything fails from here on, we must unmap the ring resources.
+  // size.
   //
   Status = Dev->VirtIo->SetQueueNum (Dev->VirtIo, QueueSize);
   if (EFI_ERROR (Status)) {
-    goto UnmapQueue;
+    goto UnmapSharedReqs;
   }
 
   Status = Dev->VirtIo->SetQueueAlign (Dev->VirtIo, EFI_PAGE_SIZE);
   if (EFI_ERROR (Status)) {
-    goto UnmapQueue;
+    goto UnmapSharedReqs;
   }
 
   //
@@ -886,7 +1513,7 @@ VirtioBlkInit (
                           RingBaseShift
                           );
   if (EFI_ERROR (Status)) {
-    goto UnmapQueue;
+    goto UnmapSharedReqs;
   }
 
 
@@ -897,7 +1524,7 @@ VirtioBlkInit (
     Features &= ~(UINT64)(VIRTIO_F_VERSION_1 | VIRTIO_F_IOMMU_PLATFORM);
     Status = Dev->VirtIo->SetGuestFeatures (Dev->VirtIo, Features);
     if (EFI_ERROR (Status)) {
-      goto UnmapQueue;
+      goto UnmapSharedReqs;
     }
   }
 
@@ -907,7 +1534,7 @@ VirtioBlkInit (
   NextDevStat |= VSTAT_DRIVER_OK;
   Status = Dev->VirtIo->SetDeviceStatus (Dev->VirtIo, NextDevStat);
   if (EFI_ERROR (Status)) {
-    goto UnmapQueue;
+    goto UnmapSharedReqs;
   }
 
   //
@@ -931,9 +1558,17 @@ VirtioBlkInit (
   Dev->BlockIoMedia.LastBlock        = DivU64x32 (NumSectors,
                                          BlockSize / 512) - 1;
 
+  Dev->BlockIo2.Media                = &Dev->BlockIoMedia;
+  Dev->BlockIo2.Reset                = &VirtioBlkResetEx;
+  Dev->BlockIo2.ReadBlocksEx         = &VirtioBlkReadBlocksEx;
+  Dev->BlockIo2.WriteBlocksEx        = &VirtioBlkWriteBlocksEx;
+  Dev->BlockIo2.FlushBlocksEx        = &VirtioBlkFlushBlocksEx;
+
   DEBUG ((DEBUG_INFO, "%a: LbaSize=0x%x[B] NumBlocks=0x%Lx[Lba]\n",
     __FUNCTION__, Dev->BlockIoMedia.BlockSize,
     Dev->BlockIoMedia.LastBlock + 1));
+  DEBUG ((DEBUG_INFO, "%a: RequestSlots=%d IndirectDesc=%d\n", __FUNCTION__,
+    Dev->SlotCount, Dev->IndirectDesc));
 
   if (Features & VIRTIO_BLK_F_TOPOLOGY) {
     Dev->BlockIo.Revision = EFI_BLOCK_IO_PROTOCOL_REVISION3;
@@ -950,6 +1585,12 @@ VirtioBlkInit (
   }
   return EFI_SUCCESS;
 
+UnmapSharedReqs:
+  Dev->VirtIo->UnmapSharedBuffer (Dev->VirtIo, Dev->SharedReqsMap);
+
+FreeSharedReqs:
+  Dev->VirtIo->FreeSharedPages (Dev->VirtIo, SharedReqsPages, Dev->SharedReqs);
+
 UnmapQueue:
   Dev->VirtIo->UnmapSharedBuffer (Dev->VirtIo, Dev->RingMap);
 
@@ -991,10 +1632,18 @@ VirtioBlkUninit (
   //
   Dev->VirtIo->SetDeviceStatus (Dev->VirtIo, 0);
 
+  Dev->VirtIo->UnmapSharedBuffer (Dev->VirtIo, Dev->SharedReqsMap);
+  Dev->VirtIo->FreeSharedPages (
+                 Dev->VirtIo,
+                 EFI_SIZE_TO_PAGES (VBLK_MAX_REQUESTS *
+                                    sizeof (VBLK_SHARED_REQ)),
+                 Dev->SharedReqs
+                 );
   Dev->VirtIo->UnmapSharedBuffer (Dev->VirtIo, Dev->RingMap);
   VirtioRingUninit (Dev->VirtIo, &Dev->Ring);
 
   SetMem (&Dev->BlockIo,      sizeof Dev->BlockIo,      0x00);
+  SetMem (&Dev->BlockIo2,     sizeof Dev->BlockIo2,     0x00);
   SetMem (&Dev->BlockIoMedia, sizeof Dev->BlockIoMedia, 0x00);
 }
 
@@ -1030,9 +1679,10 @@ VirtioBlkExitBoot (
   Dev->VirtIo->SetDeviceStatus (Dev->VirtIo, 0);
 
   //
-  // Unmap the ring buffer so that hypervisor will not be able to get
-  // readable data after device is reset.
+  // Unmap the ring buffer and the request headers so that hypervisor will not
+  // be able to get readable data after device is reset.
   //
+  Dev->VirtIo->UnmapSharedBuffer (Dev->VirtIo, Dev->SharedReqsMap);
   Dev->VirtIo->UnmapSharedBuffer (Dev->VirtIo, Dev->RingMap);
 }
 
@@ -1088,12 +1738,22 @@ VirtioBlkDriverBindingStart (
     goto FreeVirtioBlk;
   }
 
+  //
+  // The timer that retires non-blocking requests is armed only while some are
+  // in flight.
+  //
+  Status = gBS->CreateEvent (EVT_TIMER | EVT_NOTIFY_SIGNAL, TPL_NOTIFY,
+                  &VirtioBlkCompletionTimer, Dev, &Dev->CompletionTimer);
+  if (EFI_ERROR (Status)) {
+    goto CloseVirtIo;
+  }
+
   //
   // VirtIo access granted, configure virtio-blk device.
   //
   Status = VirtioBlkInit (Dev);
   if (EFI_ERROR (Status)) {
-    goto CloseVirtIo;
+    goto CloseCompletionTimer;
   }
 
   Status = gBS->CreateEvent (EVT_SIGNAL_EXIT_BOOT_SERVICES, TPL_CALLBACK,
@@ -1103,12 +1763,14 @@ VirtioBlkDriverBindingStart (
   }
 
   //
-  // Setup complete, attempt to export the driver instance's BlockIo interface.
+  // Setup complete, attempt to export the driver instance's BlockIo and
+  // BlockIo2 interfaces.
   //
   Dev->Signature = VBLK_SIG;
-  Status = gBS->InstallProtocolInterface (&DeviceHandle,
-                  &gEfiBlockIoProtocolGuid, EFI_NATIVE_INTERFACE,
-                  &Dev->BlockIo);
+  Status = gBS->InstallMultipleProtocolInterfaces (&DeviceHandle,
+                  &gEfiBlockIoProtocolGuid, &Dev->BlockIo,
+                  &gEfiBlockIo2ProtocolGuid, &Dev->BlockIo2,
+                  NULL);
   if (EFI_ERROR (Status)) {
     goto CloseExitBoot;
   }
@@ -1121,6 +1783,9 @@ CloseExitBoot:
 UninitDev:
   VirtioBlkUninit (Dev);
 
+CloseCompletionTimer:
+  gBS->CloseEvent (Dev->CompletionTimer);
+
 CloseVirtIo:
   gBS->CloseProtocol (DeviceHandle, &gVirtioDeviceProtocolGuid,
          This->DriverBindingHandle, DeviceHandle);
@@ -1185,12 +1850,21 @@ VirtioBlkDriverBindingStop (
   //
   // Handle Stop() requests for in-use driver instances gracefully.
   //
-  Status = gBS->UninstallProtocolInterface (DeviceHandle,
-                  &gEfiBlockIoProtocolGuid, &Dev->BlockIo);
+  Status = gBS->UninstallMultipleProtocolInterfaces (DeviceHandle,
+                  &gEfiBlockIoProtocolGuid, &Dev->BlockIo,
+                  &gEfiBlockIo2ProtocolGuid, &Dev->BlockIo2,
+                  NULL);
   if (EFI_ERROR (Status)) {
     return Status;
   }
 
+  //
+  // Complete the non-blocking requests still in flight, so their tokens are
+  // not left pending.
+  //
+  DrainRequests (Dev);
+  gBS->CloseEvent (Dev->CompletionTimer);
+
   gBS->CloseEvent (Dev->ExitBoot);
 
   VirtioBlkUninit (Dev);
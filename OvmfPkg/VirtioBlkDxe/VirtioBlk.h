@@ -1,7 +1,7 @@
 /** @file
 
   Internal definitions for the virtio-blk driver, which produces Block I/O
-  Protocol instances for virtio-blk devices.
+  and Block I/O 2 Protocol instances for virtio-blk devices.
 
   Copyright (C) 2012, Red Hat, Inc.
 
@@ -19,6 +19,7 @@
 #define _VIRTIO_BLK_DXE_H_
 
 #include <Protocol/BlockIo.h>
+#include <Protocol/BlockIo2.h>
 #include <Protocol/ComponentName.h>
 #include <Protocol/DriverBinding.h>
 
@@ -27,6 +28,55 @@
 
 #define VBLK_SIG SIGNATURE_32 ('V', 'B', 'L', 'K')
 
+//
+// The number of requests that may be in flight in the virtqueue at the same
+// time. The actual limit also depends on the queue size; see VirtioBlkInit().
+//
+#define VBLK_MAX_REQUESTS 64
+
+//
+// The period of the timer event that reaps completed non-blocking requests.
+//
+#define VBLK_COMPLETION_POLL_PERIOD EFI_TIMER_PERIOD_MILLISECONDS (1)
+
+//
+// The part of a request that the device accesses, apart from the data buffer.
+// One such structure exists per request slot, in a single common buffer that
+// is mapped for the lifetime of the driver instance. When indirect descriptors
+// have been negotiated, the descriptor chain of the request is built in
+// Indirect, and the request takes up only one descriptor of the virtqueue.
+// The size of the structure is a multiple of 16 bytes, so that every Indirect
+// table is suitably aligned.
+//
+typedef struct {
+  VRING_DESC     Indirect[3];
+  VIRTIO_BLK_REQ Request;
+  UINT8          HostStatus;
+  UINT8          Reserved[15];
+} VBLK_SHARED_REQ;
+
+typedef enum {
+  VblkSlotFree,
+  VblkSlotBusy,
+  VblkSlotDone
+} VBLK_SLOT_STATE;
+
+//
+// The driver side bookkeeping of a request slot.
+//
+typedef struct {
+  VBLK_SLOT_STATE     State;
+  BOOLEAN             RequestIsWrite;
+  UINTN               BufferSize;
+  VOID                *BufferMapping;
+  //
+  // Token is NULL for blocking requests. Those are completed by the caller of
+  // SubmitRequest(), which collects Status once State is VblkSlotDone.
+  //
+  EFI_BLOCK_IO2_TOKEN *Token;
+  EFI_STATUS          Status;
+} VBLK_REQ_SLOT;
+
 typedef struct {
   //
   // Parts of this structure are initialized / torn down in various functions
@@ -38,15 +88,29 @@ typedef struct {
   UINT32                 Signature;            // DriverBindingStart  0
   VIRTIO_DEVICE_PROTOCOL *VirtIo;              // DriverBindingStart  0
   EFI_EVENT              ExitBoot;             // DriverBindingStart  0
+  EFI_EVENT              CompletionTimer;      // DriverBindingStart  0
   VRING                  Ring;                 // VirtioRingInit      2
   EFI_BLOCK_IO_PROTOCOL  BlockIo;              // VirtioBlkInit       1
+  EFI_BLOCK_IO2_PROTOCOL BlockIo2;             // VirtioBlkInit       1
   EFI_BLOCK_IO_MEDIA     BlockIoMedia;         // VirtioBlkInit       1
   VOID                   *RingMap;             // VirtioRingMap       2
+  BOOLEAN                IndirectDesc;         // VirtioBlkInit       1
+  UINT16                 SlotCount;            // VirtioBlkInit       1
+  VBLK_SHARED_REQ        *SharedReqs;          // VirtioBlkInit       1
+  EFI_PHYSICAL_ADDRESS   SharedReqsAddress;    // VirtioBlkInit       1
+  VOID                   *SharedReqsMap;       // VirtioBlkInit       1
+  UINT16                 LastUsedIdx;          // VirtioBlkInit       1
+  UINTN                  AsyncCount;           // VirtioBlkInit       1
+  VBLK_REQ_SLOT          Slots[VBLK_MAX_REQUESTS];
+                                               // VirtioBlkInit       1
 } VBLK_DEV;
 
 #define VIRTIO_BLK_FROM_BLOCK_IO(BlockIoPointer) \
         CR (BlockIoPointer, VBLK_DEV, BlockIo, VBLK_SIG)
 
+#define VIRTIO_BLK_FROM_BLOCK_IO2(BlockIo2Pointer) \
+        CR (BlockIo2Pointer, VBLK_DEV, BlockIo2, VBLK_SIG)
+
 
 /**
 
@@ -259,6 +323,94 @@ VirtioBlkFlushBlocks (
   );
 
 
+//
+// UEFI Spec 2.6, 13.10 EFI Block I/O 2 Protocol
+//
+EFI_STATUS
+EFIAPI
+VirtioBlkResetEx (
+  IN EFI_BLOCK_IO2_PROTOCOL *This,
+  IN BOOLEAN                ExtendedVerification
+  );
+
+
+/**
+
+  ReadBlocksEx() operation for virtio-blk.
+
+  See
+  - UEFI Spec 2.6, 13.10 EFI Block I/O 2 Protocol,
+    EFI_BLOCK_IO2_PROTOCOL.ReadBlocksEx().
+  - Driver Writer's Guide for UEFI 2.3.1 v1.01, 24.2.2. ReadBlocks() and
+    ReadBlocksEx() Implementation.
+
+  If Token is NULL or Token->Event is NULL, the request is blocking. Otherwise
+  it is queued to the device, and Token->Event is signaled when it completes.
+
+**/
+
+EFI_STATUS
+EFIAPI
+VirtioBlkReadBlocksEx (
+  IN     EFI_BLOCK_IO2_PROTOCOL *This,
+  IN     UINT32                 MediaId,
+  IN     EFI_LBA                Lba,
+  IN OUT EFI_BLOCK_IO2_TOKEN    *Token,
+  IN     UINTN                  BufferSize,
+  OUT    VOID                   *Buffer
+  );
+
+
+/**
+
+  WriteBlocksEx() operation for virtio-blk.
+
+  See
+  - UEFI Spec 2.6, 13.10 EFI Block I/O 2 Protocol,
+    EFI_BLOCK_IO2_PROTOCOL.WriteBlocksEx().
+  - Driver Writer's Guide for UEFI 2.3.1 v1.01, 24.2.3 WriteBlocks() and
+    WriteBlockEx() Implementation.
+
+  If Token is NULL or Token->Event is NULL, the request is blocking. Otherwise
+  it is queued to the device, and Token->Event is signaled when it completes.
+
+**/
+
+EFI_STATUS
+EFIAPI
+VirtioBlkWriteBlocksEx (
+  IN     EFI_BLOCK_IO2_PROTOCOL *This,
+  IN     UINT32                 MediaId,
+  IN     EFI_LBA                Lba,
+  IN OUT EFI_BLOCK_IO2_TOKEN    *Token,
+  IN     UINTN                  BufferSize,
+  IN     VOID                   *Buffer
+  );
+
+
+/**
+
+  FlushBlocksEx() operation for virtio-blk.
+
+  See
+  - UEFI Spec 2.6, 13.10 EFI Block I/O 2 Protocol,
+    EFI_BLOCK_IO2_PROTOCOL.FlushBlocksEx().
+  - Driver Writer's Guide for UEFI 2.3.1 v1.01, 24.2.4 FlushBlocks() and
+    FlushBlocksEx() Implementation.
+
+  Requests already in flight are completed before the flush is queued, so that
+  it covers their data too.
+
+**/
+
+EFI_STATUS
+EFIAPI
+VirtioBlkFlushBlocksEx (
+  IN     EFI_BLOCK_IO2_PROTOCOL *This,
+  IN OUT EFI_BLOCK_IO2_TOKEN    *Token
+  );
+
+
 //
 // The purpose of the following scaffolding (EFI_COMPONENT_NAME_PROTOCOL and
 // EFI_COMPONENT_NAME2_PROTOCOL implementation) is to format the driver's name
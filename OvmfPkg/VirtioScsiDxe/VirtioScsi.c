@@ -7,16 +7,17 @@
 
   - No hotplug / hot-unplug.
 
-  - Although EFI_EXT_SCSI_PASS_THRU_PROTOCOL.PassThru() could be a good match
-    for multiple in-flight virtio-scsi requests, we stick to synchronous
-    requests for now.
+  - EFI_EXT_SCSI_PASS_THRU_PROTOCOL.PassThru() is non-blocking when the caller
+    passes an Event. Several requests may be in flight in each request queue;
+    completions are polled for by a timer event.
 
   - Timeouts are not supported for EFI_EXT_SCSI_PASS_THRU_PROTOCOL.PassThru().
 
   - Only one channel is supported. (At the time of this writing, host-side
     virtio-scsi supports a single channel too.)
 
-  - Only one request queue is used (for the one synchronous request).
+  - Up to VSCSI_MAX_REQUEST_QUEUES request queues are used, if the host offers
+    them. Requests are steered to a queue by target.
 
   - The ResetChannel() and ResetTargetLun() functions of
     EFI_EXT_SCSI_PASS_THRU_PROTOCOL are not supported (which is allowed by the
@@ -419,73 +420,327 @@ ReportHostAdapterError (
 }
 
 
-//
-// The next seven functions implement EFI_EXT_SCSI_PASS_THRU_PROTOCOL
-// for the virtio-scsi HBA. Refer to UEFI Spec 2.3.1 + Errata C, sections
-// - 14.1 SCSI Driver Model Overview,
-// - 14.7 Extended SCSI Pass Thru Protocol.
-//
+/**
 
-EFI_STATUS
-EFIAPI
-VirtioScsiPassThru (
-  IN     EFI_EXT_SCSI_PASS_THRU_PROTOCOL            *This,
-  IN     UINT8                                      *Target,
-  IN     UINT64                                     Lun,
-  IN OUT EFI_EXT_SCSI_PASS_THRU_SCSI_REQUEST_PACKET *Packet,
-  IN     EFI_EVENT                                  Event   OPTIONAL
+  Fill in a virtio descriptor.
+
+  @param[out] Desc               The descriptor to fill in.
+
+  @param[in] BufferDeviceAddress (Bus master device) start address of the
+                                 buffer.
+
+  @param[in] BufferSize          Number of bytes in the buffer.
+
+  @param[in] Flags               A bitmask of VRING_DESC_F_* flags.
+
+  @param[in] Next                The index of the next descriptor in the same
+                                 table, interpreted by the host only if Flags
+                                 has VRING_DESC_F_NEXT set.
+
+**/
+STATIC
+VOID
+SetDesc (
+  OUT volatile VRING_DESC *Desc,
+  IN  UINT64              BufferDeviceAddress,
+  IN  UINT32              BufferSize,
+  IN  UINT16              Flags,
+  IN  UINT16              Next
   )
 {
-  VSCSI_DEV                 *Dev;
-  UINT16                    TargetValue;
-  EFI_STATUS                Status;
-  volatile VIRTIO_SCSI_REQ  Request;
-  volatile VIRTIO_SCSI_RESP *Response;
-  VOID                      *ResponseBuffer;
-  DESC_INDICES              Indices;
-  VOID                      *RequestMapping;
-  VOID                      *ResponseMapping;
-  VOID                      *InDataMapping;
-  VOID                      *OutDataMapping;
-  EFI_PHYSICAL_ADDRESS      RequestDeviceAddress;
-  EFI_PHYSICAL_ADDRESS      ResponseDeviceAddress;
-  EFI_PHYSICAL_ADDRESS      InDataDeviceAddress;
-  EFI_PHYSICAL_ADDRESS      OutDataDeviceAddress;
-  VOID                      *InDataBuffer;
-  UINTN                     InDataNumPages;
-  BOOLEAN                   OutDataBufferIsMapped;
-
-  ZeroMem ((VOID*) &Request, sizeof (Request));
+  Desc->Addr  = BufferDeviceAddress;
+  Desc->Len   = BufferSize;
+  Desc->Flags = Flags;
+  Desc->Next  = Next;
+}
 
-  Dev = VIRTIO_SCSI_FROM_PASS_THRU (This);
-  CopyMem (&TargetValue, Target, sizeof TargetValue);
 
-  InDataBuffer = NULL;
-  OutDataBufferIsMapped = FALSE;
-  InDataNumPages = 0;
+/**
 
-  Status = PopulateRequest (Dev, TargetValue, Lun, Packet, &Request);
-  if (EFI_ERROR (Status)) {
-    return Status;
+  Release the data buffer mappings of a request, and the intermediate input
+  buffer if any.
+
+  @param[in] Dev   The virtio-scsi host device the request was targeted at.
+
+  @param[in] Slot  The request slot (or the request slot to be) whose
+                   buffers should be released.
+
+**/
+STATIC
+VOID
+ReleaseRequestBuffers (
+  IN     VSCSI_DEV      *Dev,
+  IN OUT VSCSI_REQ_SLOT *Slot
+  )
+{
+  if (Slot->OutDataMapping != NULL) {
+    Dev->VirtIo->UnmapSharedBuffer (Dev->VirtIo, Slot->OutDataMapping);
+    Slot->OutDataMapping = NULL;
   }
+  if (Slot->InDataMapping != NULL) {
+    Dev->VirtIo->UnmapSharedBuffer (Dev->VirtIo, Slot->InDataMapping);
+    Slot->InDataMapping = NULL;
+  }
+  if (Slot->InDataBuffer != NULL) {
+    Dev->VirtIo->FreeSharedPages (Dev->VirtIo, Slot->InDataNumPages,
+                   Slot->InDataBuffer);
+    Slot->InDataBuffer = NULL;
+  }
+}
+
+
+/**
+
+  Retire a request that the host has marked as used.
+
+  The response is parsed into the Extended SCSI Pass Thru Protocol packet, and
+  the data buffers are released. Non-blocking requests have their event
+  signaled, and their slot is released. Blocking requests leave the result in
+  the slot, for VirtioScsiPassThru() to collect.
+
+  The caller is responsible for running at TPL_NOTIFY.
+
+  @param[in,out] Dev   The virtio-scsi host device the request was targeted
+                       at.
+
+  @param[in] SlotIdx   The slot of the request.
+
+**/
+STATIC
+VOID
+CompleteRequest (
+  IN OUT VSCSI_DEV *Dev,
+  IN     UINTN     SlotIdx
+  )
+{
+  VSCSI_REQ_SLOT                             *Slot;
+  EFI_EXT_SCSI_PASS_THRU_SCSI_REQUEST_PACKET *Packet;
+  EFI_STATUS                                 Status;
+
+  Slot = &Dev->Slots[SlotIdx];
+  ASSERT (Slot->State == VscsiSlotBusy);
+
+  Packet = Slot->Packet;
+  Status = ParseResponse (Packet, &Dev->SharedReqs[SlotIdx].Response);
 
   //
-  // Map the virtio-scsi Request header buffer
+  // If it was a CPU read request then we have used an intermediate buffer.
+  // Copy the data from intermediate buffer to the final buffer.
   //
-  Status = VirtioMapAllBytesInSharedBuffer (
-             Dev->VirtIo,
-             VirtioOperationBusMasterRead,
-             (VOID *) &Request,
-             sizeof Request,
-             &RequestDeviceAddress,
-             &RequestMapping);
-  if (EFI_ERROR (Status)) {
-    return ReportHostAdapterError (Packet);
+  if (Slot->InDataBuffer != NULL) {
+    CopyMem (Packet->InDataBuffer, Slot->InDataBuffer,
+      Packet->InTransferLength);
   }
+  ReleaseRequestBuffers (Dev, Slot);
+
+  if (Slot->Event == NULL) {
+    Slot->Status = Status;
+    Slot->State  = VscsiSlotDone;
+    return;
+  }
+
+  gBS->SignalEvent (Slot->Event);
+  Slot->Event  = NULL;
+  Slot->Packet = NULL;
+  Slot->State  = VscsiSlotFree;
+
+  ASSERT (Dev->AsyncCount > 0);
+  if (--Dev->AsyncCount == 0) {
+    gBS->SetTimer (Dev->CompletionTimer, TimerCancel, 0);
+  }
+}
+
+
+/**
+
+  Retire all requests that the host has marked as used since the last call,
+  in all request queues.
+
+  virtio-0.9.5, 2.4.2 Receiving Used Buffers From the Device. The head
+  descriptor index in each used element identifies the request slot, see
+  SubmitRequest().
+
+  The caller is responsible for running at TPL_NOTIFY.
+
+  @param[in,out] Dev  The virtio-scsi host device to process the used rings
+                      of.
+
+**/
+STATIC
+VOID
+ReapRequests (
+  IN OUT VSCSI_DEV *Dev
+  )
+{
+  UINT16                         QueueIdx;
+  VSCSI_REQUEST_QUEUE            *Queue;
+  volatile CONST VRING_USED_ELEM *UsedElem;
+  UINT16                         UsedIdx;
+  UINT32                         HeadDescIdx;
+
+  for (QueueIdx = 0; QueueIdx < Dev->QueueCount; QueueIdx++) {
+    Queue = &Dev->Queues[QueueIdx];
+
+    MemoryFence ();
+    UsedIdx = *Queue->Ring.Used.Idx;
+    MemoryFence ();
+
+    while (Queue->LastUsedIdx != UsedIdx) {
+      UsedElem    = &Queue->Ring.Used.UsedElem[Queue->LastUsedIdx %
+                                               Queue->Ring.QueueSize];
+      HeadDescIdx = UsedElem->Id;
+      Queue->LastUsedIdx++;
+
+      ASSERT (HeadDescIdx % VSCSI_DESC_PER_REQUEST == 0);
+      HeadDescIdx /= VSCSI_DESC_PER_REQUEST;
+      ASSERT (HeadDescIdx < Queue->SlotCount);
+      CompleteRequest (Dev,
+        QueueIdx * VSCSI_MAX_QUEUE_REQUESTS + HeadDescIdx);
+    }
+  }
+}
+
+
+/**
+
+  Timer event notification function that retires the non-blocking requests
+  the host has completed.
+
+  @param[in] Event    Event whose notification function is being invoked.
+
+  @param[in] Context  Pointer to the VSCSI_DEV structure.
+
+**/
+STATIC
+VOID
+EFIAPI
+VirtioScsiCompletionTimer (
+  IN  EFI_EVENT Event,
+  IN  VOID      *Context
+  )
+{
+  ReapRequests (Context);
+}
+
+
+/**
+
+  Wait until no non-blocking request is in flight in the request queues.
+
+  @param[in,out] Dev  The virtio-scsi host device to drain.
+
+**/
+STATIC
+VOID
+DrainRequests (
+  IN OUT VSCSI_DEV *Dev
+  )
+{
+  EFI_TPL OldTpl;
+  UINTN   AsyncCount;
+  UINTN   PollPeriodUsecs;
+
+  PollPeriodUsecs = 1;
+  for (;;) {
+    OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
+    ReapRequests (Dev);
+    AsyncCount = Dev->AsyncCount;
+    gBS->RestoreTPL (OldTpl);
+    if (AsyncCount == 0) {
+      break;
+    }
+
+    gBS->Stall (PollPeriodUsecs);
+    if (PollPeriodUsecs < 1024) {
+      PollPeriodUsecs *= 2;
+    }
+  }
+}
+
+
+/**
+
+  Push a populated virtio-scsi request to the host, without waiting for it to
+  complete.
+
+  The request queue is selected by the target, so that the commands for one
+  target are processed in order, while different targets are served by
+  different queues in parallel. The request is placed in a free request slot
+  of that queue; local slot N owns descriptors 4*N to 4*N+3 of the virtqueue,
+  so the head descriptor index reported by the host identifies the slot, and
+  descriptors never need to be tracked individually. If no slot is free but a
+  non-blocking request holds one, the host is polled, at the caller's TPL,
+  until that request completes. Slots held by blocking requests are only
+  released by their callers, which the current caller has preempted, so if all
+  slots of the queue are held by blocking requests the function fails rather
+  than waiting for them.
+
+  @param[in] Dev          The virtio-scsi host device the packet targets.
+
+  @param[in] Target       The SCSI target controlled by the virtio-scsi host
+                          device.
+
+  @param[in] Request      The virtio-scsi request populated by
+                          PopulateRequest().
+
+  @param[in out] Packet   The Extended SCSI Pass Thru Protocol packet that has
+                          been translated to Request. On failure this
+                          parameter relays error contents.
+
+  @param[in] Event        The event to signal when the host has processed the
+                          request, or NULL if the caller will poll for the
+                          request.
+
+  @param[out] SlotIdx     The slot the request was placed in.
+
+
+  @retval EFI_SUCCESS       The request has been submitted.
+
+  @retval EFI_NOT_READY     All slots of the request queue are held by
+                            blocking requests that the caller has preempted.
+                            The caller may retry later.
+
+  @retval EFI_DEVICE_ERROR  The data buffers could not be set up for the
+                            device. A host adapter error has been reported in
+                            Packet.
+
+**/
+STATIC
+EFI_STATUS
+SubmitRequest (
+  IN OUT VSCSI_DEV                                  *Dev,
+  IN     UINT16                                     Target,
+  IN     CONST VIRTIO_SCSI_REQ                      *Request,
+  IN OUT EFI_EXT_SCSI_PASS_THRU_SCSI_REQUEST_PACKET *Packet,
+  IN     EFI_EVENT                                  Event   OPTIONAL,
+  OUT    UINTN                                      *SlotIdx
+  )
+{
+  VSCSI_REQ_SLOT       Buffers;
+  EFI_PHYSICAL_ADDRESS InDataDeviceAddress;
+  EFI_PHYSICAL_ADDRESS OutDataDeviceAddress;
+  EFI_PHYSICAL_ADDRESS SharedReqAddress;
+  UINT16               QueueIdx;
+  VSCSI_REQUEST_QUEUE  *Queue;
+  UINTN                Idx;
+  VSCSI_SHARED_REQ     *SharedReq;
+  volatile VRING_DESC  *Desc;
+  UINT16               DescIdx;
+  UINT16               HeadDescIdx;
+  UINT16               AvailIdx;
+  EFI_TPL              OldTpl;
+  BOOLEAN              AsyncBusy;
+  UINTN                PollPeriodUsecs;
+  EFI_STATUS           Status;
+
+  //
+  // Set up the data buffers before entering TPL_NOTIFY; doing so may have to
+  // allocate memory.
+  //
+  ZeroMem (&Buffers, sizeof Buffers);
+  InDataDeviceAddress  = 0;
+  OutDataDeviceAddress = 0;
 
-  //
-  // Map the input buffer
-  //
   if (Packet->InTransferLength > 0) {
     //
     // Allocate a intermediate input buffer. This is mainly to handle the
@@ -502,36 +757,33 @@ VirtioScsiPassThru (
     // the Virtio request is successful then we copy the data from temporary
     // buffer into Packet->InDataBuffer.
     //
-    InDataNumPages = EFI_SIZE_TO_PAGES ((UINTN)Packet->InTransferLength);
+    Buffers.InDataNumPages = EFI_SIZE_TO_PAGES ((UINTN)Packet->InTransferLength);
     Status = Dev->VirtIo->AllocateSharedPages (
                             Dev->VirtIo,
-                            InDataNumPages,
-                            &InDataBuffer
+                            Buffers.InDataNumPages,
+                            &Buffers.InDataBuffer
                             );
     if (EFI_ERROR (Status)) {
-      Status = ReportHostAdapterError (Packet);
-      goto UnmapRequestBuffer;
+      Buffers.InDataBuffer = NULL;
+      goto ReleaseBuffers;
     }
 
-    ZeroMem (InDataBuffer, Packet->InTransferLength);
+    ZeroMem (Buffers.InDataBuffer, Packet->InTransferLength);
 
     Status = VirtioMapAllBytesInSharedBuffer (
                Dev->VirtIo,
                VirtioOperationBusMasterCommonBuffer,
-               InDataBuffer,
+               Buffers.InDataBuffer,
                Packet->InTransferLength,
                &InDataDeviceAddress,
-               &InDataMapping
+               &Buffers.InDataMapping
                );
     if (EFI_ERROR (Status)) {
-      Status = ReportHostAdapterError (Packet);
-      goto FreeInDataBuffer;
+      Buffers.InDataMapping = NULL;
+      goto ReleaseBuffers;
     }
   }
 
-  //
-  // Map the output buffer
-  //
   if (Packet->OutTransferLength > 0) {
     Status = VirtioMapAllBytesInSharedBuffer (
                Dev->VirtIo,
@@ -539,163 +791,233 @@ VirtioScsiPassThru (
                Packet->OutDataBuffer,
                Packet->OutTransferLength,
                &OutDataDeviceAddress,
-               &OutDataMapping
+               &Buffers.OutDataMapping
                );
     if (EFI_ERROR (Status)) {
-      Status = ReportHostAdapterError (Packet);
-      goto UnmapInDataBuffer;
+      Buffers.OutDataMapping = NULL;
+      goto ReleaseBuffers;
     }
-
-    OutDataBufferIsMapped = TRUE;
   }
 
   //
-  // Response header is bi-direction (we preset with host status and expect
-  // the device to update it). Allocate a response buffer which can be mapped
-  // to access equally by both processor and device.
+  // The virtqueues, the slots and the completion timer are shared with
+  // VirtioScsiCompletionTimer().
   //
-  Status = Dev->VirtIo->AllocateSharedPages (
-                          Dev->VirtIo,
-                          EFI_SIZE_TO_PAGES (sizeof *Response),
-                          &ResponseBuffer
-                          );
-  if (EFI_ERROR (Status)) {
-    Status = ReportHostAdapterError (Packet);
-    goto UnmapOutDataBuffer;
-  }
+  QueueIdx        = (UINT16) (Target % Dev->QueueCount);
+  Queue           = &Dev->Queues[QueueIdx];
+  PollPeriodUsecs = 1;
 
-  Response = ResponseBuffer;
+  for (;;) {
+    OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
+    ReapRequests (Dev);
 
-  ZeroMem ((VOID *)Response, sizeof (*Response));
+    AsyncBusy = FALSE;
+    for (Idx = 0; Idx < Queue->SlotCount; Idx++) {
+      if (Dev->Slots[QueueIdx * VSCSI_MAX_QUEUE_REQUESTS + Idx].State ==
+          VscsiSlotFree) {
+        break;
+      }
+      if (Dev->Slots[QueueIdx * VSCSI_MAX_QUEUE_REQUESTS + Idx].Event !=
+          NULL) {
+        AsyncBusy = TRUE;
+      }
+    }
+    if (Idx < Queue->SlotCount) {
+      break;
+    }
+    gBS->RestoreTPL (OldTpl);
 
-  //
-  // preset a host status for ourselves that we do not accept as success
-  //
-  Response->Response = VIRTIO_SCSI_S_FAILURE;
+    if (!AsyncBusy) {
+      ReleaseRequestBuffers (Dev, &Buffers);
+      return EFI_NOT_READY;
+    }
 
-  //
-  // Map the response buffer with BusMasterCommonBuffer so that response
-  // buffer can be accessed by both host and device.
-  //
-  Status = VirtioMapAllBytesInSharedBuffer (
-             Dev->VirtIo,
-             VirtioOperationBusMasterCommonBuffer,
-             ResponseBuffer,
-             sizeof (*Response),
-             &ResponseDeviceAddress,
-             &ResponseMapping
-             );
-  if (EFI_ERROR (Status)) {
-    Status = ReportHostAdapterError (Packet);
-    goto FreeResponseBuffer;
+    gBS->Stall (PollPeriodUsecs);
+    if (PollPeriodUsecs < 1024) {
+      PollPeriodUsecs *= 2;
+    }
   }
 
-  VirtioPrepare (&Dev->Ring, &Indices);
+  HeadDescIdx = (UINT16) (Idx * VSCSI_DESC_PER_REQUEST);
+  Idx        += QueueIdx * VSCSI_MAX_QUEUE_REQUESTS;
+
+  Buffers.State  = VscsiSlotBusy;
+  Buffers.Packet = Packet;
+  Buffers.Event  = Event;
+  CopyMem (&Dev->Slots[Idx], &Buffers, sizeof Buffers);
+  if (Event != NULL && Dev->AsyncCount++ == 0) {
+    gBS->SetTimer (Dev->CompletionTimer, TimerPeriodic,
+           VSCSI_COMPLETION_POLL_PERIOD);
+  }
 
   //
-  // ensured by VirtioScsiInit() -- this predicate, in combination with the
-  // lock-step progress, ensures we don't have to track free descriptors.
+  // Copy the request header, and preset a host status for ourselves that we
+  // do not accept as success.
   //
-  ASSERT (Dev->Ring.QueueSize >= 4);
+  SharedReq = &Dev->SharedReqs[Idx];
+  CopyMem (&SharedReq->Request, Request, sizeof SharedReq->Request);
+  ZeroMem (&SharedReq->Response, sizeof SharedReq->Response);
+  SharedReq->Response.Response = VIRTIO_SCSI_S_FAILURE;
+
+  SharedReqAddress = Dev->SharedReqsAddress + Idx * sizeof *SharedReq;
+  Desc             = Queue->Ring.Desc;
+  DescIdx          = HeadDescIdx;
 
   //
   // enqueue Request
   //
-  VirtioAppendDesc (
-    &Dev->Ring,
-    RequestDeviceAddress,
-    sizeof Request,
+  SetDesc (
+    &Desc[DescIdx],
+    SharedReqAddress + OFFSET_OF (VSCSI_SHARED_REQ, Request),
+    sizeof SharedReq->Request,
     VRING_DESC_F_NEXT,
-    &Indices
+    (UINT16) (DescIdx + 1)
     );
+  DescIdx++;
 
   //
   // enqueue "dataout" if any
   //
   if (Packet->OutTransferLength > 0) {
-    VirtioAppendDesc (
-      &Dev->Ring,
+    SetDesc (
+      &Desc[DescIdx],
       OutDataDeviceAddress,
       Packet->OutTransferLength,
       VRING_DESC_F_NEXT,
-      &Indices
+      (UINT16) (DescIdx + 1)
       );
+    DescIdx++;
   }
 
   //
   // enqueue Response, to be written by the host
   //
-  VirtioAppendDesc (
-    &Dev->Ring,
-    ResponseDeviceAddress,
-    sizeof *Response,
+  SetDesc (
+    &Desc[DescIdx],
+    SharedReqAddress + OFFSET_OF (VSCSI_SHARED_REQ, Response),
+    sizeof SharedReq->Response,
     VRING_DESC_F_WRITE | (Packet->InTransferLength > 0 ? VRING_DESC_F_NEXT : 0),
-    &Indices
+    (UINT16) (DescIdx + 1)
     );
+  DescIdx++;
 
   //
   // enqueue "datain" if any, to be written by the host
   //
   if (Packet->InTransferLength > 0) {
-    VirtioAppendDesc (
-      &Dev->Ring,
+    SetDesc (
+      &Desc[DescIdx],
       InDataDeviceAddress,
       Packet->InTransferLength,
       VRING_DESC_F_WRITE,
-      &Indices
+      0
       );
   }
 
-  // If kicking the host fails, we must fake a host adapter error.
-  // EFI_NOT_READY would save us the effort, but it would also suggest that the
-  // caller retry.
   //
-  if (VirtioFlush (Dev->VirtIo, VIRTIO_SCSI_REQUEST_QUEUE, &Dev->Ring,
-        &Indices, NULL) != EFI_SUCCESS) {
-    Status = ReportHostAdapterError (Packet);
-    goto UnmapResponseBuffer;
-  }
-
-  Status = ParseResponse (Packet, Response);
+  // virtio-0.9.5, 2.4.1.2 Updating the Available Ring, and 2.4.1.3 Updating
+  // the Index Field
+  //
+  AvailIdx = *Queue->Ring.Avail.Idx;
+  Queue->Ring.Avail.Ring[AvailIdx++ % Queue->Ring.QueueSize] = HeadDescIdx;
+  MemoryFence ();
+  *Queue->Ring.Avail.Idx = AvailIdx;
 
   //
-  // If virtio request was successful and it was a CPU read request then we
-  // have used an intermediate buffer. Copy the data from intermediate buffer
-  // to the final buffer.
+  // virtio-0.9.5, 2.4.1.4 Notifying the Device
   //
-  if (InDataBuffer != NULL) {
-    CopyMem (Packet->InDataBuffer, InDataBuffer, Packet->InTransferLength);
+  MemoryFence ();
+  Status = Dev->VirtIo->SetQueueNotify (Dev->VirtIo,
+                          (UINT16) (VIRTIO_SCSI_REQUEST_QUEUE + QueueIdx));
+  if (EFI_ERROR (Status)) {
+    //
+    // The request is visible to the host, which picks it up with the next
+    // notification; the slot is retired through the used ring like any other.
+    //
+    DEBUG ((DEBUG_ERROR, "%a: SetQueueNotify: %r\n", __FUNCTION__, Status));
   }
 
-UnmapResponseBuffer:
-  Dev->VirtIo->UnmapSharedBuffer (Dev->VirtIo, ResponseMapping);
+  gBS->RestoreTPL (OldTpl);
 
-FreeResponseBuffer:
-  Dev->VirtIo->FreeSharedPages (
-                 Dev->VirtIo,
-                 EFI_SIZE_TO_PAGES (sizeof *Response),
-                 ResponseBuffer
-                 );
+  *SlotIdx = Idx;
+  return EFI_SUCCESS;
+
+ReleaseBuffers:
+  ReleaseRequestBuffers (Dev, &Buffers);
+  return ReportHostAdapterError (Packet);
+}
 
-UnmapOutDataBuffer:
-  if (OutDataBufferIsMapped) {
-    Dev->VirtIo->UnmapSharedBuffer (Dev->VirtIo, OutDataMapping);
-  }
 
-UnmapInDataBuffer:
-  if (InDataBuffer != NULL) {
-    Dev->VirtIo->UnmapSharedBuffer (Dev->VirtIo, InDataMapping);
+//
+// The next seven functions implement EFI_EXT_SCSI_PASS_THRU_PROTOCOL
+// for the virtio-scsi HBA. Refer to UEFI Spec 2.3.1 + Errata C, sections
+// - 14.1 SCSI Driver Model Overview,
+// - 14.7 Extended SCSI Pass Thru Protocol.
+//
+
+EFI_STATUS
+EFIAPI
+VirtioScsiPassThru (
+  IN     EFI_EXT_SCSI_PASS_THRU_PROTOCOL            *This,
+  IN     UINT8                                      *Target,
+  IN     UINT64                                     Lun,
+  IN OUT EFI_EXT_SCSI_PASS_THRU_SCSI_REQUEST_PACKET *Packet,
+  IN     EFI_EVENT                                  Event   OPTIONAL
+  )
+{
+  VSCSI_DEV       *Dev;
+  UINT16          TargetValue;
+  EFI_STATUS      Status;
+  VIRTIO_SCSI_REQ Request;
+  UINTN           SlotIdx;
+  VSCSI_REQ_SLOT  *Slot;
+  EFI_TPL         OldTpl;
+  BOOLEAN         Done;
+  UINTN           PollPeriodUsecs;
+
+  ZeroMem (&Request, sizeof (Request));
+
+  Dev = VIRTIO_SCSI_FROM_PASS_THRU (This);
+  CopyMem (&TargetValue, Target, sizeof TargetValue);
+
+  Status = PopulateRequest (Dev, TargetValue, Lun, Packet, &Request);
+  if (EFI_ERROR (Status)) {
+    return Status;
   }
 
-FreeInDataBuffer:
-  if (InDataBuffer != NULL) {
-    Dev->VirtIo->FreeSharedPages (Dev->VirtIo, InDataNumPages, InDataBuffer);
+  Status = SubmitRequest (Dev, TargetValue, &Request, Packet, Event, &SlotIdx);
+  if (EFI_ERROR (Status) || Event != NULL) {
+    //
+    // A non-blocking request is completed by CompleteRequest(), which signals
+    // Event.
+    //
+    return Status;
   }
 
-UnmapRequestBuffer:
-  Dev->VirtIo->UnmapSharedBuffer (Dev->VirtIo, RequestMapping);
+  //
+  // Keep slowing down until we reach a poll period of slightly above 1 ms.
+  //
+  Slot            = &Dev->Slots[SlotIdx];
+  PollPeriodUsecs = 1;
+  for (;;) {
+    OldTpl = gBS->RaiseTPL (TPL_NOTIFY);
+    ReapRequests (Dev);
+    Done = (BOOLEAN) (Slot->State == VscsiSlotDone);
+    if (Done) {
+      Status       = Slot->Status;
+      Slot->Packet = NULL;
+      Slot->State  = VscsiSlotFree;
+    }
+    gBS->RestoreTPL (OldTpl);
+    if (Done) {
+      return Status;
+    }
 
-  return Status;
+    gBS->Stall (PollPeriodUsecs); // calls AcpiTimerLib::MicroSecondDelay
+    if (PollPeriodUsecs < 1024) {
+      PollPeriodUsecs *= 2;
+    }
+  }
 }
 
 
@@ -913,6 +1235,143 @@ VirtioScsiGetNextTarget (
 }
 
 
+/**
+
+  Set up one request virtqueue of the virtio-scsi device.
+
+  @param[in,out] Dev   The virtio-scsi host device.
+
+  @param[in] QueueIdx  The index of the request queue to set up, relative to
+                       VIRTIO_SCSI_REQUEST_QUEUE.
+
+
+  @retval EFI_SUCCESS      The request queue is ready for use.
+
+  @retval EFI_UNSUPPORTED  The request queue is too small.
+
+  @return                  Error codes from VirtioRingInit(), VirtioRingMap()
+                           or the VirtIo protocol. The resources of the
+                           request queue have been released.
+
+**/
+STATIC
+EFI_STATUS
+VirtioScsiInitQueue (
+  IN OUT VSCSI_DEV *Dev,
+  IN     UINT16    QueueIdx
+  )
+{
+  VSCSI_REQUEST_QUEUE *Queue;
+  EFI_STATUS          Status;
+  UINT64              RingBaseShift;
+  UINT16              QueueSize;
+
+  Queue = &Dev->Queues[QueueIdx];
+
+  Status = Dev->VirtIo->SetQueueSel (Dev->VirtIo,
+                          (UINT16) (VIRTIO_SCSI_REQUEST_QUEUE + QueueIdx));
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  Status = Dev->VirtIo->GetQueueNumMax (Dev->VirtIo, &QueueSize);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+  //
+  // SubmitRequest() uses at most four descriptors per request
+  //
+  if (QueueSize < VSCSI_DESC_PER_REQUEST) {
+    return EFI_UNSUPPORTED;
+  }
+  Queue->SlotCount = (UINT16) MIN (VSCSI_MAX_QUEUE_REQUESTS,
+                                QueueSize / VSCSI_DESC_PER_REQUEST);
+
+  Status = VirtioRingInit (Dev->VirtIo, QueueSize, &Queue->Ring);
+  if (EFI_ERROR (Status)) {
+    return Status;
+  }
+
+  //
+  // If anything fails from here on, we must release the ring resources
+  //
+  Status = VirtioRingMap (
+             Dev->VirtIo,
+             &Queue->Ring,
+             &RingBaseShift,
+             &Queue->RingMap
+             );
+  if (EFI_ERROR (Status)) {
+    goto ReleaseQueue;
+  }
+
+  //
+  // Completions are polled for; virtio-0.9.5, 2.4.2 Receiving Used Buffers
+  // From the Device.
+  //
+  *Queue->Ring.Avail.Flags = (UINT16) VRING_AVAIL_F_NO_INTERRUPT;
+  Queue->LastUsedIdx       = 0;
+
+  //
+  // Additional steps for MMIO: align the queue appropriately, and set the
+  // size. If anything fails from here on, we must unmap the ring resources.
+  //
+  Status = Dev->VirtIo->SetQueueNum (Dev->VirtIo, QueueSize);
+  if (EFI_ERROR (Status)) {
+    goto UnmapQueue;
+  }
+
+  Status = Dev->VirtIo->SetQueueAlign (Dev->VirtIo, EFI_PAGE_SIZE);
+  if (EFI_ERROR (Status)) {
+    goto UnmapQueue;
+  }
+
+  //
+  // step 4c -- Report GPFN (guest-physical frame number) of queue.
+  //
+  Status = Dev->VirtIo->SetQueueAddress (
+                          Dev->VirtIo,
+                          &Queue->Ring,
+                          RingBaseShift
+                          );
+  if (EFI_ERROR (Status)) {
+    goto UnmapQueue;
+  }
+
+  return EFI_SUCCESS;
+
+UnmapQueue:
+  Dev->VirtIo->UnmapSharedBuffer (Dev->VirtIo, Queue->RingMap);
+
+ReleaseQueue:
+  VirtioRingUninit (Dev->VirtIo, &Queue->Ring);
+
+  return Status;
+}
+
+
+/**
+
+  Release the request virtqueues set up by VirtioScsiInitQueue().
+
+  @param[in,out] Dev  The virtio-scsi host device.
+
+**/
+STATIC
+VOID
+VirtioScsiReleaseQueues (
+  IN OUT VSCSI_DEV *Dev
+  )
+{
+  UINT16 QueueIdx;
+
+  for (QueueIdx = 0; QueueIdx < Dev->QueueCount; QueueIdx++) {
+    Dev->VirtIo->UnmapSharedBuffer (Dev->VirtIo, Dev->Queues[QueueIdx].RingMap);
+    VirtioRingUninit (Dev->VirtIo, &Dev->Queues[QueueIdx].Ring);
+  }
+  Dev->QueueCount = 0;
+}
+
+
 STATIC
 EFI_STATUS
 EFIAPI
@@ -922,11 +1381,10 @@ VirtioScsiInit (
 {
   UINT8      NextDevStat;
   EFI_STATUS Status;
-  UINT64     RingBaseShift;
   UINT64     Features;
   UINT16     MaxChannel; // for validation only
-  UINT32     NumQueues;  // for validation only
-  UINT16     QueueSize;
+  UINT32     NumQueues;
+  UINTN      SharedReqsPages;
 
   //
   // Execute virtio-0.9.5, 2.2.1 Device Initialization Sequence.
@@ -1031,67 +1489,55 @@ VirtioScsiInit (
   }
 
   //
-  // step 4b -- allocate request virtqueue
+  // step 4b -- allocate request virtqueues
   //
-  Status = Dev->VirtIo->SetQueueSel (Dev->VirtIo, VIRTIO_SCSI_REQUEST_QUEUE);
-  if (EFI_ERROR (Status)) {
-    goto Failed;
-  }
-  Status = Dev->VirtIo->GetQueueNumMax (Dev->VirtIo, &QueueSize);
-  if (EFI_ERROR (Status)) {
-    goto Failed;
+  Dev->QueueCount = 0;
+  while (Dev->QueueCount < MIN (NumQueues, VSCSI_MAX_REQUEST_QUEUES)) {
+    Status = VirtioScsiInitQueue (Dev, Dev->QueueCount);
+    if (EFI_ERROR (Status)) {
+      if (Dev->QueueCount == 0) {
+        goto Failed;
+      }
+      //
+      // Make do with the request queues set up thus far.
+      //
+      break;
+    }
+    Dev->QueueCount++;
   }
+
   //
-  // VirtioScsiPassThru() uses at most four descriptors
+  // Allocate and map the request headers and responses of all request slots,
+  // for access by both processor and device. If anything fails from here on,
+  // we must release them.
   //
-  if (QueueSize < 4) {
-    Status = EFI_UNSUPPORTED;
-    goto Failed;
-  }
-
-  Status = VirtioRingInit (Dev->VirtIo, QueueSize, &Dev->Ring);
+  SharedReqsPages = EFI_SIZE_TO_PAGES (sizeof (VSCSI_SHARED_REQ) *
+                                       VSCSI_MAX_REQUEST_QUEUES *
+                                       VSCSI_MAX_QUEUE_REQUESTS);
+  Status = Dev->VirtIo->AllocateSharedPages (
+                          Dev->VirtIo,
+                          SharedReqsPages,
+                          (VOID **) &Dev->SharedReqs
+                          );
   if (EFI_ERROR (Status)) {
-    goto Failed;
+    goto ReleaseQueues;
   }
+  ZeroMem (Dev->SharedReqs, EFI_PAGES_TO_SIZE (SharedReqsPages));
 
-  //
-  // If anything fails from here on, we must release the ring resources
-  //
-  Status = VirtioRingMap (
+  Status = VirtioMapAllBytesInSharedBuffer (
              Dev->VirtIo,
-             &Dev->Ring,
-             &RingBaseShift,
-             &Dev->RingMap
+             VirtioOperationBusMasterCommonBuffer,
+             Dev->SharedReqs,
+             EFI_PAGES_TO_SIZE (SharedReqsPages),
+             &Dev->SharedReqsAddress,
+             &Dev->SharedReqsMap
              );
   if (EFI_ERROR (Status)) {
-    goto ReleaseQueue;
-  }
-
-  //
-  // Additional steps for MMIO: align the queue appropriately, and set the
-  // size. If anything fails from here on, we must unmap the ring resources.
-  //
-  Status = Dev->VirtIo->SetQueueNum (Dev->VirtIo, QueueSize);
-  if (EFI_ERROR (Status)) {
-    goto UnmapQueue;
+    goto FreeSharedReqs;
   }
 
-  Status = Dev->VirtIo->SetQueueAlign (Dev->VirtIo, EFI_PAGE_SIZE);
-  if (EFI_ERROR (Status)) {
-    goto UnmapQueue;
-  }
-
-  //
-  // step 4c -- Report GPFN (guest-physical frame number) of queue.
-  //
-  Status = Dev->VirtIo->SetQueueAddress (
-                          Dev->VirtIo,
-                          &Dev->Ring,
-                          RingBaseShift
-                          );
-  if (EFI_ERROR (Status)) {
-    goto UnmapQueue;
-  }
+  Dev->AsyncCount = 0;
+  ZeroMem (Dev->Slots, sizeof Dev->Slots);
 
   //
   // step 5 -- Report understood features and guest-tuneables.
@@ -1100,7 +1546,7 @@ VirtioScsiInit (
     Features &= ~(UINT64)(VIRTIO_F_VERSION_1 | VIRTIO_F_IOMMU_PLATFORM);
     Status = Dev->VirtIo->SetGuestFeatures (Dev->VirtIo, Features);
     if (EFI_ERROR (Status)) {
-      goto UnmapQueue;
+      goto UnmapSharedReqs;
     }
   }
 
@@ -1110,11 +1556,11 @@ VirtioScsiInit (
   //
   Status = VIRTIO_CFG_WRITE (Dev, CdbSize, VIRTIO_SCSI_CDB_SIZE);
   if (EFI_ERROR (Status)) {
-    goto UnmapQueue;
+    goto UnmapSharedReqs;
   }
   Status = VIRTIO_CFG_WRITE (Dev, SenseSize, VIRTIO_SCSI_SENSE_SIZE);
   if (EFI_ERROR (Status)) {
-    goto UnmapQueue;
+    goto UnmapSharedReqs;
   }
 
   //
@@ -1123,7 +1569,7 @@ VirtioScsiInit (
   NextDevStat |= VSTAT_DRIVER_OK;
   Status = Dev->VirtIo->SetDeviceStatus (Dev->VirtIo, NextDevStat);
   if (EFI_ERROR (Status)) {
-    goto UnmapQueue;
+    goto UnmapSharedReqs;
   }
 
   //
@@ -1150,20 +1596,27 @@ VirtioScsiInit (
   // SCSI Pass Thru Protocol.
   //
   Dev->PassThruMode.Attributes = EFI_EXT_SCSI_PASS_THRU_ATTRIBUTES_PHYSICAL |
-                                 EFI_EXT_SCSI_PASS_THRU_ATTRIBUTES_LOGICAL;
+                                 EFI_EXT_SCSI_PASS_THRU_ATTRIBUTES_LOGICAL |
+                                 EFI_EXT_SCSI_PASS_THRU_ATTRIBUTES_NONBLOCKIO;
 
   //
   // no restriction on transfer buffer alignment
   //
   Dev->PassThruMode.IoAlign = 0;
 
+  DEBUG ((DEBUG_INFO, "%a: RequestQueues=%d\n", __FUNCTION__,
+    Dev->QueueCount));
+
   return EFI_SUCCESS;
 
-UnmapQueue:
-  Dev->VirtIo->UnmapSharedBuffer (Dev->VirtIo, Dev->RingMap);
+UnmapSharedReqs:
+  Dev->VirtIo->UnmapSharedBuffer (Dev->VirtIo, Dev->SharedReqsMap);
 
-ReleaseQueue:
-  VirtioRingUninit (Dev->VirtIo, &Dev->Ring);
+FreeSharedReqs:
+  Dev->VirtIo->FreeSharedPages (Dev->VirtIo, SharedReqsPages, Dev->SharedReqs);
+
+ReleaseQueues:
+  VirtioScsiReleaseQueues (Dev);
 
 Failed:
   //
@@ -1201,8 +1654,15 @@ VirtioScsiUninit (
   Dev->MaxLun         = 0;
   Dev->MaxSectors     = 0;
 
-  Dev->VirtIo->UnmapSharedBuffer (Dev->VirtIo, Dev->RingMap);
-  VirtioRingUninit (Dev->VirtIo, &Dev->Ring);
+  Dev->VirtIo->UnmapSharedBuffer (Dev->VirtIo, Dev->SharedReqsMap);
+  Dev->VirtIo->FreeSharedPages (
+                 Dev->VirtIo,
+                 EFI_SIZE_TO_PAGES (sizeof (VSCSI_SHARED_REQ) *
+                                    VSCSI_MAX_REQUEST_QUEUES *
+                                    VSCSI_MAX_QUEUE_REQUESTS),
+                 Dev->SharedReqs
+                 );
+  VirtioScsiReleaseQueues (Dev);
 
   SetMem (&Dev->PassThru,     sizeof Dev->PassThru,     0x00);
   SetMem (&Dev->PassThruMode, sizeof Dev->PassThruMode, 0x00);
@@ -1222,6 +1682,7 @@ VirtioScsiExitBoot (
   )
 {
   VSCSI_DEV *Dev;
+  UINT16    QueueIdx;
 
   //
   // Reset the device. This causes the hypervisor to forget about the virtio
@@ -1234,10 +1695,14 @@ VirtioScsiExitBoot (
   Dev->VirtIo->SetDeviceStatus (Dev->VirtIo, 0);
 
   //
-  // Unmap the ring buffer so that hypervisor will not be able to get
-  // readable data after device reset.
+  // Unmap the ring buffers and the request headers so that hypervisor will
+  // not be able to get readable data after device reset.
   //
-  Dev->VirtIo->UnmapSharedBuffer (Dev->VirtIo, Dev->RingMap);
+  Dev->VirtIo->UnmapSharedBuffer (Dev->VirtIo, Dev->SharedReqsMap);
+  for (QueueIdx = 0; QueueIdx < Dev->QueueCount; QueueIdx++) {
+    Dev->VirtIo->UnmapSharedBuffer (Dev->VirtIo,
+                   Dev->Queues[QueueIdx].RingMap);
+  }
 }
 
 
@@ -1323,12 +1788,22 @@ VirtioScsiDriverBindingStart (
     goto FreeVirtioScsi;
   }
 
+  //
+  // The timer that retires non-blocking requests is armed only while some are
+  // in flight.
+  //
+  Status = gBS->CreateEvent (EVT_TIMER | EVT_NOTIFY_SIGNAL, TPL_NOTIFY,
+                  &VirtioScsiCompletionTimer, Dev, &Dev->CompletionTimer);
+  if (EFI_ERROR (Status)) {
+    goto CloseVirtIo;
+  }
+
   //
   // VirtIo access granted, configure virtio-scsi device.
   //
   Status = VirtioScsiInit (Dev);
   if (EFI_ERROR (Status)) {
-    goto CloseVirtIo;
+    goto CloseCompletionTimer;
   }
 
   Status = gBS->CreateEvent (EVT_SIGNAL_EXIT_BOOT_SERVICES, TPL_CALLBACK,
@@ -1357,6 +1832,9 @@ CloseExitBoot:
 UninitDev:
   VirtioScsiUninit (Dev);
 
+CloseCompletionTimer:
+  gBS->CloseEvent (Dev->CompletionTimer);
+
 CloseVirtIo:
   gBS->CloseProtocol (DeviceHandle, &gVirtioDeviceProtocolGuid,
          This->DriverBindingHandle, DeviceHandle);
@@ -1404,6 +1882,13 @@ VirtioScsiDriverBindingStop (
     return Status;
   }
 
+  //
+  // Complete the non-blocking requests still in flight, so their events are
+  // not left pending.
+  //
+  DrainRequests (Dev);
+  gBS->CloseEvent (Dev->CompletionTimer);
+
   gBS->CloseEvent (Dev->ExitBoot);
 
   VirtioScsiUninit (Dev);
@@ -22,7 +22,7 @@
 #include <Protocol/DriverBinding.h>
 #include <Protocol/ScsiPassThruExt.h>
 
-#include <IndustryStandard/Virtio.h>
+#include <IndustryStandard/VirtioScsi.h>
 
 
 //
@@ -42,6 +42,69 @@
 
 #define VSCSI_SIG SIGNATURE_32 ('V', 'S', 'C', 'S')
 
+//
+// The number of request queues used, if the host offers that many, and the
+// number of requests that may be in flight in each of them at the same time.
+// The actual limits also depend on the queue sizes; see VirtioScsiInit().
+//
+#define VSCSI_MAX_REQUEST_QUEUES 4
+#define VSCSI_MAX_QUEUE_REQUESTS 16
+
+//
+// Every request takes up four descriptors of its virtqueue: request header,
+// dataout, response, datain. See SubmitRequest().
+//
+#define VSCSI_DESC_PER_REQUEST 4
+
+//
+// The period of the timer event that reaps completed non-blocking requests.
+//
+#define VSCSI_COMPLETION_POLL_PERIOD EFI_TIMER_PERIOD_MILLISECONDS (1)
+
+//
+// The request header and the response of a request, which are accessed by
+// the device. One such structure exists per request slot, in a single common
+// buffer that is mapped for the lifetime of the driver instance.
+//
+typedef struct {
+  VIRTIO_SCSI_REQ  Request;
+  VIRTIO_SCSI_RESP Response;
+} VSCSI_SHARED_REQ;
+
+typedef enum {
+  VscsiSlotFree,
+  VscsiSlotBusy,
+  VscsiSlotDone
+} VSCSI_SLOT_STATE;
+
+//
+// The driver side bookkeeping of a request slot.
+//
+typedef struct {
+  VSCSI_SLOT_STATE                           State;
+  EFI_EXT_SCSI_PASS_THRU_SCSI_REQUEST_PACKET *Packet;
+  VOID                                       *InDataBuffer;
+  UINTN                                      InDataNumPages;
+  VOID                                       *InDataMapping;
+  VOID                                       *OutDataMapping;
+  //
+  // Event is NULL for blocking requests. Those are completed by the caller of
+  // SubmitRequest(), which collects Status once State is VscsiSlotDone.
+  //
+  EFI_EVENT                                  Event;
+  EFI_STATUS                                 Status;
+} VSCSI_REQ_SLOT;
+
+//
+// A request virtqueue, and the state of its used ring.
+//
+typedef struct {
+  VRING  Ring;
+  VOID   *RingMap;
+  UINT16 LastUsedIdx;
+  UINT16 SlotCount;
+} VSCSI_REQUEST_QUEUE;
+
 typedef struct {
   //
   // Parts of this structure are initialized / torn down in various functions
@@ -53,14 +116,25 @@ typedef struct {
   UINT32                          Signature;      // DriverBindingStart  0
   VIRTIO_DEVICE_PROTOCOL          *VirtIo;        // DriverBindingStart  0
   EFI_EVENT                       ExitBoot;       // DriverBindingStart  0
+  EFI_EVENT                       CompletionTimer;
+                                                  // DriverBindingStart  0
   BOOLEAN                         InOutSupported; // VirtioScsiInit      1
   UINT16                          MaxTarget;      // VirtioScsiInit      1
   UINT32                          MaxLun;         // VirtioScsiInit      1
   UINT32                          MaxSectors;     // VirtioScsiInit      1
-  VRING                           Ring;           // VirtioRingInit      2
+  UINT16                          QueueCount;     // VirtioScsiInit      1
+  VSCSI_REQUEST_QUEUE             Queues[VSCSI_MAX_REQUEST_QUEUES];
+                                                  // VirtioRingInit      2
   EFI_EXT_SCSI_PASS_THRU_PROTOCOL PassThru;       // VirtioScsiInit      1
   EFI_EXT_SCSI_PASS_THRU_MODE     PassThruMode;   // VirtioScsiInit      1
-  VOID                            *RingMap;       // VirtioRingMap       2
+  VSCSI_SHARED_REQ                *SharedReqs;    // VirtioScsiInit      1
+  EFI_PHYSICAL_ADDRESS            SharedReqsAddress;
+                                                  // VirtioScsiInit      1
+  VOID                            *SharedReqsMap; // VirtioScsiInit      1
+  UINTN                           AsyncCount;     // VirtioScsiInit      1
+  VSCSI_REQ_SLOT                  Slots[VSCSI_MAX_REQUEST_QUEUES *
+                                        VSCSI_MAX_QUEUE_REQUESTS];
+                                                  // VirtioScsiInit      1
 } VSCSI_DEV;
 
 #define VIRTIO_SCSI_FROM_PASS_THRU(PassThruPointer) \